@@ -0,0 +1,243 @@
+//
+// AllanVariance.cpp
+//
+
+#include "pch.h"
+#include "AllanVariance.h"
+
+#include <math.h>
+
+
+const char* const ALLAN_CHANNEL_NAMES[IMU_CHANNEL_COUNT] = { "Accel X", "Accel Y", "Accel Z", "Gyro X", "Gyro Y", "Gyro Z" };
+
+
+namespace
+{
+	float ChannelValue(const SensorSample& _sample, int _channel)
+	{
+		return (_channel < 3) ? _sample.accel[_channel] / ACCEL_UNITS_PER_G : _sample.gyro[_channel - 3] / GYRO_UNITS_PER_DPS;
+	}
+
+	// the next record of the device at or after the cursor
+	void SkipOtherDevices(SensorLogCursor& _cursor, uint32_t _deviceId)
+	{
+		while (_cursor.IsValid() && _cursor.GetRecord().deviceId != _deviceId)
+		{
+			_cursor.Next();
+		}
+	}
+
+	// running sum of every channel with the mean removed; the mean does not change
+	// the Allan variance but would make the sums large enough to lose precision
+	struct RunningSum
+	{
+		SensorLogCursor cursor;
+		double sum[IMU_CHANNEL_COUNT];
+	};
+
+	// adds the sample under the cursor, then moves to the next one of the device
+	void Advance(RunningSum& _running, uint32_t _deviceId, const double* _mean)
+	{
+		const SensorSample sample = _running.cursor.GetSample();
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			_running.sum[channel] += ChannelValue(sample, channel) - _mean[channel];
+		}
+		_running.cursor.Next();
+		SkipOtherDevices(_running.cursor, _deviceId);
+	}
+
+	// overlapping estimator over all N - 2m + 1 cluster pairs, from the running sums
+	// at sample k, k + m and k + 2m
+	void AllanVariance(const MappedSensorLog& _log, uint32_t _deviceId, const double* _mean, size_t _count, size_t _clusterSize,
+		double* _variance)
+	{
+		const size_t m = _clusterSize;
+		const size_t terms = _count - 2 * m + 1;
+
+		RunningSum sums[3];
+		sums[0].cursor = _log.Begin();
+		SkipOtherDevices(sums[0].cursor, _deviceId);
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			sums[0].sum[channel] = 0.0;
+		}
+		for (int i = 1; i < 3; ++i)
+		{
+			sums[i] = sums[i - 1];
+			for (size_t k = 0; k < m; ++k)
+			{
+				Advance(sums[i], _deviceId, _mean);
+			}
+		}
+
+		double total[IMU_CHANNEL_COUNT] = {};
+		for (size_t k = 0; k < terms; ++k)
+		{
+			for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+			{
+				const double difference = sums[2].sum[channel] - 2.0 * sums[1].sum[channel] + sums[0].sum[channel];
+				total[channel] += difference * difference;
+			}
+			if (k + 1 < terms)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					Advance(sums[i], _deviceId, _mean);
+				}
+			}
+		}
+
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			_variance[channel] = total[channel] / (2.0 * double(m) * double(m) * double(terms));
+		}
+	}
+}
+
+
+std::vector<size_t> MakeClusterSizes(size_t _sampleCount, int _pointsPerDecade)
+{
+	std::vector<size_t> sizes;
+	const size_t maxSize = (_sampleCount - 1) / 2;
+	for (int i = 0; ; ++i)
+	{
+		const size_t size = size_t(pow(10.0, double(i) / _pointsPerDecade) + 0.5);
+		if (size > maxSize)
+		{
+			break;
+		}
+		if (sizes.empty() || size != sizes.back())
+		{
+			sizes.push_back(size);
+		}
+	}
+	return sizes;
+}
+
+AllanResult ComputeAllanDeviation(const MappedSensorLog& _log, uint32_t _deviceId, WorkStealingPool& _pool, int _pointsPerDecade)
+{
+	AllanResult result;
+	result.deviceId = _deviceId;
+	result.sampleCount = 0;
+	result.samplePeriod = 0.0;
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		result.randomWalk[channel] = 0.0;
+		result.biasInstability[channel] = 0.0;
+	}
+
+	// count, span and channel means of the device
+	double mean[IMU_CHANNEL_COUNT] = {};
+	uint64_t firstTimestamp = 0, lastTimestamp = 0;
+	for (SensorLogCursor cursor = _log.Begin(); cursor.IsValid(); cursor.Next())
+	{
+		if (cursor.GetRecord().deviceId != _deviceId)
+		{
+			continue;
+		}
+		const SensorSample sample = cursor.GetSample();
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			mean[channel] += ChannelValue(sample, channel);
+		}
+		firstTimestamp = (result.sampleCount == 0) ? sample.timestamp : firstTimestamp;
+		lastTimestamp = sample.timestamp;
+		++result.sampleCount;
+	}
+	const size_t count = result.sampleCount;
+	if (count < 3)
+	{
+		return result;
+	}
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		mean[channel] /= double(count);
+	}
+
+	result.samplePeriod = DX::StepTimer::TicksToSeconds(lastTimestamp - firstTimestamp) / double(count - 1);
+
+	const std::vector<size_t> clusterSizes = MakeClusterSizes(count, _pointsPerDecade);
+	result.points.resize(clusterSizes.size());
+	for (size_t i = 0; i < clusterSizes.size(); ++i)
+	{
+		AllanPoint& point = result.points[i];
+		point.clusterSize = clusterSizes[i];
+		point.tau = clusterSizes[i] * result.samplePeriod;
+
+		// every task walks the log with its own cursors and writes its own point
+		_pool.Submit([&_log, _deviceId, &mean, count, &point]()
+		{
+			double variance[IMU_CHANNEL_COUNT];
+			AllanVariance(_log, _deviceId, mean, count, point.clusterSize, variance);
+			for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+			{
+				point.deviation[channel] = sqrt(variance[channel]);
+			}
+		});
+	}
+	_pool.Wait();
+
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		// white noise: the point where the local log-log slope is closest to -1/2
+		double bestSlopeError = 1e30;
+		double minimum = 1e30;
+		for (size_t i = 0; i < result.points.size(); ++i)
+		{
+			const double deviation = result.points[i].deviation[channel];
+			minimum = std::min(minimum, deviation);
+
+			if (i > 0 && i + 1 < result.points.size())
+			{
+				const AllanPoint& previous = result.points[i - 1];
+				const AllanPoint& next = result.points[i + 1];
+				if (previous.deviation[channel] > 0.0 && next.deviation[channel] > 0.0)
+				{
+					const double slope = log(next.deviation[channel] / previous.deviation[channel]) / log(next.tau / previous.tau);
+					if (fabs(slope + 0.5) < bestSlopeError)
+					{
+						bestSlopeError = fabs(slope + 0.5);
+						result.randomWalk[channel] = deviation * sqrt(result.points[i].tau);
+					}
+				}
+			}
+		}
+		result.biasInstability[channel] = minimum / 0.664;
+	}
+
+	return result;
+}
+
+void WriteAllanTable(const AllanResult& _result, FILE* _file)
+{
+	fprintf(_file, "# device 0x%02X, %zu samples, %.6f s period, accel in g, gyro in deg/s\n", _result.deviceId, _result.sampleCount, _result.samplePeriod);
+	fprintf(_file, "%12s", "tau");
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		fprintf(_file, " %12s", ALLAN_CHANNEL_NAMES[channel]);
+	}
+	fprintf(_file, "\n");
+
+	for (const AllanPoint& point : _result.points)
+	{
+		fprintf(_file, "%12.6g", point.tau);
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			fprintf(_file, " %12.6g", point.deviation[channel]);
+		}
+		fprintf(_file, "\n");
+	}
+
+	fprintf(_file, "%12s", "random walk");
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		fprintf(_file, " %12.6g", _result.randomWalk[channel]);
+	}
+	fprintf(_file, "\n%12s", "bias instab");
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		fprintf(_file, " %12.6g", _result.biasInstability[channel]);
+	}
+	fprintf(_file, "\n");
+}
@@ -0,0 +1,50 @@
+//
+// AllanVariance.h - overlapping Allan deviation of all sensor channels
+//
+// Used offline on long stationary logs to characterize sensor noise: the white
+// noise density (angle/velocity random walk) feeds the filter noise settings and
+// the flat minimum gives the bias instability.
+//
+// The samples are streamed from the mapped log rather than loaded, so hours of
+// data do not have to fit in memory: each cluster size walks the records of one
+// device with three cursors m samples apart, every cursor keeping the running
+// sum of the channels, and accumulates the squared cluster differences as it goes.
+//
+
+#pragma once
+
+#include "SensorLog.h"
+#include "WorkStealingPool.h"
+
+#include <stdio.h>
+#include <vector>
+
+
+// channel order matches SampleBlock: accel XYZ in g, gyro XYZ in deg/s
+extern const char* const ALLAN_CHANNEL_NAMES[IMU_CHANNEL_COUNT];
+
+struct AllanPoint
+{
+	size_t clusterSize;		// samples per cluster
+	double tau;				// s
+	double deviation[IMU_CHANNEL_COUNT];
+};
+
+struct AllanResult
+{
+	uint32_t deviceId;
+	size_t sampleCount;
+	double samplePeriod;						// s, mean over the whole log
+	std::vector<AllanPoint> points;				// increasing tau
+	double randomWalk[IMU_CHANNEL_COUNT];		// deviation at tau = 1 s on the white noise slope, unit/sqrt(Hz)
+	double biasInstability[IMU_CHANNEL_COUNT];	// minimum deviation / 0.664
+};
+
+// roughly log spaced cluster sizes from 1 up to half of the log
+std::vector<size_t> MakeClusterSizes(size_t _sampleCount, int _pointsPerDecade);
+
+// the records of _deviceId only; one pass for the channel means, then one pool task per cluster size
+AllanResult ComputeAllanDeviation(const MappedSensorLog& _log, uint32_t _deviceId, WorkStealingPool& _pool, int _pointsPerDecade = 10);
+
+// text table: tau followed by the deviation of every channel, then the noise parameters
+void WriteAllanTable(const AllanResult& _result, FILE* _file);
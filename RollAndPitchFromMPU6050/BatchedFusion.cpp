@@ -0,0 +1,236 @@
+//
+// BatchedFusion.cpp
+//
+
+#include "pch.h"
+#include "BatchedFusion.h"
+#include "FastMath.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+BatchedComplementary::BatchedComplementary(size_t _streamCount, const BatchedFusionSettings& _settings) :
+	m_StreamCount(_streamCount),
+	m_PaddedCount((_streamCount + SIMD_LANE_COUNT - 1) / SIMD_LANE_COUNT * SIMD_LANE_COUNT),
+	m_Settings(_settings)
+{
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		m_Input[channel].assign(m_PaddedCount, 0.0f);
+	}
+	m_InputDt.assign(m_PaddedCount, 0.0f);
+	m_StepDt.assign(m_PaddedCount, 0.0f);
+
+	m_Qw.resize(m_PaddedCount);
+	m_Qx.resize(m_PaddedCount);
+	m_Qy.resize(m_PaddedCount);
+	m_Qz.resize(m_PaddedCount);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_Bias[axis].resize(m_PaddedCount);
+	}
+	m_Initialized.resize(m_PaddedCount);
+
+	Reset();
+}
+
+int BatchedComplementary::GetLaneCount()
+{
+	return SIMD_LANE_COUNT;
+}
+
+const char* BatchedComplementary::GetLaneName()
+{
+	return SIMD_LANES_NAME;
+}
+
+void BatchedComplementary::Reset()
+{
+	std::fill(m_Qw.begin(), m_Qw.end(), 1.0f);
+	std::fill(m_Qx.begin(), m_Qx.end(), 0.0f);
+	std::fill(m_Qy.begin(), m_Qy.end(), 0.0f);
+	std::fill(m_Qz.begin(), m_Qz.end(), 0.0f);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		std::fill(m_Bias[axis].begin(), m_Bias[axis].end(), 0.0f);
+	}
+	std::fill(m_Initialized.begin(), m_Initialized.end(), uint8_t(0));
+	m_PendingInitialization = m_StreamCount;
+
+	ClearSamples();
+}
+
+void BatchedComplementary::ClearSamples()
+{
+	std::fill(m_InputDt.begin(), m_InputDt.end(), 0.0f);
+}
+
+void BatchedComplementary::SetSample(size_t _stream, const ImuReading& _reading, float _dt)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_Input[axis][_stream] = _reading.accel[axis];
+		m_Input[3 + axis][_stream] = _reading.gyro[axis];
+	}
+	m_InputDt[_stream] = _dt;
+}
+
+// the first sample of a stream only sets its tilt from gravity, like the other engines
+void BatchedComplementary::InitializePending()
+{
+	for (size_t stream = 0; stream < m_StreamCount && m_PendingInitialization > 0; ++stream)
+	{
+		if (m_Initialized[stream] || m_InputDt[stream] <= 0.0f)
+		{
+			continue;
+		}
+
+		const float accel[3] = { m_Input[0][stream], m_Input[1][stream], m_Input[2][stream] };
+		const Quaternion q = QuaternionFromGravity(accel);
+		m_Qw[stream] = q.w;
+		m_Qx[stream] = q.x;
+		m_Qy[stream] = q.y;
+		m_Qz[stream] = q.z;
+		m_StepDt[stream] = 0.0f;	// consumed
+		m_Initialized[stream] = 1;
+		--m_PendingInitialization;
+	}
+}
+
+void BatchedComplementary::Step()
+{
+	const float* stepDt = m_InputDt.data();
+	if (m_PendingInitialization > 0)
+	{
+		m_StepDt = m_InputDt;
+		InitializePending();
+		stepDt = m_StepDt.data();
+	}
+
+	const FloatLanes zero = SplatLanes(0.0f);
+	const FloatLanes half = SplatLanes(0.5f);
+	const FloatLanes two = SplatLanes(2.0f);
+	const FloatLanes minAccel = SplatLanes(1e-6f);
+	const FloatLanes kp = SplatLanes(m_Settings.proportionalGain);
+	const FloatLanes ki = SplatLanes(m_Settings.integralGain);
+
+	for (size_t i = 0; i < m_PaddedCount; i += SIMD_LANE_COUNT)
+	{
+		const FloatLanes dt = LoadLanes(&stepDt[i]);
+		const LaneMask active = dt > zero;
+		if (!AnyLane(active))
+		{
+			continue;	// whole group idle this step
+		}
+
+		FloatLanes qw = LoadLanes(&m_Qw[i]);
+		FloatLanes qx = LoadLanes(&m_Qx[i]);
+		FloatLanes qy = LoadLanes(&m_Qy[i]);
+		FloatLanes qz = LoadLanes(&m_Qz[i]);
+		FloatLanes bx = LoadLanes(&m_Bias[0][i]);
+		FloatLanes by = LoadLanes(&m_Bias[1][i]);
+		FloatLanes bz = LoadLanes(&m_Bias[2][i]);
+
+		FloatLanes ax = LoadLanes(&m_Input[0][i]);
+		FloatLanes ay = LoadLanes(&m_Input[1][i]);
+		FloatLanes az = LoadLanes(&m_Input[2][i]);
+		const FloatLanes gx = LoadLanes(&m_Input[3][i]);
+		const FloatLanes gy = LoadLanes(&m_Input[4][i]);
+		const FloatLanes gz = LoadLanes(&m_Input[5][i]);
+
+		// gravity direction predicted by the current orientation (see GravityInSensorFrame)
+		const FloatLanes vx = two * (qx * qz - qw * qy);
+		const FloatLanes vy = two * (qy * qz + qw * qx);
+		const FloatLanes vz = qw * qw - qx * qx - qy * qy + qz * qz;
+
+		// tilt error: measured x predicted, zero when the accel carries no direction
+		const FloatLanes accelSquared = MulAdd(ax, ax, MulAdd(ay, ay, az * az));
+		const LaneMask hasAccel = accelSquared > minAccel;
+		const FloatLanes accelScale = Select(hasAccel, Rsqrt(Select(hasAccel, accelSquared, two)), zero);
+		ax = ax * accelScale;
+		ay = ay * accelScale;
+		az = az * accelScale;
+
+		const FloatLanes ex = ay * vz - az * vy;
+		const FloatLanes ey = az * vx - ax * vz;
+		const FloatLanes ez = ax * vy - ay * vx;
+
+		// integral term learns the gyro bias, proportional term pulls the tilt
+		const FloatLanes kiDt = ki * dt;
+		bx = MulAdd(kiDt, ex, bx);
+		by = MulAdd(kiDt, ey, by);
+		bz = MulAdd(kiDt, ez, bz);
+
+		const FloatLanes halfDt = half * dt;
+		const FloatLanes wx = MulAdd(kp, ex, gx + bx) * halfDt;
+		const FloatLanes wy = MulAdd(kp, ey, gy + by) * halfDt;
+		const FloatLanes wz = MulAdd(kp, ez, gz + bz) * halfDt;
+
+		// q += q * (0, w) dt / 2, then renormalize
+		FloatLanes nw = qw - qx * wx - qy * wy - qz * wz;
+		FloatLanes nx = qx + qw * wx + qy * wz - qz * wy;
+		FloatLanes ny = qy + qw * wy - qx * wz + qz * wx;
+		FloatLanes nz = qz + qw * wz + qx * wy - qy * wx;
+
+		const FloatLanes norm = Rsqrt(MulAdd(nw, nw, MulAdd(nx, nx, MulAdd(ny, ny, nz * nz))));
+		nw = nw * norm;
+		nx = nx * norm;
+		ny = ny * norm;
+		nz = nz * norm;
+
+		// streams without a sample keep their state
+		StoreLanes(&m_Qw[i], Select(active, nw, qw));
+		StoreLanes(&m_Qx[i], Select(active, nx, qx));
+		StoreLanes(&m_Qy[i], Select(active, ny, qy));
+		StoreLanes(&m_Qz[i], Select(active, nz, qz));
+		StoreLanes(&m_Bias[0][i], Select(active, bx, LoadLanes(&m_Bias[0][i])));
+		StoreLanes(&m_Bias[1][i], Select(active, by, LoadLanes(&m_Bias[1][i])));
+		StoreLanes(&m_Bias[2][i], Select(active, bz, LoadLanes(&m_Bias[2][i])));
+	}
+}
+
+Quaternion BatchedComplementary::GetOrientation(size_t _stream) const
+{
+	return Quaternion(m_Qx[_stream], m_Qy[_stream], m_Qz[_stream], m_Qw[_stream]);
+}
+
+// same formulas as QuaternionToEuler, SIMD_LANE_COUNT streams at a time
+void BatchedComplementary::GetEulerAngles(float* _roll, float* _pitch, float* _yaw) const
+{
+	const FloatLanes one = SplatLanes(1.0f);
+	const FloatLanes two = SplatLanes(2.0f);
+
+	for (size_t i = 0; i < m_StreamCount; i += SIMD_LANE_COUNT)
+	{
+		const FloatLanes qw = LoadLanes(&m_Qw[i]);
+		const FloatLanes qx = LoadLanes(&m_Qx[i]);
+		const FloatLanes qy = LoadLanes(&m_Qy[i]);
+		const FloatLanes qz = LoadLanes(&m_Qz[i]);
+
+		const FloatLanes roll = Atan2Lanes(two * (qw * qx + qy * qz), one - two * (qx * qx + qy * qy));
+		const FloatLanes pitch = AsinLanes(two * (qw * qy - qz * qx));
+		const FloatLanes yaw = Atan2Lanes(two * (qw * qz + qx * qy), one - two * (qy * qy + qz * qz));
+
+		if (i + SIMD_LANE_COUNT <= m_StreamCount)
+		{
+			StoreLanes(&_roll[i], roll);
+			StoreLanes(&_pitch[i], pitch);
+			StoreLanes(&_yaw[i], yaw);
+		}
+		else
+		{
+			// last partial group, the caller's arrays are not padded
+			float lanes[3][SIMD_LANE_COUNT];
+			StoreLanes(lanes[0], roll);
+			StoreLanes(lanes[1], pitch);
+			StoreLanes(lanes[2], yaw);
+			for (size_t lane = 0; i + lane < m_StreamCount; ++lane)
+			{
+				_roll[i + lane] = lanes[0][lane];
+				_pitch[i + lane] = lanes[1][lane];
+				_yaw[i + lane] = lanes[2][lane];
+			}
+		}
+	}
+}
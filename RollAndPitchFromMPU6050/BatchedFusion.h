@@ -0,0 +1,81 @@
+//
+// BatchedFusion.h - one complementary filter kernel advancing many streams at once
+//
+// For fleets of live devices or many recorded logs. The quaternion and gyro
+// bias of every stream live in structure-of-arrays form and each step runs
+// SIMD_LANE_COUNT streams per instruction (16 AVX-512, 8 AVX2, 4 SSE/NEON).
+// Streams without a new sample in a step are masked and keep their state.
+//
+// The filter is a Mahony style complementary filter (gyro integration with a
+// proportional-integral tilt correction from the accelerometer); it needs only
+// multiply-adds and a reciprocal square root, so it maps directly onto lanes.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+#include <vector>
+
+
+struct BatchedFusionSettings
+{
+	float proportionalGain;		// rad/s of correction per unit of tilt error
+	float integralGain;			// gyro bias learning rate
+
+	BatchedFusionSettings() :
+		proportionalGain(1.0f),
+		integralGain(0.02f)
+	{
+	}
+};
+
+
+class BatchedComplementary
+{
+public:
+
+	explicit BatchedComplementary(size_t _streamCount, const BatchedFusionSettings& _settings = BatchedFusionSettings());
+
+	size_t GetStreamCount() const		{ return m_StreamCount; }
+	static int GetLaneCount();
+	static const char* GetLaneName();
+
+	void Reset();
+
+	// staging of the next step: every stream starts without a sample
+	void ClearSamples();
+	void SetSample(size_t _stream, const ImuReading& _reading, float _dt);
+
+	// bulk staging, _channel in SampleBlock order, arrays hold GetStreamCount() values;
+	// a stream with dt <= 0 has no sample in this step
+	float* GetInputChannel(int _channel)		{ return m_Input[_channel].data(); }
+	float* GetInputDt()							{ return m_InputDt.data(); }
+
+	// advance all streams with a staged sample
+	void Step();
+
+	DirectX::SimpleMath::Quaternion GetOrientation(size_t _stream) const;
+	bool IsInitialized(size_t _stream) const	{ return m_Initialized[_stream] != 0; }
+
+	// roll, pitch and yaw of every stream in radians, arrays hold GetStreamCount() values
+	void GetEulerAngles(float* _roll, float* _pitch, float* _yaw) const;
+
+private:
+
+	void InitializePending();
+
+	size_t m_StreamCount;
+	size_t m_PaddedCount;		// multiple of the lane count, padding streams never get samples
+	BatchedFusionSettings m_Settings;
+
+	std::vector<float> m_Input[IMU_CHANNEL_COUNT];
+	std::vector<float> m_InputDt;
+	std::vector<float> m_StepDt;	// copy of m_InputDt without the samples spent on initialization
+
+	// state, structure of arrays
+	std::vector<float> m_Qw, m_Qx, m_Qy, m_Qz;
+	std::vector<float> m_Bias[3];
+	std::vector<uint8_t> m_Initialized;
+	size_t m_PendingInitialization;
+};
@@ -0,0 +1,688 @@
+//
+// Benchmark.cpp
+//
+
+#include "pch.h"
+#include "Benchmark.h"
+#include "BatchedFusion.h"
+#include "ErrorStateKalman.h"
+#include "FastMath.h"
+#include "FilterBank.h"
+#include "OneEuroFilter.h"
+#include "QuaternionMath.h"
+#include "SensorLogCodec.h"
+
+#include <string.h>
+
+
+namespace
+{
+	const uint32_t SYNTHETIC_SAMPLE_COUNT = 1024;
+	const uint64_t SYNTHETIC_SAMPLE_PERIOD = DX::StepTimer::TicksPerSecond / 1000;	// 1 kHz
+	const uint32_t APPROXIMATION_INPUT_COUNT = 1024;	// multiple of every SIMD_LANE_COUNT
+	const uint32_t ACCURACY_SAMPLE_COUNT = 1 << 20;
+
+	// deterministic noise so every run benchmarks the same data
+	float NextNoise(uint32_t& _state)
+	{
+		_state = _state * 1664525u + 1013904223u;
+		return float(_state >> 8) / float(1 << 24) - 0.5f;
+	}
+
+	// slow rocking motion with sensor noise
+	std::vector<ImuReading> GenerateReadings()
+	{
+		std::vector<ImuReading> readings(SYNTHETIC_SAMPLE_COUNT);
+		uint32_t noise = 12345;
+
+		for (uint32_t i = 0; i < SYNTHETIC_SAMPLE_COUNT; ++i)
+		{
+			const float t = i * 0.001f;
+			const float roll = 0.3f * sinf(2.0f * t);
+
+			ImuReading& reading = readings[i];
+			reading.accel[0] = 0.01f * NextNoise(noise);
+			reading.accel[1] = sinf(roll) + 0.01f * NextNoise(noise);
+			reading.accel[2] = cosf(roll) + 0.01f * NextNoise(noise);
+			reading.gyro[0] = 0.6f * cosf(2.0f * t) + 0.01f * NextNoise(noise);
+			reading.gyro[1] = 0.01f * NextNoise(noise);
+			reading.gyro[2] = 0.01f * NextNoise(noise);
+		}
+		return readings;
+	}
+
+	double NowSeconds()
+	{
+		LARGE_INTEGER frequency;
+		LARGE_INTEGER counter;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+		return double(counter.QuadPart) / double(frequency.QuadPart);
+	}
+
+	BenchmarkResult BenchmarkErrorStateKalman(const std::vector<ImuReading>& _readings, uint32_t _iterations)
+	{
+		ErrorStateKalman filter;
+		uint64_t timestamp = 0;
+		float checksum = 0.0f;
+
+		const double start = NowSeconds();
+		for (uint32_t i = 0; i < _iterations; ++i)
+		{
+			timestamp += SYNTHETIC_SAMPLE_PERIOD;
+			filter.ProcessReading(_readings[i % _readings.size()], timestamp);
+			checksum += filter.GetOrientation().orientation.w;
+		}
+		const double elapsed = NowSeconds() - start;
+
+		// keep the optimizer from dropping the loop
+		volatile float sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "ESKF predict+update";
+		result.iterations = _iterations;
+		result.nanosecondsPerIteration = elapsed * 1e9 / _iterations;
+		return result;
+	}
+
+	// gyro prediction every sample, accel correction through the anti-alias FIR on 1 in 8
+	BenchmarkResult BenchmarkMultiRateKalman(const std::vector<ImuReading>& _readings, uint32_t _iterations)
+	{
+		const int DECIMATION = 8;
+		const float SAMPLE_RATE = float(DX::StepTimer::TicksPerSecond / SYNTHETIC_SAMPLE_PERIOD);
+
+		ErrorStateKalman filter;
+		DecimatingFir decimator;
+		decimator.Configure(DECIMATION, 4 * DECIMATION, 0.4f * SAMPLE_RATE / DECIMATION, SAMPLE_RATE);
+		uint64_t timestamp = 0;
+		float checksum = 0.0f;
+
+		const double start = NowSeconds();
+		for (uint32_t i = 0; i < _iterations; ++i)
+		{
+			timestamp += SYNTHETIC_SAMPLE_PERIOD;
+			const ImuReading& reading = _readings[i % _readings.size()];
+			float accel[3];
+			if (filter.PredictReading(reading, timestamp) && decimator.Push(reading.accel, accel))
+			{
+				filter.Correct(accel);
+			}
+			checksum += filter.GetOrientation().orientation.w;
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile float sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "ESKF predict, update 1 in 8";
+		result.iterations = _iterations;
+		result.nanosecondsPerIteration = elapsed * 1e9 / _iterations;
+		return result;
+	}
+
+	// the same synthetic readings as raw registers
+	std::vector<SensorSample> ToRawSamples(const std::vector<ImuReading>& _readings)
+	{
+		const float UNITS_PER_RAD_S = GYRO_UNITS_PER_DPS * 180.0f / 3.14159265f;
+
+		std::vector<SensorSample> samples(_readings.size());
+		for (size_t i = 0; i < _readings.size(); ++i)
+		{
+			SensorSample& sample = samples[i];
+			sample.timestamp = (i + 1) * SYNTHETIC_SAMPLE_PERIOD;
+			sample.deviceId = MPU6050_I2C_ADDRESS;
+			sample.temperature = 0;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				sample.accel[axis] = int16_t(_readings[i].accel[axis] * ACCEL_UNITS_PER_G);
+				sample.gyro[axis] = int16_t(_readings[i].gyro[axis] * UNITS_PER_RAD_S);
+			}
+		}
+		return samples;
+	}
+
+	BenchmarkResult BenchmarkFixedPoint(const std::vector<SensorSample>& _samples, uint32_t _iterations)
+	{
+		FixedPointComplementary filter;
+		SensorSample sample;
+		int32_t checksum = 0;
+
+		const double start = NowSeconds();
+		for (uint32_t i = 0; i < _iterations; ++i)
+		{
+			sample = _samples[i % _samples.size()];
+			sample.timestamp = (i + 1) * SYNTHETIC_SAMPLE_PERIOD;
+			filter.ProcessSample(sample);
+			checksum += filter.GetRoll();
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile int32_t sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "Fixed-point complementary";
+		result.iterations = _iterations;
+		result.nanosecondsPerIteration = elapsed * 1e9 / _iterations;
+		return result;
+	}
+
+	// _samples packed into one log chunk, unpacked back into records: the replay cost per record
+	BenchmarkResult BenchmarkLogUnpack(const std::vector<SensorSample>& _samples, uint32_t _iterations)
+	{
+		std::vector<SensorLogRecord> records(_samples.size());
+		for (size_t i = 0; i < _samples.size(); ++i)
+		{
+			records[i].timeOffset = uint32_t(i * SYNTHETIC_SAMPLE_PERIOD);
+			records[i].deviceId = MPU6050_I2C_ADDRESS;
+			records[i].reserved = 0;
+			EncodeMPU6050Frame(_samples[i], records[i].frame);
+		}
+
+		std::vector<uint8_t> chunk(sizeof(SensorChunkHeader) + (records.size() / PACKED_BLOCK_RECORDS + 1) * PACKED_BLOCK_MAX_SIZE, 0);
+		uint32_t size = sizeof(SensorChunkHeader);
+		for (uint32_t first = 0; first < records.size(); first += PACKED_BLOCK_RECORDS)
+		{
+			const uint32_t count = std::min(PACKED_BLOCK_RECORDS, uint32_t(records.size()) - first);
+			size += PackSensorBlock(&records[first], count, &chunk[size]);
+		}
+		SensorChunkHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = SENSOR_PACKED_CHUNK_MAGIC;
+		header.recordCount = uint32_t(records.size());
+		memcpy(chunk.data(), &header, sizeof(header));
+
+		const uint32_t passes = std::max<uint32_t>(_iterations / header.recordCount, 1);
+		uint32_t checksum = 0;
+		const double start = NowSeconds();
+		for (uint32_t pass = 0; pass < passes; ++pass)
+		{
+			UnpackSensorChunk(chunk.data(), size, records.data());
+			checksum += records[pass % records.size()].frame[1];
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile uint32_t sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "Log chunk unpack, per record";
+		result.iterations = passes * header.recordCount;
+		result.nanosecondsPerIteration = elapsed * 1e9 / result.iterations;
+		return result;
+	}
+
+	// worst case configuration: all sections and FIR taps on every channel
+	BenchmarkResult BenchmarkFilterBank(const std::vector<ImuReading>& _readings, uint32_t _iterations)
+	{
+		ChannelFilterConfig config;
+		config.sections.push_back(DesignBiquad(BIQUAD_NOTCH, 50.0f, 4.0f, 1000.0f));
+		config.sections.push_back(DesignBiquad(BIQUAD_NOTCH, 120.0f, 4.0f, 1000.0f));
+		config.sections.push_back(DesignBiquad(BIQUAD_LOWPASS, 100.0f, 0.7071f, 1000.0f));
+		config.sections.push_back(DesignBiquad(BIQUAD_LOWPASS, 100.0f, 0.7071f, 1000.0f));
+		config.firTaps = DesignLowpassFir(FilterBank::MAX_FIR_TAPS, 100.0f, 1000.0f);
+
+		const ChannelFilterConfig channels[IMU_CHANNEL_COUNT] = { config, config, config, config, config, config };
+		std::unique_ptr<FilterBank> filterBank = std::make_unique<FilterBank>();
+		filterBank->Configure(channels);
+
+		std::unique_ptr<SampleBlock> block = std::make_unique<SampleBlock>();
+		const uint32_t blockCount = _iterations / SampleBlock::CAPACITY;
+		float checksum = 0.0f;
+
+		const double start = NowSeconds();
+		for (uint32_t b = 0; b < blockCount; ++b)
+		{
+			block->count = 0;
+			for (size_t i = 0; i < SampleBlock::CAPACITY; ++i)
+			{
+				AppendToBlock(*block, i, _readings[(b * SampleBlock::CAPACITY + i) % _readings.size()]);
+			}
+			filterBank->Process(*block);
+			checksum += block->channels[0][0];
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile float sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "Filter bank, 6 ch x (4 biquads + 32 FIR)";
+		result.iterations = blockCount * SampleBlock::CAPACITY;
+		result.nanosecondsPerIteration = elapsed * 1e9 / result.iterations;
+		return result;
+	}
+	// every stream gets a sample each step, iterations count stream updates
+	BenchmarkResult BenchmarkBatchedFusion(const std::vector<ImuReading>& _readings, uint32_t _iterations)
+	{
+		const size_t STREAM_COUNT = 1024;
+
+		BatchedComplementary fusion(STREAM_COUNT);
+		const uint32_t stepCount = uint32_t(_iterations / STREAM_COUNT);
+		float checksum = 0.0f;
+
+		const double start = NowSeconds();
+		for (uint32_t step = 0; step < stepCount; ++step)
+		{
+			float* dt = fusion.GetInputDt();
+			for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+			{
+				float* input = fusion.GetInputChannel(channel);
+				for (size_t stream = 0; stream < STREAM_COUNT; ++stream)
+				{
+					const ImuReading& reading = _readings[(step + stream) % _readings.size()];
+					input[stream] = channel < 3 ? reading.accel[channel] : reading.gyro[channel - 3];
+				}
+			}
+			for (size_t stream = 0; stream < STREAM_COUNT; ++stream)
+			{
+				dt[stream] = 0.001f;
+			}
+			fusion.Step();
+			checksum += fusion.GetOrientation(step % STREAM_COUNT).w;
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile float sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = "Batched complementary, 1024 streams, " SIMD_LANES_NAME;
+		result.iterations = uint32_t(stepCount * STREAM_COUNT);
+		result.nanosecondsPerIteration = elapsed * 1e9 / result.iterations;
+		return result;
+	}
+	// arguments for the approximation benchmarks: atan2 pairs on all four quadrants, asin in [-1, 1], rsqrt of norms
+	struct ApproximationInputs
+	{
+		std::vector<float> y, x, unit, positive, output;
+	};
+
+	ApproximationInputs GenerateApproximationInputs()
+	{
+		ApproximationInputs inputs;
+		inputs.y.resize(APPROXIMATION_INPUT_COUNT);
+		inputs.x.resize(APPROXIMATION_INPUT_COUNT);
+		inputs.unit.resize(APPROXIMATION_INPUT_COUNT);
+		inputs.positive.resize(APPROXIMATION_INPUT_COUNT);
+		inputs.output.resize(APPROXIMATION_INPUT_COUNT);
+
+		uint32_t noise = 54321;
+		for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i)
+		{
+			inputs.y[i] = 4.0f * NextNoise(noise);
+			inputs.x[i] = 4.0f * NextNoise(noise);
+			inputs.unit[i] = 2.0f * NextNoise(noise);
+			inputs.positive[i] = 0.5f + 2.0f * (NextNoise(noise) + 0.5f);
+		}
+		return inputs;
+	}
+
+	// _kernel processes all inputs once and returns a value that keeps the work alive
+	template<typename Kernel>
+	BenchmarkResult BenchmarkApproximation(const char* _name, uint32_t _iterations, Kernel _kernel)
+	{
+		const uint32_t passes = _iterations / APPROXIMATION_INPUT_COUNT;
+		float checksum = 0.0f;
+
+		const double start = NowSeconds();
+		for (uint32_t pass = 0; pass < passes; ++pass)
+		{
+			checksum += _kernel();
+		}
+		const double elapsed = NowSeconds() - start;
+
+		volatile float sink = checksum;
+		(void)sink;
+
+		BenchmarkResult result;
+		result.name = _name;
+		result.iterations = passes * APPROXIMATION_INPUT_COUNT;
+		result.nanosecondsPerIteration = elapsed * 1e9 / result.iterations;
+		return result;
+	}
+
+	void BenchmarkApproximations(std::vector<BenchmarkResult>& _results, uint32_t _iterations)
+	{
+		ApproximationInputs in = GenerateApproximationInputs();
+		float* out = in.output.data();
+
+		_results.push_back(BenchmarkApproximation("atan2f, C library", _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = atan2f(in.y[i], in.x[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("FastAtan2, " FAST_MATH_PRECISION_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = FastAtan2(in.y[i], in.x[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("Atan2Lanes, " FAST_MATH_PRECISION_NAME ", " SIMD_LANES_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; i += SIMD_LANE_COUNT) StoreLanes(&out[i], Atan2Lanes(LoadLanes(&in.y[i]), LoadLanes(&in.x[i])));
+			return out[0];
+		}));
+
+		_results.push_back(BenchmarkApproximation("asinf, C library", _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = asinf(in.unit[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("FastAsin, " FAST_MATH_PRECISION_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = FastAsin(in.unit[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("AsinLanes, " FAST_MATH_PRECISION_NAME ", " SIMD_LANES_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; i += SIMD_LANE_COUNT) StoreLanes(&out[i], AsinLanes(LoadLanes(&in.unit[i])));
+			return out[0];
+		}));
+
+		_results.push_back(BenchmarkApproximation("1 / sqrtf, C library", _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = 1.0f / sqrtf(in.positive[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("FastRsqrt, " FAST_MATH_PRECISION_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; ++i) out[i] = FastRsqrt(in.positive[i]);
+			return out[0];
+		}));
+		_results.push_back(BenchmarkApproximation("RsqrtLanes, " FAST_MATH_PRECISION_NAME ", " SIMD_LANES_NAME, _iterations, [&]()
+		{
+			for (uint32_t i = 0; i < APPROXIMATION_INPUT_COUNT; i += SIMD_LANE_COUNT) StoreLanes(&out[i], RsqrtLanes(LoadLanes(&in.positive[i])));
+			return out[0];
+		}));
+	}
+
+	// largest error of a scalar and a lane function against a double reference on _count inputs from _input(i)
+	template<typename Input, typename Scalar, typename Lanes, typename Reference>
+	void MeasureAccuracy(std::vector<ApproximationAccuracy>& _results, const char* _scalarName, const char* _lanesName, double _bound,
+		Input _input, Scalar _scalar, Lanes _lanes, Reference _reference)
+	{
+		double scalarError = 0.0;
+		double lanesError = 0.0;
+		float a[SIMD_LANE_COUNT], b[SIMD_LANE_COUNT], lanes[SIMD_LANE_COUNT];
+
+		for (uint32_t i = 0; i < ACCURACY_SAMPLE_COUNT; i += SIMD_LANE_COUNT)
+		{
+			for (int lane = 0; lane < SIMD_LANE_COUNT; ++lane)
+			{
+				_input(i + lane, a[lane], b[lane]);
+			}
+			StoreLanes(lanes, _lanes(LoadLanes(a), LoadLanes(b)));
+
+			for (int lane = 0; lane < SIMD_LANE_COUNT; ++lane)
+			{
+				const double reference = _reference(a[lane], b[lane]);
+				scalarError = std::max(scalarError, fabs(_scalar(a[lane], b[lane]) - reference));
+				lanesError = std::max(lanesError, fabs(lanes[lane] - reference));
+			}
+		}
+
+		ApproximationAccuracy scalar = { _scalarName, scalarError, _bound };
+		ApproximationAccuracy vector = { _lanesName, lanesError, _bound };
+		_results.push_back(scalar);
+		_results.push_back(vector);
+	}
+
+	// Roll error of the multi-rate Kalman filter at 1 kHz, accel corrections on 1
+	// in 8 samples, for a device held at a fixed roll with 130 Hz vibration on the
+	// lateral accel axis: through the anti-alias FIR of the pipeline, and taking
+	// every 8th sample, which folds the vibration down to 5 Hz.
+	void MeasureVibrationRejection(std::vector<FeatureMeasurement>& _results)
+	{
+		const int DECIMATION = 8;
+		const float SAMPLE_RATE = 1000.0f;
+		const uint32_t SAMPLE_COUNT = 20000;
+		const uint32_t SETTLE_SAMPLES = 5000;
+		const float VIBRATION_HZ = 130.0f;
+		const float VIBRATION_G = 0.15f;
+		const float ROLL = 0.3f;
+
+		for (int filtered = 1; filtered >= 0; --filtered)
+		{
+			ErrorStateKalman filter;
+			DecimatingFir decimator;
+			decimator.Configure(DECIMATION, filtered ? 4 * DECIMATION : 1, 0.4f * SAMPLE_RATE / DECIMATION, SAMPLE_RATE);
+			uint32_t noise = 777;
+			double squares = 0.0;
+
+			for (uint32_t i = 0; i < SAMPLE_COUNT; ++i)
+			{
+				const float t = i / SAMPLE_RATE;
+
+				ImuReading reading;
+				reading.accel[0] = 0.01f * NextNoise(noise);
+				reading.accel[1] = sinf(ROLL) + VIBRATION_G * sinf(2.0f * 3.14159265f * VIBRATION_HZ * t) + 0.01f * NextNoise(noise);
+				reading.accel[2] = cosf(ROLL) + 0.01f * NextNoise(noise);
+				reading.gyro[0] = 0.01f * NextNoise(noise);
+				reading.gyro[1] = 0.01f * NextNoise(noise);
+				reading.gyro[2] = 0.01f * NextNoise(noise);
+
+				float accel[3];
+				if (filter.PredictReading(reading, (i + 1) * SYNTHETIC_SAMPLE_PERIOD) && decimator.Push(reading.accel, accel))
+				{
+					filter.Correct(accel);
+				}
+
+				if (i >= SETTLE_SAMPLES)
+				{
+					float fusedRoll, pitch, yaw;
+					QuaternionToEuler(filter.GetOrientation().orientation, fusedRoll, pitch, yaw);
+					const double error = fusedRoll - ROLL;
+					squares += error * error;
+				}
+			}
+
+			const FeatureMeasurement rms = { filtered ? "Roll RMS, 130 Hz vibration, FIR 1 in 8" : "Roll RMS, 130 Hz vibration, every 8th",
+				180.0 / 3.14159265358979 * sqrt(squares / (SAMPLE_COUNT - SETTLE_SAMPLES)), "deg" };
+			_results.push_back(rms);
+		}
+	}
+
+	// Records in a full packed chunk against a raw one, for a still sensor at
+	// 1 kHz with Gaussian noise of _sigma LSB on every axis: the size ratio of
+	// a log whose chunks are sealed full.
+	void MeasureLogPacking(std::vector<FeatureMeasurement>& _results, const char* _name, float _sigma)
+	{
+		const uint32_t RECORD_COUNT = 64 * PACKED_BLOCK_RECORDS;
+		uint32_t noise = 4242;
+		auto gaussian = [&noise]()
+		{
+			float sum = 0.0f;
+			for (int i = 0; i < 12; ++i)
+			{
+				sum += NextNoise(noise);
+			}
+			return sum;
+		};
+
+		std::vector<SensorLogRecord> records(RECORD_COUNT);
+		for (uint32_t i = 0; i < RECORD_COUNT; ++i)
+		{
+			SensorSample sample;
+			sample.timestamp = i * SYNTHETIC_SAMPLE_PERIOD;
+			sample.deviceId = MPU6050_I2C_ADDRESS;
+			sample.accel[0] = int16_t(lrintf(_sigma * gaussian()));
+			sample.accel[1] = int16_t(lrintf(_sigma * gaussian()));
+			sample.accel[2] = int16_t(16384 + lrintf(_sigma * gaussian()));
+			sample.temperature = int16_t(-2000 + i / 1000);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				sample.gyro[axis] = int16_t(lrintf(_sigma * gaussian()));
+			}
+			records[i].timeOffset = uint32_t(sample.timestamp);
+			records[i].deviceId = uint8_t(sample.deviceId);
+			records[i].reserved = 0;
+			EncodeMPU6050Frame(sample, records[i].frame);
+		}
+
+		// whole blocks only, the writer also splits the last one
+		std::vector<uint8_t> block(PACKED_BLOCK_MAX_SIZE);
+		uint32_t packedSize = sizeof(SensorChunkHeader);
+		uint32_t packedCount = 0;
+		while (packedCount < RECORD_COUNT)
+		{
+			const uint32_t size = PackSensorBlock(&records[packedCount], PACKED_BLOCK_RECORDS, block.data());
+			if (packedSize + size > SENSOR_CHUNK_SIZE)
+			{
+				break;
+			}
+			packedSize += size;
+			packedCount += PACKED_BLOCK_RECORDS;
+		}
+
+		const FeatureMeasurement ratio = { _name, double(packedCount) / SENSOR_CHUNK_CAPACITY, "x smaller" };
+		_results.push_back(ratio);
+	}
+
+	// acos of the dot product loses the hundredths of a degree in float
+	double SmallAngleBetween(const DirectX::SimpleMath::Quaternion& _a, const DirectX::SimpleMath::Quaternion& _b)
+	{
+		const DirectX::SimpleMath::Quaternion inverse(-_a.x, -_a.y, -_a.z, _a.w);
+		float rotation[3];
+		QuaternionToRotationVector(QuaternionProduct(inverse, _b), rotation);
+		return sqrt(double(rotation[0]) * rotation[0] + double(rotation[1]) * rotation[1] + double(rotation[2]) * rotation[2]);
+	}
+
+	// Display smoothing at 60 Hz with the default settings: frame to frame jitter
+	// of a still device whose fused orientation has 0.23 degrees of noise per axis,
+	// and how far the output trails a steady turn.
+	void MeasureDisplaySmoothing(std::vector<FeatureMeasurement>& _results)
+	{
+		const float FRAME_DT = 1.0f / 60.0f;
+		const uint32_t STILL_FRAMES = 6000;
+		const float NOISE_RADIANS = 0.23f * 3.14159265f / 180.0f / 0.2887f;	// NextNoise has a standard deviation of 0.2887
+		const float TURN_RATE = 1.5f;		// rad/s
+		const uint32_t TURN_FRAMES = 120;	// past the settling of the speed estimate
+
+		const OneEuroSettings settings;
+		OrientationOneEuro smoothing;
+		uint32_t noise = 54321;
+
+		double rawSquares = 0.0;
+		double smoothedSquares = 0.0;
+		DirectX::SimpleMath::Quaternion previousRaw, previousSmoothed;
+		for (uint32_t frame = 0; frame < STILL_FRAMES; ++frame)
+		{
+			const float x = NOISE_RADIANS * NextNoise(noise);
+			const float y = NOISE_RADIANS * NextNoise(noise);
+			const float z = NOISE_RADIANS * NextNoise(noise);
+			const DirectX::SimpleMath::Quaternion raw = QuaternionFromRotationVector(x, y, z);
+			const DirectX::SimpleMath::Quaternion smoothed = smoothing.Filter(raw, FRAME_DT, settings);
+			if (frame > 0)
+			{
+				const double rawStep = SmallAngleBetween(previousRaw, raw);
+				const double smoothedStep = SmallAngleBetween(previousSmoothed, smoothed);
+				rawSquares += rawStep * rawStep;
+				smoothedSquares += smoothedStep * smoothedStep;
+			}
+			previousRaw = raw;
+			previousSmoothed = smoothed;
+		}
+
+		smoothing.Reset();
+		float lag = 0.0f;
+		for (uint32_t frame = 0; frame <= TURN_FRAMES; ++frame)
+		{
+			const DirectX::SimpleMath::Quaternion raw = QuaternionFromRotationVector(TURN_RATE * FRAME_DT * frame, 0.0f, 0.0f);
+			lag = float(SmallAngleBetween(smoothing.Filter(raw, FRAME_DT, settings), raw)) / TURN_RATE;
+		}
+
+		const double DEGREES = 180.0 / 3.14159265358979;
+		const FeatureMeasurement rawJitter = { "Display jitter still, raw", DEGREES * sqrt(rawSquares / (STILL_FRAMES - 1)), "deg" };
+		const FeatureMeasurement smoothedJitter = { "Display jitter still, smoothed", DEGREES * sqrt(smoothedSquares / (STILL_FRAMES - 1)), "deg" };
+		const FeatureMeasurement turnLag = { "Display smoothing lag at 1.5 rad/s", 1000.0 * lag, "ms" };
+		_results.push_back(rawJitter);
+		_results.push_back(smoothedJitter);
+		_results.push_back(turnLag);
+	}
+}
+
+
+const char* GetTargetArchitecture()
+{
+#if defined(_M_X64)
+	return "x64";
+#elif defined(_M_ARM)
+	return "ARM";
+#elif defined(_M_IX86)
+	return "x86";
+#else
+	return "unknown";
+#endif
+}
+
+std::vector<BenchmarkResult> RunBenchmarks()
+{
+	const std::vector<ImuReading> readings = GenerateReadings();
+
+	std::vector<BenchmarkResult> results;
+	results.push_back(BenchmarkErrorStateKalman(readings, 100000));
+	results.push_back(BenchmarkMultiRateKalman(readings, 100000));
+	results.push_back(BenchmarkFixedPoint(ToRawSamples(readings), 100000));
+	results.push_back(BenchmarkFilterBank(readings, 100000));
+	results.push_back(BenchmarkLogUnpack(ToRawSamples(readings), 1000000));
+	results.push_back(BenchmarkBatchedFusion(readings, 1000000));
+	BenchmarkApproximations(results, 1000000);
+	return results;
+}
+
+std::vector<ApproximationAccuracy> MeasureFastMathAccuracy()
+{
+	const double PI = 3.14159265358979;
+	std::vector<ApproximationAccuracy> results;
+
+	// atan2: a full turn at radii from 0.01 to 100
+	MeasureAccuracy(results, "FastAtan2 " FAST_MATH_PRECISION_NAME, "Atan2Lanes " FAST_MATH_PRECISION_NAME, FAST_ATAN_MAX_ERROR,
+		[=](uint32_t _i, float& _y, float& _x)
+		{
+			const double angle = 2.0 * PI * _i / ACCURACY_SAMPLE_COUNT - PI;
+			const double radius = pow(10.0, 4.0 * (_i % 97) / 96.0 - 2.0);
+			_y = float(radius * sin(angle));
+			_x = float(radius * cos(angle));
+		},
+		[](float _y, float _x) { return FastAtan2(_y, _x); },
+		[](const FloatLanes& _y, const FloatLanes& _x) { return Atan2Lanes(_y, _x); },
+		[](float _y, float _x) { return atan2(double(_y), double(_x)); });
+
+	MeasureAccuracy(results, "FastAsin " FAST_MATH_PRECISION_NAME, "AsinLanes " FAST_MATH_PRECISION_NAME, FAST_ASIN_MAX_ERROR,
+		[](uint32_t _i, float& _x, float& _unused) { _x = -1.0f + 2.0f * _i / (ACCURACY_SAMPLE_COUNT - 1); _unused = 0.0f; },
+		[](float _x, float) { return FastAsin(_x); },
+		[](const FloatLanes& _x, const FloatLanes&) { return AsinLanes(_x); },
+		[](float _x, float) { return asin(double(_x)); });
+
+	// rsqrt relative error over the norms the pipeline sees, 1e-3 to 1e3
+	MeasureAccuracy(results, "FastRsqrt " FAST_MATH_PRECISION_NAME, "RsqrtLanes " FAST_MATH_PRECISION_NAME, FAST_RSQRT_MAX_ERROR,
+		[](uint32_t _i, float& _x, float& _unused) { _x = float(pow(10.0, 6.0 * _i / ACCURACY_SAMPLE_COUNT - 3.0)); _unused = 0.0f; },
+		[](float _x, float) { return FastRsqrt(_x) * sqrt(double(_x)); },
+		[](const FloatLanes& _x, const FloatLanes&) { return RsqrtLanes(_x) * Sqrt(_x); },
+		[](float, float) { return 1.0; });
+
+	return results;
+}
+
+PipelineValidation ValidatePipeline(const std::vector<SensorSample>& _samples, const FixedPointSettings& _fixedPointSettings, const InterpolatorSettings& _interpolatorSettings)
+{
+	// every other sample hidden from the interpolator, so errors between samples are measured too
+	const uint32_t INTERPOLATION_DECIMATION = 2;
+
+	PipelineValidation result;
+	result.fixedPoint = ValidateFixedPointFusion(_samples, _fixedPointSettings);
+	result.interpolation = MeasureInterpolationError(_samples, INTERPOLATION_DECIMATION, _interpolatorSettings);
+	return result;
+}
+
+std::vector<FeatureMeasurement> MeasureFeatures()
+{
+	std::vector<FeatureMeasurement> results;
+	MeasureVibrationRejection(results);
+	MeasureDisplaySmoothing(results);
+	MeasureLogPacking(results, "Log packing, noise 30 LSB", 30.0f);
+	MeasureLogPacking(results, "Log packing, noise 90 LSB", 90.0f);
+	return results;
+}
@@ -0,0 +1,60 @@
+//
+// Benchmark.h - micro benchmarks of the sensor pipeline
+//
+// Run the same build on x64 and on the Raspberry Pi (ARM) to compare per-update cost.
+//
+
+#pragma once
+
+#include "FixedPointFusion.h"
+#include "OrientationInterpolator.h"
+
+#include <stdint.h>
+#include <vector>
+
+
+struct BenchmarkResult
+{
+	const char* name;
+	uint32_t iterations;
+	double nanosecondsPerIteration;
+};
+
+// name of the platform this binary was compiled for
+const char* GetTargetArchitecture();
+
+// runs all pipeline benchmarks, takes a few hundred milliseconds
+std::vector<BenchmarkResult> RunBenchmarks();
+
+
+// FastMath approximations against double precision libm over their whole input range
+struct ApproximationAccuracy
+{
+	const char* name;
+	double maxError;	// radians, relative for rsqrt
+	double bound;		// documented maximum for the compiled FAST_MATH_PRECISION
+};
+
+std::vector<ApproximationAccuracy> MeasureFastMathAccuracy();
+
+
+// effect of a pipeline feature on synthetic data, the figures its documentation quotes
+struct FeatureMeasurement
+{
+	const char* name;
+	double value;
+	const char* unit;
+};
+
+// takes a few hundred milliseconds
+std::vector<FeatureMeasurement> MeasureFeatures();
+
+
+// accuracy checks on recorded samples
+struct PipelineValidation
+{
+	FixedPointValidation fixedPoint;
+	InterpolationError interpolation;
+};
+
+PipelineValidation ValidatePipeline(const std::vector<SensorSample>& _samples, const FixedPointSettings& _fixedPointSettings, const InterpolatorSettings& _interpolatorSettings);
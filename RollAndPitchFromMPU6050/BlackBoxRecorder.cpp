@@ -0,0 +1,261 @@
+//
+// BlackBoxRecorder.cpp
+//
+
+#include "pch.h"
+#include "BlackBoxRecorder.h"
+#include "SensorLog.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+
+namespace
+{
+	const float RING_MARGIN = 1.25f;			// room for rate jitter and the wait for the dump thread
+	const int POLL_MILLISECONDS = 20;			// dump thread checks for the end of the window
+	const double MAX_EXTRA_WAIT_SECONDS = 1.0;	// gives up waiting when samples stopped, e.g. after an exception
+
+	const char DUMP_SUFFIX[] = ".bbx";
+
+	std::basic_string<PathChar> MakeDumpPath(const std::basic_string<PathChar>& _prefix, uint32_t _number)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%04u%s", _number, DUMP_SUFFIX);
+
+		std::basic_string<PathChar> path = _prefix;
+		for (const char* c = name; *c != 0; ++c)
+		{
+			path.push_back(PathChar(*c));
+		}
+		return path;
+	}
+
+	FILE* OpenForWriting(const PathChar* _path)
+	{
+#if defined(_WIN32)
+		FILE* file = nullptr;
+		return (_wfopen_s(&file, _path, L"wb") == 0) ? file : nullptr;
+#else
+		return fopen(_path, "wb");
+#endif
+	}
+
+	// first entry at or after _timestamp of a time ordered range
+	template<typename T>
+	size_t LowerBound(const T* _entries, size_t _count, uint64_t _timestamp)
+	{
+		return size_t(std::lower_bound(_entries, _entries + _count, _timestamp,
+			[](const T& _entry, uint64_t _time) { return _entry.timestamp < _time; }) - _entries);
+	}
+}
+
+
+BlackBoxRecorder::BlackBoxRecorder() :
+	m_Pending(false),
+	m_TriggerReady(false),
+	m_Trigger(BLACK_BOX_MANUAL),
+	m_TriggerTimestamp(0),
+	m_Stopping(false),
+	m_DumpCount(0),
+	m_IgnoredTriggers(0),
+	m_WriteError(false)
+{
+}
+
+BlackBoxRecorder::~BlackBoxRecorder()
+{
+	Stop();
+}
+
+bool BlackBoxRecorder::Start(const PathChar* _pathPrefix, const BlackBoxSettings& _settings)
+{
+	Stop();
+
+	m_Settings = _settings;
+	m_PathPrefix = _pathPrefix;
+
+	const size_t capacity = size_t((_settings.preSeconds + _settings.postSeconds) * _settings.sampleRate * RING_MARGIN) + 1;
+	m_Samples.Allocate(capacity);
+	m_Orientations.Allocate(capacity);
+	m_SampleCopy.resize(m_Samples.GetCapacity());
+	m_OrientationCopy.resize(m_Orientations.GetCapacity());
+
+	m_Pending.store(false);
+	m_TriggerReady.store(false);
+	m_DumpCount.store(0);
+	m_IgnoredTriggers.store(0);
+	m_WriteError.store(false);
+	m_Stopping.store(false);
+	m_Thread = std::thread([this]() { DumpLoop(); });
+	return true;
+}
+
+void BlackBoxRecorder::Stop()
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Stopping.store(true);
+	}
+	m_Wake.notify_one();
+	m_Thread.join();
+}
+
+void BlackBoxRecorder::PushOrientation(const FusedOrientation& _orientation)
+{
+	BlackBoxOrientation entry;
+	entry.timestamp = _orientation.timestamp;
+	entry.orientation[0] = _orientation.orientation.x;
+	entry.orientation[1] = _orientation.orientation.y;
+	entry.orientation[2] = _orientation.orientation.z;
+	entry.orientation[3] = _orientation.orientation.w;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		entry.attitudeVariance[axis] = _orientation.attitudeVariance[axis];
+	}
+	entry.reserved = 0.0f;
+	m_Orientations.Push(entry);
+}
+
+bool BlackBoxRecorder::Trigger(BlackBoxTrigger _trigger, uint64_t _timestamp)
+{
+	if (m_Pending.exchange(true, std::memory_order_acq_rel))
+	{
+		m_IgnoredTriggers.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_Trigger.store(_trigger, std::memory_order_relaxed);
+	m_TriggerTimestamp.store(_timestamp, std::memory_order_relaxed);
+	m_TriggerReady.store(true, std::memory_order_release);
+
+	// the dump thread also polls, a lost wakeup only delays the dump
+	m_Wake.notify_one();
+	return true;
+}
+
+void BlackBoxRecorder::DumpLoop()
+{
+	std::unique_lock<std::mutex> lock(m_WakeMutex);
+	while (!m_Stopping.load())
+	{
+		m_Wake.wait_for(lock, std::chrono::milliseconds(POLL_MILLISECONDS));
+		if (!m_TriggerReady.load(std::memory_order_acquire))
+		{
+			continue;
+		}
+
+		const BlackBoxTrigger trigger = BlackBoxTrigger(m_Trigger.load(std::memory_order_relaxed));
+		const uint64_t timestamp = m_TriggerTimestamp.load(std::memory_order_relaxed);
+		const uint64_t windowEnd = timestamp + DX::StepTimer::SecondsToTicks(m_Settings.postSeconds);
+		const std::chrono::steady_clock::time_point giveUp = std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_Settings.postSeconds + MAX_EXTRA_WAIT_SECONDS));
+
+		// wait for the samples after the trigger, by their timestamps so a virtual clock works as well
+		lock.unlock();
+		while (!m_Stopping.load() && std::chrono::steady_clock::now() < giveUp)
+		{
+			uint64_t first;
+			const size_t count = m_Samples.Copy(m_SampleCopy.data(), first);
+			if (count > 0 && m_SampleCopy[count - 1].timestamp >= windowEnd)
+			{
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+		}
+
+		if (WriteDump(trigger, timestamp))
+		{
+			m_DumpCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			m_WriteError.store(true, std::memory_order_relaxed);
+		}
+		m_TriggerReady.store(false, std::memory_order_relaxed);
+		m_Pending.store(false, std::memory_order_release);
+		lock.lock();
+	}
+}
+
+bool BlackBoxRecorder::WriteDump(BlackBoxTrigger _trigger, uint64_t _timestamp)
+{
+	const uint64_t windowStart = _timestamp - std::min(_timestamp, DX::StepTimer::SecondsToTicks(m_Settings.preSeconds));
+	const uint64_t windowEnd = _timestamp + DX::StepTimer::SecondsToTicks(m_Settings.postSeconds);
+
+	uint64_t first;
+	const size_t sampleCount = m_Samples.Copy(m_SampleCopy.data(), first);
+	const size_t orientationCount = m_Orientations.Copy(m_OrientationCopy.data(), first);
+
+	const size_t sampleBegin = LowerBound(m_SampleCopy.data(), sampleCount, windowStart);
+	const size_t sampleEnd = LowerBound(m_SampleCopy.data(), sampleCount, windowEnd + 1);
+	const size_t orientationBegin = LowerBound(m_OrientationCopy.data(), orientationCount, windowStart);
+	const size_t orientationEnd = LowerBound(m_OrientationCopy.data(), orientationCount, windowEnd + 1);
+
+	BlackBoxHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = BLACK_BOX_MAGIC;
+	header.version = BLACK_BOX_VERSION;
+	header.sampleSize = sizeof(SensorSample);
+	header.orientationSize = sizeof(BlackBoxOrientation);
+	header.trigger = _trigger;
+	header.sampleCount = uint32_t(sampleEnd - sampleBegin);
+	header.orientationCount = uint32_t(orientationEnd - orientationBegin);
+	header.triggerTimestamp = _timestamp;
+
+	const SensorSample* samples = m_SampleCopy.data() + sampleBegin;
+	const BlackBoxOrientation* orientations = m_OrientationCopy.data() + orientationBegin;
+	uint32_t crc = Crc32(&header, sizeof(header));
+	crc = Crc32(samples, header.sampleCount * sizeof(SensorSample), crc);
+	header.crc = Crc32(orientations, header.orientationCount * sizeof(BlackBoxOrientation), crc);
+
+	const std::basic_string<PathChar> path = MakeDumpPath(m_PathPrefix, m_DumpCount.load(std::memory_order_relaxed));
+	FILE* file = OpenForWriting(path.c_str());
+	if (file == nullptr)
+	{
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	written = written && fwrite(samples, sizeof(SensorSample), header.sampleCount, file) == header.sampleCount;
+	written = written && fwrite(orientations, sizeof(BlackBoxOrientation), header.orientationCount, file) == header.orientationCount;
+	return (fclose(file) == 0) && written;
+}
+
+
+bool LoadBlackBoxDump(const PathChar* _path, BlackBoxDump& _dump)
+{
+	MappedFile file;
+	if (!file.Open(_path) || file.GetSize() < sizeof(BlackBoxHeader))
+	{
+		return false;
+	}
+
+	BlackBoxHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != BLACK_BOX_MAGIC || header.version != BLACK_BOX_VERSION
+		|| header.sampleSize != sizeof(SensorSample) || header.orientationSize != sizeof(BlackBoxOrientation)
+		|| file.GetSize() != sizeof(header) + uint64_t(header.sampleCount) * sizeof(SensorSample) + uint64_t(header.orientationCount) * sizeof(BlackBoxOrientation))
+	{
+		return false;
+	}
+
+	BlackBoxHeader check = header;
+	check.crc = 0;
+	uint32_t crc = Crc32(&check, sizeof(check));
+	if (Crc32(file.GetData() + sizeof(header), file.GetSize() - sizeof(header), crc) != header.crc)
+	{
+		return false;
+	}
+
+	const SensorSample* samples = reinterpret_cast<const SensorSample*>(file.GetData() + sizeof(header));
+	const BlackBoxOrientation* orientations = reinterpret_cast<const BlackBoxOrientation*>(samples + header.sampleCount);
+	_dump.header = header;
+	_dump.samples.assign(samples, samples + header.sampleCount);
+	_dump.orientations.assign(orientations, orientations + header.orientationCount);
+	return true;
+}
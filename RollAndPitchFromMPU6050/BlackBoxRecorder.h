@@ -0,0 +1,147 @@
+//
+// BlackBoxRecorder.h - the last seconds of samples and orientation in memory, dumped on a trigger
+//
+// Continuous logging is not always wanted, but after a crash or a shock the
+// moments before it are. The recorder keeps raw samples and fused orientation
+// in two preallocated rings that are overwritten all the time. A trigger (shock,
+// an exception in the acquisition, a key) marks a time; once the rings hold the
+// configured seconds after it, a dump thread copies the window around it and
+// writes one file. The producers only store into the rings, they never lock,
+// allocate or touch the file.
+//
+
+#pragma once
+
+#include "SensorData.h"
+#include "MappedFile.h"
+#include "HistoryRing.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum BlackBoxTrigger
+{
+	BLACK_BOX_MANUAL,
+	BLACK_BOX_SHOCK,
+	BLACK_BOX_FREE_FALL,
+	BLACK_BOX_ACQUISITION_ERROR,
+	BLACK_BOX_TRIGGER_COUNT,
+};
+
+const uint32_t BLACK_BOX_MAGIC = 0x4255504D;	// "MPUB"
+const uint32_t BLACK_BOX_VERSION = 1;
+
+// dump file: this header, the samples, then the orientations, all in time order
+struct BlackBoxHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sampleSize;		// sizeof(SensorSample) of the writer
+	uint32_t orientationSize;	// sizeof(BlackBoxOrientation)
+	uint32_t trigger;			// BlackBoxTrigger
+	uint32_t sampleCount;
+	uint32_t orientationCount;
+	uint32_t crc;				// CRC-32 of the whole file with this field zero
+	uint64_t triggerTimestamp;	// StepTimer ticks
+};
+
+struct BlackBoxOrientation
+{
+	uint64_t timestamp;
+	float orientation[4];		// x, y, z, w
+	float attitudeVariance[3];
+	float reserved;
+};
+
+struct BlackBoxSettings
+{
+	float preSeconds;			// kept before the trigger
+	float postSeconds;			// waited for after the trigger
+	float sampleRate;			// highest rate of either stream, sizes the rings
+
+	BlackBoxSettings() :
+		preSeconds(10.0f),
+		postSeconds(2.0f),
+		sampleRate(1000.0f)
+	{
+	}
+};
+
+
+// Any thread may trigger; one thread pushes samples and one pushes orientations.
+// A trigger while a dump is being collected is counted and otherwise ignored.
+class BlackBoxRecorder
+{
+public:
+
+	BlackBoxRecorder();
+	~BlackBoxRecorder();
+
+	// allocates the rings and the dump buffers and starts the dump thread; dumps are
+	// written to _pathPrefix followed by their number and ".bbx". Call before the producers run.
+	bool Start(const PathChar* _pathPrefix, const BlackBoxSettings& _settings = BlackBoxSettings());
+	void Stop();
+	bool IsStarted() const						{ return m_Thread.joinable(); }
+
+	// hot path, constant time, no locks or allocation
+	void PushSample(const SensorSample& _sample)					{ m_Samples.Push(_sample); }
+	void PushOrientation(const FusedOrientation& _orientation);
+
+	// false when a dump is already pending
+	bool Trigger(BlackBoxTrigger _trigger, uint64_t _timestamp);
+
+	bool IsDumpPending() const					{ return m_Pending.load(std::memory_order_acquire); }
+	uint32_t GetDumpCount() const				{ return m_DumpCount.load(std::memory_order_relaxed); }
+	uint32_t GetIgnoredTriggerCount() const		{ return m_IgnoredTriggers.load(std::memory_order_relaxed); }
+	bool HasWriteError() const					{ return m_WriteError.load(std::memory_order_relaxed); }
+
+private:
+
+	BlackBoxRecorder(const BlackBoxRecorder&);
+	BlackBoxRecorder& operator=(const BlackBoxRecorder&);
+
+	void DumpLoop();
+	bool WriteDump(BlackBoxTrigger _trigger, uint64_t _timestamp);
+
+	BlackBoxSettings m_Settings;
+	std::basic_string<PathChar> m_PathPrefix;
+
+	HistoryRing<SensorSample> m_Samples;
+	HistoryRing<BlackBoxOrientation> m_Orientations;
+
+	// trigger handed to the dump thread: m_Pending is claimed first, the fields
+	// are valid once m_TriggerReady is set
+	std::atomic<bool> m_Pending;
+	std::atomic<bool> m_TriggerReady;
+	std::atomic<uint32_t> m_Trigger;
+	std::atomic<uint64_t> m_TriggerTimestamp;
+
+	std::thread m_Thread;
+	std::mutex m_WakeMutex;
+	std::condition_variable m_Wake;
+	std::atomic<bool> m_Stopping;
+
+	// dump thread: copies of the rings, allocated by Start
+	std::vector<SensorSample> m_SampleCopy;
+	std::vector<BlackBoxOrientation> m_OrientationCopy;
+
+	std::atomic<uint32_t> m_DumpCount;
+	std::atomic<uint32_t> m_IgnoredTriggers;
+	std::atomic<bool> m_WriteError;
+};
+
+
+// a dump file read back, false when it is missing, foreign or damaged
+struct BlackBoxDump
+{
+	BlackBoxHeader header;
+	std::vector<SensorSample> samples;
+	std::vector<BlackBoxOrientation> orientations;
+};
+
+bool LoadBlackBoxDump(const PathChar* _path, BlackBoxDump& _dump);
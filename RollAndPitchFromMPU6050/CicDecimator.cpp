@@ -0,0 +1,207 @@
+//
+// CicDecimator.cpp
+//
+
+#include "pch.h"
+#include "CicDecimator.h"
+
+#include <math.h>
+
+
+namespace
+{
+	const int INPUT_BITS = 16;
+	const int REGISTER_BITS = 32;
+	const double NOISE_WINDOW_SECONDS = 1.0;
+
+	int16_t GetChannel(const SensorSample& _sample, int _channel)
+	{
+		return (_channel < 3) ? _sample.accel[_channel] : _sample.gyro[_channel - 3];
+	}
+
+	void SetChannel(SensorSample& _sample, int _channel, int16_t _value)
+	{
+		if (_channel < 3)
+		{
+			_sample.accel[_channel] = _value;
+		}
+		else
+		{
+			_sample.gyro[_channel - 3] = _value;
+		}
+	}
+}
+
+
+CicDecimator::CicDecimator() :
+	m_Order(1),
+	m_Shift(0)
+{
+	Reset();
+}
+
+void CicDecimator::Configure(int _order, int _decimationShift)
+{
+	m_Order = std::min(std::max(_order, 1), MAX_ORDER);
+	m_Shift = std::min(std::max(_decimationShift, 0), MAX_DECIMATION_SHIFT);
+
+	// keep the full-scale output inside the wrapping registers
+	while (m_Order > 1 && INPUT_BITS + m_Order * m_Shift > REGISTER_BITS)
+	{
+		--m_Order;
+	}
+	Reset();
+}
+
+void CicDecimator::Reset()
+{
+	for (int stage = 0; stage < MAX_ORDER; ++stage)
+	{
+		for (int channel = 0; channel < CHANNEL_COUNT; ++channel)
+		{
+			m_Integrators[stage][channel] = 0;
+			m_CombDelays[stage][channel] = 0;
+		}
+	}
+	m_Phase = 0;
+	m_Warmup = m_Order;
+	m_FirstTimestamp = 0;
+}
+
+bool CicDecimator::Push(const SensorSample& _input, SensorSample& _output)
+{
+	if (m_Shift == 0)
+	{
+		_output = _input;
+		return true;
+	}
+
+	if (m_Phase == 0)
+	{
+		m_FirstTimestamp = _input.timestamp;
+	}
+
+	// integrators at the input rate, unsigned so the wrap-around is defined
+	for (int channel = 0; channel < CHANNEL_COUNT; ++channel)
+	{
+		uint32_t value = uint32_t(int32_t(GetChannel(_input, channel)));
+		for (int stage = 0; stage < m_Order; ++stage)
+		{
+			m_Integrators[stage][channel] += value;
+			value = m_Integrators[stage][channel];
+		}
+	}
+
+	if (++m_Phase < GetDecimation())
+	{
+		return false;
+	}
+	m_Phase = 0;
+
+	// combs at the output rate, then remove the R^N gain with rounding
+	const int gainShift = m_Order * m_Shift;
+	_output = _input;
+	for (int channel = 0; channel < CHANNEL_COUNT; ++channel)
+	{
+		uint32_t value = m_Integrators[m_Order - 1][channel];
+		for (int stage = 0; stage < m_Order; ++stage)
+		{
+			const uint32_t delayed = m_CombDelays[stage][channel];
+			m_CombDelays[stage][channel] = value;
+			value -= delayed;
+		}
+		const int64_t rounded = (int64_t(int32_t(value)) + (int64_t(1) << (gainShift - 1))) >> gainShift;
+		SetChannel(_output, channel, int16_t(std::min<int64_t>(std::max<int64_t>(rounded, INT16_MIN), INT16_MAX)));
+	}
+
+	// stamp the output at the centre of the impulse response
+	const uint64_t span = _input.timestamp - m_FirstTimestamp;
+	const uint64_t delay = uint64_t(span * GetDelaySamples() / (GetDecimation() - 1));
+	_output.timestamp = (delay < _input.timestamp) ? _input.timestamp - delay : 0;
+
+	if (m_Warmup > 0)
+	{
+		--m_Warmup;
+		return false;
+	}
+	return true;
+}
+
+
+NoiseFloorMeter::NoiseFloorMeter()
+{
+	Reset();
+}
+
+void NoiseFloorMeter::Reset(int _lag)
+{
+	for (int channel = 0; channel < CicDecimator::CHANNEL_COUNT; ++channel)
+	{
+		m_SquaredDifferences[channel] = 0.0;
+		m_Rms[channel] = 0.0f;
+	}
+	m_Lag = std::min(std::max(_lag, 1), CicDecimator::MAX_ORDER);
+	m_HistoryPosition = 0;
+	m_HistoryCount = 0;
+	m_Count = 0;
+	m_WindowIntervals = 0;
+	m_WindowStart = 0;
+	m_Rate = 0.0f;
+}
+
+void NoiseFloorMeter::Push(const SensorSample& _sample)
+{
+	if (m_HistoryCount == 0)
+	{
+		m_WindowStart = _sample.timestamp;
+	}
+	else
+	{
+		++m_WindowIntervals;
+	}
+
+	// m_HistoryPosition holds the sample _lag steps back, replaced by this one
+	int16_t* lagged = m_History[m_HistoryPosition];
+	for (int channel = 0; channel < CicDecimator::CHANNEL_COUNT; ++channel)
+	{
+		const int16_t value = GetChannel(_sample, channel);
+		if (m_HistoryCount == m_Lag)
+		{
+			const double difference = double(value) - lagged[channel];
+			m_SquaredDifferences[channel] += difference * difference;
+		}
+		lagged[channel] = value;
+	}
+	m_HistoryPosition = (m_HistoryPosition + 1) % m_Lag;
+	if (m_HistoryCount < m_Lag)
+	{
+		++m_HistoryCount;
+	}
+	else
+	{
+		++m_Count;
+	}
+
+	const double windowSeconds = DX::StepTimer::TicksToSeconds(_sample.timestamp - m_WindowStart);
+	if (windowSeconds < NOISE_WINDOW_SECONDS || m_Count < 2)
+	{
+		return;
+	}
+
+	// the difference of two independent samples has twice the variance of one
+	for (int channel = 0; channel < CicDecimator::CHANNEL_COUNT; ++channel)
+	{
+		const float scale = (channel < 3) ? 1.0f / ACCEL_UNITS_PER_G : 1.0f / GYRO_UNITS_PER_DPS;
+		m_Rms[channel] = float(sqrt(m_SquaredDifferences[channel] / (2.0 * m_Count))) * scale;
+		m_SquaredDifferences[channel] = 0.0;
+	}
+	m_Rate = float(m_WindowIntervals / windowSeconds);
+	m_Count = 0;
+	m_WindowIntervals = 0;
+	m_WindowStart = _sample.timestamp;
+}
+
+float NoiseFloorMeter::GetDensity(int _channel) const
+{
+	return (m_Rate > 0.0f) ? m_Rms[_channel] / sqrtf(0.5f * m_Rate) : 0.0f;
+}
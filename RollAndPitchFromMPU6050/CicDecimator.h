@@ -0,0 +1,94 @@
+//
+// CicDecimator.h - oversample and decimate the raw sensor channels in integer arithmetic
+//
+// The sensor runs far faster than the display needs. Averaging R samples into
+// one cuts white noise by about sqrt(R) and the fusion rate by R, at the cost of
+// I2C bandwidth. A cascaded integrator-comb filter does this with adds only: N
+// integrators at the input rate, N combs at the output rate, gain R^N removed by
+// a shift (R is a power of two). The registers wrap modulo 2^32, which is exact
+// as long as the output fits: 16 + N * log2(R) <= 32 bits.
+//
+// NoiseFloorMeter estimates the white noise of a stream from sample differences,
+// which cancel slow motion, so it can run on live data before and after the CIC.
+// CIC outputs overlap with the N - 1 neighbours on each side, so differences are
+// taken N samples apart there to keep the two terms independent.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+
+class CicDecimator
+{
+public:
+
+	static const int CHANNEL_COUNT = 6;			// accel XYZ, gyro XYZ
+	static const int MAX_ORDER = 4;
+	static const int MAX_DECIMATION_SHIFT = 4;	// R = 16, 1 kHz to 62.5 Hz
+
+	CicDecimator();
+
+	// R = 2^_decimationShift, 0 passes samples through; the sum of bit growth is clamped to 16
+	void Configure(int _order, int _decimationShift);
+	void Reset();
+
+	// true when _output holds a new decimated sample; the first _order outputs
+	// after a reset are dropped while the filter settles
+	bool Push(const SensorSample& _input, SensorSample& _output);
+
+	int GetOrder() const				{ return m_Order; }
+	int GetDecimation() const			{ return 1 << m_Shift; }
+
+	// group delay N (R - 1) / 2, in input samples; output timestamps already account for it
+	float GetDelaySamples() const		{ return 0.5f * m_Order * (GetDecimation() - 1); }
+
+private:
+
+	int m_Order;
+	int m_Shift;
+
+	uint32_t m_Integrators[MAX_ORDER][CHANNEL_COUNT];
+	uint32_t m_CombDelays[MAX_ORDER][CHANNEL_COUNT];
+	int m_Phase;
+	int m_Warmup;
+	uint64_t m_FirstTimestamp;		// first input of the current output period
+};
+
+
+class NoiseFloorMeter
+{
+public:
+
+	NoiseFloorMeter();
+
+	// _lag 1 for raw samples, the CIC order for its output
+	void Reset(int _lag = 1);
+	void Push(const SensorSample& _sample);
+
+	// estimate of the last completed 1 s window, false before the first one
+	bool HasEstimate() const			{ return m_Rate > 0.0f; }
+	float GetSampleRate() const			{ return m_Rate; }
+
+	// RMS noise per channel in SampleBlock order, accel in g, gyro in deg/s
+	const float* GetRms() const			{ return m_Rms; }
+
+	// RMS spread over the band up to Nyquist, unit/sqrt(Hz); constant for white noise at any rate
+	float GetDensity(int _channel) const;
+
+private:
+
+	// the last _lag samples, oldest at m_HistoryPosition once filled
+	int16_t m_History[CicDecimator::MAX_ORDER][CicDecimator::CHANNEL_COUNT];
+	int m_Lag;
+	int m_HistoryPosition;
+	int m_HistoryCount;
+
+	double m_SquaredDifferences[CicDecimator::CHANNEL_COUNT];
+	uint32_t m_Count;				// differences in this window
+	uint32_t m_WindowIntervals;		// sample intervals in this window, for the rate
+	uint64_t m_WindowStart;
+
+	float m_Rms[CicDecimator::CHANNEL_COUNT];
+	float m_Rate;
+};
@@ -0,0 +1,218 @@
+//
+// Clock.cpp
+//
+
+#include "pch.h"
+#include "Clock.h"
+#include "StepTimer.h"
+
+#include <chrono>
+
+
+namespace
+{
+	const uint64_t TICKS_PER_SECOND = DX::StepTimer::TicksPerSecond;
+
+	typedef std::chrono::duration<int64_t, std::ratio<1, 10000000>> TickDuration;
+	static_assert(TickDuration::period::den == TICKS_PER_SECOND, "clock ticks are StepTimer ticks");
+
+	std::chrono::steady_clock::duration TicksToDuration(uint64_t _ticks)
+	{
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(TickDuration(int64_t(_ticks)));
+	}
+}
+
+
+Clock& GetRealClock()
+{
+	static RealClock clock;
+	return clock;
+}
+
+
+RealClock::RealClock() :
+	m_NextId(1)
+{
+}
+
+RealClock::~RealClock()
+{
+	std::vector<uint32_t> timers;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const std::unique_ptr<Timer>& timer : m_Timers)
+		{
+			timers.push_back(timer->id);
+		}
+	}
+	for (uint32_t timer : timers)
+	{
+		StopTimer(timer);
+	}
+}
+
+uint64_t RealClock::GetTicks() const
+{
+#if defined(_WIN32)
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	// split to avoid overflow of counter * TicksPerSecond
+	const uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+	const uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * TICKS_PER_SECOND + remainder * TICKS_PER_SECOND / frequency.QuadPart;
+#else
+	const std::chrono::steady_clock::duration now = std::chrono::steady_clock::now().time_since_epoch();
+	return uint64_t(std::chrono::duration_cast<TickDuration>(now).count());
+#endif
+}
+
+uint32_t RealClock::StartTimer(uint64_t _periodTicks, const ClockCallback& _callback)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	std::unique_ptr<Timer> timer(new Timer);
+	timer->id = m_NextId++;
+	timer->periodTicks = std::max<uint64_t>(_periodTicks, 1);
+	timer->callback = _callback;
+	timer->stopping = false;
+	timer->thread = std::thread(&RealClock::TimerLoop, this, timer.get());
+
+	m_Timers.push_back(std::move(timer));
+	return m_Timers.back()->id;
+}
+
+void RealClock::StopTimer(uint32_t _timer)
+{
+	std::unique_ptr<Timer> timer;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t i = 0; i < m_Timers.size(); ++i)
+		{
+			if (m_Timers[i]->id == _timer)
+			{
+				timer = std::move(m_Timers[i]);
+				m_Timers.erase(m_Timers.begin() + i);
+				break;
+			}
+		}
+		if (!timer)
+		{
+			return;
+		}
+		timer->stopping = true;
+	}
+	m_Wake.notify_all();
+	timer->thread.join();
+}
+
+void RealClock::TimerLoop(Timer* _timer)
+{
+	const std::chrono::steady_clock::duration period = TicksToDuration(_timer->periodTicks);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + period;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		m_Wake.wait_until(lock, deadline, [_timer]() { return _timer->stopping; });
+		if (_timer->stopping)
+		{
+			return;
+		}
+		if (std::chrono::steady_clock::now() < deadline)
+		{
+			continue;
+		}
+
+		// outside the lock, the callback may start and stop other timers
+		lock.unlock();
+		_timer->callback();
+		lock.lock();
+
+		// skip the periods a slow callback missed instead of running them back to back
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		deadline += period;
+		if (deadline <= now)
+		{
+			deadline += ((now - deadline) / period + 1) * period;
+		}
+	}
+}
+
+
+VirtualClock::VirtualClock(uint64_t _start) :
+	m_Now(_start),
+	m_NextId(1)
+{
+}
+
+uint32_t VirtualClock::StartTimer(uint64_t _periodTicks, const ClockCallback& _callback)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	Timer timer;
+	timer.id = m_NextId++;
+	timer.periodTicks = std::max<uint64_t>(_periodTicks, 1);
+	timer.deadline = GetTicks() + timer.periodTicks;
+	timer.callback = _callback;
+	m_Timers.push_back(timer);
+	return timer.id;
+}
+
+void VirtualClock::StopTimer(uint32_t _timer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (size_t i = 0; i < m_Timers.size(); ++i)
+	{
+		if (m_Timers[i].id == _timer)
+		{
+			m_Timers.erase(m_Timers.begin() + i);
+			return;
+		}
+	}
+}
+
+void VirtualClock::AdvanceTo(uint64_t _time)
+{
+	for (;;)
+	{
+		ClockCallback callback;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+
+			// earliest deadline, the first started on a tie
+			Timer* due = nullptr;
+			for (Timer& timer : m_Timers)
+			{
+				if (timer.deadline <= _time && (due == nullptr || timer.deadline < due->deadline))
+				{
+					due = &timer;
+				}
+			}
+			if (due == nullptr)
+			{
+				m_Now.store(std::max(GetTicks(), _time), std::memory_order_release);
+				return;
+			}
+
+			m_Now.store(std::max(GetTicks(), due->deadline), std::memory_order_release);
+			due->deadline += due->periodTicks;
+			callback = due->callback;
+		}
+
+		// outside the lock, the callback may start and stop timers, its own as well
+		callback();
+	}
+}
+
+void VirtualClock::Restart(uint64_t _start)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Now.store(_start, std::memory_order_release);
+	for (Timer& timer : m_Timers)
+	{
+		timer.deadline = _start + timer.periodTicks;
+	}
+}
@@ -0,0 +1,121 @@
+//
+// Clock.h - time source of the frame timer, the acquisition timers and the sample timestamps
+//
+// Everything that reads the time or waits for it goes through a Clock, in
+// StepTimer ticks (100 ns). RealClock is the monotonic high resolution counter
+// with a thread per periodic timer. VirtualClock only moves when it is advanced
+// and runs the timers that fall due on the way from the advancing thread, each
+// at its own deadline, so hours of acquisition and frames pass in seconds and
+// always in the same order.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+
+typedef std::function<void()> ClockCallback;
+
+class Clock
+{
+public:
+
+	virtual ~Clock() {}
+
+	// monotonic, StepTimer ticks
+	virtual uint64_t GetTicks() const = 0;
+
+	// _callback every _periodTicks, the first one period from now; returns the id for StopTimer.
+	// A late callback is not repeated to catch up, the next one keeps the period grid.
+	virtual uint32_t StartTimer(uint64_t _periodTicks, const ClockCallback& _callback) = 0;
+
+	// no callback of the timer starts after this returns; waits for one in progress,
+	// so a callback must not stop its own timer on a RealClock
+	virtual void StopTimer(uint32_t _timer) = 0;
+};
+
+// the process wide RealClock
+Clock& GetRealClock();
+
+
+// QueryPerformanceCounter on Windows, std::chrono::steady_clock elsewhere
+class RealClock : public Clock
+{
+public:
+
+	RealClock();
+	~RealClock();		// stops all timers
+
+	uint64_t GetTicks() const override;
+	uint32_t StartTimer(uint64_t _periodTicks, const ClockCallback& _callback) override;
+	void StopTimer(uint32_t _timer) override;
+
+private:
+
+	RealClock(const RealClock&);
+	RealClock& operator=(const RealClock&);
+
+	struct Timer
+	{
+		uint32_t id;
+		uint64_t periodTicks;
+		ClockCallback callback;
+		std::thread thread;
+		bool stopping;
+	};
+
+	void TimerLoop(Timer* _timer);
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::vector<std::unique_ptr<Timer>> m_Timers;
+	uint32_t m_NextId;
+};
+
+
+// Time is set by the owner. AdvanceTo runs the due callbacks in deadline order
+// (timers started first go first on equal deadlines) with GetTicks returning the
+// deadline inside each, so what they timestamp does not depend on the step size.
+// Any thread may read the time; one thread advances it.
+class VirtualClock : public Clock
+{
+public:
+
+	explicit VirtualClock(uint64_t _start = 0);
+
+	uint64_t GetTicks() const override				{ return m_Now.load(std::memory_order_acquire); }
+	uint32_t StartTimer(uint64_t _periodTicks, const ClockCallback& _callback) override;
+	void StopTimer(uint32_t _timer) override;
+
+	// time never goes back, an earlier _time only runs nothing
+	void AdvanceTo(uint64_t _time);
+	void Advance(uint64_t _ticks)					{ AdvanceTo(GetTicks() + _ticks); }
+
+	// for a new run from _start, the timers are kept on their period grid from there
+	void Restart(uint64_t _start);
+
+private:
+
+	VirtualClock(const VirtualClock&);
+	VirtualClock& operator=(const VirtualClock&);
+
+	struct Timer
+	{
+		uint32_t id;
+		uint64_t periodTicks;
+		uint64_t deadline;
+		ClockCallback callback;
+	};
+
+	std::mutex m_Mutex;
+	std::vector<Timer> m_Timers;		// in start order
+	std::atomic<uint64_t> m_Now;
+	uint32_t m_NextId;
+};
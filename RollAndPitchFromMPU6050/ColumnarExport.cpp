@@ -0,0 +1,404 @@
+//
+// ColumnarExport.cpp
+//
+
+#include "pch.h"
+#include "ColumnarExport.h"
+#include "SensorLog.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdio.h>
+#include <string.h>
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	const size_t DIRECTORY_ENTRY_SIZE = sizeof(ColumnarBlock) + COLUMNAR_COLUMN_COUNT * sizeof(ColumnarStats);
+	const size_t DATA_OFFSET = (sizeof(ColumnarFileHeader) + COLUMNAR_COLUMN_COUNT * sizeof(ColumnarColumn) + COLUMNAR_ALIGNMENT - 1) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT;
+
+#if defined(_WIN32)
+	const PathChar OUTPUT_EXTENSION[] = L".cols";
+#else
+	const PathChar OUTPUT_EXTENSION[] = ".cols";
+#endif
+
+	struct ColumnDescription
+	{
+		const char* name;
+		const char* unit;
+	};
+
+	const ColumnDescription COLUMNS[COLUMNAR_COLUMN_COUNT] =
+	{
+		{ "timestamp", "tick" },
+		{ "accel_x", "g" },
+		{ "accel_y", "g" },
+		{ "accel_z", "g" },
+		{ "gyro_x", "rad/s" },
+		{ "gyro_y", "rad/s" },
+		{ "gyro_z", "rad/s" },
+		{ "temperature", "C" },
+		{ "orientation_x", "" },
+		{ "orientation_y", "" },
+		{ "orientation_z", "" },
+		{ "orientation_w", "" },
+	};
+
+	FILE* OpenForWriting(const PathChar* _path)
+	{
+#if defined(_WIN32)
+		FILE* file = nullptr;
+		return (_wfopen_s(&file, _path, L"wb") == 0) ? file : nullptr;
+#else
+		return fopen(_path, "wb");
+#endif
+	}
+
+	void RemoveFile(const PathChar* _path)
+	{
+#if defined(_WIN32)
+		_wremove(_path);
+#else
+		remove(_path);
+#endif
+	}
+
+	template<typename T>
+	ColumnarStats GetRange(const T* _values, uint32_t _count)
+	{
+		T minimum = _values[0];
+		T maximum = _values[0];
+		for (uint32_t i = 1; i < _count; ++i)
+		{
+			minimum = std::min(minimum, _values[i]);
+			maximum = std::max(maximum, _values[i]);
+		}
+
+		ColumnarStats stats;
+		stats.minimum = double(minimum);
+		stats.maximum = double(maximum);
+		return stats;
+	}
+
+
+	// Rows of one block are staged column by column at the full block stride;
+	// a short last block is closed up before it is written.
+	class BlockWriter
+	{
+	public:
+
+		BlockWriter(FILE* _file, uint32_t _blockRows, bool _hasTemperature) :
+			m_File(_file),
+			m_BlockRows(_blockRows),
+			m_HasTemperature(_hasTemperature),
+			m_Rows(0),
+			m_Offset(0),
+			m_Failed(false)
+		{
+			m_Data.resize(size_t(GetColumnarColumnOffset(_blockRows, COLUMNAR_COLUMN_COUNT)));
+		}
+
+		bool IsFull() const						{ return m_Rows == m_BlockRows; }
+		uint32_t GetRowCount() const			{ return m_Rows; }
+		uint64_t GetOffset() const				{ return m_Offset; }
+		bool HasFailed() const					{ return m_Failed; }
+		uint32_t GetBlockCount() const			{ return uint32_t(m_Directory.size() / DIRECTORY_ENTRY_SIZE); }
+
+		template<typename T>
+		T* GetColumn(uint32_t _column)			{ return reinterpret_cast<T*>(m_Data.data() + GetColumnarColumnOffset(m_BlockRows, _column)); }
+
+		void AddRow(const SensorSample& _sample)
+		{
+			const ImuReading reading = ConvertToPhysical(_sample);
+			GetColumn<int64_t>(COLUMN_TIMESTAMP)[m_Rows] = int64_t(_sample.timestamp);
+			for (uint32_t axis = 0; axis < 3; ++axis)
+			{
+				GetColumn<float>(COLUMN_ACCEL_X + axis)[m_Rows] = reading.accel[axis];
+				GetColumn<float>(COLUMN_GYRO_X + axis)[m_Rows] = reading.gyro[axis];
+			}
+			GetColumn<float>(COLUMN_TEMPERATURE)[m_Rows] = m_HasTemperature
+				? _sample.temperature / TEMPERATURE_UNITS_PER_C + TEMPERATURE_OFFSET_C : std::numeric_limits<float>::quiet_NaN();
+			++m_Rows;
+		}
+
+		void Write(const void* _data, size_t _size)
+		{
+			m_Failed = m_Failed || (_size > 0 && fwrite(_data, _size, 1, m_File) != 1);
+			m_Offset += _size;
+		}
+
+		void PadTo(uint64_t _alignment)
+		{
+			static const uint8_t zeros[COLUMNAR_ALIGNMENT] = {};
+			Write(zeros, size_t((_alignment - m_Offset % _alignment) % _alignment));
+		}
+
+		// statistics, close up, one write of the whole block; rows and
+		// orientation columns must be complete
+		void FinishBlock()
+		{
+			if (m_Rows == 0)
+			{
+				return;
+			}
+
+			uint8_t entry[DIRECTORY_ENTRY_SIZE];
+			ColumnarStats* stats = reinterpret_cast<ColumnarStats*>(entry + sizeof(ColumnarBlock));
+			stats[COLUMN_TIMESTAMP] = GetRange(GetColumn<int64_t>(COLUMN_TIMESTAMP), m_Rows);
+			for (uint32_t column = COLUMN_TIMESTAMP + 1; column < COLUMNAR_COLUMN_COUNT; ++column)
+			{
+				stats[column] = GetRange(GetColumn<float>(column), m_Rows);
+			}
+
+			if (m_Rows < m_BlockRows)
+			{
+				for (uint32_t column = 1; column < COLUMNAR_COLUMN_COUNT; ++column)
+				{
+					memmove(m_Data.data() + GetColumnarColumnOffset(m_Rows, column), GetColumn<uint8_t>(column), size_t(m_Rows) * GetColumnarElementSize(column));
+				}
+			}
+			const size_t size = size_t(GetColumnarColumnOffset(m_Rows, COLUMNAR_COLUMN_COUNT));
+
+			ColumnarBlock block;
+			block.offset = m_Offset;
+			block.rowCount = m_Rows;
+			block.crc = Crc32(m_Data.data(), size);
+			memcpy(entry, &block, sizeof(block));
+			m_Directory.insert(m_Directory.end(), entry, entry + sizeof(entry));
+
+			Write(m_Data.data(), size);
+			PadTo(COLUMNAR_ALIGNMENT);
+			m_Rows = 0;
+		}
+
+		void WriteDirectory()
+		{
+			Write(m_Directory.data(), m_Directory.size());
+		}
+
+	private:
+
+		FILE* m_File;
+		uint32_t m_BlockRows;
+		bool m_HasTemperature;
+		uint32_t m_Rows;
+		uint64_t m_Offset;
+		bool m_Failed;
+		std::vector<uint8_t> m_Data;
+		std::vector<uint8_t> m_Directory;
+	};
+}
+
+
+bool ExportColumnar(const PathChar* _logPath, const PathChar* _outputPath, const ColumnarExportSettings& _settings, ColumnarExportResult& _result)
+{
+	const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+	_result = ColumnarExportResult();
+
+	MappedSensorLog log;
+	if (_settings.blockRows == 0 || !log.Open(_logPath))
+	{
+		return false;
+	}
+
+	SensorLogCursor cursor = log.Begin();
+	if (!cursor.IsValid())
+	{
+		return false;
+	}
+	const uint32_t deviceId = (_settings.deviceId != 0) ? _settings.deviceId : cursor.GetRecord().deviceId;
+
+	FILE* file = OpenForWriting(_outputPath);
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	// fused orientations not yet passed by the rows, in time order
+	std::vector<FusedOrientation> fused;
+	SensorPipeline pipeline(_settings.pipeline);
+	pipeline.SetCallback([&fused](const SensorSample&, const FusedOrientation& _fused) { fused.push_back(_fused); });
+	Quaternion orientation = Quaternion::Identity;
+
+	BlockWriter writer(file, _settings.blockRows, log.HasTemperature());
+
+	ColumnarFileHeader header;
+	header.magic = COLUMNAR_MAGIC;
+	header.version = COLUMNAR_VERSION;
+	header.columnCount = COLUMNAR_COLUMN_COUNT;
+	header.deviceId = deviceId;
+	header.ticksPerSecond = DX::StepTimer::TicksPerSecond;
+	writer.Write(&header, sizeof(header));
+	for (uint32_t column = 0; column < COLUMNAR_COLUMN_COUNT; ++column)
+	{
+		ColumnarColumn description = {};
+		strncpy(description.name, COLUMNS[column].name, sizeof(description.name) - 1);
+		strncpy(description.unit, COLUMNS[column].unit, sizeof(description.unit) - 1);
+		description.type = (column == COLUMN_TIMESTAMP) ? COLUMNAR_INT64 : COLUMNAR_FLOAT32;
+		writer.Write(&description, sizeof(description));
+	}
+	writer.PadTo(DATA_OFFSET);
+
+	uint64_t rowCount = 0;
+	bool more = true;
+	while (more && !writer.HasFailed())
+	{
+		for (; cursor.IsValid() && !writer.IsFull(); cursor.Next())
+		{
+			if (cursor.GetRecord().deviceId == deviceId)
+			{
+				const SensorSample sample = cursor.GetSample();
+				pipeline.Push(sample);
+				writer.AddRow(sample);
+			}
+		}
+		more = cursor.IsValid();
+
+		// the pipeline fuses in blocks of its own; flush so that every row of
+		// this block has had its chance to be fused before the hold below
+		pipeline.Flush();
+
+		const uint32_t rows = writer.GetRowCount();
+		const int64_t* timestamps = writer.GetColumn<int64_t>(COLUMN_TIMESTAMP);
+		float* components[4] = { writer.GetColumn<float>(COLUMN_ORIENTATION_X), writer.GetColumn<float>(COLUMN_ORIENTATION_Y),
+			writer.GetColumn<float>(COLUMN_ORIENTATION_Z), writer.GetColumn<float>(COLUMN_ORIENTATION_W) };
+		size_t next = 0;
+		for (uint32_t row = 0; row < rows; ++row)
+		{
+			for (; next < fused.size() && int64_t(fused[next].timestamp) <= timestamps[row]; ++next)
+			{
+				orientation = fused[next].orientation;
+			}
+			components[0][row] = orientation.x;
+			components[1][row] = orientation.y;
+			components[2][row] = orientation.z;
+			components[3][row] = orientation.w;
+		}
+		fused.erase(fused.begin(), fused.begin() + next);
+
+		rowCount += rows;
+		writer.FinishBlock();
+	}
+
+	ColumnarTrailer trailer;
+	trailer.directoryOffset = writer.GetOffset();
+	trailer.rowCount = rowCount;
+	trailer.blockCount = writer.GetBlockCount();
+	trailer.magic = COLUMNAR_MAGIC;
+	writer.WriteDirectory();
+	writer.Write(&trailer, sizeof(trailer));
+
+	const bool written = (fclose(file) == 0) && !writer.HasFailed();
+	if (!written || rowCount == 0)
+	{
+		RemoveFile(_outputPath);
+		return false;
+	}
+
+	_result.succeeded = true;
+	_result.deviceId = deviceId;
+	_result.rowCount = rowCount;
+	_result.blockCount = trailer.blockCount;
+	_result.fileSize = writer.GetOffset();
+	_result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	return true;
+}
+
+std::vector<ColumnarExportResult> ExportColumnar(const std::vector<std::basic_string<PathChar>>& _logPaths, const ColumnarExportSettings& _settings,
+	WorkStealingPool& _pool)
+{
+	// files are independent, each task maps its own log and writes its own output
+	std::vector<ColumnarExportResult> results(_logPaths.size());
+	for (size_t i = 0; i < _logPaths.size(); ++i)
+	{
+		_pool.Submit([&_logPaths, &_settings, &results, i]()
+		{
+			const std::basic_string<PathChar> outputPath = _logPaths[i] + OUTPUT_EXTENSION;
+			ExportColumnar(_logPaths[i].c_str(), outputPath.c_str(), _settings, results[i]);
+		});
+	}
+	_pool.Wait();
+	return results;
+}
+
+
+ColumnarFile::ColumnarFile() :
+	m_Header(nullptr),
+	m_Columns(nullptr),
+	m_Trailer(nullptr),
+	m_Directory(nullptr)
+{
+}
+
+bool ColumnarFile::Open(const PathChar* _path, bool _verifyBlocks)
+{
+	Close();
+	if (!m_File.Open(_path) || m_File.GetSize() < DATA_OFFSET + sizeof(ColumnarTrailer))
+	{
+		Close();
+		return false;
+	}
+
+	const uint8_t* data = m_File.GetData();
+	const uint64_t size = m_File.GetSize();
+	m_Header = reinterpret_cast<const ColumnarFileHeader*>(data);
+	m_Columns = reinterpret_cast<const ColumnarColumn*>(data + sizeof(ColumnarFileHeader));
+	m_Trailer = reinterpret_cast<const ColumnarTrailer*>(data + size - sizeof(ColumnarTrailer));
+	m_Directory = data + m_Trailer->directoryOffset;
+
+	bool valid = m_Header->magic == COLUMNAR_MAGIC && m_Header->version == COLUMNAR_VERSION && m_Header->columnCount == COLUMNAR_COLUMN_COUNT
+		&& m_Trailer->magic == COLUMNAR_MAGIC && m_Trailer->directoryOffset >= DATA_OFFSET
+		&& m_Trailer->directoryOffset + uint64_t(m_Trailer->blockCount) * DIRECTORY_ENTRY_SIZE + sizeof(ColumnarTrailer) == size;
+
+	uint64_t rowCount = 0;
+	for (uint32_t i = 0; valid && i < m_Trailer->blockCount; ++i)
+	{
+		const ColumnarBlock& block = GetBlock(i);
+		const uint64_t blockSize = GetColumnarColumnOffset(block.rowCount, COLUMNAR_COLUMN_COUNT);
+		valid = block.offset >= DATA_OFFSET && block.offset % COLUMNAR_ALIGNMENT == 0 && block.offset + blockSize <= m_Trailer->directoryOffset
+			&& (!_verifyBlocks || Crc32(data + block.offset, size_t(blockSize)) == block.crc);
+		rowCount += block.rowCount;
+	}
+
+	if (!valid || rowCount != m_Trailer->rowCount)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ColumnarFile::Close()
+{
+	m_File.Close();
+	m_Header = nullptr;
+	m_Columns = nullptr;
+	m_Trailer = nullptr;
+	m_Directory = nullptr;
+}
+
+const uint8_t* ColumnarFile::GetDirectoryEntry(uint32_t _block) const
+{
+	return m_Directory + size_t(_block) * DIRECTORY_ENTRY_SIZE;
+}
+
+const ColumnarBlock& ColumnarFile::GetBlock(uint32_t _block) const
+{
+	return *reinterpret_cast<const ColumnarBlock*>(GetDirectoryEntry(_block));
+}
+
+const ColumnarStats& ColumnarFile::GetStats(uint32_t _block, uint32_t _column) const
+{
+	return reinterpret_cast<const ColumnarStats*>(GetDirectoryEntry(_block) + sizeof(ColumnarBlock))[_column];
+}
+
+const void* ColumnarFile::GetColumnData(uint32_t _block, uint32_t _column) const
+{
+	const ColumnarBlock& block = GetBlock(_block);
+	return m_File.GetData() + block.offset + GetColumnarColumnOffset(block.rowCount, _column);
+}
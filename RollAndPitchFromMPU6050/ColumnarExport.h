@@ -0,0 +1,183 @@
+//
+// ColumnarExport.h - recorded logs converted to per-channel arrays for analytics tools
+//
+// The log keeps whole records chunk by chunk, which suits appending and seeking
+// but not tools that read one channel over hours. A columnar file holds the
+// samples of one device in blocks of rows; inside a block every channel is one
+// contiguous little-endian array in physical units, so numpy, Arrow or a mapped
+// ColumnarFile take it as is. After the blocks comes a directory with the offset,
+// row count and CRC of every block and the minimum and maximum of each of its
+// channels, which lets a query skip blocks on the statistics alone. The
+// orientation channels are the fused quaternion of the pipeline, the newest one
+// at or before each sample.
+//
+// Layout: ColumnarFileHeader, COLUMNAR_COLUMN_COUNT ColumnarColumn descriptors,
+// the blocks (each at a multiple of COLUMNAR_ALIGNMENT, the columns of a block
+// back to back in descriptor order), then per block a ColumnarBlock followed by
+// one ColumnarStats per column, and a ColumnarTrailer as the last bytes. The
+// writer goes front to back once, in writes of a whole block.
+//
+
+#pragma once
+
+#include "SensorPipeline.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+
+class WorkStealingPool;
+
+const uint32_t COLUMNAR_MAGIC = 0x4B55504D;	// "MPUK"
+const uint32_t COLUMNAR_VERSION = 1;
+const uint32_t COLUMNAR_ALIGNMENT = 64;
+
+enum ColumnarType
+{
+	COLUMNAR_INT64 = 1,
+	COLUMNAR_FLOAT32 = 2,
+};
+
+enum ColumnarChannel
+{
+	COLUMN_TIMESTAMP,			// StepTimer ticks, int64
+	COLUMN_ACCEL_X,				// g
+	COLUMN_ACCEL_Y,
+	COLUMN_ACCEL_Z,
+	COLUMN_GYRO_X,				// rad/s
+	COLUMN_GYRO_Y,
+	COLUMN_GYRO_Z,
+	COLUMN_TEMPERATURE,			// degrees C, NaN when the log has none (before SENSOR_LOG_TEMPERATURE_VERSION)
+	COLUMN_ORIENTATION_X,		// sensor to world quaternion
+	COLUMN_ORIENTATION_Y,
+	COLUMN_ORIENTATION_Z,
+	COLUMN_ORIENTATION_W,
+	COLUMNAR_COLUMN_COUNT
+};
+
+struct ColumnarFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t columnCount;
+	uint32_t deviceId;			// I2C address of the exported sensor
+	uint64_t ticksPerSecond;	// of the timestamp column
+};
+
+struct ColumnarColumn
+{
+	char name[20];				// zero padded
+	char unit[8];
+	uint32_t type;				// ColumnarType
+};
+
+struct ColumnarBlock
+{
+	uint64_t offset;			// from the start of the file
+	uint32_t rowCount;
+	uint32_t crc;				// CRC-32 of the block's column data
+};
+
+struct ColumnarStats
+{
+	double minimum;				// exact for every column, timestamps included; NaN for a column without values
+	double maximum;
+};
+
+struct ColumnarTrailer
+{
+	uint64_t directoryOffset;
+	uint64_t rowCount;
+	uint32_t blockCount;
+	uint32_t magic;
+};
+
+inline uint32_t GetColumnarElementSize(uint32_t _column)
+{
+	return (_column == COLUMN_TIMESTAMP) ? 8 : 4;
+}
+
+// start of _column inside a block of _rowCount rows
+inline uint64_t GetColumnarColumnOffset(uint32_t _rowCount, uint32_t _column)
+{
+	uint64_t offset = 0;
+	for (uint32_t column = 0; column < _column; ++column)
+	{
+		offset += uint64_t(_rowCount) * GetColumnarElementSize(column);
+	}
+	return offset;
+}
+
+
+struct ColumnarExportSettings
+{
+	uint32_t blockRows;			// rows per block, the unit of statistics and of writing
+	uint32_t deviceId;			// 0 = device of the first record
+	PipelineSettings pipeline;	// for the orientation columns
+
+	ColumnarExportSettings() :
+		blockRows(65536),		// 3.4 MB, a minute of one sensor at 1 kHz
+		deviceId(0)
+	{
+	}
+};
+
+struct ColumnarExportResult
+{
+	bool succeeded;
+	uint32_t deviceId;
+	uint64_t rowCount;
+	uint32_t blockCount;
+	uint64_t fileSize;
+	double wallSeconds;
+};
+
+// one log to one columnar file; false when the log cannot be opened, has no
+// record of the device or the output cannot be written (no file is left then)
+bool ExportColumnar(const PathChar* _logPath, const PathChar* _outputPath, const ColumnarExportSettings& _settings, ColumnarExportResult& _result);
+
+// every log to its path plus ".cols", one task per file on _pool; the results
+// are in the order of _logPaths
+std::vector<ColumnarExportResult> ExportColumnar(const std::vector<std::basic_string<PathChar>>& _logPaths, const ColumnarExportSettings& _settings,
+	WorkStealingPool& _pool);
+
+
+// a columnar file mapped for reading, the columns are handed out in place
+class ColumnarFile
+{
+public:
+
+	ColumnarFile();
+
+	// checks the header, trailer and directory, and the block CRCs when verifying
+	bool Open(const PathChar* _path, bool _verifyBlocks = true);
+	void Close();
+	bool IsOpen() const								{ return m_File.IsOpen(); }
+
+	const ColumnarFileHeader& GetHeader() const		{ return *m_Header; }
+	const ColumnarColumn& GetColumn(uint32_t _column) const	{ return m_Columns[_column]; }
+	uint64_t GetRowCount() const					{ return m_Trailer->rowCount; }
+	uint32_t GetBlockCount() const					{ return m_Trailer->blockCount; }
+
+	const ColumnarBlock& GetBlock(uint32_t _block) const;
+	const ColumnarStats& GetStats(uint32_t _block, uint32_t _column) const;
+
+	// GetBlock(_block).rowCount elements of the column's type
+	const void* GetColumnData(uint32_t _block, uint32_t _column) const;
+	const int64_t* GetTimestamps(uint32_t _block) const		{ return static_cast<const int64_t*>(GetColumnData(_block, COLUMN_TIMESTAMP)); }
+	const float* GetChannel(uint32_t _block, uint32_t _column) const	{ return static_cast<const float*>(GetColumnData(_block, _column)); }
+
+private:
+
+	ColumnarFile(const ColumnarFile&);
+	ColumnarFile& operator=(const ColumnarFile&);
+
+	const uint8_t* GetDirectoryEntry(uint32_t _block) const;
+
+	MappedFile m_File;
+	const ColumnarFileHeader* m_Header;
+	const ColumnarColumn* m_Columns;
+	const ColumnarTrailer* m_Trailer;
+	const uint8_t* m_Directory;
+};
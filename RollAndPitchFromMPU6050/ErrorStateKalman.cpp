@@ -0,0 +1,170 @@
+//
+// ErrorStateKalman.cpp
+//
+
+#include "pch.h"
+#include "ErrorStateKalman.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	const float INITIAL_ATTITUDE_VARIANCE = 0.1f;		// rad^2
+	const float INITIAL_BIAS_VARIANCE = 0.001f;			// (rad/s)^2
+	const float MAX_PREDICT_DT = 0.5f;					// longer gaps are treated as a restart of the stream
+}
+
+
+ErrorStateKalman::ErrorStateKalman()
+{
+	Reset();
+}
+
+ErrorStateKalman::ErrorStateKalman(const ErrorStateKalmanSettings& _settings) :
+	m_Settings(_settings)
+{
+	Reset();
+}
+
+void ErrorStateKalman::Reset()
+{
+	m_Orientation = Quaternion::Identity;
+	m_GyroBias[0] = m_GyroBias[1] = m_GyroBias[2] = 0.0f;
+
+	m_P = Covariance::Zero();
+	for (int i = 0; i < 3; ++i)
+	{
+		m_P(i, i) = INITIAL_ATTITUDE_VARIANCE;
+		m_P(3 + i, 3 + i) = INITIAL_BIAS_VARIANCE;
+	}
+
+	m_LastTimestamp = 0;
+	m_Initialized = false;
+}
+
+void ErrorStateKalman::Initialize(const float _accel[3])
+{
+	// start from the accelerometer tilt so the first seconds don't show a slow convergence
+	m_Orientation = QuaternionFromGravity(_accel);
+	m_Initialized = true;
+}
+
+void ErrorStateKalman::ProcessReading(const ImuReading& _reading, uint64_t _timestamp)
+{
+	if (PredictReading(_reading, _timestamp))
+	{
+		Correct(_reading.accel);
+	}
+}
+
+bool ErrorStateKalman::PredictReading(const ImuReading& _reading, uint64_t _timestamp)
+{
+	if (!m_Initialized)
+	{
+		Initialize(_reading.accel);
+		m_LastTimestamp = _timestamp;
+		return false;
+	}
+
+	const float dt = float(DX::StepTimer::TicksToSeconds(_timestamp - m_LastTimestamp));
+	m_LastTimestamp = _timestamp;
+
+	if (dt > 0.0f && dt < MAX_PREDICT_DT)
+	{
+		Predict(_reading.gyro, dt);
+	}
+	return true;
+}
+
+void ErrorStateKalman::Predict(const float _gyro[3], float _dt)
+{
+	const float wx = (_gyro[0] - m_GyroBias[0]) * _dt;
+	const float wy = (_gyro[1] - m_GyroBias[1]) * _dt;
+	const float wz = (_gyro[2] - m_GyroBias[2]) * _dt;
+
+	// nominal state: integrate the bias-corrected rate, bias is a random walk
+	m_Orientation = QuaternionNormalized(QuaternionProduct(m_Orientation, QuaternionFromRotationVector(wx, wy, wz)));
+
+	// error state transition
+	//   F = | I - [w dt]x   -I dt |
+	//       |     0           I   |
+	Covariance F = Covariance::Identity();
+	F.SetBlock(0, 0, FixedMatrix<3, 3>::Identity() - Skew(wx, wy, wz));
+	F.SetBlock(0, 3, FixedMatrix<3, 3>::Diagonal(-_dt));
+
+	const float attitudeNoise = m_Settings.gyroNoiseDensity * m_Settings.gyroNoiseDensity * _dt;
+	const float biasNoise = m_Settings.gyroBiasRandomWalk * m_Settings.gyroBiasRandomWalk * _dt;
+
+	m_P = F * m_P * F.Transpose();
+	for (int i = 0; i < 3; ++i)
+	{
+		m_P(i, i) += attitudeNoise;
+		m_P(3 + i, 3 + i) += biasNoise;
+	}
+	m_P.Symmetrize();
+}
+
+bool ErrorStateKalman::Correct(const float _accel[3])
+{
+	const float norm = sqrtf(_accel[0] * _accel[0] + _accel[1] * _accel[1] + _accel[2] * _accel[2]);
+	if (fabsf(norm - 1.0f) > m_Settings.accelGate)
+	{
+		return false;	// linear acceleration dominates, gravity direction is unreliable
+	}
+
+	FixedVector<3> z;
+	z[0] = _accel[0] / norm;
+	z[1] = _accel[1] / norm;
+	z[2] = _accel[2] / norm;
+
+	// predicted measurement and its Jacobian: h = R^T g, dh/dtheta = [h]x
+	float gravity[3];
+	GravityInSensorFrame(m_Orientation, gravity);
+
+	FixedMatrix<3, STATE_SIZE> H = FixedMatrix<3, STATE_SIZE>::Zero();
+	H.SetBlock(0, 0, Skew(gravity[0], gravity[1], gravity[2]));
+
+	FixedVector<3> innovation;
+	innovation[0] = z[0] - gravity[0];
+	innovation[1] = z[1] - gravity[1];
+	innovation[2] = z[2] - gravity[2];
+
+	const FixedMatrix<3, 3> R = FixedMatrix<3, 3>::Diagonal(m_Settings.accelNoise * m_Settings.accelNoise);
+	const FixedMatrix<STATE_SIZE, 3> PHt = m_P * H.Transpose();
+	const FixedMatrix<3, 3> S = H * PHt + R;
+
+	FixedMatrix<3, 3> invS;
+	if (!Invert(S, invS))
+	{
+		return false;
+	}
+
+	const FixedMatrix<STATE_SIZE, 3> K = PHt * invS;
+	const FixedVector<STATE_SIZE> dx = K * innovation;
+
+	// inject error state into nominal state
+	m_Orientation = QuaternionNormalized(QuaternionProduct(m_Orientation, QuaternionFromRotationVector(dx[0], dx[1], dx[2])));
+	m_GyroBias[0] += dx[3];
+	m_GyroBias[1] += dx[4];
+	m_GyroBias[2] += dx[5];
+
+	// Joseph form keeps P positive definite in single precision
+	const Covariance IKH = Covariance::Identity() - K * H;
+	m_P = IKH * m_P * IKH.Transpose() + K * R * K.Transpose();
+	m_P.Symmetrize();
+
+	return true;
+}
+
+FusedOrientation ErrorStateKalman::GetOrientation() const
+{
+	FusedOrientation result;
+	result.timestamp = m_LastTimestamp;
+	result.orientation = m_Orientation;
+	result.attitudeVariance[0] = m_P(0, 0);
+	result.attitudeVariance[1] = m_P(1, 1);
+	result.attitudeVariance[2] = m_P(2, 2);
+	return result;
+}
@@ -0,0 +1,76 @@
+//
+// ErrorStateKalman.h - error-state EKF for attitude and gyro bias
+//
+
+#pragma once
+
+#include "FixedMatrix.h"
+#include "SensorData.h"
+
+
+struct ErrorStateKalmanSettings
+{
+	float gyroNoiseDensity;		// rad/s/sqrt(Hz)
+	float gyroBiasRandomWalk;	// rad/s^2/sqrt(Hz)
+	float accelNoise;			// g, includes vibration and linear acceleration
+	float accelGate;			// skip correction when |accel| differs from 1g by more than this
+
+	ErrorStateKalmanSettings() :
+		gyroNoiseDensity(0.003f),
+		gyroBiasRandomWalk(0.0002f),
+		accelNoise(0.03f),
+		accelGate(0.2f)
+	{
+	}
+};
+
+
+// Nominal state is the orientation quaternion plus gyro bias. The filter tracks
+// the 6-dimensional error state [attitude error (rad), gyro bias error (rad/s)]
+// and folds it back into the nominal state after every accelerometer correction.
+class ErrorStateKalman
+{
+public:
+
+	static const int STATE_SIZE = 6;
+	typedef FixedMatrix<STATE_SIZE, STATE_SIZE> Covariance;
+
+	ErrorStateKalman();
+	explicit ErrorStateKalman(const ErrorStateKalmanSettings& _settings);
+
+	void Reset();
+
+	// predict with gyro and correct with accel, dt is taken from sample timestamps
+	void ProcessReading(const ImuReading& _reading, uint64_t _timestamp);
+
+	// gyro propagation only, for schedules that correct at a lower rate;
+	// false for the first reading, which initializes the tilt from its accel instead
+	bool PredictReading(const ImuReading& _reading, uint64_t _timestamp);
+
+	void Predict(const float _gyro[3], float _dt);
+	bool Correct(const float _accel[3]);
+
+	FusedOrientation GetOrientation() const;
+	const Covariance& GetCovariance() const			{ return m_P; }
+	const float* GetGyroBias() const				{ return m_GyroBias; }
+	bool IsInitialized() const						{ return m_Initialized; }
+
+	const ErrorStateKalmanSettings& GetSettings() const			{ return m_Settings; }
+	void SetSettings(const ErrorStateKalmanSettings& _settings)	{ m_Settings = _settings; }
+
+private:
+
+	void Initialize(const float _accel[3]);
+
+	ErrorStateKalmanSettings m_Settings;
+
+	// nominal state
+	DirectX::SimpleMath::Quaternion m_Orientation;
+	float m_GyroBias[3];
+
+	// error state covariance
+	Covariance m_P;
+
+	uint64_t m_LastTimestamp;
+	bool m_Initialized;
+};
@@ -0,0 +1,224 @@
+//
+// FastMath.h - polynomial atan2, asin and rsqrt for the fusion and display paths
+//
+// FAST_MATH_PRECISION picks the approximation at compile time:
+//   FAST_MATH_HIGH (default)  atan degree 17, asin degree 7, max error 1e-6 rad
+//   FAST_MATH_LOW             atan degree 9, asin degree 3, max error 1.5e-5 / 7e-5 rad
+//   FAST_MATH_EXACT           C library calls, for comparison
+// Rsqrt is the hardware estimate (LOW, 4e-4 relative) or the estimate refined
+// to full precision (HIGH).
+// MeasureFastMathAccuracy() in Benchmark.h checks the bounds on the running platform.
+//
+// Scalar functions are Fast*, the SIMD versions take FloatLanes and end in Lanes.
+//
+
+#pragma once
+
+#include "SimdLanes.h"
+
+#include <math.h>
+
+
+#define FAST_MATH_EXACT		0
+#define FAST_MATH_HIGH		1
+#define FAST_MATH_LOW		2
+
+#ifndef FAST_MATH_PRECISION
+#define FAST_MATH_PRECISION FAST_MATH_HIGH
+#endif
+
+#if FAST_MATH_PRECISION == FAST_MATH_LOW
+#define FAST_MATH_PRECISION_NAME "low"
+const float FAST_ATAN_MAX_ERROR = 1.5e-5f;	// radians
+const float FAST_ASIN_MAX_ERROR = 7e-5f;	// radians
+const float FAST_RSQRT_MAX_ERROR = 4e-4f;	// relative
+#elif FAST_MATH_PRECISION == FAST_MATH_HIGH
+#define FAST_MATH_PRECISION_NAME "high"
+const float FAST_ATAN_MAX_ERROR = 1e-6f;
+const float FAST_ASIN_MAX_ERROR = 1e-6f;
+const float FAST_RSQRT_MAX_ERROR = 1e-6f;
+#else
+#define FAST_MATH_PRECISION_NAME "exact"
+const float FAST_ATAN_MAX_ERROR = 1e-6f;
+const float FAST_ASIN_MAX_ERROR = 1e-6f;
+const float FAST_RSQRT_MAX_ERROR = 1e-6f;
+#endif
+
+
+// minimax polynomials from Abramowitz & Stegun: atan(x) = x P(x^2) on [-1, 1] (4.4.47, 4.4.49),
+// asin(x) = pi/2 - sqrt(1 - x) Q(x) on [0, 1] (4.4.45, 4.4.46)
+#if FAST_MATH_PRECISION == FAST_MATH_LOW
+const int FAST_ATAN_TERMS = 5;
+const float FAST_ATAN_COEFFICIENTS[FAST_ATAN_TERMS] = { 0.9998660f, -0.3302995f, 0.1801410f, -0.0851330f, 0.0208351f };
+const int FAST_ASIN_TERMS = 4;
+const float FAST_ASIN_COEFFICIENTS[FAST_ASIN_TERMS] = { 1.5707288f, -0.2121144f, 0.0742610f, -0.0187293f };
+#else
+const int FAST_ATAN_TERMS = 9;
+const float FAST_ATAN_COEFFICIENTS[FAST_ATAN_TERMS] =
+{
+	1.0f, -0.3333314528f, 0.1999355085f, -0.1420889944f, 0.1065626393f,
+	-0.0752896400f, 0.0429096138f, -0.0161657367f, 0.0028662257f
+};
+const int FAST_ASIN_TERMS = 8;
+const float FAST_ASIN_COEFFICIENTS[FAST_ASIN_TERMS] =
+{
+	1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+	0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f
+};
+#endif
+
+const float FAST_MATH_PI = 3.14159265f;
+
+
+inline float FastAtanUnit(float _x)
+{
+	const float x2 = _x * _x;
+	float p = FAST_ATAN_COEFFICIENTS[FAST_ATAN_TERMS - 1];
+	for (int i = FAST_ATAN_TERMS - 2; i >= 0; --i)
+	{
+		p = p * x2 + FAST_ATAN_COEFFICIENTS[i];
+	}
+	return _x * p;
+}
+
+inline float FastAtan2(float _y, float _x)
+{
+#if FAST_MATH_PRECISION == FAST_MATH_EXACT
+	return atan2f(_y, _x);
+#else
+	// reduce to atan of a ratio in [0, 1], then unfold the octant
+	const float ax = fabsf(_x);
+	const float ay = fabsf(_y);
+	const float larger = (ax > ay) ? ax : ay;
+	if (larger == 0.0f)
+	{
+		return 0.0f;
+	}
+	const float smaller = (ax > ay) ? ay : ax;
+
+	float angle = FastAtanUnit(smaller / larger);
+	if (ay > ax)
+	{
+		angle = 0.5f * FAST_MATH_PI - angle;
+	}
+	if (_x < 0.0f)
+	{
+		angle = FAST_MATH_PI - angle;
+	}
+	return (_y < 0.0f) ? -angle : angle;
+#endif
+}
+
+// input clamped to [-1, 1]
+inline float FastAsin(float _x)
+{
+	const float x = (_x > 1.0f) ? 1.0f : ((_x < -1.0f) ? -1.0f : _x);
+#if FAST_MATH_PRECISION == FAST_MATH_EXACT
+	return asinf(x);
+#else
+	const float ax = fabsf(x);
+	float p = FAST_ASIN_COEFFICIENTS[FAST_ASIN_TERMS - 1];
+	for (int i = FAST_ASIN_TERMS - 2; i >= 0; --i)
+	{
+		p = p * ax + FAST_ASIN_COEFFICIENTS[i];
+	}
+	const float angle = 0.5f * FAST_MATH_PI - sqrtf(1.0f - ax) * p;
+	return (x < 0.0f) ? -angle : angle;
+#endif
+}
+
+inline float FastRsqrt(float _x)
+{
+#if FAST_MATH_PRECISION != FAST_MATH_EXACT && defined(_XM_SSE_INTRINSICS_)
+	float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(_x)));
+#if FAST_MATH_PRECISION == FAST_MATH_HIGH
+	y = y * (1.5f - 0.5f * _x * y * y);
+#endif
+	return y;
+#else
+	return 1.0f / sqrtf(_x);
+#endif
+}
+
+
+// SIMD versions, same algorithms lane by lane
+
+inline FloatLanes AtanUnitLanes(const FloatLanes& _x)
+{
+	const FloatLanes x2 = _x * _x;
+	FloatLanes p = SplatLanes(FAST_ATAN_COEFFICIENTS[FAST_ATAN_TERMS - 1]);
+	for (int i = FAST_ATAN_TERMS - 2; i >= 0; --i)
+	{
+		p = MulAdd(p, x2, SplatLanes(FAST_ATAN_COEFFICIENTS[i]));
+	}
+	return _x * p;
+}
+
+inline FloatLanes Atan2Lanes(const FloatLanes& _y, const FloatLanes& _x)
+{
+#if FAST_MATH_PRECISION == FAST_MATH_EXACT
+	float y[SIMD_LANE_COUNT], x[SIMD_LANE_COUNT];
+	StoreLanes(y, _y);
+	StoreLanes(x, _x);
+	for (int i = 0; i < SIMD_LANE_COUNT; ++i)
+	{
+		y[i] = atan2f(y[i], x[i]);
+	}
+	return LoadLanes(y);
+#else
+	const FloatLanes zero = SplatLanes(0.0f);
+	const FloatLanes ax = Abs(_x);
+	const FloatLanes ay = Abs(_y);
+
+	// both zero gives 0 / tiny = 0
+	const FloatLanes ratio = Min(ax, ay) / Max(Max(ax, ay), SplatLanes(1e-30f));
+	FloatLanes angle = AtanUnitLanes(ratio);
+	angle = Select(ay > ax, SplatLanes(0.5f * FAST_MATH_PI) - angle, angle);
+	angle = Select(_x < zero, SplatLanes(FAST_MATH_PI) - angle, angle);
+	return Select(_y < zero, zero - angle, angle);
+#endif
+}
+
+inline FloatLanes AsinLanes(const FloatLanes& _x)
+{
+	const FloatLanes zero = SplatLanes(0.0f);
+	const FloatLanes one = SplatLanes(1.0f);
+	const FloatLanes ax = Min(Abs(_x), one);
+
+#if FAST_MATH_PRECISION == FAST_MATH_EXACT
+	float x[SIMD_LANE_COUNT];
+	StoreLanes(x, ax);
+	for (int i = 0; i < SIMD_LANE_COUNT; ++i)
+	{
+		x[i] = asinf(x[i]);
+	}
+	const FloatLanes angle = LoadLanes(x);
+#else
+	FloatLanes p = SplatLanes(FAST_ASIN_COEFFICIENTS[FAST_ASIN_TERMS - 1]);
+	for (int i = FAST_ASIN_TERMS - 2; i >= 0; --i)
+	{
+		p = MulAdd(p, ax, SplatLanes(FAST_ASIN_COEFFICIENTS[i]));
+	}
+	const FloatLanes angle = SplatLanes(0.5f * FAST_MATH_PI) - Sqrt(one - ax) * p;
+#endif
+	return Select(_x < zero, zero - angle, angle);
+}
+
+inline FloatLanes RsqrtLanes(const FloatLanes& _x)
+{
+#if FAST_MATH_PRECISION == FAST_MATH_LOW
+	// one refinement less than Rsqrt: the raw estimate on x86, one step on NEON
+	const int steps = SIMD_RSQRT_STEPS - 1;
+#else
+	const int steps = SIMD_RSQRT_STEPS;
+#endif
+	const FloatLanes half = SplatLanes(0.5f);
+	const FloatLanes threeHalves = SplatLanes(1.5f);
+
+	FloatLanes y = RsqrtEstimate(_x);
+	for (int i = 0; i < steps; ++i)
+	{
+		y = y * (threeHalves - half * _x * y * y);
+	}
+	return y;
+}
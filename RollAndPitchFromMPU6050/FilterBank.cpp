@@ -0,0 +1,372 @@
+//
+// FilterBank.cpp
+//
+
+#include "pch.h"
+#include "FilterBank.h"
+#include "SimdLanes.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_ARM_NEON_INTRINSICS_)
+#define FILTER_BANK_LANES
+#endif
+
+
+namespace
+{
+	const float PI = 3.14159265f;
+
+	// vectors of SIMD_LANE_COUNT channels that hold all of them
+	const int CHANNEL_VECTORS = (IMU_CHANNEL_COUNT + SIMD_LANE_COUNT - 1) / SIMD_LANE_COUNT;
+	const int BIQUAD_TILE_STEPS = 32;
+}
+
+
+BiquadCoefficients DesignBiquad(BiquadType _type, float _frequency, float _q, float _sampleRate)
+{
+	const float w0 = 2.0f * PI * _frequency / _sampleRate;
+	const float cosW0 = cosf(w0);
+	const float alpha = sinf(w0) / (2.0f * _q);
+
+	float b0, b1, b2;
+	switch (_type)
+	{
+	case BIQUAD_LOWPASS:
+		b0 = 0.5f * (1.0f - cosW0);
+		b1 = 1.0f - cosW0;
+		b2 = 0.5f * (1.0f - cosW0);
+		break;
+	case BIQUAD_HIGHPASS:
+		b0 = 0.5f * (1.0f + cosW0);
+		b1 = -(1.0f + cosW0);
+		b2 = 0.5f * (1.0f + cosW0);
+		break;
+	case BIQUAD_NOTCH:
+		b0 = 1.0f;
+		b1 = -2.0f * cosW0;
+		b2 = 1.0f;
+		break;
+	case BIQUAD_BANDPASS:
+	default:
+		b0 = alpha;
+		b1 = 0.0f;
+		b2 = -alpha;
+		break;
+	}
+
+	const float a0 = 1.0f + alpha;
+
+	BiquadCoefficients result;
+	result.b0 = b0 / a0;
+	result.b1 = b1 / a0;
+	result.b2 = b2 / a0;
+	result.a1 = -2.0f * cosW0 / a0;
+	result.a2 = (1.0f - alpha) / a0;
+	return result;
+}
+
+std::vector<float> DesignLowpassFir(int _taps, float _cutoff, float _sampleRate)
+{
+	std::vector<float> taps(std::max(_taps, 1));
+	const float normalizedCutoff = _cutoff / _sampleRate;
+	const float center = 0.5f * (taps.size() - 1);
+
+	float sum = 0.0f;
+	for (size_t n = 0; n < taps.size(); ++n)
+	{
+		const float x = n - center;
+		const float sinc = (fabsf(x) < 1e-6f) ? 2.0f * normalizedCutoff : sinf(2.0f * PI * normalizedCutoff * x) / (PI * x);
+		const float window = (taps.size() > 1) ? 0.54f - 0.46f * cosf(2.0f * PI * n / (taps.size() - 1)) : 1.0f;
+		taps[n] = sinc * window;
+		sum += taps[n];
+	}
+
+	for (float& tap : taps)
+	{
+		tap /= sum;
+	}
+	return taps;
+}
+
+ChannelFilterConfig MakeChannelFilterConfig(const VibrationFilterSettings& _settings, float _sampleRate)
+{
+	// designs are only valid below Nyquist
+	const float nyquist = 0.5f * _sampleRate;
+
+	ChannelFilterConfig config;
+	if (_settings.notchHz > 0.0f && _settings.notchHz < nyquist)
+	{
+		config.sections.push_back(DesignBiquad(BIQUAD_NOTCH, _settings.notchHz, _settings.notchQ, _sampleRate));
+	}
+	if (_settings.lowpassHz > 0.0f && _settings.lowpassHz < nyquist)
+	{
+		config.sections.push_back(DesignBiquad(BIQUAD_LOWPASS, _settings.lowpassHz, 0.7071f, _sampleRate));
+		if (_settings.firTaps > 0)
+		{
+			config.firTaps = DesignLowpassFir(std::min(_settings.firTaps, int(FilterBank::MAX_FIR_TAPS)), _settings.lowpassHz, _sampleRate);
+		}
+	}
+	return config;
+}
+
+
+FilterBank::FilterBank()
+{
+	ChannelFilterConfig passThrough[IMU_CHANNEL_COUNT];
+	Configure(passThrough);
+}
+
+void FilterBank::Configure(const ChannelFilterConfig _channels[IMU_CHANNEL_COUNT])
+{
+	m_SectionCount = 0;
+	m_FirTapCount = 0;
+	for (int lane = 0; lane < LANE_STRIDE; ++lane)
+	{
+		const int sectionCount = (lane < IMU_CHANNEL_COUNT) ? std::min(int(_channels[lane].sections.size()), int(MAX_SECTIONS)) : 0;
+		for (int section = 0; section < MAX_SECTIONS; ++section)
+		{
+			const BiquadCoefficients passThrough = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			const BiquadCoefficients& coefficients = (section < sectionCount) ? _channels[lane].sections[section] : passThrough;
+			m_B0[section][lane] = coefficients.b0;
+			m_B1[section][lane] = coefficients.b1;
+			m_B2[section][lane] = coefficients.b2;
+			m_A1[section][lane] = coefficients.a1;
+			m_A2[section][lane] = coefficients.a2;
+		}
+		m_SectionCount = std::max(m_SectionCount, sectionCount);
+	}
+
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		m_ChannelTaps[channel] = std::min(int(_channels[channel].firTaps.size()), int(MAX_FIR_TAPS));
+		for (int tap = 0; tap < MAX_FIR_TAPS; ++tap)
+		{
+			m_Fir[channel][tap] = (tap < m_ChannelTaps[channel]) ? _channels[channel].firTaps[tap] : 0.0f;
+		}
+		m_FirTapCount = std::max(m_FirTapCount, m_ChannelTaps[channel]);
+	}
+
+	Reset();
+}
+
+void FilterBank::Reset()
+{
+	memset(m_Z1, 0, sizeof(m_Z1));
+	memset(m_Z2, 0, sizeof(m_Z2));
+	memset(m_History, 0, sizeof(m_History));
+}
+
+void FilterBank::Process(SampleBlock& _block)
+{
+	if (m_SectionCount > 0)
+	{
+#if defined(FILTER_BANK_LANES)
+		ProcessBiquadLanes(_block);
+#else
+		ProcessBiquadsScalar(_block);
+#endif
+	}
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		if (m_ChannelTaps[channel] > 0)
+		{
+			ProcessFir(channel, _block.channels[channel], _block.count);
+		}
+	}
+}
+
+// cascaded biquads, transposed direct form II, all channels in lanes with the
+// coefficients and state in registers for the whole block
+void FilterBank::ProcessBiquadLanes(SampleBlock& _block)
+{
+	static_assert(CHANNEL_VECTORS * SIMD_LANE_COUNT <= LANE_STRIDE, "channel lanes do not fit the stride");
+
+	FloatLanes b0[MAX_SECTIONS][CHANNEL_VECTORS], b1[MAX_SECTIONS][CHANNEL_VECTORS], b2[MAX_SECTIONS][CHANNEL_VECTORS];
+	FloatLanes a1[MAX_SECTIONS][CHANNEL_VECTORS], a2[MAX_SECTIONS][CHANNEL_VECTORS];
+	FloatLanes z1[MAX_SECTIONS][CHANNEL_VECTORS], z2[MAX_SECTIONS][CHANNEL_VECTORS];
+	for (int section = 0; section < m_SectionCount; ++section)
+	{
+		for (int v = 0; v < CHANNEL_VECTORS; ++v)
+		{
+			const int lane = v * SIMD_LANE_COUNT;
+			b0[section][v] = LoadLanes(&m_B0[section][lane]);
+			b1[section][v] = LoadLanes(&m_B1[section][lane]);
+			b2[section][v] = LoadLanes(&m_B2[section][lane]);
+			a1[section][v] = LoadLanes(&m_A1[section][lane]);
+			a2[section][v] = LoadLanes(&m_A2[section][lane]);
+			z1[section][v] = LoadLanes(&m_Z1[section][lane]);
+			z2[section][v] = LoadLanes(&m_Z2[section][lane]);
+		}
+	}
+
+	// the block goes through in tiles of time steps, one row of lanes per step with
+	// the padding lanes zero; whole tiles are gathered and scattered at once so
+	// the scalar stores are done before the vector loads read them
+	float tile[BIQUAD_TILE_STEPS][LANE_STRIDE] = {};
+	for (size_t first = 0; first < _block.count; first += BIQUAD_TILE_STEPS)
+	{
+		const size_t steps = std::min(_block.count - first, size_t(BIQUAD_TILE_STEPS));
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			const float* samples = _block.channels[channel] + first;
+			for (size_t step = 0; step < steps; ++step)
+			{
+				tile[step][channel] = samples[step];
+			}
+		}
+
+		for (size_t step = 0; step < steps; ++step)
+		{
+			for (int v = 0; v < CHANNEL_VECTORS; ++v)
+			{
+				FloatLanes x = LoadLanes(&tile[step][v * SIMD_LANE_COUNT]);
+				for (int section = 0; section < m_SectionCount; ++section)
+				{
+					const FloatLanes y = MulAdd(b0[section][v], x, z1[section][v]);
+					z1[section][v] = MulAdd(b1[section][v], x, z2[section][v]) - a1[section][v] * y;
+					z2[section][v] = b2[section][v] * x - a2[section][v] * y;
+					x = y;
+				}
+				StoreLanes(&tile[step][v * SIMD_LANE_COUNT], x);
+			}
+		}
+
+		for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+		{
+			float* samples = _block.channels[channel] + first;
+			for (size_t step = 0; step < steps; ++step)
+			{
+				samples[step] = tile[step][channel];
+			}
+		}
+	}
+
+	for (int section = 0; section < m_SectionCount; ++section)
+	{
+		for (int v = 0; v < CHANNEL_VECTORS; ++v)
+		{
+			StoreLanes(&m_Z1[section][v * SIMD_LANE_COUNT], z1[section][v]);
+			StoreLanes(&m_Z2[section][v * SIMD_LANE_COUNT], z2[section][v]);
+		}
+	}
+}
+
+// the same recursion one channel at a time, for builds without SIMD and as the
+// reference of the lane kernel
+void FilterBank::ProcessBiquadsScalar(SampleBlock& _block)
+{
+	for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+	{
+		float* samples = _block.channels[channel];
+		for (int section = 0; section < m_SectionCount; ++section)
+		{
+			const float b0 = m_B0[section][channel], b1 = m_B1[section][channel], b2 = m_B2[section][channel];
+			const float a1 = m_A1[section][channel], a2 = m_A2[section][channel];
+			float z1 = m_Z1[section][channel];
+			float z2 = m_Z2[section][channel];
+			for (size_t i = 0; i < _block.count; ++i)
+			{
+				const float x = samples[i];
+				const float y = b0 * x + z1;
+				z1 = b1 * x + z2 - a1 * y;
+				z2 = b2 * x - a2 * y;
+				samples[i] = y;
+			}
+			m_Z1[section][channel] = z1;
+			m_Z2[section][channel] = z2;
+		}
+	}
+}
+
+// y[i] = sum of taps[k] * x[i - k]; the history and the block are laid out as
+// one array so SIMD_LANE_COUNT consecutive outputs read consecutive inputs
+void FilterBank::ProcessFir(int _channel, float* _samples, size_t _count)
+{
+	const int HISTORY = MAX_FIR_TAPS - 1;
+	float input[HISTORY + SampleBlock::CAPACITY];
+	memcpy(input, m_History[_channel], sizeof(m_History[_channel]));
+	memcpy(input + HISTORY, _samples, _count * sizeof(float));
+
+	const float* taps = m_Fir[_channel];
+	const int tapCount = m_ChannelTaps[_channel];
+	const float* current = input + HISTORY;		// current[i] is x[i], current[i - k] reaches back into the history
+
+	size_t i = 0;
+	for (; i + SIMD_LANE_COUNT <= _count; i += SIMD_LANE_COUNT)
+	{
+		FloatLanes sum = SplatLanes(0.0f);
+		for (int tap = 0; tap < tapCount; ++tap)
+		{
+			sum = MulAdd(SplatLanes(taps[tap]), LoadLanes(current + i - tap), sum);
+		}
+		StoreLanes(_samples + i, sum);
+	}
+	for (; i < _count; ++i)
+	{
+		float sum = 0.0f;
+		for (int tap = 0; tap < tapCount; ++tap)
+		{
+			sum += taps[tap] * current[i - tap];
+		}
+		_samples[i] = sum;
+	}
+
+	memcpy(m_History[_channel], input + _count, sizeof(m_History[_channel]));
+}
+
+
+DecimatingFir::DecimatingFir()
+{
+	Configure(1, 1, 0.0f, 1.0f);
+}
+
+void DecimatingFir::Configure(int _decimation, int _taps, float _cutoff, float _sampleRate)
+{
+	m_Decimation = std::max(_decimation, 1);
+	if (m_Decimation == 1)
+	{
+		m_Taps.assign(1, 1.0f);
+	}
+	else
+	{
+		m_Taps = DesignLowpassFir(std::min(std::max(_taps, 1), int(MAX_TAPS)), _cutoff, _sampleRate);
+	}
+	m_Delay = 0.5f * (m_Taps.size() - 1) / _sampleRate;
+	Reset();
+}
+
+void DecimatingFir::Reset()
+{
+	memset(m_History, 0, sizeof(m_History));
+	m_Position = 0;
+	m_Phase = 0;
+}
+
+bool DecimatingFir::Push(const float _input[CHANNEL_COUNT], float _output[CHANNEL_COUNT])
+{
+	m_Position = (m_Position == 0) ? MAX_TAPS - 1 : m_Position - 1;
+	for (int channel = 0; channel < CHANNEL_COUNT; ++channel)
+	{
+		m_History[m_Position][channel] = _input[channel];
+		m_History[m_Position + MAX_TAPS][channel] = _input[channel];
+	}
+
+	if (++m_Phase < m_Decimation)
+	{
+		return false;
+	}
+	m_Phase = 0;
+
+	for (int channel = 0; channel < CHANNEL_COUNT; ++channel)
+	{
+		float sum = 0.0f;
+		for (size_t tap = 0; tap < m_Taps.size(); ++tap)
+		{
+			sum += m_Taps[tap] * m_History[m_Position + tap][channel];
+		}
+		_output[channel] = sum;
+	}
+	return true;
+}
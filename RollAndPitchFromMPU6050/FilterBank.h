@@ -0,0 +1,149 @@
+//
+// FilterBank.h - per-channel vibration filters between decode and fusion
+//
+// Every channel gets a cascade of biquads followed by an FIR. The biquads run
+// all six channels in SIMD lanes (SSE, AVX2, AVX-512 or NEON, see SimdLanes.h),
+// one time step per iteration with coefficients and state in registers; the
+// FIR runs along each channel's array, SIMD_LANE_COUNT output samples per
+// instruction. Builds without SIMD take a scalar biquad loop, which is also the
+// reference the lane kernel is checked against.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+#include <vector>
+
+
+enum BiquadType
+{
+	BIQUAD_LOWPASS,
+	BIQUAD_HIGHPASS,
+	BIQUAD_NOTCH,
+	BIQUAD_BANDPASS,
+};
+
+// normalized direct form coefficients (a0 == 1)
+struct BiquadCoefficients
+{
+	float b0, b1, b2;
+	float a1, a2;
+};
+
+// RBJ audio cookbook designs
+BiquadCoefficients DesignBiquad(BiquadType _type, float _frequency, float _q, float _sampleRate);
+
+// Hamming windowed sinc lowpass with unity DC gain
+std::vector<float> DesignLowpassFir(int _taps, float _cutoff, float _sampleRate);
+
+
+struct ChannelFilterConfig
+{
+	std::vector<BiquadCoefficients> sections;	// applied in order, at most FilterBank::MAX_SECTIONS
+	std::vector<float> firTaps;					// empty = no FIR, at most FilterBank::MAX_FIR_TAPS
+};
+
+
+// filter chain shared by a group of channels (all accel or all gyro axes)
+struct VibrationFilterSettings
+{
+	float notchHz;		// 0 = off
+	float notchQ;
+	float lowpassHz;	// biquad lowpass, 0 = off
+	int firTaps;		// windowed sinc lowpass at lowpassHz, 0 = off
+
+	VibrationFilterSettings() :
+		notchHz(0.0f),
+		notchQ(4.0f),
+		lowpassHz(0.0f),
+		firTaps(0)
+	{
+	}
+};
+
+ChannelFilterConfig MakeChannelFilterConfig(const VibrationFilterSettings& _settings, float _sampleRate);
+
+
+class FilterBank
+{
+public:
+
+	static const int MAX_SECTIONS = 4;
+	static const int MAX_FIR_TAPS = 32;
+
+	FilterBank();
+
+	// copies the coefficients, resets the filter state
+	void Configure(const ChannelFilterConfig _channels[IMU_CHANNEL_COUNT]);
+	void Reset();
+
+	// filters all channels of the block in place
+	void Process(SampleBlock& _block);
+
+	int GetSectionCount() const		{ return m_SectionCount; }
+	int GetFirTapCount() const		{ return m_FirTapCount; }
+
+private:
+
+	// six channels padded to whole vectors of the widest lanes (AVX-512)
+	static const int LANE_STRIDE = 16;
+
+	void ProcessBiquadLanes(SampleBlock& _block);
+	void ProcessBiquadsScalar(SampleBlock& _block);
+	void ProcessFir(int _channel, float* _samples, size_t _count);
+
+	// biquad coefficients, one float per lane; channels with fewer sections than
+	// m_SectionCount and the padding lanes get pass-through sections
+	float m_B0[MAX_SECTIONS][LANE_STRIDE];
+	float m_B1[MAX_SECTIONS][LANE_STRIDE];
+	float m_B2[MAX_SECTIONS][LANE_STRIDE];
+	float m_A1[MAX_SECTIONS][LANE_STRIDE];
+	float m_A2[MAX_SECTIONS][LANE_STRIDE];
+	float m_Fir[IMU_CHANNEL_COUNT][MAX_FIR_TAPS];
+	int m_ChannelTaps[IMU_CHANNEL_COUNT];		// 0 = no FIR
+	int m_SectionCount;							// most of any channel
+	int m_FirTapCount;
+
+	// state, transposed direct form II for the biquads
+	float m_Z1[MAX_SECTIONS][LANE_STRIDE];
+	float m_Z2[MAX_SECTIONS][LANE_STRIDE];
+
+	// last MAX_FIR_TAPS - 1 FIR inputs of every channel, oldest first
+	float m_History[IMU_CHANNEL_COUNT][MAX_FIR_TAPS - 1];
+};
+
+
+// Lowpass FIR in front of a rate reduction: only the kept output samples are
+// computed, so the cost per input sample is taps / decimation multiply-adds.
+// Used as the anti-alias filter of the decimated accelerometer correction.
+class DecimatingFir
+{
+public:
+
+	static const int CHANNEL_COUNT = 3;
+	static const int MAX_TAPS = 64;
+
+	DecimatingFir();
+
+	// _decimation 1 passes every sample through unfiltered
+	void Configure(int _decimation, int _taps, float _cutoff, float _sampleRate);
+	void Reset();
+
+	// true when _output holds a new decimated sample
+	bool Push(const float _input[CHANNEL_COUNT], float _output[CHANNEL_COUNT]);
+
+	int GetDecimation() const		{ return m_Decimation; }
+	float GetDelaySeconds() const	{ return m_Delay; }
+
+private:
+
+	std::vector<float> m_Taps;
+	int m_Decimation;
+	float m_Delay;
+
+	// history stored twice so the taps always read a contiguous window, newest first from m_Position
+	float m_History[2 * MAX_TAPS][CHANNEL_COUNT];
+	int m_Position;
+	int m_Phase;
+};
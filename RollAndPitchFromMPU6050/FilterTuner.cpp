@@ -0,0 +1,338 @@
+//
+// FilterTuner.cpp
+//
+
+#include "pch.h"
+#include "FilterTuner.h"
+#include "QuaternionMath.h"
+
+#include <chrono>
+#include <math.h>
+
+
+namespace
+{
+	const float STILL_ACCEL_TOLERANCE = 0.02f;	// g
+	const float STILL_GYRO_RATE = 0.03f;		// rad/s
+	const float MAX_SCORED_DT = 0.5f;			// s, gaps in the log are not scored
+
+	// a tuned value and the range of its grid
+	struct TunedParameter
+	{
+		int engine;
+		float minimum;
+		float maximum;
+		float (*get)(const TuningCandidate&);
+		void (*set)(TuningCandidate&, float);
+	};
+
+	const TunedParameter TUNED_PARAMETERS[] =
+	{
+		{ FUSION_KALMAN, 1e-4f, 1e-1f,
+			[](const TuningCandidate& _c) { return _c.kalman.gyroNoiseDensity; },
+			[](TuningCandidate& _c, float _value) { _c.kalman.gyroNoiseDensity = _value; } },
+		{ FUSION_KALMAN, 3e-3f, 1.0f,
+			[](const TuningCandidate& _c) { return _c.kalman.accelNoise; },
+			[](TuningCandidate& _c, float _value) { _c.kalman.accelNoise = _value; } },
+		{ FUSION_FIXED_POINT, 1e-3f, 0.25f,
+			[](const TuningCandidate& _c) { return Q16ToFloat(_c.fixedPoint.accelWeight); },
+			[](TuningCandidate& _c, float _value) { _c.fixedPoint.accelWeight = std::max(FloatToQ16(_value), 1); } },
+	};
+	const int TUNED_PARAMETER_COUNT = sizeof(TUNED_PARAMETERS) / sizeof(TUNED_PARAMETERS[0]);
+
+	float Clamp(float _value, const TunedParameter& _parameter)
+	{
+		return std::min(std::max(_value, _parameter.minimum), _parameter.maximum);
+	}
+
+	// angle between two vectors, robust for tiny angles
+	float AngleDegrees(const float _a[3], const float _b[3])
+	{
+		const float cx = _a[1] * _b[2] - _a[2] * _b[1];
+		const float cy = _a[2] * _b[0] - _a[0] * _b[2];
+		const float cz = _a[0] * _b[1] - _a[1] * _b[0];
+		const float dot = _a[0] * _b[0] + _a[1] * _b[1] + _a[2] * _b[2];
+		return atan2f(sqrtf(cx * cx + cy * cy + cz * cz), dot) * (180.0f / 3.14159265f);
+	}
+
+	// where and how long a device appears in the log
+	struct DeviceSpan
+	{
+		uint32_t deviceId;
+		size_t sampleCount;
+		uint64_t firstTimestamp;
+		uint64_t lastTimestamp;
+	};
+
+	// mean rate of a device log, the fixed-point defaults depend on it
+	float MeasureSampleRate(const DeviceSpan& _device)
+	{
+		if (_device.sampleCount < 2 || _device.lastTimestamp <= _device.firstTimestamp)
+		{
+			return 25.0f;	// too short to tell, assume the timer polling rate
+		}
+		return float((_device.sampleCount - 1) / DX::StepTimer::TicksToSeconds(_device.lastTimestamp - _device.firstTimestamp));
+	}
+
+	// all candidates of one device and engine
+	struct SearchState
+	{
+		uint32_t deviceId;
+		TuningCandidate best;
+		std::vector<TuningCandidate> trials;
+	};
+
+	void EvaluateAll(const MappedSensorLog& _log, std::vector<SearchState>& _states, WorkStealingPool& _pool, const TunerSettings& _settings)
+	{
+		for (SearchState& state : _states)
+		{
+			for (TuningCandidate& trial : state.trials)
+			{
+				const uint32_t deviceId = state.deviceId;
+				TuningCandidate* candidate = &trial;
+				_pool.Submit([&_log, deviceId, candidate, &_settings]()
+				{
+					candidate->cost = EvaluateCandidate(_log, deviceId, *candidate, _settings);
+				});
+			}
+		}
+		_pool.Wait();
+
+		for (SearchState& state : _states)
+		{
+			for (const TuningCandidate& trial : state.trials)
+			{
+				if (trial.cost.total < state.best.cost.total)
+				{
+					state.best = trial;
+				}
+			}
+		}
+	}
+}
+
+
+TuningCost EvaluateCandidate(const MappedSensorLog& _log, uint32_t _deviceId, const TuningCandidate& _candidate, const TunerSettings& _settings)
+{
+	TuningCost cost;
+	cost.jitterDegrees = 0.0f;
+	cost.staticDegrees = 0.0f;
+	cost.total = 0.0f;
+
+	ErrorStateKalman kalman(_candidate.kalman);
+	FixedPointComplementary fixedPoint(_candidate.fixedPoint);
+
+	uint64_t scoreStart = 0;
+	double jitterSum = 0.0, staticSum = 0.0;
+	size_t jitterCount = 0, staticCount = 0;
+
+	float previousGravity[3] = { 0.0f, 0.0f, 1.0f };
+	uint64_t previousTimestamp = 0;
+	bool hasPrevious = false;
+	bool hasFirst = false;
+
+	for (SensorLogCursor cursor = _log.Begin(); cursor.IsValid(); cursor.Next())
+	{
+		if (cursor.GetRecord().deviceId != _deviceId)
+		{
+			continue;
+		}
+		const SensorSample sample = cursor.GetSample();
+		const ImuReading reading = ConvertToPhysical(sample);
+		if (!hasFirst)
+		{
+			scoreStart = sample.timestamp + DX::StepTimer::SecondsToTicks(_settings.warmupSeconds);
+			hasFirst = true;
+		}
+
+		FusedOrientation orientation;
+		bool ready;
+		if (_candidate.engine == FUSION_FIXED_POINT)
+		{
+			fixedPoint.ProcessSample(sample);
+			orientation = fixedPoint.GetOrientation();
+			ready = fixedPoint.IsCalibrated();
+		}
+		else
+		{
+			kalman.ProcessReading(reading, sample.timestamp);
+			orientation = kalman.GetOrientation();
+			ready = kalman.IsInitialized();
+		}
+		if (!ready)
+		{
+			continue;
+		}
+
+		// compare in the sensor frame through gravity, heading does not matter here
+		float gravity[3];
+		GravityInSensorFrame(orientation.orientation, gravity);
+
+		const float dt = float(DX::StepTimer::TicksToSeconds(sample.timestamp - previousTimestamp));
+		if (hasPrevious && sample.timestamp >= scoreStart && dt > 0.0f && dt < MAX_SCORED_DT)
+		{
+			// rotate the previous gravity with the measured rate: dg/dt = g x w
+			const float* w = reading.gyro;
+			float predicted[3] =
+			{
+				previousGravity[0] + (previousGravity[1] * w[2] - previousGravity[2] * w[1]) * dt,
+				previousGravity[1] + (previousGravity[2] * w[0] - previousGravity[0] * w[2]) * dt,
+				previousGravity[2] + (previousGravity[0] * w[1] - previousGravity[1] * w[0]) * dt,
+			};
+			const float jitter = AngleDegrees(predicted, gravity);
+			jitterSum += jitter * jitter;
+			++jitterCount;
+
+			const float* a = reading.accel;
+			const float accelNorm = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+			const float rate = sqrtf(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+			if (fabsf(accelNorm - 1.0f) < STILL_ACCEL_TOLERANCE && rate < STILL_GYRO_RATE)
+			{
+				const float error = AngleDegrees(a, gravity);
+				staticSum += error * error;
+				++staticCount;
+			}
+		}
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			previousGravity[axis] = gravity[axis];
+		}
+		previousTimestamp = sample.timestamp;
+		hasPrevious = true;
+	}
+
+	cost.jitterDegrees = (jitterCount > 0) ? float(sqrt(jitterSum / jitterCount)) : 0.0f;
+	cost.staticDegrees = (staticCount > 0) ? float(sqrt(staticSum / staticCount)) : 0.0f;
+	cost.total = _settings.jitterWeight * cost.jitterDegrees + _settings.staticWeight * cost.staticDegrees;
+	return cost;
+}
+
+TuningReport TuneFilters(const MappedSensorLog& _log, WorkStealingPool& _pool, const TunerSettings& _settings)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// the devices of the log, in order of first appearance
+	std::vector<DeviceSpan> devices;
+	for (SensorLogCursor cursor = _log.Begin(); cursor.IsValid(); cursor.Next())
+	{
+		const uint32_t deviceId = cursor.GetRecord().deviceId;
+		size_t device = 0;
+		while (device < devices.size() && devices[device].deviceId != deviceId)
+		{
+			++device;
+		}
+		if (device == devices.size())
+		{
+			DeviceSpan span;
+			span.deviceId = deviceId;
+			span.sampleCount = 0;
+			span.firstTimestamp = cursor.GetTimestamp();
+			devices.push_back(span);
+		}
+		devices[device].lastTimestamp = cursor.GetTimestamp();
+		++devices[device].sampleCount;
+	}
+
+	TuningReport report;
+	report.devices.resize(devices.size());
+
+	// one search per device and engine, seeded with the current defaults
+	std::vector<SearchState> states;
+	for (size_t device = 0; device < devices.size(); ++device)
+	{
+		for (int engine = 0; engine < FUSION_ENGINE_COUNT; ++engine)
+		{
+			SearchState state;
+			state.deviceId = devices[device].deviceId;
+			state.best.engine = engine;
+			state.best.fixedPoint = MakeFixedPointSettings(MeasureSampleRate(devices[device]));
+			state.best.cost.total = 1e30f;
+			state.trials.push_back(state.best);
+			states.push_back(state);
+		}
+	}
+	EvaluateAll(_log, states, _pool, _settings);
+	for (size_t s = 0; s < states.size(); ++s)
+	{
+		report.devices[s / FUSION_ENGINE_COUNT].defaults[states[s].best.engine] = states[s].best;
+	}
+	uint32_t candidateCount = uint32_t(states.size());
+
+	// full grid over the parameters of each engine
+	const int gridSize = std::max(_settings.gridSize, 2);
+	for (SearchState& state : states)
+	{
+		state.trials.clear();
+		state.trials.push_back(state.best);
+		for (int p = 0; p < TUNED_PARAMETER_COUNT; ++p)
+		{
+			const TunedParameter& parameter = TUNED_PARAMETERS[p];
+			if (parameter.engine != state.best.engine)
+			{
+				continue;
+			}
+
+			std::vector<TuningCandidate> expanded;
+			for (const TuningCandidate& trial : state.trials)
+			{
+				for (int g = 0; g < gridSize; ++g)
+				{
+					TuningCandidate candidate = trial;
+					parameter.set(candidate, parameter.minimum * powf(parameter.maximum / parameter.minimum, float(g) / (gridSize - 1)));
+					expanded.push_back(candidate);
+				}
+			}
+			state.trials.swap(expanded);
+		}
+		candidateCount += uint32_t(state.trials.size());
+	}
+	EvaluateAll(_log, states, _pool, _settings);
+
+	// coordinate descent around the best grid point with shrinking log steps
+	for (int pass = 0; pass < _settings.descentPasses; ++pass)
+	{
+		for (int p = 0; p < TUNED_PARAMETER_COUNT; ++p)
+		{
+			const TunedParameter& parameter = TUNED_PARAMETERS[p];
+			const float gridStep = powf(parameter.maximum / parameter.minimum, 1.0f / (gridSize - 1));
+			const float step = powf(gridStep, 1.0f / float(2 << pass));
+
+			for (SearchState& state : states)
+			{
+				state.trials.clear();
+				if (parameter.engine != state.best.engine)
+				{
+					continue;
+				}
+
+				const float value = parameter.get(state.best);
+				TuningCandidate up = state.best;
+				TuningCandidate down = state.best;
+				parameter.set(up, Clamp(value * step, parameter));
+				parameter.set(down, Clamp(value / step, parameter));
+				state.trials.push_back(up);
+				state.trials.push_back(down);
+				candidateCount += 2;
+			}
+			EvaluateAll(_log, states, _pool, _settings);
+		}
+	}
+
+	for (size_t s = 0; s < states.size(); ++s)
+	{
+		DeviceTuning& device = report.devices[s / FUSION_ENGINE_COUNT];
+		const DeviceSpan& span = devices[s / FUSION_ENGINE_COUNT];
+		device.deviceId = span.deviceId;
+		device.sampleCount = span.sampleCount;
+		device.logSeconds = DX::StepTimer::TicksToSeconds(span.lastTimestamp - span.firstTimestamp);
+		device.best[states[s].best.engine] = states[s].best;
+	}
+	for (DeviceTuning& device : report.devices)
+	{
+		device.candidateCount = candidateCount / uint32_t(report.devices.size());
+	}
+
+	report.replaySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return report;
+}
@@ -0,0 +1,77 @@
+//
+// FilterTuner.h - fusion parameter search by replaying recorded logs
+//
+// Logs have no reference orientation, so candidates are scored on the two
+// properties the gains trade against each other:
+//   jitter  - tilt change not explained by the gyro between two samples
+//             (accelerometer noise leaking into the output)
+//   static  - tilt error against the accelerometer while the sensor is still
+//             (gyro drift and slow convergence)
+// Every device in the log is tuned separately, all candidates run on a pool.
+// Candidates replay the mapped log through their own cursor, so the log is
+// never loaded into memory.
+//
+
+#pragma once
+
+#include "ErrorStateKalman.h"
+#include "FixedPointFusion.h"
+#include "SensorLog.h"
+#include "WorkStealingPool.h"
+
+#include <vector>
+
+
+struct TunerSettings
+{
+	int gridSize;				// points per parameter on the log spaced grid
+	int descentPasses;			// coordinate descent refinement passes after the grid
+	float jitterWeight;
+	float staticWeight;
+	float warmupSeconds;		// ignored at the start of the log while the filters converge
+
+	TunerSettings() :
+		gridSize(8),
+		descentPasses(3),
+		jitterWeight(1.0f),
+		staticWeight(1.0f),
+		warmupSeconds(2.0f)
+	{
+	}
+};
+
+struct TuningCost
+{
+	float jitterDegrees;		// RMS
+	float staticDegrees;		// RMS over still samples
+	float total;
+};
+
+struct TuningCandidate
+{
+	int engine;							// FusionEngine
+	ErrorStateKalmanSettings kalman;
+	FixedPointSettings fixedPoint;
+	TuningCost cost;
+};
+
+struct DeviceTuning
+{
+	uint32_t deviceId;
+	size_t sampleCount;
+	double logSeconds;
+	TuningCandidate best[FUSION_ENGINE_COUNT];
+	TuningCandidate defaults[FUSION_ENGINE_COUNT];		// current settings, for comparison
+	uint32_t candidateCount;
+};
+
+struct TuningReport
+{
+	std::vector<DeviceTuning> devices;
+	double replaySeconds;		// wall clock time of the whole search
+};
+
+// replays the records of one device through the candidate's engine
+TuningCost EvaluateCandidate(const MappedSensorLog& _log, uint32_t _deviceId, const TuningCandidate& _candidate, const TunerSettings& _settings);
+
+TuningReport TuneFilters(const MappedSensorLog& _log, WorkStealingPool& _pool, const TunerSettings& _settings = TunerSettings());
@@ -0,0 +1,198 @@
+//
+// FixedMatrix.h - small dense matrices with compile-time dimensions
+//
+// All storage is inline and all loops have compile-time bounds, so the compiler
+// can fully unroll the filter math and nothing touches the heap.
+//
+
+#pragma once
+
+#include <math.h>
+
+
+template<int Rows, int Cols>
+struct FixedMatrix
+{
+	static_assert(Rows > 0 && Cols > 0, "FixedMatrix dimensions must be positive");
+
+	float m[Rows][Cols];
+
+	static const int RowCount = Rows;
+	static const int ColCount = Cols;
+
+	static FixedMatrix Zero()
+	{
+		FixedMatrix result;
+		for (int r = 0; r < Rows; ++r)
+			for (int c = 0; c < Cols; ++c)
+				result.m[r][c] = 0.0f;
+		return result;
+	}
+
+	static FixedMatrix Identity()
+	{
+		static_assert(Rows == Cols, "Identity requires a square matrix");
+		FixedMatrix result = Zero();
+		for (int i = 0; i < Rows; ++i)
+			result.m[i][i] = 1.0f;
+		return result;
+	}
+
+	static FixedMatrix Diagonal(float _value)
+	{
+		static_assert(Rows == Cols, "Diagonal requires a square matrix");
+		FixedMatrix result = Zero();
+		for (int i = 0; i < Rows; ++i)
+			result.m[i][i] = _value;
+		return result;
+	}
+
+	float& operator()(int _row, int _col)				{ return m[_row][_col]; }
+	float operator()(int _row, int _col) const			{ return m[_row][_col]; }
+
+	// vector access for single-column matrices
+	float& operator[](int _index)						{ static_assert(Cols == 1, "operator[] requires a column vector"); return m[_index][0]; }
+	float operator[](int _index) const					{ static_assert(Cols == 1, "operator[] requires a column vector"); return m[_index][0]; }
+
+	FixedMatrix& operator+=(const FixedMatrix& _other)
+	{
+		for (int r = 0; r < Rows; ++r)
+			for (int c = 0; c < Cols; ++c)
+				m[r][c] += _other.m[r][c];
+		return *this;
+	}
+
+	FixedMatrix& operator-=(const FixedMatrix& _other)
+	{
+		for (int r = 0; r < Rows; ++r)
+			for (int c = 0; c < Cols; ++c)
+				m[r][c] -= _other.m[r][c];
+		return *this;
+	}
+
+	FixedMatrix& operator*=(float _scale)
+	{
+		for (int r = 0; r < Rows; ++r)
+			for (int c = 0; c < Cols; ++c)
+				m[r][c] *= _scale;
+		return *this;
+	}
+
+	FixedMatrix<Cols, Rows> Transpose() const
+	{
+		FixedMatrix<Cols, Rows> result;
+		for (int r = 0; r < Rows; ++r)
+			for (int c = 0; c < Cols; ++c)
+				result.m[c][r] = m[r][c];
+		return result;
+	}
+
+	// copy a sub-matrix starting at (_row, _col)
+	template<int BlockRows, int BlockCols>
+	FixedMatrix<BlockRows, BlockCols> GetBlock(int _row, int _col) const
+	{
+		FixedMatrix<BlockRows, BlockCols> result;
+		for (int r = 0; r < BlockRows; ++r)
+			for (int c = 0; c < BlockCols; ++c)
+				result.m[r][c] = m[_row + r][_col + c];
+		return result;
+	}
+
+	template<int BlockRows, int BlockCols>
+	void SetBlock(int _row, int _col, const FixedMatrix<BlockRows, BlockCols>& _block)
+	{
+		for (int r = 0; r < BlockRows; ++r)
+			for (int c = 0; c < BlockCols; ++c)
+				m[_row + r][_col + c] = _block.m[r][c];
+	}
+
+	// average with the transpose to remove round-off asymmetry of covariance matrices
+	void Symmetrize()
+	{
+		static_assert(Rows == Cols, "Symmetrize requires a square matrix");
+		for (int r = 0; r < Rows; ++r)
+		{
+			for (int c = r + 1; c < Cols; ++c)
+			{
+				const float value = 0.5f * (m[r][c] + m[c][r]);
+				m[r][c] = value;
+				m[c][r] = value;
+			}
+		}
+	}
+};
+
+template<int N>
+using FixedVector = FixedMatrix<N, 1>;
+
+
+template<int Rows, int Cols>
+inline FixedMatrix<Rows, Cols> operator+(FixedMatrix<Rows, Cols> _a, const FixedMatrix<Rows, Cols>& _b)
+{
+	return _a += _b;
+}
+
+template<int Rows, int Cols>
+inline FixedMatrix<Rows, Cols> operator-(FixedMatrix<Rows, Cols> _a, const FixedMatrix<Rows, Cols>& _b)
+{
+	return _a -= _b;
+}
+
+template<int Rows, int Cols>
+inline FixedMatrix<Rows, Cols> operator*(FixedMatrix<Rows, Cols> _a, float _scale)
+{
+	return _a *= _scale;
+}
+
+template<int Rows, int Inner, int Cols>
+inline FixedMatrix<Rows, Cols> operator*(const FixedMatrix<Rows, Inner>& _a, const FixedMatrix<Inner, Cols>& _b)
+{
+	FixedMatrix<Rows, Cols> result;
+	for (int r = 0; r < Rows; ++r)
+	{
+		for (int c = 0; c < Cols; ++c)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < Inner; ++k)
+				sum += _a.m[r][k] * _b.m[k][c];
+			result.m[r][c] = sum;
+		}
+	}
+	return result;
+}
+
+// cross product matrix: Skew(a) * b == a x b
+inline FixedMatrix<3, 3> Skew(float _x, float _y, float _z)
+{
+	FixedMatrix<3, 3> result;
+	result.m[0][0] = 0.0f;	result.m[0][1] = -_z;	result.m[0][2] = _y;
+	result.m[1][0] = _z;	result.m[1][1] = 0.0f;	result.m[1][2] = -_x;
+	result.m[2][0] = -_y;	result.m[2][1] = _x;	result.m[2][2] = 0.0f;
+	return result;
+}
+
+// inverse of a 3x3 matrix by cofactors, returns false when singular
+inline bool Invert(const FixedMatrix<3, 3>& _a, FixedMatrix<3, 3>& _inverse)
+{
+	const float c00 = _a.m[1][1] * _a.m[2][2] - _a.m[1][2] * _a.m[2][1];
+	const float c01 = _a.m[1][2] * _a.m[2][0] - _a.m[1][0] * _a.m[2][2];
+	const float c02 = _a.m[1][0] * _a.m[2][1] - _a.m[1][1] * _a.m[2][0];
+
+	const float det = _a.m[0][0] * c00 + _a.m[0][1] * c01 + _a.m[0][2] * c02;
+	if (fabsf(det) < 1e-12f)
+	{
+		return false;
+	}
+
+	const float invDet = 1.0f / det;
+	_inverse.m[0][0] = c00 * invDet;
+	_inverse.m[1][0] = c01 * invDet;
+	_inverse.m[2][0] = c02 * invDet;
+	_inverse.m[0][1] = (_a.m[0][2] * _a.m[2][1] - _a.m[0][1] * _a.m[2][2]) * invDet;
+	_inverse.m[1][1] = (_a.m[0][0] * _a.m[2][2] - _a.m[0][2] * _a.m[2][0]) * invDet;
+	_inverse.m[2][1] = (_a.m[0][1] * _a.m[2][0] - _a.m[0][0] * _a.m[2][1]) * invDet;
+	_inverse.m[0][2] = (_a.m[0][1] * _a.m[1][2] - _a.m[0][2] * _a.m[1][1]) * invDet;
+	_inverse.m[1][2] = (_a.m[0][2] * _a.m[1][0] - _a.m[0][0] * _a.m[1][2]) * invDet;
+	_inverse.m[2][2] = (_a.m[0][0] * _a.m[1][1] - _a.m[0][1] * _a.m[1][0]) * invDet;
+	return true;
+}
@@ -0,0 +1,559 @@
+//
+// FixedPointFusion.cpp
+//
+
+#include "pch.h"
+#include "FixedPointFusion.h"
+#include "QuaternionMath.h"
+
+#include <math.h>
+
+
+namespace
+{
+	// atan(2^-i) in Q16.16
+	const q16_t CORDIC_ANGLES[16] = { 51472, 30386, 16055, 8150, 4091, 2047, 1024, 512, 256, 128, 64, 32, 16, 8, 4, 2 };
+	const int CORDIC_ITERATIONS = 16;
+	const int CORDIC_INPUT_SHIFT = 13;	// 2^16 inputs grow to < 2^31 with the CORDIC gain
+
+	// Q16 radians per (register unit * StepTimer tick) scaled by 2^GYRO_SCALE_SHIFT:
+	// (pi / 180 / 131) / 10^7 * 2^16 * 2^36
+	const int64_t GYRO_SCALE = 60002;
+	const int GYRO_SCALE_SHIFT = 36;
+
+	// keeps raw * dt * GYRO_SCALE below 2^53, so the golden model in double stays exact
+	const uint64_t MAX_DT_TICKS = DX::StepTimer::TicksPerSecond / 8;
+
+	q16_t WrapAngle(q16_t _angle)
+	{
+		if (_angle > Q16_PI)
+		{
+			_angle -= 2 * Q16_PI;
+		}
+		else if (_angle <= -Q16_PI)
+		{
+			_angle += 2 * Q16_PI;
+		}
+		return _angle;
+	}
+
+	int64_t RoundShift(int64_t _value, int _shift)
+	{
+		return (_value + (int64_t(1) << (_shift - 1))) >> _shift;
+	}
+
+	uint64_t ClampedDt(uint64_t _timestamp, uint64_t _lastTimestamp)
+	{
+		const uint64_t dt = (_timestamp > _lastTimestamp) ? _timestamp - _lastTimestamp : 0;
+		return (dt > MAX_DT_TICKS) ? 0 : dt;
+	}
+
+
+	// tilt from gravity, inputs in int16 range
+	void AccelTilt(int32_t _x, int32_t _y, int32_t _z, q16_t& _roll, q16_t& _pitch)
+	{
+		_roll = FixedAtan2(_y, _z);
+		const uint32_t horizontal = FixedSqrt(uint32_t(_y * _y) + uint32_t(_z * _z));
+		_pitch = FixedAtan2(-_x, int32_t(horizontal));
+	}
+
+
+	// Golden model: the same algorithm with every value held in a double. Integers
+	// stay below 2^53, so the model is exact and any overflow or shift mistake in
+	// the integer code shows up as a mismatch.
+	class GoldenModel
+	{
+	public:
+
+		explicit GoldenModel(const FixedPointSettings& _settings) :
+			m_Settings(_settings),
+			m_CalibrationCount(0),
+			m_Roll(0.0),
+			m_Pitch(0.0),
+			m_LastTimestamp(0),
+			m_Initialized(false)
+		{
+			m_GyroSum[0] = m_GyroSum[1] = m_GyroSum[2] = 0.0;
+			m_GyroOffset[0] = m_GyroOffset[1] = m_GyroOffset[2] = 0.0;
+			m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0.0;
+			m_AccelCount = 0;
+		}
+
+		void ProcessSample(const SensorSample& _sample)
+		{
+			const double calibrationSamples = ldexp(1.0, m_Settings.gyroCalibrationShift);
+			if (m_CalibrationCount < calibrationSamples)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					m_GyroSum[i] += _sample.gyro[i];
+				}
+				if (++m_CalibrationCount == calibrationSamples)
+				{
+					for (int i = 0; i < 3; ++i)
+					{
+						m_GyroOffset[i] = floor(m_GyroSum[i] / calibrationSamples);
+					}
+				}
+			}
+
+			if (!m_Initialized)
+			{
+				AccelTilt(_sample.accel[0], _sample.accel[1], _sample.accel[2], m_Roll, m_Pitch);
+				m_LastTimestamp = _sample.timestamp;
+				m_Initialized = true;
+				return;
+			}
+
+			const double dt = double(ClampedDt(_sample.timestamp, m_LastTimestamp));
+			m_LastTimestamp = _sample.timestamp;
+
+			m_Roll = Wrap(m_Roll + RoundShift((_sample.gyro[0] - m_GyroOffset[0]) * dt * GYRO_SCALE, GYRO_SCALE_SHIFT));
+			m_Pitch = m_Pitch + RoundShift((_sample.gyro[1] - m_GyroOffset[1]) * dt * GYRO_SCALE, GYRO_SCALE_SHIFT);
+
+			for (int i = 0; i < 3; ++i)
+			{
+				m_AccelSum[i] += _sample.accel[i];
+			}
+			const double correctionSamples = ldexp(1.0, m_Settings.correctionShift);
+			if (++m_AccelCount < correctionSamples)
+			{
+				return;
+			}
+
+			double accelRoll, accelPitch;
+			AccelTilt(floor(m_AccelSum[0] / correctionSamples), floor(m_AccelSum[1] / correctionSamples), floor(m_AccelSum[2] / correctionSamples), accelRoll, accelPitch);
+			m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0.0;
+			m_AccelCount = 0;
+
+			m_Roll = Wrap(m_Roll + RoundShift(Wrap(accelRoll - m_Roll) * m_Settings.accelWeight, Q16_SHIFT));
+			m_Pitch = m_Pitch + RoundShift((accelPitch - m_Pitch) * m_Settings.accelWeight, Q16_SHIFT);
+		}
+
+		double GetRoll() const		{ return m_Roll; }
+		double GetPitch() const		{ return m_Pitch; }
+
+	private:
+
+		static void AccelTilt(double _x, double _y, double _z, double& _roll, double& _pitch)
+		{
+			_roll = Atan2(_y, _z);
+			_pitch = Atan2(-_x, floor(sqrt(_y * _y + _z * _z)));
+		}
+
+		static double RoundShift(double _value, int _shift)
+		{
+			return floor((_value + ldexp(1.0, _shift - 1)) / ldexp(1.0, _shift));
+		}
+
+		static double Wrap(double _angle)
+		{
+			if (_angle > Q16_PI)
+			{
+				return _angle - 2.0 * Q16_PI;
+			}
+			if (_angle <= -Q16_PI)
+			{
+				return _angle + 2.0 * Q16_PI;
+			}
+			return _angle;
+		}
+
+		static double Atan2(double _y, double _x)
+		{
+			if (_x == 0.0 && _y == 0.0)
+			{
+				return 0.0;
+			}
+
+			double angle = 0.0;
+			double x = _x * (1 << CORDIC_INPUT_SHIFT);
+			double y = _y * (1 << CORDIC_INPUT_SHIFT);
+
+			if (x < 0.0)
+			{
+				const double t = x;
+				if (y >= 0.0)
+				{
+					x = y;
+					y = -t;
+					angle = Q16_PIDIV2;
+				}
+				else
+				{
+					x = -y;
+					y = t;
+					angle = -Q16_PIDIV2;
+				}
+			}
+
+			for (int i = 0; i < CORDIC_ITERATIONS; ++i)
+			{
+				const double xs = floor(x / (1 << i));
+				const double ys = floor(y / (1 << i));
+				if (y > 0.0)
+				{
+					x += ys;
+					y -= xs;
+					angle += CORDIC_ANGLES[i];
+				}
+				else
+				{
+					x -= ys;
+					y += xs;
+					angle -= CORDIC_ANGLES[i];
+				}
+			}
+			return angle;
+		}
+
+		FixedPointSettings m_Settings;
+		double m_GyroSum[3];
+		double m_GyroOffset[3];
+		uint32_t m_CalibrationCount;
+		double m_AccelSum[3];
+		uint32_t m_AccelCount;
+		double m_Roll;
+		double m_Pitch;
+		uint64_t m_LastTimestamp;
+		bool m_Initialized;
+	};
+
+
+	// the same complementary filter in float, to measure the fixed-point accuracy
+	class FloatModel
+	{
+	public:
+
+		explicit FloatModel(const FixedPointSettings& _settings) :
+			m_AccelWeight(Q16ToFloat(_settings.accelWeight)),
+			m_CalibrationSamples(1u << _settings.gyroCalibrationShift),
+			m_CalibrationCount(0),
+			m_CorrectionSamples(1u << _settings.correctionShift),
+			m_AccelCount(0),
+			m_Roll(0.0f),
+			m_Pitch(0.0f),
+			m_LastTimestamp(0),
+			m_Initialized(false)
+		{
+			m_GyroOffset[0] = m_GyroOffset[1] = 0.0f;
+			m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0.0f;
+		}
+
+		void ProcessSample(const SensorSample& _sample)
+		{
+			const float RAD_PER_UNIT = 3.14159265f / 180.0f / GYRO_UNITS_PER_DPS;
+
+			if (m_CalibrationCount < m_CalibrationSamples)
+			{
+				m_GyroOffset[0] += float(_sample.gyro[0]) / m_CalibrationSamples;
+				m_GyroOffset[1] += float(_sample.gyro[1]) / m_CalibrationSamples;
+				++m_CalibrationCount;
+			}
+
+			if (!m_Initialized)
+			{
+				AccelTilt(_sample.accel[0], _sample.accel[1], _sample.accel[2], m_Roll, m_Pitch);
+				m_LastTimestamp = _sample.timestamp;
+				m_Initialized = true;
+				return;
+			}
+
+			const float dt = float(DX::StepTimer::TicksToSeconds(ClampedDt(_sample.timestamp, m_LastTimestamp)));
+			m_LastTimestamp = _sample.timestamp;
+
+			m_Roll = WrapFloat(m_Roll + (_sample.gyro[0] - m_GyroOffset[0]) * RAD_PER_UNIT * dt);
+			m_Pitch += (_sample.gyro[1] - m_GyroOffset[1]) * RAD_PER_UNIT * dt;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				m_AccelSum[i] += _sample.accel[i];
+			}
+			if (++m_AccelCount < m_CorrectionSamples)
+			{
+				return;
+			}
+
+			float accelRoll, accelPitch;
+			AccelTilt(m_AccelSum[0] / m_CorrectionSamples, m_AccelSum[1] / m_CorrectionSamples, m_AccelSum[2] / m_CorrectionSamples, accelRoll, accelPitch);
+			m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0.0f;
+			m_AccelCount = 0;
+
+			m_Roll = WrapFloat(m_Roll + WrapFloat(accelRoll - m_Roll) * m_AccelWeight);
+			m_Pitch += (accelPitch - m_Pitch) * m_AccelWeight;
+		}
+
+		float GetRoll() const		{ return m_Roll; }
+		float GetPitch() const		{ return m_Pitch; }
+
+	private:
+
+		static void AccelTilt(float _x, float _y, float _z, float& _roll, float& _pitch)
+		{
+			_roll = FastAtan2(_y, _z);
+			_pitch = FastAtan2(-_x, sqrtf(_y * _y + _z * _z));
+		}
+
+		static float WrapFloat(float _angle)
+		{
+			const float PI = 3.14159265f;
+			if (_angle > PI)
+			{
+				return _angle - 2.0f * PI;
+			}
+			if (_angle <= -PI)
+			{
+				return _angle + 2.0f * PI;
+			}
+			return _angle;
+		}
+
+		float m_AccelWeight;
+		uint32_t m_CalibrationSamples;
+		uint32_t m_CalibrationCount;
+		uint32_t m_CorrectionSamples;
+		float m_AccelSum[3];
+		uint32_t m_AccelCount;
+		float m_GyroOffset[2];
+		float m_Roll;
+		float m_Pitch;
+		uint64_t m_LastTimestamp;
+		bool m_Initialized;
+	};
+}
+
+
+q16_t FixedAtan2(int32_t _y, int32_t _x)
+{
+	if (_x == 0 && _y == 0)
+	{
+		return 0;
+	}
+
+	q16_t angle = 0;
+	int32_t x = _x * (1 << CORDIC_INPUT_SHIFT);
+	int32_t y = _y * (1 << CORDIC_INPUT_SHIFT);
+
+	// rotate into the right half plane, CORDIC converges for |angle| < 99 degrees
+	if (x < 0)
+	{
+		const int32_t t = x;
+		if (y >= 0)
+		{
+			x = y;
+			y = -t;
+			angle = Q16_PIDIV2;
+		}
+		else
+		{
+			x = -y;
+			y = t;
+			angle = -Q16_PIDIV2;
+		}
+	}
+
+	for (int i = 0; i < CORDIC_ITERATIONS; ++i)
+	{
+		const int32_t xs = x >> i;
+		const int32_t ys = y >> i;
+		if (y > 0)
+		{
+			x += ys;
+			y -= xs;
+			angle += CORDIC_ANGLES[i];
+		}
+		else
+		{
+			x -= ys;
+			y += xs;
+			angle -= CORDIC_ANGLES[i];
+		}
+	}
+	return angle;
+}
+
+uint32_t FixedSqrt(uint32_t _value)
+{
+	uint32_t result = 0;
+	uint32_t bit = 1u << 30;
+
+	while (bit > _value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (_value >= result + bit)
+		{
+			_value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+	return result;
+}
+
+
+FixedPointSettings MakeFixedPointSettings(float _sampleRate)
+{
+	const float ACCEL_TIME_CONSTANT = 2.0f;		// seconds, matches the 25 Hz default weight
+	const float CALIBRATION_SECONDS = 2.5f;
+	const float CORRECTION_RATE = 25.0f;
+
+	FixedPointSettings settings;
+	settings.gyroCalibrationShift = 0;
+	while (settings.gyroCalibrationShift < 15 && float(1u << settings.gyroCalibrationShift) < CALIBRATION_SECONDS * _sampleRate)
+	{
+		++settings.gyroCalibrationShift;
+	}
+	settings.correctionShift = 0;
+	while (settings.correctionShift < 15 && float(2u << settings.correctionShift) <= _sampleRate / CORRECTION_RATE)
+	{
+		++settings.correctionShift;
+	}
+
+	const float correctionInterval = float(1u << settings.correctionShift) / _sampleRate;
+	settings.accelWeight = std::max(FloatToQ16(1.0f - expf(-correctionInterval / ACCEL_TIME_CONSTANT)), q16_t(1));
+	return settings;
+}
+
+FixedPointSettings RescaleFixedPointSettings(const FixedPointSettings& _settings, float _fromRate, float _toRate)
+{
+	if (_fromRate == _toRate)
+	{
+		return _settings;
+	}
+
+	const float fromInterval = float(1u << _settings.correctionShift) / _fromRate;
+	const float timeConstant = -fromInterval / logf(1.0f - Q16ToFloat(_settings.accelWeight));
+
+	FixedPointSettings settings = MakeFixedPointSettings(_toRate);
+	const float correctionInterval = float(1u << settings.correctionShift) / _toRate;
+	settings.accelWeight = std::max(FloatToQ16(1.0f - expf(-correctionInterval / timeConstant)), q16_t(1));
+	return settings;
+}
+
+
+FixedPointComplementary::FixedPointComplementary()
+{
+	Reset();
+}
+
+FixedPointComplementary::FixedPointComplementary(const FixedPointSettings& _settings) :
+	m_Settings(_settings)
+{
+	Reset();
+}
+
+void FixedPointComplementary::Reset()
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		m_GyroSum[i] = 0;
+		m_GyroOffset[i] = 0;
+	}
+	m_CalibrationCount = 0;
+	m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0;
+	m_AccelCount = 0;
+	m_Roll = 0;
+	m_Pitch = 0;
+	m_LastTimestamp = 0;
+	m_Initialized = false;
+}
+
+void FixedPointComplementary::ProcessSample(const SensorSample& _sample)
+{
+	// calibration: average gyro offsets over the first samples
+	if (!IsCalibrated())
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			m_GyroSum[i] += _sample.gyro[i];
+		}
+		if (++m_CalibrationCount == (1u << m_Settings.gyroCalibrationShift))
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				m_GyroOffset[i] = m_GyroSum[i] >> m_Settings.gyroCalibrationShift;
+			}
+		}
+	}
+
+	if (!m_Initialized)
+	{
+		AccelTilt(_sample.accel[0], _sample.accel[1], _sample.accel[2], m_Roll, m_Pitch);
+		m_LastTimestamp = _sample.timestamp;
+		m_Initialized = true;
+		return;
+	}
+
+	const int64_t dt = int64_t(ClampedDt(_sample.timestamp, m_LastTimestamp));
+	m_LastTimestamp = _sample.timestamp;
+
+	// gyro propagation
+	m_Roll = WrapAngle(m_Roll + q16_t(RoundShift((_sample.gyro[0] - m_GyroOffset[0]) * dt * GYRO_SCALE, GYRO_SCALE_SHIFT)));
+	m_Pitch = m_Pitch + q16_t(RoundShift((_sample.gyro[1] - m_GyroOffset[1]) * dt * GYRO_SCALE, GYRO_SCALE_SHIFT));
+
+	// accelerometer correction on the average of the last 2^correctionShift samples
+	for (int i = 0; i < 3; ++i)
+	{
+		m_AccelSum[i] += _sample.accel[i];
+	}
+	if (++m_AccelCount < (1u << m_Settings.correctionShift))
+	{
+		return;
+	}
+
+	q16_t accelRoll, accelPitch;
+	AccelTilt(m_AccelSum[0] >> m_Settings.correctionShift, m_AccelSum[1] >> m_Settings.correctionShift, m_AccelSum[2] >> m_Settings.correctionShift, accelRoll, accelPitch);
+	m_AccelSum[0] = m_AccelSum[1] = m_AccelSum[2] = 0;
+	m_AccelCount = 0;
+
+	m_Roll = WrapAngle(m_Roll + q16_t(RoundShift(int64_t(WrapAngle(accelRoll - m_Roll)) * m_Settings.accelWeight, Q16_SHIFT)));
+	m_Pitch = m_Pitch + q16_t(RoundShift(int64_t(accelPitch - m_Pitch) * m_Settings.accelWeight, Q16_SHIFT));
+}
+
+FusedOrientation FixedPointComplementary::GetOrientation() const
+{
+	FusedOrientation result;
+	result.timestamp = m_LastTimestamp;
+	result.orientation = QuaternionFromEuler(Q16ToFloat(m_Roll), Q16ToFloat(m_Pitch), 0.0f);
+	result.attitudeVariance[0] = result.attitudeVariance[1] = result.attitudeVariance[2] = 0.0f;	// not estimated
+	return result;
+}
+
+
+FixedPointValidation ValidateFixedPointFusion(const std::vector<SensorSample>& _samples, const FixedPointSettings& _settings)
+{
+	FixedPointComplementary fixedPoint(_settings);
+	GoldenModel golden(_settings);
+	FloatModel floatModel(_settings);
+
+	FixedPointValidation result;
+	result.sampleCount = uint32_t(_samples.size());
+	result.mismatchCount = 0;
+	result.maxErrorDegrees = 0.0f;
+
+	for (const SensorSample& sample : _samples)
+	{
+		fixedPoint.ProcessSample(sample);
+		golden.ProcessSample(sample);
+		floatModel.ProcessSample(sample);
+
+		if (double(fixedPoint.GetRoll()) != golden.GetRoll() || double(fixedPoint.GetPitch()) != golden.GetPitch())
+		{
+			++result.mismatchCount;
+		}
+
+		const float rollError = fabsf(Q16ToFloat(fixedPoint.GetRoll()) - floatModel.GetRoll());
+		const float pitchError = fabsf(Q16ToFloat(fixedPoint.GetPitch()) - floatModel.GetPitch());
+		const float errorDegrees = std::max(std::min(rollError, 2.0f * 3.14159265f - rollError), pitchError) * 180.0f / 3.14159265f;
+		result.maxErrorDegrees = std::max(result.maxErrorDegrees, errorDegrees);
+	}
+	return result;
+}
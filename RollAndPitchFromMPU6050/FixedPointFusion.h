@@ -0,0 +1,104 @@
+//
+// FixedPointFusion.h - integer complementary filter for cores with weak FPUs
+//
+// Works directly on the int16 register values. Angles are Q16.16 radians,
+// the only floating point is the conversion of the final angles for rendering.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+#include <vector>
+
+
+typedef int32_t q16_t;
+
+const int Q16_SHIFT = 16;
+const q16_t Q16_ONE = 1 << Q16_SHIFT;
+const q16_t Q16_PI = 205887;
+const q16_t Q16_PIDIV2 = 102944;
+
+inline float Q16ToFloat(q16_t _value)		{ return float(_value) / Q16_ONE; }
+inline q16_t FloatToQ16(float _value)		{ return q16_t(_value * Q16_ONE + (_value >= 0.0f ? 0.5f : -0.5f)); }
+
+// CORDIC atan2 in Q16.16 radians, inputs must satisfy |x|, |y| < 2^16
+q16_t FixedAtan2(int32_t _y, int32_t _x);
+
+// floor(sqrt(_value))
+uint32_t FixedSqrt(uint32_t _value);
+
+
+struct FixedPointSettings
+{
+	q16_t accelWeight;				// Q16 fraction of the accelerometer tilt blended in per correction
+	uint32_t gyroCalibrationShift;	// average 2^shift samples at startup for gyro offsets (device must be still)
+	uint32_t correctionShift;		// correct every 2^shift samples with their averaged accel, gyro still every sample
+
+	FixedPointSettings() :
+		accelWeight(1311),			// 0.02
+		gyroCalibrationShift(6),	// 64 samples
+		correctionShift(0)			// every sample
+	{
+	}
+};
+
+// The defaults are tuned for 25 Hz. At higher rates the per-sample weight gets so
+// small that Q16 rounding leaves a dead zone, so corrections are decimated to about
+// 25 Hz (the averaging is the anti-alias filter) with the same 2 s time constant.
+FixedPointSettings MakeFixedPointSettings(float _sampleRate);
+
+// settings made or tuned for _fromRate moved to _toRate: the shifts are remade
+// for the new rate and the accel weight keeps its correction time constant
+FixedPointSettings RescaleFixedPointSettings(const FixedPointSettings& _settings, float _fromRate, float _toRate);
+
+
+// roll and pitch complementary filter on raw MPU6050 registers
+class FixedPointComplementary
+{
+public:
+
+	FixedPointComplementary();
+	explicit FixedPointComplementary(const FixedPointSettings& _settings);
+
+	void Reset();
+	void ProcessSample(const SensorSample& _sample);
+
+	q16_t GetRoll() const							{ return m_Roll; }
+	q16_t GetPitch() const							{ return m_Pitch; }
+	bool IsCalibrated() const						{ return m_CalibrationCount == (1u << m_Settings.gyroCalibrationShift); }
+	const FixedPointSettings& GetSettings() const	{ return m_Settings; }
+
+	FusedOrientation GetOrientation() const;
+
+private:
+
+	FixedPointSettings m_Settings;
+
+	// calibration: gyro offsets in register units
+	int32_t m_GyroSum[3];
+	int32_t m_GyroOffset[3];
+	uint32_t m_CalibrationCount;
+
+	// accel accumulated for the next correction
+	int32_t m_AccelSum[3];
+	uint32_t m_AccelCount;
+
+	q16_t m_Roll;
+	q16_t m_Pitch;
+	uint64_t m_LastTimestamp;
+	bool m_Initialized;
+};
+
+
+// Compares the fixed-point path with a double precision golden model that
+// mirrors every quantization step (must match bit-exactly), and with the
+// same filter in plain float (reports the fixed-point accuracy loss).
+struct FixedPointValidation
+{
+	uint32_t sampleCount;
+	uint32_t mismatchCount;		// samples where fixed-point and golden model differ
+	float maxErrorDegrees;		// largest deviation from the float filter
+};
+
+FixedPointValidation ValidateFixedPointFusion(const std::vector<SensorSample>& _samples, const FixedPointSettings& _settings = FixedPointSettings());
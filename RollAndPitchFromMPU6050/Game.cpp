@@ -8,6 +8,8 @@
 #include "imgui.h"
 #include "imgui_impl_dx12.h"
 
+#include "QuaternionMath.h"
+
 using Microsoft::WRL::ComPtr;
 using namespace Platform;
 using namespace Windows::Foundation;
@@ -16,7 +18,152 @@ using namespace DirectX::SimpleMath;
 
 extern void ExitGame();
 
-Game::Game() :
+namespace
+{
+	// the sensor samples on its own clock into the FIFO, the timer only drains it
+	const Mpu6050RateConfig SENSOR_RATE = MakeRateConfig(1000.0f);
+	const float SAMPLE_RATE = SENSOR_RATE.sampleRate;
+	const uint64_t TICKS_PER_MS = DX::StepTimer::TicksPerSecond / 1000;
+	const int FIFO_READ_PERIOD_MS = 20;		// 20 frames per burst, the FIFO holds 85
+
+	const int CORRECTION_FIR_TAPS_PER_PHASE = 4;		// of SensorPipeline, bounds the decimation slider
+
+	const double REPLAY_FRAME_SECONDS = 1.0 / 60.0;		// virtual time per rendered frame at 1x
+	const float REPLAY_MAX_SPEED = 64.0f;
+
+	const int SPECTRUM_PERIOD_MS = 100;
+	const float SPECTRUM_FLOOR_DB = -60.0f;		// spectrogram color range, dB relative to 1 g
+
+	const int MOTION_INTERRUPT_GPIO = 17;		// MPU6050 INT pin, header pin 11 on Raspberry Pi
+	const double MOTION_ALERT_SECONDS = 2.0;	// how long the last event stays highlighted
+
+	const size_t VALIDATION_SAMPLE_COUNT = 16384;	// about 16 seconds at 1 kHz
+
+	const uint32_t SHARED_MEMORY_SLOTS = 4096;		// about 4 seconds for readers to catch up
+
+	const uint64_t I2C_TRACE_MAX_BYTES = 64 * 1024 * 1024;	// about an hour of FIFO bursts, then rotated
+
+	// the I2cDevice under m_Bus; the partial calls report NAKs and short transfers
+	// as a status, and the arrays wrap the caller's buffers without a copy
+	class DeviceI2cTransport : public I2cTransport
+	{
+	public:
+
+		explicit DeviceI2cTransport(I2cDevice^ _device) :
+			m_Device(_device)
+		{
+		}
+
+		I2cResult Write(uint8_t, const uint8_t* _data, uint32_t _size) override
+		{
+			try
+			{
+				return ToResult(m_Device->WritePartial(Platform::ArrayReference<byte>(const_cast<byte*>(_data), _size)));
+			}
+			catch (...)
+			{
+				return I2cResult(I2C_UNKNOWN_ERROR, 0);
+			}
+		}
+
+		I2cResult WriteRead(uint8_t, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize) override
+		{
+			try
+			{
+				return ToResult(m_Device->WriteReadPartial(Platform::ArrayReference<byte>(const_cast<byte*>(_write), _writeSize),
+					Platform::ArrayReference<byte>(_read, _readSize)));
+			}
+			catch (...)
+			{
+				return I2cResult(I2C_UNKNOWN_ERROR, 0);
+			}
+		}
+
+	private:
+
+		static I2cResult ToResult(I2cTransferResult _result)
+		{
+			return I2cResult(uint32_t(_result.Status), _result.BytesTransferred);
+		}
+
+		I2cDevice^ m_Device;
+	};
+
+	// IPv4 address of the first interface on a private network (RFC 1918), where
+	// privateNetworkClientServer lets dashboards connect; loopback without one, the
+	// server is unauthenticated and must not end up on a public interface
+	std::string FindPrivateNetworkAddress()
+	{
+		for (Windows::Networking::HostName^ host : Windows::Networking::Connectivity::NetworkInformation::GetHostNames())
+		{
+			if (host->Type != Windows::Networking::HostNameType::Ipv4)
+			{
+				continue;
+			}
+			const std::wstring name(host->CanonicalName->Data());
+			const std::string address(name.begin(), name.end());
+			unsigned int first, second;
+			if (sscanf_s(address.c_str(), "%u.%u", &first, &second) == 2
+				&& (first == 10 || (first == 172 && second >= 16 && second < 32) || (first == 192 && second == 168)))
+			{
+				return address;
+			}
+		}
+		return "127.0.0.1";
+	}
+
+	// startup settings of the pipeline, also those of the golden replay digest;
+	// the notch and lowpass apply once the filters are enabled
+	PipelineSettings MakeStartupSettings()
+	{
+		PipelineSettings settings;
+		settings.sampleRate = SAMPLE_RATE;
+		settings.accelFilter.notchHz = 10.0f;
+		settings.accelFilter.lowpassHz = 5.0f;
+		settings.gyroFilter.notchHz = 10.0f;
+		return settings;
+	}
+
+	SensorShmSample ToSharedSample(const SensorSample& _sample)
+	{
+		SensorShmSample shared;
+		shared.timestamp = _sample.timestamp;
+		shared.deviceId = _sample.deviceId;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			shared.accel[axis] = _sample.accel[axis];
+			shared.gyro[axis] = _sample.gyro[axis];
+		}
+		shared.temperature = _sample.temperature;
+		shared.reserved = 0;
+		return shared;
+	}
+
+	SensorShmOrientation ToSharedOrientation(const FusedOrientation& _orientation)
+	{
+		SensorShmOrientation shared;
+		shared.timestamp = _orientation.timestamp;
+		shared.orientation[0] = _orientation.orientation.x;
+		shared.orientation[1] = _orientation.orientation.y;
+		shared.orientation[2] = _orientation.orientation.z;
+		shared.orientation[3] = _orientation.orientation.w;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			shared.attitudeVariance[axis] = _orientation.attitudeVariance[axis];
+		}
+		shared.reserved = 0.0f;
+		return shared;
+	}
+
+	// Sensor frame is X forward, Z up; the airplane model is Z forward, Y up.
+	// The axis permutation is a cyclic (even) one, so it maps rotations to rotations.
+	Quaternion SensorToModel(const Quaternion& _sensor)
+	{
+		return Quaternion(_sensor.y, _sensor.z, _sensor.x, _sensor.w);
+	}
+}
+
+Game::Game(Clock& _clock) :
     m_window(nullptr),
     m_outputWidth(800),
     m_outputHeight(600),
@@ -24,8 +171,68 @@ Game::Game() :
     m_featureLevel(D3D_FEATURE_LEVEL_11_0),
     m_backBufferIndex(0),
     m_fenceValues{},
-	m_AccelerometerReads(0)
+	m_Clock(_clock),
+	m_timer(m_Clock),
+	m_AcquisitionTimer(0),
+	m_AccelerometerReads(0),
+	m_Bus(m_Clock, m_I2cTrace),
+	m_FifoReader(MPU6050_I2C_ADDRESS, SAMPLE_RATE),
+	m_BusReplayStarted(false),
+	m_BusTraceCheckStarted(false),
+	m_FusionTicks(0),
+	m_FusionUpdates(0),
+	m_MotionEventCounts{},
+	m_SpectrumTimer(0),
+	m_SpectrumAxis(2),
+	m_Recording(false),
+	m_PackStarted(false),
+	m_AllanStarted(false),
+	m_TuningStarted(false),
+	m_Replaying(false),
+	m_ReplaySpeed(1.0f),
+	m_ReplayCheckStarted(false),
+	m_ExportStarted(false),
+	m_LogCheckStarted(false),
+	m_SharedMemory(nullptr),
+	m_TelemetryAddress{},
+	m_TelemetryPort(TELEMETRY_DEFAULT_PORT),
+	m_TelemetryFailed(false),
+	m_ValidationStarted(false)
 {
+	m_LastMotionEvent.timestamp = 0;
+
+	// runs on the acquisition thread, hand events over to the render thread
+	m_MotionDetector.SetCallback([this](const MotionEvent& _event)
+	{
+		m_MotionEvents.Push(_event);
+		if (_event.type == MOTION_SHOCK || _event.type == MOTION_FREE_FALL)
+		{
+			m_BlackBox.Trigger(_event.type == MOTION_SHOCK ? BLACK_BOX_SHOCK : BLACK_BOX_FREE_FALL, _event.timestamp);
+		}
+	});
+
+	// validation wants live data, replayed samples would repeat the log
+	m_Pipeline.SetCallback([this](const SensorSample& _sample, const FusedOrientation& _orientation)
+	{
+		if (m_Replaying)
+		{
+			return;
+		}
+		m_BlackBox.PushOrientation(_orientation);
+		const SensorShmOrientation shared = ToSharedOrientation(_orientation);
+		if (m_SharedMemory != nullptr)
+		{
+			SensorShmPublishOrientation(m_SharedMemory, &shared);
+		}
+		m_Telemetry.PushOrientation(shared);
+		if (m_ValidationSamples.size() < VALIDATION_SAMPLE_COUNT)
+		{
+			m_ValidationSamples.push_back(_sample);
+		}
+	});
+
+	m_Pipeline.GetSettings() = MakeStartupSettings();
+	m_Pipeline.ConfigureOversampling();
 }
 
 // Initialize the Direct3D resources required to run.
@@ -39,6 +246,32 @@ void Game::Initialize(IUnknown* window, int width, int height, DXGI_MODE_ROTATIO
     CreateDevice();
     CreateResources();
 
+	// logs go to the app local folder, the only writable place for a UWP app
+	const std::wstring localFolder = Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data();
+	m_LogPath = localFolder + L"\\sensor.log";
+	m_I2cTracePath = localFolder + L"\\i2c.trace";
+
+	// cheap enough to keep on, bus faults in the field come with the transactions that led to them
+	m_I2cTrace.Open(m_I2cTracePath.c_str(), I2C_TRACE_MAX_BYTES);
+
+	// before the acquisition starts pushing into it
+	BlackBoxSettings blackBox;
+	blackBox.sampleRate = SAMPLE_RATE;
+	m_BlackBox.Start((localFolder + L"\\blackbox-").c_str(), blackBox);
+	m_SharedMemory = SensorShmCreate(SENSOR_SHM_DEFAULT_NAME, SHARED_MEMORY_SLOTS, SHARED_MEMORY_SLOTS);
+	TelemetrySettings telemetry;
+	telemetry.bindAddress = FindPrivateNetworkAddress();
+	m_TelemetryFailed = !m_Telemetry.Start(telemetry);
+	strcpy_s(m_TelemetryAddress, telemetry.bindAddress.c_str());
+	m_TelemetryPort = telemetry.port;
+
+	// measure pipeline cost on this platform in background
+	m_BenchmarkTask = Concurrency::create_task([]() { return RunBenchmarks(); });
+	m_AccuracyTask = Concurrency::create_task([]() { return MeasureFastMathAccuracy(); });
+	m_FeatureTask = Concurrency::create_task([]() { return MeasureFeatures(); });
+
+	StartTimers();
+
 	auto initMPU6050Task = InitMPU6050();
 
 	initMPU6050Task.then([this](bool _i2cDeviceFound) {
@@ -48,72 +281,88 @@ void Game::Initialize(IUnknown* window, int width, int height, DXGI_MODE_ROTATIO
 			return;	// I2C device not found. Quit.
 		}
 
-		// start periodical timer
-		TimeSpan timerPeriod;
-		timerPeriod.Duration = 40 * 10000; // read MPU6050 accelerometer data every 40 mS
+		OpenMotionInterruptPin();
+		StartTimers();
 
-		unsigned char regAddrBuf[]{ 0x3B };	// MPU6050 read data register
-		unsigned char readBufChar[14];
+	});	// of initMPU6050Task 'then'
+}
 
-		m_ReadRegAddr = ref new Platform::Array<byte>(regAddrBuf, _countof(regAddrBuf));
-		m_ReadBuf = ref new Platform::Array<byte>(readBufChar, _countof(readBufChar));
+Game::~Game()
+{
+	StopTimers();
 
-		m_PeriodicTimer = Threading::ThreadPoolTimer::CreatePeriodicTimer(
-			ref new Threading::TimerElapsedHandler(
-				[this](Threading::ThreadPoolTimer ^timer)
-		{
-			if (m_I2cMPU6050Device)
-			{
+	// readers see the region closed and wait for the next publisher
+	SensorShmClose(m_SharedMemory);
+	m_SharedMemory = nullptr;
+}
 
-				try
-				{
-					// 1) read MPU6050 sensor datadata
-					m_I2cMPU6050Device->WriteRead(m_ReadRegAddr, m_ReadBuf);
-
-					// 2) calculatoins
-					short AccelerationRawX = (short)(m_ReadBuf[0] * 256);
-					AccelerationRawX += (m_ReadBuf[1]);
-					short AccelerationRawY = (short)(m_ReadBuf[2] * 256);
-					AccelerationRawY += m_ReadBuf[3];
-					short AccelerationRawZ = (short)(m_ReadBuf[4] * 256);
-					AccelerationRawZ += m_ReadBuf[5];
-
-					short GyroRawX = (short)(m_ReadBuf[8] * 256);
-					GyroRawX += (m_ReadBuf[9]);
-					short GyroRawY = (short)(m_ReadBuf[10] * 256);
-					GyroRawY += m_ReadBuf[11];
-					short GyroRawZ = (short)(m_ReadBuf[12] * 256);
-					GyroRawZ += m_ReadBuf[13];
-
-					// accelerometer
-					// Convert raw accelerometer values to G's
-					const int ACCEL_RES = 32767;	// MPU6050 accelerometer dynamic range = 16 bits signed
-					const int ACCEL_DYN_RANGE_G = 2;	// use +/- 2g mode (see register 0x1C)
-					const int UNITS_PER_G = ACCEL_RES / ACCEL_DYN_RANGE_G;
-
-					// normalize accelerometer values to +/- 1.0
-					float accelX, accelY, accelZ;
-					accelX = (float)AccelerationRawX / UNITS_PER_G;
-					accelY = (float)AccelerationRawY / UNITS_PER_G;
-					accelZ = (float)AccelerationRawZ / UNITS_PER_G;
-
-					// 3) store values to render data
-					m_AccelData.accelX = accelX;
-					m_AccelData.accelY = accelY;
-					m_AccelData.accelZ = accelZ;
-
-					m_AccelerometerReads += 1;
-				}
-				catch (...)
-				{
-				}
-			}
+// the spectrum transform off the render thread; once the device is found, the
+// FIFO drained every 20 mS
+void Game::StartTimers()
+{
+	std::lock_guard<std::mutex> lock(m_TimerMutex);
+	if (m_SpectrumTimer == 0)
+	{
+		m_SpectrumTimer = m_Clock.StartTimer(SPECTRUM_PERIOD_MS * TICKS_PER_MS, [this]() { m_Spectrum.ProcessPending(); });
+	}
+	if (m_AcquisitionTimer == 0 && m_I2cMPU6050Device)
+	{
+		m_AcquisitionTimer = m_Clock.StartTimer(FIFO_READ_PERIOD_MS * TICKS_PER_MS, [this]() { ReadFifoBurst(); });
+	}
+}
 
-		})
-			, timerPeriod
-		);	// of CreatePeriodicTimer
+void Game::StopTimers()
+{
+	std::lock_guard<std::mutex> lock(m_TimerMutex);
+	if (m_AcquisitionTimer != 0)
+	{
+		m_Clock.StopTimer(m_AcquisitionTimer);
+		m_AcquisitionTimer = 0;
+	}
+	if (m_SpectrumTimer != 0)
+	{
+		m_Clock.StopTimer(m_SpectrumTimer);
+		m_SpectrumTimer = 0;
+	}
+}
 
-	});	// of initMPU6050Task 'then'
+// acquisition timer
+void Game::ReadFifoBurst()
+{
+	// 1) and 2) the FIFO count, then every whole frame in one read
+	SensorSample samples[MPU6050_FIFO_MAX_FRAMES];
+	unsigned int frameCount = 0;
+	if (m_FifoReader.ReadBurst(m_Bus, m_Clock, samples, frameCount) == FIFO_BURST_BUS_ERROR)
+	{
+		// keep what led up to it, the dump waits for samples that may never come
+		m_BlackBox.Trigger(BLACK_BOX_ACQUISITION_ERROR, m_Clock.GetTicks());
+		return;
+	}
+
+	for (unsigned int i = 0; i < frameCount; ++i)
+	{
+		// 3) pass timestamped sample to fusion and to the unfiltered vibration spectrum
+		const SensorSample& sample = samples[i];
+		m_SampleQueue.Push(sample);
+		m_Spectrum.Push(sample);
+
+		// 4) motion events fire right here, not at the next frame
+		m_MotionDetector.ProcessSample(sample);
+
+		// 5) raw frames to the log, a no-op unless recording; the file is written on its own thread
+		m_LogWriter.Write(sample);
+		m_BlackBox.PushSample(sample);
+
+		// 6) to other processes and remote dashboards, stores into rings only
+		const SensorShmSample shared = ToSharedSample(sample);
+		if (m_SharedMemory != nullptr)
+		{
+			SensorShmPublishSample(m_SharedMemory, &shared);
+		}
+		m_Telemetry.PushSample(shared);
+	}
+
+	m_AccelerometerReads += frameCount;
 }
 
 // Executes the basic game loop.
@@ -134,12 +383,69 @@ void Game::Update(DX::StepTimer const& timer)
 {
     float elapsedTime = float(timer.GetElapsedSeconds());
 
-	// use MPU6050 accelerometer data in render
-	m_AngleRoll = m_AccelData.accelY;
-	m_AnglePitch = -m_AccelData.accelX;
+	if (m_Replaying && m_Replay.IsFinished())
+	{
+		StopReplay();
+	}
+
+	uint64_t now;
+	if (m_Replaying)
+	{
+		// live samples keep arriving, they are dropped while the log plays
+		SensorSample raw;
+		while (m_SampleQueue.Pop(raw))
+		{
+		}
+
+		// whole ticks per frame keep the replay independent of the frame timing
+		const uint64_t frameTicks = DX::StepTimer::SecondsToTicks(REPLAY_FRAME_SECONDS * m_ReplaySpeed);
+		m_Replay.AdvanceTo(m_Replay.GetTime() + frameTicks, m_Pipeline);
+		m_Pipeline.Flush();
+		now = m_Replay.GetTime();
+		elapsedTime = float(DX::StepTimer::TicksToSeconds(frameTicks));
+	}
+	else
+	{
+		// fuse all samples received since previous frame; the cost is wall time whatever m_Clock is
+		const uint64_t fusionStart = GetRealClock().GetTicks();
+		const uint64_t fusedBefore = m_Pipeline.GetFusedCount();
+
+		SensorSample raw;
+		while (m_SampleQueue.Pop(raw))
+		{
+			m_Pipeline.Push(raw);
+		}
+		m_Pipeline.Flush();
+
+		now = m_Clock.GetTicks();
+		const uint64_t fusedCount = m_Pipeline.GetFusedCount() - fusedBefore;
+		if (fusedCount > 0)
+		{
+			m_FusionTicks += GetRealClock().GetTicks() - fusionStart;
+			m_FusionUpdates += uint32(fusedCount);
+		}
+	}
+
+	// collect motion events for display
+	MotionEvent motionEvent;
+	while (m_MotionEvents.Pop(motionEvent) || m_InterruptEvents.Pop(motionEvent))
+	{
+		++m_MotionEventCounts[motionEvent.type];
+		m_LastMotionEvent = motionEvent;
+	}
+
+	// check fixed-point fusion against its reference once enough live data is captured
+	if (!m_ValidationStarted && m_ValidationSamples.size() == VALIDATION_SAMPLE_COUNT)
+	{
+		const FixedPointSettings fixedPointSettings = m_Pipeline.GetFixedPoint().GetSettings();
+		const InterpolatorSettings interpolatorSettings = m_Pipeline.GetSettings().interpolator;
+		m_ValidationTask = Concurrency::create_task([this, fixedPointSettings, interpolatorSettings]() { return ValidatePipeline(m_ValidationSamples, fixedPointSettings, interpolatorSettings); });
+		m_ValidationStarted = true;
+	}
 
-	// calculate model rotation matrix
-	m_world = Matrix::CreateFromYawPitchRoll(0.0f, m_AnglePitch, m_AngleRoll);
+	// fused orientation at the time this frame reaches the display, with tracked or zero heading
+	const Quaternion displayed = m_Pipeline.UpdateDisplay(now, elapsedTime);
+	m_world = Matrix::CreateFromQuaternion(SensorToModel(displayed));
 }
 
 
@@ -166,7 +472,7 @@ void Game::Render()
 	ImGui_ImplDX12_NewFrame(m_commandList.Get(), m_outputWidth, m_outputHeight);
 
 	constexpr float INFO_WINDOW_WIDTH = 260.0f;
-	constexpr float INFO_WINDOW_HEIGHT = 80.0f;
+	constexpr float INFO_WINDOW_HEIGHT = 120.0f;
 
 	// put debug window at center bottom position
 	ImGui::SetNextWindowPos(ImVec2((0) / 2, m_outputHeight - INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
@@ -175,17 +481,164 @@ void Game::Render()
 	// put data to display
 	ImGui::Begin("Performance");
 	ImGui::Text("FPS=%.1f", ImGui::GetIO().Framerate);
-	ImGui::Text("Accel reads/sec %.1f", float(m_AccelerometerReads / m_timer.GetTotalSeconds()));
+	ImGui::Text("Samples/sec %.1f (sensor clock %.1f Hz)", float(m_AccelerometerReads / m_timer.GetTotalSeconds()), float(m_FifoReader.GetTimeline().GetMeasuredRate()));
+	if (m_FifoReader.GetOverflowCount() > 0)
+	{
+		ImGui::Text("FIFO overflows %u", m_FifoReader.GetOverflowCount());
+	}
+	if (m_FusionUpdates > 0)
+	{
+		ImGui::Text("Fusion %.2f us/update", float(DX::StepTimer::TicksToSeconds(m_FusionTicks) * 1e6 / m_FusionUpdates));
+	}
+	if (m_BenchmarkTask.is_done())
+	{
+		for (const BenchmarkResult& result : m_BenchmarkTask.get())
+		{
+			ImGui::Text("%s (%s) %.0f ns", result.name, GetTargetArchitecture(), result.nanosecondsPerIteration);
+		}
+	}
+	if (m_AccuracyTask.is_done())
+	{
+		for (const ApproximationAccuracy& accuracy : m_AccuracyTask.get())
+		{
+			const ImVec4 color = (accuracy.maxError <= accuracy.bound) ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+			ImGui::TextColored(color, "%s max err %.1e (bound %.1e)", accuracy.name, accuracy.maxError, accuracy.bound);
+		}
+	}
+	if (m_FeatureTask.is_done())
+	{
+		for (const FeatureMeasurement& measurement : m_FeatureTask.get())
+		{
+			ImGui::Text("%s %.3g %s", measurement.name, measurement.value, measurement.unit);
+		}
+	}
+	if (m_ValidationStarted && m_ValidationTask.is_done())
+	{
+		const PipelineValidation& validation = m_ValidationTask.get();
+		ImGui::Text("Fixed-point: %u mismatches, max err %.2f deg", validation.fixedPoint.mismatchCount, validation.fixedPoint.maxErrorDegrees);
+		ImGui::Text("Display err %.2f deg (max %.2f, hold %.2f)", validation.interpolation.meanDegrees, validation.interpolation.maxDegrees, validation.interpolation.holdMeanDegrees);
+	}
 	ImGui::End();
 
 	// put debug window at center bottom position
-	ImGui::SetNextWindowPos(ImVec2(m_outputWidth - INFO_WINDOW_WIDTH, m_outputHeight - INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
-	ImGui::SetNextWindowSize(ImVec2(INFO_WINDOW_WIDTH, INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowPos(ImVec2(m_outputWidth - INFO_WINDOW_WIDTH, m_outputHeight - 2.0f * INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(INFO_WINDOW_WIDTH, 2.0f * INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+
+	// pipeline settings are edited in place, changes that need a reconfiguration say so
+	PipelineSettings& settings = m_Pipeline.GetSettings();
+	HeadingTracker& heading = m_Pipeline.GetHeading();
 
 	// put data to display
-	ImGui::Begin("Accelerometer");
-	ImGui::SliderFloat("Roll angle", &m_AngleRoll, -1.0f, 1.0f);
-	ImGui::SliderFloat("Pitch angle", &m_AnglePitch, -1.0f, 1.0f);
+	if (ImGui::Begin("Accelerometer"))
+	{
+		if (ImGui::Combo("Fusion", &settings.fusionEngine, "Kalman\0Fixed-point\0"))
+		{
+			m_Pipeline.ResetFusion();
+		}
+
+		// Euler angles are only for display, skip the conversion while the panel is collapsed
+		float roll, pitch, yaw;
+		QuaternionToEuler(m_Pipeline.GetDisplayOrientation(), roll, pitch, yaw);
+		ImGui::SliderFloat("Roll angle", &roll, -XM_PI, XM_PI);
+		ImGui::SliderFloat("Pitch angle", &pitch, -XM_PIDIV2, XM_PIDIV2);
+		ImGui::SliderFloat("Yaw angle", &yaw, -XM_PI, XM_PI);
+		ImGui::Checkbox("Track yaw", &settings.heading.enabled);
+		ImGui::SameLine();
+		ImGui::Checkbox("Hold when still", &settings.heading.zeroRateHold);
+		if (ImGui::Button("Reset yaw"))
+		{
+			heading.ResetHeading();
+		}
+		ImGui::SameLine();
+		ImGui::Text("%s, Z bias %.3f deg/s", heading.IsStationary() ? "still" : "moving", XMConvertToDegrees(heading.GetGyroBias()[2]));
+		ImGui::Text("Sigma X %.2f Y %.2f deg", XMConvertToDegrees(sqrtf(m_Pipeline.GetOrientation().attitudeVariance[0])), XMConvertToDegrees(sqrtf(m_Pipeline.GetOrientation().attitudeVariance[1])));
+
+		ImGui::Text("Taps %u  Falls %u  Shocks %u  Wakes %u", m_MotionEventCounts[MOTION_TAP], m_MotionEventCounts[MOTION_FREE_FALL], m_MotionEventCounts[MOTION_SHOCK],
+			m_MotionEventCounts[MOTION_WAKE]);
+		if (m_LastMotionEvent.timestamp != 0)
+		{
+			static const char* const EVENT_NAMES[MOTION_EVENT_TYPE_COUNT] = { "Tap", "Free-fall", "Shock", "Wake" };
+			const double age = DX::StepTimer::TicksToSeconds(m_Clock.GetTicks() - m_LastMotionEvent.timestamp);
+			const ImVec4 color = (age < MOTION_ALERT_SECONDS) ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f) : ImVec4(0.7f, 0.7f, 0.7f, 1.0f);
+			ImGui::TextColored(color, "%s%s %.2f, %.1f s ago", EVENT_NAMES[m_LastMotionEvent.type], m_LastMotionEvent.hardware ? " (INT)" : "", m_LastMotionEvent.magnitude, age);
+		}
+	}
+	ImGui::End();
+
+	RenderSpectrum();
+	RenderNoiseAnalysis();
+
+	// put display settings window at top right position
+	ImGui::SetNextWindowPos(ImVec2(m_outputWidth - INFO_WINDOW_WIDTH, 0.0f), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(INFO_WINDOW_WIDTH, 2.0f * INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+
+	ImGui::Begin("Display");
+	ImGui::SliderFloat("Delay ms", &settings.interpolator.delayMs, 0.0f, 100.0f, "%.0f");
+	ImGui::SliderFloat("Latency ms", &settings.interpolator.latencyMs, 0.0f, 50.0f, "%.0f");
+	ImGui::SliderFloat("Predict max ms", &settings.interpolator.maxExtrapolationMs, 0.0f, 100.0f, "%.0f");
+	ImGui::Checkbox("Smoothing", &settings.displaySmoothing.enabled);
+	ImGui::SliderFloat("Min cutoff Hz", &settings.displaySmoothing.minCutoffHz, 0.05f, 10.0f, "%.2f", 2.0f);
+	ImGui::SliderFloat("Beta", &settings.displaySmoothing.beta, 0.0f, 10.0f, "%.2f");
+	ImGui::SliderFloat("Speed cutoff Hz", &settings.displaySmoothing.derivativeCutoffHz, 0.1f, 10.0f, "%.1f");
+	if (settings.displaySmoothing.enabled)
+	{
+		const float* cutoff = m_Pipeline.GetDisplaySmoothing().GetCutoffHz();
+		ImGui::Text("Cutoff %.1f %.1f %.1f Hz", cutoff[0], cutoff[1], cutoff[2]);
+	}
+	ImGui::End();
+
+	// put vibration filter window under the display settings
+	ImGui::SetNextWindowPos(ImVec2(m_outputWidth - INFO_WINDOW_WIDTH, 2.0f * INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(INFO_WINDOW_WIDTH, 3.0f * INFO_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+
+	if (ImGui::Begin("Filters"))
+	{
+		ImGui::Text("Oversampling");
+		bool oversamplingChanged = ImGui::SliderInt("Decimate 2^n", &settings.oversamplingShift, 0, CicDecimator::MAX_DECIMATION_SHIFT);
+		oversamplingChanged |= ImGui::SliderInt("CIC order", &settings.oversamplingOrder, 1, CicDecimator::MAX_ORDER);
+		if (oversamplingChanged)
+		{
+			m_Pipeline.ConfigureOversampling();
+		}
+		ImGui::Text("Fusion %.1f Hz, CIC delay %.1f ms", m_Pipeline.GetFusionRate(), m_Pipeline.GetOversampler().GetDelaySamples() * 1000.0f / SAMPLE_RATE);
+		const NoiseFloorMeter& rawNoise = m_Pipeline.GetRawNoise();
+		const NoiseFloorMeter& decimatedNoise = m_Pipeline.GetDecimatedNoise();
+		if (rawNoise.HasEstimate() && decimatedNoise.HasEstimate())
+		{
+			// Z accel and X gyro, noise RMS at the sample rate and white noise density
+			const float* raw = rawNoise.GetRms();
+			const float* decimated = decimatedNoise.GetRms();
+			ImGui::Text("Accel %.2f -> %.2f mg (%.0f -> %.0f ug/rtHz)", raw[2] * 1e3f, decimated[2] * 1e3f,
+				rawNoise.GetDensity(2) * 1e6f, decimatedNoise.GetDensity(2) * 1e6f);
+			ImGui::Text("Gyro %.3f -> %.3f dps (%.4f -> %.4f dps/rtHz)", raw[3], decimated[3],
+				rawNoise.GetDensity(3), decimatedNoise.GetDensity(3));
+		}
+
+		const float nyquist = 0.5f * m_Pipeline.GetFusionRate();
+		bool changed = ImGui::Checkbox("Enabled", &settings.filtersEnabled);
+
+		ImGui::Text("Accel");
+		changed |= ImGui::SliderFloat("Notch Hz##accel", &settings.accelFilter.notchHz, 0.0f, nyquist, "%.1f");
+		changed |= ImGui::SliderFloat("Notch Q##accel", &settings.accelFilter.notchQ, 0.5f, 20.0f, "%.1f");
+		changed |= ImGui::SliderFloat("Lowpass Hz##accel", &settings.accelFilter.lowpassHz, 0.0f, nyquist, "%.1f");
+		changed |= ImGui::SliderInt("FIR taps##accel", &settings.accelFilter.firTaps, 0, FilterBank::MAX_FIR_TAPS);
+
+		ImGui::Text("Gyro");
+		changed |= ImGui::SliderFloat("Notch Hz##gyro", &settings.gyroFilter.notchHz, 0.0f, nyquist, "%.1f");
+		changed |= ImGui::SliderFloat("Notch Q##gyro", &settings.gyroFilter.notchQ, 0.5f, 20.0f, "%.1f");
+		changed |= ImGui::SliderFloat("Lowpass Hz##gyro", &settings.gyroFilter.lowpassHz, 0.0f, nyquist, "%.1f");
+		changed |= ImGui::SliderInt("FIR taps##gyro", &settings.gyroFilter.firTaps, 0, FilterBank::MAX_FIR_TAPS);
+
+		ImGui::Text("Kalman accel correction");
+		changed |= ImGui::SliderInt("1 in N samples", &settings.correctionDecimation, 1, DecimatingFir::MAX_TAPS / CORRECTION_FIR_TAPS_PER_PHASE);
+
+		if (changed)
+		{
+			m_Pipeline.ConfigureFilters();
+		}
+		ImGui::Text("%d sections, %d FIR taps per channel", m_Pipeline.GetFilterBank().GetSectionCount(), m_Pipeline.GetFilterBank().GetFirTapCount());
+		ImGui::Text("Correction %.0f Hz, anti-alias delay %.1f ms", m_Pipeline.GetFusionRate() / settings.correctionDecimation, m_Pipeline.GetCorrectionDecimator().GetDelaySeconds() * 1000.0f);
+	}
 	ImGui::End();
 
 	// render debug window
@@ -198,6 +651,634 @@ void Game::Render()
 	m_graphicsMemory->Commit(m_commandQueue.Get());
 }
 
+// scrolling spectrogram (newest frame on top) and peak list, left of the accelerometer panel
+void Game::RenderSpectrum()
+{
+	constexpr float SPECTRUM_WINDOW_WIDTH = 300.0f;
+	constexpr float SPECTRUM_WINDOW_HEIGHT = 260.0f;
+	constexpr float SPECTROGRAM_HEIGHT = 128.0f;
+
+	ImGui::SetNextWindowPos(ImVec2(m_outputWidth - 260.0f - SPECTRUM_WINDOW_WIDTH, m_outputHeight - SPECTRUM_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(SPECTRUM_WINDOW_WIDTH, SPECTRUM_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+
+	if (ImGui::Begin("Spectrum"))
+	{
+		ImGui::Combo("Axis", &m_SpectrumAxis, "X\0Y\0Z\0");
+
+		const SpectrumSnapshot& snapshot = m_Spectrum.GetSnapshot();
+		if (snapshot.frameCount == 0)
+		{
+			ImGui::Text("Waiting for %d samples", SPECTRUM_FFT_SIZE);
+		}
+		else
+		{
+			const ImVec2 origin = ImGui::GetCursorScreenPos();
+			const float width = ImGui::GetContentRegionAvail().x;
+			const float cellWidth = width / SPECTRUM_BIN_COUNT;
+			const float cellHeight = SPECTROGRAM_HEIGHT / SPECTRUM_HISTORY;
+			const int rowCount = std::min<int>(snapshot.frameCount, SPECTRUM_HISTORY);
+
+			ImDrawList* drawList = ImGui::GetWindowDrawList();
+			for (int age = 0; age < rowCount; ++age)
+			{
+				const float* amplitude = snapshot.amplitude[(snapshot.newestRow + SPECTRUM_HISTORY - age) % SPECTRUM_HISTORY][m_SpectrumAxis];
+				const float top = origin.y + age * cellHeight;
+				for (int k = 0; k < SPECTRUM_BIN_COUNT; ++k)
+				{
+					// dB mapped from blue (floor) to red (1 g)
+					const float db = 20.0f * log10f(std::max(amplitude[k], 1e-6f));
+					const float level = std::min(std::max(1.0f - db / SPECTRUM_FLOOR_DB, 0.0f), 1.0f);
+					const float left = origin.x + k * cellWidth;
+					drawList->AddRectFilled(ImVec2(left, top), ImVec2(left + cellWidth, top + cellHeight), ImColor::HSV(0.66f * (1.0f - level), 1.0f, level));
+				}
+			}
+			ImGui::Dummy(ImVec2(width, SPECTROGRAM_HEIGHT));
+
+			ImGui::Text("0 .. %.1f Hz, %.1f Hz/bin", 0.5f * snapshot.sampleRate, snapshot.sampleRate / SPECTRUM_FFT_SIZE);
+			for (int p = 0; p < SPECTRUM_PEAK_COUNT; ++p)
+			{
+				const SpectrumPeak& peak = snapshot.peaks[m_SpectrumAxis][p];
+				if (peak.amplitude > 0.0f)
+				{
+					ImGui::Text("%5.2f Hz  %6.1f mg", peak.frequency, peak.amplitude * 1000.0f);
+				}
+			}
+		}
+		if (m_Spectrum.GetDroppedCount() > 0)
+		{
+			ImGui::Text("%u samples dropped", m_Spectrum.GetDroppedCount());
+		}
+	}
+	ImGui::End();
+}
+
+// record a stationary log and show its Allan deviation as table and log-log plot
+void Game::RenderNoiseAnalysis()
+{
+	constexpr float NOISE_WINDOW_WIDTH = 420.0f;
+	constexpr float NOISE_WINDOW_HEIGHT = 420.0f;
+	constexpr float PLOT_HEIGHT = 200.0f;
+
+	ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f), ImGuiSetCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(NOISE_WINDOW_WIDTH, NOISE_WINDOW_HEIGHT), ImGuiSetCond_FirstUseEver);
+
+	if (!ImGui::Begin("Noise analysis"))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (ImGui::Checkbox("Record stationary log", &m_Recording))
+	{
+		m_Recording = m_Recording && m_LogWriter.Open(m_LogPath.c_str());
+		if (!m_Recording)
+		{
+			m_LogWriter.Close();
+		}
+	}
+	ImGui::Text("%llu samples recorded, %u chunks written", (unsigned long long)m_LogWriter.GetSampleCount(), m_LogWriter.GetChunkCount());
+	if (m_LogWriter.GetChunkCount() > 0)
+	{
+		ImGui::Text("%.1f bytes per sample on disk", double(m_LogWriter.GetWrittenSize()) / double(m_LogWriter.GetSampleCount()));
+	}
+	if (m_LogWriter.GetDroppedCount() > 0 || m_LogWriter.HasWriteError())
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%u samples dropped%s", m_LogWriter.GetDroppedCount(), m_LogWriter.HasWriteError() ? ", write error" : "");
+	}
+
+	// recording stays raw, packing is for keeping a finished log
+	const bool packRunning = m_PackStarted && !m_PackTask.is_done();
+	if (!packRunning && ImGui::Button("Pack log"))
+	{
+		m_Recording = false;
+		m_LogWriter.Close();
+
+		const std::wstring path = m_LogPath;
+		m_PackTask = Concurrency::create_task([path]()
+		{
+			SensorLogPackResult result;
+			if (!PackSensorLog(path.c_str(), (path + L".packed").c_str(), result))
+			{
+				result.packedSize = 0;
+			}
+			return result;
+		});
+		m_PackStarted = true;
+	}
+	if (packRunning)
+	{
+		ImGui::Text("Packing...");
+	}
+	if (m_PackStarted && m_PackTask.is_done())
+	{
+		const SensorLogPackResult& result = m_PackTask.get();
+		if (result.packedSize == 0)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Log could not be packed");
+		}
+		else
+		{
+			ImGui::SameLine();
+			ImGui::Text("%llu samples, %.1f MB to %.1f MB (%.2fx)", (unsigned long long)result.sampleCount,
+				result.sourceSize / 1e6, result.packedSize / 1e6, double(result.sourceSize) / double(result.packedSize));
+		}
+	}
+
+	const bool allanRunning = m_AllanStarted && !m_AllanTask.is_done();
+	if (!allanRunning && ImGui::Button("Allan deviation"))
+	{
+		// the log is memory mapped by the analysis, finish writing it first
+		m_Recording = false;
+		m_LogWriter.Close();
+
+		const std::wstring path = m_LogPath;
+		m_AllanTask = Concurrency::create_task([path]()
+		{
+			MappedSensorLog log;
+			log.Open(path.c_str());
+
+			WorkStealingPool pool;
+			const AllanResult result = ComputeAllanDeviation(log, MPU6050_I2C_ADDRESS, pool);
+
+			FILE* table = nullptr;
+			if (result.sampleCount > 0 && _wfopen_s(&table, (path + L".allan.txt").c_str(), L"w") == 0)
+			{
+				WriteAllanTable(result, table);
+				fclose(table);
+			}
+			return result;
+		});
+		m_AllanStarted = true;
+	}
+	if (allanRunning)
+	{
+		ImGui::Text("Analyzing...");
+	}
+
+	RenderFilterTuning();
+	RenderReplay();
+	RenderColumnarExport();
+	RenderLogCheck();
+	RenderBusTrace();
+	RenderBlackBox();
+	RenderTelemetry();
+
+	if (m_AllanStarted && m_AllanTask.is_done())
+	{
+		const AllanResult& result = m_AllanTask.get();
+		if (result.points.empty())
+		{
+			ImGui::Text("Log is missing or too short");
+		}
+		else
+		{
+			// decade bounds of both axes
+			double minDeviation = 1e30, maxDeviation = 0.0;
+			for (const AllanPoint& point : result.points)
+			{
+				for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+				{
+					if (point.deviation[channel] > 0.0)
+					{
+						minDeviation = std::min(minDeviation, point.deviation[channel]);
+						maxDeviation = std::max(maxDeviation, point.deviation[channel]);
+					}
+				}
+			}
+			const float tauMin = floorf(log10f(float(result.points.front().tau)));
+			const float tauMax = std::max(ceilf(log10f(float(result.points.back().tau))), tauMin + 1.0f);
+			const float deviationMin = floorf(log10f(float(minDeviation)));
+			const float deviationMax = std::max(ceilf(log10f(float(maxDeviation))), deviationMin + 1.0f);
+
+			const ImVec2 origin = ImGui::GetCursorScreenPos();
+			const float width = ImGui::GetContentRegionAvail().x;
+			auto toScreen = [&](double _tau, double _deviation)
+			{
+				return ImVec2(
+					origin.x + (log10f(float(_tau)) - tauMin) / (tauMax - tauMin) * width,
+					origin.y + (deviationMax - log10f(float(_deviation))) / (deviationMax - deviationMin) * PLOT_HEIGHT);
+			};
+
+			ImDrawList* drawList = ImGui::GetWindowDrawList();
+			const ImU32 gridColor = ImColor(0.4f, 0.4f, 0.4f, 1.0f);
+			for (float decade = tauMin; decade <= tauMax; decade += 1.0f)
+			{
+				const float x = toScreen(pow(10.0, decade), 1.0).x;
+				drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + PLOT_HEIGHT), gridColor);
+			}
+			for (float decade = deviationMin; decade <= deviationMax; decade += 1.0f)
+			{
+				const float y = toScreen(1.0, pow(10.0, decade)).y;
+				drawList->AddLine(ImVec2(origin.x, y), ImVec2(origin.x + width, y), gridColor);
+			}
+
+			for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+			{
+				const ImU32 color = ImColor::HSV(channel / float(IMU_CHANNEL_COUNT), 0.8f, 1.0f);
+				for (size_t i = 1; i < result.points.size(); ++i)
+				{
+					const AllanPoint& a = result.points[i - 1];
+					const AllanPoint& b = result.points[i];
+					if (a.deviation[channel] > 0.0 && b.deviation[channel] > 0.0)
+					{
+						drawList->AddLine(toScreen(a.tau, a.deviation[channel]), toScreen(b.tau, b.deviation[channel]), color);
+					}
+				}
+			}
+			ImGui::Dummy(ImVec2(width, PLOT_HEIGHT));
+			ImGui::Text("tau 1e%.0f .. 1e%.0f s, deviation 1e%.0f .. 1e%.0f", tauMin, tauMax, deviationMin, deviationMax);
+
+			// legend with the noise parameters, then the full table
+			for (int channel = 0; channel < IMU_CHANNEL_COUNT; ++channel)
+			{
+				ImGui::TextColored(ImColor::HSV(channel / float(IMU_CHANNEL_COUNT), 0.8f, 1.0f), "%-8s RW %.3g  BI %.3g",
+					ALLAN_CHANNEL_NAMES[channel], result.randomWalk[channel], result.biasInstability[channel]);
+			}
+			ImGui::Text("%8s %9s %9s %9s %9s %9s %9s", "tau", "ax", "ay", "az", "gx", "gy", "gz");
+			for (const AllanPoint& point : result.points)
+			{
+				ImGui::Text("%8.3g %9.3g %9.3g %9.3g %9.3g %9.3g %9.3g", point.tau,
+					point.deviation[0], point.deviation[1], point.deviation[2], point.deviation[3], point.deviation[4], point.deviation[5]);
+			}
+		}
+	}
+
+	ImGui::End();
+}
+
+// replay the log through both fusion engines and offer the best parameters
+void Game::RenderFilterTuning()
+{
+	const bool tuningRunning = m_TuningStarted && !m_TuningTask.is_done();
+	if (!tuningRunning && ImGui::Button("Tune filters"))
+	{
+		m_Recording = false;
+		m_LogWriter.Close();
+
+		const std::wstring path = m_LogPath;
+		m_TuningTask = Concurrency::create_task([path]()
+		{
+			MappedSensorLog log;
+			log.Open(path.c_str());
+
+			WorkStealingPool pool;
+			return TuneFilters(log, pool);
+		});
+		m_TuningStarted = true;
+	}
+	if (tuningRunning)
+	{
+		ImGui::Text("Tuning...");
+	}
+	if (!m_TuningStarted || !m_TuningTask.is_done())
+	{
+		return;
+	}
+
+	const TuningReport& report = m_TuningTask.get();
+	if (report.devices.empty())
+	{
+		ImGui::Text("Log is missing or empty");
+		return;
+	}
+
+	for (const DeviceTuning& device : report.devices)
+	{
+		ImGui::Text("Device 0x%02X: %u candidates, %.0fx real time", device.deviceId, device.candidateCount,
+			device.logSeconds * device.candidateCount / std::max(report.replaySeconds, 1e-3));
+
+		const TuningCandidate& kalman = device.best[FUSION_KALMAN];
+		const TuningCandidate& fixedPoint = device.best[FUSION_FIXED_POINT];
+		ImGui::Text(" Kalman gyro %.2g accel %.2g: jitter %.3f static %.3f deg (was %.3f)", kalman.kalman.gyroNoiseDensity, kalman.kalman.accelNoise,
+			kalman.cost.jitterDegrees, kalman.cost.staticDegrees, device.defaults[FUSION_KALMAN].cost.total);
+		ImGui::Text(" Fixed-point weight %.4f: jitter %.3f static %.3f deg (was %.3f)", Q16ToFloat(fixedPoint.fixedPoint.accelWeight),
+			fixedPoint.cost.jitterDegrees, fixedPoint.cost.staticDegrees, device.defaults[FUSION_FIXED_POINT].cost.total);
+
+		if (device.deviceId == MPU6050_I2C_ADDRESS && ImGui::Button("Apply"))
+		{
+			// tuned on the raw samples of the log, at their rate
+			m_Pipeline.SetFusionSettings(kalman.kalman, fixedPoint.fixedPoint, float((device.sampleCount - 1) / std::max(device.logSeconds, 1e-3)));
+		}
+	}
+}
+
+// play the log through the pipeline in place of the live samples, and check replays against the golden digest
+void Game::RenderReplay()
+{
+	bool replaying = m_Replaying;
+	if (ImGui::Checkbox("Replay log", &replaying))
+	{
+		if (replaying)
+		{
+			m_Recording = false;
+			m_LogWriter.Close();
+
+			m_Replaying = m_Replay.Open(m_LogPath.c_str(), MPU6050_I2C_ADDRESS, FIFO_READ_PERIOD_MS / 1000.0);
+			if (m_Replaying)
+			{
+				m_Pipeline.Reset();
+			}
+		}
+		else
+		{
+			StopReplay();
+		}
+	}
+	ImGui::SameLine();
+	ImGui::SliderFloat("Speed", &m_ReplaySpeed, 0.25f, REPLAY_MAX_SPEED, "%.2fx", 2.0f);
+	if (m_Replaying)
+	{
+		ImGui::Text("%.1f of %.1f s, %llu samples", DX::StepTimer::TicksToSeconds(m_Replay.GetTime() - m_Replay.GetStartTime()),
+			DX::StepTimer::TicksToSeconds(m_Replay.GetEndTime() - m_Replay.GetStartTime()), (unsigned long long)m_Replay.GetSampleCount());
+	}
+
+	const bool checkRunning = m_ReplayCheckStarted && !m_ReplayCheckTask.is_done();
+	if (!checkRunning && ImGui::Button("Check replay"))
+	{
+		m_Recording = false;
+		m_LogWriter.Close();
+
+		// an unpaced run with the startup settings against the golden digest of the log
+		const std::wstring path = m_LogPath;
+		m_ReplayCheckTask = Concurrency::create_task([path]()
+		{
+			ReplaySettings replay;
+			replay.burstPeriod = FIFO_READ_PERIOD_MS / 1000.0;
+			replay.deviceId = MPU6050_I2C_ADDRESS;
+
+			ReplayGoldenCheck check;
+			CheckReplayGolden(path.c_str(), MakeStartupSettings(), replay, check);
+			return check;
+		});
+		m_ReplayCheckStarted = true;
+	}
+	if (checkRunning)
+	{
+		ImGui::Text("Replaying...");
+	}
+	if (m_ReplayCheckStarted && m_ReplayCheckTask.is_done())
+	{
+		const ReplayGoldenCheck& check = m_ReplayCheckTask.get();
+		const ReplayResult& result = check.result;
+		if (!check.replayed)
+		{
+			ImGui::Text("Log is missing or empty");
+		}
+		else if (check.goldenSaved)
+		{
+			ImGui::Text("%llu frames, %.0fx real time, saved as the golden digest",
+				(unsigned long long)result.frameCount, result.virtualSeconds / std::max(result.wallSeconds, 1e-6));
+		}
+		else
+		{
+			ImGui::TextColored(check.matches ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%llu frames, %.0fx real time, %s",
+				(unsigned long long)result.frameCount, result.virtualSeconds / std::max(result.wallSeconds, 1e-6),
+				check.matches ? "matches the golden digest" : "differs from the golden digest");
+			if (!check.matches)
+			{
+				ImGui::SameLine();
+				if (ImGui::Button("Make golden"))
+				{
+					// written off the render thread like the check, shown as saved once it is on disk
+					const std::wstring path = m_LogPath;
+					ReplayGoldenCheck saved = check;
+					m_ReplayCheckTask = Concurrency::create_task([path, saved]() mutable
+					{
+						saved.goldenSaved = SaveReplayGolden(path.c_str(), saved.result);
+						return saved;
+					});
+				}
+			}
+		}
+	}
+}
+
+// the log next to itself as a columnar file, statistics per block for analytics tools
+void Game::RenderColumnarExport()
+{
+	const bool exportRunning = m_ExportStarted && !m_ExportTask.is_done();
+	if (!exportRunning && ImGui::Button("Export columnar"))
+	{
+		m_Recording = false;
+		m_LogWriter.Close();
+
+		const std::vector<std::wstring> paths(1, m_LogPath);
+		ColumnarExportSettings settings;
+		settings.pipeline = m_Pipeline.GetSettings();
+		m_ExportTask = Concurrency::create_task([paths, settings]()
+		{
+			WorkStealingPool pool;
+			return ExportColumnar(paths, settings, pool);
+		});
+		m_ExportStarted = true;
+	}
+	if (exportRunning)
+	{
+		ImGui::Text("Exporting...");
+	}
+	if (m_ExportStarted && m_ExportTask.is_done())
+	{
+		const ColumnarExportResult& result = m_ExportTask.get().front();
+		if (!result.succeeded)
+		{
+			ImGui::Text("Log is missing or empty");
+		}
+		else
+		{
+			ImGui::Text("%llu rows in %u blocks, %.1f MB in %.2f s", (unsigned long long)result.rowCount, result.blockCount,
+				result.fileSize / 1e6, result.wallSeconds);
+		}
+	}
+}
+
+// round trip and damage recovery of the log, and its cost on the acquisition thread
+void Game::RenderLogCheck()
+{
+	const bool checkRunning = m_LogCheckStarted && !m_LogCheckTask.is_done();
+	if (!checkRunning && ImGui::Button("Check log"))
+	{
+		const std::wstring path = m_LogPath + L".check";
+		m_LogCheckTask = Concurrency::create_task([path]()
+		{
+			SensorLogCheckResult result;
+			CheckSensorLog(path.c_str(), SensorLogCheckSettings(), result);
+			return result;
+		});
+		m_LogCheckStarted = true;
+	}
+	if (checkRunning)
+	{
+		ImGui::Text("Checking...");
+	}
+	if (m_LogCheckStarted && m_LogCheckTask.is_done())
+	{
+		const SensorLogCheckResult& result = m_LogCheckTask.get();
+		if (!result.succeeded)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Check log could not be written or read");
+		}
+		else
+		{
+			const bool passed = result.mismatchCount == 0 && result.lostSamples == result.expectedLostSamples && result.expectedLostSamples > 0
+				&& result.unverifiedIndexRebuilt && result.packedFileSize > 0 && result.packedMismatchCount == 0;
+			ImGui::TextColored(passed ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f),
+				"%llu samples, %llu mismatched, damaged copy lost %llu of %llu expected in %u chunks",
+				(unsigned long long)result.sampleCount, (unsigned long long)result.mismatchCount,
+				(unsigned long long)result.lostSamples, (unsigned long long)result.expectedLostSamples, result.damagedChunks);
+			ImGui::Text("Write %.0f ns per sample, %.1f bytes per sample on disk", result.producerNanoseconds, double(result.fileSize) / double(result.sampleCount));
+			ImGui::Text("Index built in %.2f ms, reopened in %.3f ms%s; seek %.1f us, %.1f ns per record iterated",
+				result.indexBuildSeconds * 1e3, result.indexLoadSeconds * 1e3, result.unverifiedIndexRebuilt ? "" : " (unverified index taken)",
+				result.seekNanoseconds * 1e-3, result.iterateNanoseconds);
+			ImGui::Text("Packed offline: %.1f bytes per sample, %llu mismatched", double(result.packedFileSize) / double(result.sampleCount),
+				(unsigned long long)result.packedMismatchCount);
+		}
+	}
+}
+
+// where dashboards connect; UWP blocks inbound loopback from other processes
+void Game::RenderTelemetry()
+{
+	ImGui::InputText("Telemetry address", m_TelemetryAddress, sizeof(m_TelemetryAddress));
+	ImGui::SameLine();
+	ImGui::PushItemWidth(100.0f);
+	ImGui::InputInt("Port", &m_TelemetryPort, 0);
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	if (ImGui::Button("Listen"))
+	{
+		TelemetrySettings settings;
+		settings.bindAddress = m_TelemetryAddress;
+		settings.port = uint16_t(std::min(std::max(m_TelemetryPort, 0), 65535));
+		m_TelemetryFailed = !m_Telemetry.Start(settings);
+	}
+
+	if (m_Telemetry.IsStarted())
+	{
+		ImGui::Text("Telemetry on %s:%u: %u clients, %.1f MB sent, %llu dropped", m_Telemetry.GetSettings().bindAddress.c_str(), m_Telemetry.GetPort(),
+			m_Telemetry.GetClientCount(), m_Telemetry.GetSentBytes() / 1e6, (unsigned long long)m_Telemetry.GetDroppedCount());
+	}
+	else if (m_TelemetryFailed)
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Telemetry could not listen on that address and port");
+	}
+}
+
+// the I2C trace and the FIFO acquisition replayed from it, transaction by transaction
+void Game::RenderBusTrace()
+{
+	bool tracing = m_I2cTrace.IsOpen();
+	if (ImGui::Checkbox("Trace I2C", &tracing))
+	{
+		if (tracing)
+		{
+			m_I2cTrace.Open(m_I2cTracePath.c_str(), I2C_TRACE_MAX_BYTES);
+		}
+		else
+		{
+			m_I2cTrace.Close();
+		}
+	}
+	ImGui::SameLine();
+	ImGui::Text("%llu transactions, %.1f MB%s", (unsigned long long)m_I2cTrace.GetRecordCount(), m_I2cTrace.GetWrittenSize() / 1e6,
+		m_I2cTrace.HasWriteError() ? ", write error" : "");
+
+	const bool replayRunning = m_BusReplayStarted && !m_BusReplayTask.is_done();
+	if (!replayRunning && ImGui::Button("Replay bus trace"))
+	{
+		// the trace is memory mapped by the replay, finish writing it first
+		m_I2cTrace.Close();
+
+		const std::wstring path = m_I2cTracePath;
+		m_BusReplayTask = Concurrency::create_task([path]()
+		{
+			BusReplayResult result = {};
+			ReplayBusTrace(path.c_str(), SAMPLE_RATE, result);
+			return result;
+		});
+		m_BusReplayStarted = true;
+	}
+	if (replayRunning)
+	{
+		ImGui::Text("Replaying...");
+	}
+	if (m_BusReplayStarted && m_BusReplayTask.is_done())
+	{
+		const BusReplayResult& result = m_BusReplayTask.get();
+		if (result.transactionCount == 0)
+		{
+			ImGui::Text("Trace is missing or empty");
+		}
+		else
+		{
+			ImGui::Text("%llu bursts, %llu samples, %u bus errors, %u overflows", (unsigned long long)result.burstCount,
+				(unsigned long long)result.sampleCount, result.busErrorCount, result.overflowCount);
+			ImGui::TextColored(result.divergedCount == 0 ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%llu transactions, %llu diverged",
+				(unsigned long long)result.transactionCount, (unsigned long long)result.divergedCount);
+		}
+	}
+
+	// the trace and its replay on a simulated sensor, and what tracing costs a transaction
+	const bool checkRunning = m_BusTraceCheckStarted && !m_BusTraceCheckTask.is_done();
+	if (!checkRunning && ImGui::Button("Check bus trace"))
+	{
+		const std::wstring path = m_I2cTracePath + L".check";
+		m_BusTraceCheckTask = Concurrency::create_task([path]()
+		{
+			I2cTraceCheckResult result;
+			CheckI2cTrace(path.c_str(), I2cTraceCheckSettings(), result);
+			return result;
+		});
+		m_BusTraceCheckStarted = true;
+	}
+	if (checkRunning)
+	{
+		ImGui::Text("Checking...");
+	}
+	if (m_BusTraceCheckStarted && m_BusTraceCheckTask.is_done())
+	{
+		const I2cTraceCheckResult& result = m_BusTraceCheckTask.get();
+		if (!result.succeeded)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Check trace could not be written or replayed");
+		}
+		else
+		{
+			const bool passed = result.mismatchCount == 0 && result.replay.divergedCount == 0 && result.replay.sampleCount == result.sampleCount;
+			ImGui::TextColored(passed ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f),
+				"%llu samples replayed, %llu mismatched, %llu diverged; %u bus errors, %u overflows, %u interrupt reads",
+				(unsigned long long)result.replay.sampleCount, (unsigned long long)result.mismatchCount, (unsigned long long)result.replay.divergedCount,
+				result.busErrorCount, result.overflowCount, result.interruptCount);
+			ImGui::Text("Full FIFO read %.0f ns untraced, %.0f ns traced%s", result.untracedNanoseconds, result.tracedNanoseconds,
+				(result.droppedCount > 0) ? ", writer fell behind" : "");
+		}
+	}
+}
+
+// manual trigger of the black box and the state of its dumps
+void Game::RenderBlackBox()
+{
+	if (ImGui::Button("Dump black box"))
+	{
+		OnDumpKey();
+	}
+	ImGui::SameLine();
+	ImGui::Text("%s%u dumps, %u triggers ignored", m_BlackBox.IsDumpPending() ? "dumping, " : "",
+		m_BlackBox.GetDumpCount(), m_BlackBox.GetIgnoredTriggerCount());
+	if (m_BlackBox.HasWriteError())
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Black box dump failed");
+	}
+}
+
+void Game::StopReplay()
+{
+	m_Replaying = false;
+	m_Replay.Close();
+
+	// the interpolator history is in log time, start over on live data
+	m_Pipeline.Reset();
+}
+
 // Helper method to prepare the command list for rendering and clear the back buffers.
 void Game::Clear()
 {
@@ -265,14 +1346,21 @@ void Game::OnDeactivated()
 
 void Game::OnSuspending()
 {
-    // TODO: Game is being power-suspended.
+	// the FIFO overflows meanwhile, the reader resets it on the next burst
+	StopTimers();
+
+	// no sample is published with the timers stopped, and the window is hidden
+	// before suspending, so Update does not publish an orientation either
+	SensorShmClose(m_SharedMemory);
+	m_SharedMemory = nullptr;
 }
 
 void Game::OnResuming()
 {
     m_timer.ResetElapsedTime();
 
-    // TODO: Game is being power-resumed.
+	m_SharedMemory = SensorShmCreate(SENSOR_SHM_DEFAULT_NAME, SHARED_MEMORY_SLOTS, SHARED_MEMORY_SLOTS);
+	StartTimers();
 }
 
 void Game::OnWindowSizeChanged(int width, int height, DXGI_MODE_ROTATION rotation)
@@ -322,6 +1410,19 @@ void Game::ValidateDevice()
     }
 }
 
+void Game::OnPointer(int x, int y, bool leftButton)
+{
+	// feed pointer to imgui, the DX12 imgui binding only handles Win32 messages
+	ImGuiIO& io = ImGui::GetIO();
+	io.MousePos = ImVec2(float(x), float(y));
+	io.MouseDown[0] = leftButton;
+}
+
+void Game::OnDumpKey()
+{
+	m_BlackBox.Trigger(BLACK_BOX_MANUAL, m_Clock.GetTicks());
+}
+
 // Properties
 void Game::GetDefaultSize(int& width, int& height) const
 {
@@ -691,19 +1792,74 @@ void Game::OnDeviceLost()
 }
 
 // write configuration register with I2C
-bool Game::WriteByteToI2C(I2cDevice^ _I2cMPU6050Device, byte _regAddr, byte _data)
+bool Game::WriteByteToI2C(byte _regAddr, byte _data)
 {
-	unsigned char writeBuf[]{ _regAddr, _data };
-	Platform::Array<byte> ^wb = ref new Platform::Array<byte>(writeBuf, _countof(writeBuf));
+	return WriteRegister(m_Bus, MPU6050_I2C_ADDRESS, _regAddr, _data);
+}
+
+// buffer accel and gyro frames in the FIFO, discarding what it holds
+bool Game::ResetFifo()
+{
+	return m_FifoReader.ResetFifo(m_Bus);
+}
+
+// program MPU6050 motion and free-fall interrupts with the detector thresholds
+bool Game::InitMotionInterrupts()
+{
+	const MotionInterruptConfig config = MakeMotionInterruptConfig(m_MotionDetector.GetSettings());
+
+	return WriteByteToI2C(MPU6050_FF_THR, config.freeFallThreshold)
+		&& WriteByteToI2C(MPU6050_FF_DUR, config.freeFallDuration)
+		&& WriteByteToI2C(MPU6050_MOT_THR, config.motionThreshold)
+		&& WriteByteToI2C(MPU6050_MOT_DUR, config.motionDuration)
+		&& WriteByteToI2C(MPU6050_INT_PIN_CFG, MPU6050_INT_LATCH)
+		&& WriteByteToI2C(MPU6050_INT_ENABLE, MPU6050_INT_FREE_FALL | MPU6050_INT_MOTION);
+}
 
-	try
+// MPU6050 INT line is optional, without it only the sample rules report events
+void Game::OpenMotionInterruptPin()
+{
+	GpioController^ gpio = GpioController::GetDefault();
+	if (gpio == nullptr)
 	{
-		_I2cMPU6050Device->Write(wb);
-		return true;
+		return;
 	}
-	catch (...)
+
+	GpioPin^ pin;
+	GpioOpenStatus status;
+	if (!gpio->TryOpenPin(MOTION_INTERRUPT_GPIO, GpioSharingMode::Exclusive, &pin, &status))
 	{
-		return false;
+		return;
+	}
+
+	pin->SetDriveMode(GpioPinDriveMode::InputPullDown);
+	pin->ValueChanged += ref new TypedEventHandler<GpioPin^, GpioPinValueChangedEventArgs^>(
+		[this](GpioPin^ _pin, GpioPinValueChangedEventArgs^ _args)
+	{
+		if (_args->Edge == GpioPinEdge::RisingEdge)
+		{
+			OnMotionInterrupt();
+		}
+	});
+	m_MotionInterruptPin = pin;
+}
+
+// reading INT_STATUS tells which interrupt fired and releases the latched INT line
+void Game::OnMotionInterrupt()
+{
+	const uint64_t timestamp = m_Clock.GetTicks();
+
+	uint8_t status[1];
+	if (!ReadRegisters(m_Bus, MPU6050_I2C_ADDRESS, MPU6050_INT_STATUS, status, sizeof(status)))
+	{
+		return;
+	}
+
+	MotionEvent events[2];
+	const int count = DecodeMotionInterrupts(status[0], timestamp, events);
+	for (int i = 0; i < count; ++i)
+	{
+		m_InterruptEvents.Push(events[i]);
 	}
 }
 
@@ -716,21 +1872,22 @@ Concurrency::task<bool> Game::InitMPU6050()
 
 		return Concurrency::create_task(DeviceInformation::FindAllAsync(i2cDeviceSelector)).then([this](DeviceInformationCollection^ devices)
 		{
-			const unsigned int I2C_ADDRESS = 0x68;	// I2C address for MPU6050 sensor
-
 			if (devices->Size == 0)
 			{
 				return Concurrency::task_from_result(false);
 			}
 			else
 			{
-				auto HTU21D_settings = ref new I2cConnectionSettings(I2C_ADDRESS);
+				auto HTU21D_settings = ref new I2cConnectionSettings(MPU6050_I2C_ADDRESS);
+				HTU21D_settings->BusSpeed = I2cBusSpeed::FastMode;	// 400 kHz, a 1 kHz FIFO stream needs about 130 kbit/s
 
 				return Concurrency::create_task(I2cDevice::FromIdAsync(devices->GetAt(0)->Id, HTU21D_settings)).then([this](I2cDevice^ i2cDevice) {
 
 					if (i2cDevice)
 					{
 						m_I2cMPU6050Device = i2cDevice;	// save active I2C device
+						m_DeviceBus.reset(new DeviceI2cTransport(i2cDevice));
+						m_Bus.SetTarget(m_DeviceBus.get());
 
 						// init accelerometer
 						if (m_I2cMPU6050Device)
@@ -738,21 +1895,37 @@ Concurrency::task<bool> Game::InitMPU6050()
 							// see MPU-6000-Register-Map1.pdf for registers details
 
 							// init MPU6050
-							if (!WriteByteToI2C(m_I2cMPU6050Device, 0x6B, 0x80))
+							if (!WriteByteToI2C(0x6B, 0x80))
 							{
 								return false;
 							}
 							::Sleep(100);
-							if (!WriteByteToI2C(m_I2cMPU6050Device, 0x6B, 0x2))
+							if (!WriteByteToI2C(0x6B, 0x2))
 							{
 								return false;
 							}
 
-							if (!WriteByteToI2C(m_I2cMPU6050Device, 0x1A, 4))		// Accelerometer= 21Hz
+							if (!WriteByteToI2C(MPU6050_SMPLRT_DIV, SENSOR_RATE.sampleRateDivider))	// 1 kHz output
+							{
+								return false;
+							}
+							if (!WriteByteToI2C(MPU6050_CONFIG, SENSOR_RATE.lowpassConfig))		// widest low-pass below Nyquist
+							{
+								return false;
+							}
+							if (!WriteByteToI2C(0x1C, 1))		// Accelerometer= +/- 2g, 5Hz high-pass for motion interrupt only
+							{
+								return false;
+							}
+							if (!WriteByteToI2C(0x1B, 0))		// Gyroscope= +/- 250 deg/s
+							{
+								return false;
+							}
+							if (!InitMotionInterrupts())
 							{
 								return false;
 							}
-							if (!WriteByteToI2C(m_I2cMPU6050Device, 0x1C, 0))		// Accelerometer= +/- 2g
+							if (!ResetFifo())
 							{
 								return false;
 							}
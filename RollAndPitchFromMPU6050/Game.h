@@ -5,6 +5,24 @@
 #pragma once
 
 #include "StepTimer.h"
+#include "SensorData.h"
+#include "SampleQueue.h"
+#include "Mpu6050Fifo.h"
+#include "I2cTrace.h"
+#include "I2cTraceCheck.h"
+#include "SpectrumAnalyzer.h"
+#include "MotionEventDetector.h"
+#include "SensorLog.h"
+#include "SensorLogCheck.h"
+#include "AllanVariance.h"
+#include "FilterTuner.h"
+#include "SensorPipeline.h"
+#include "LogReplay.h"
+#include "ColumnarExport.h"
+#include "BlackBoxRecorder.h"
+#include "SensorShm.h"
+#include "TelemetryServer.h"
+#include "Benchmark.h"
 
 #include <collection.h>
 #include <ppltasks.h>
@@ -13,16 +31,7 @@ using namespace Concurrency;
 using namespace Windows::System;
 using namespace Windows::Devices::Enumeration;
 using namespace Windows::Devices::I2c;
-
-
-// data from MPU6050
-struct AccelData
-{
-	// accelerometer
-	float accelX;
-	float accelY;
-	float accelZ;
-};
+using namespace Windows::Devices::Gpio;
 
 
 // A basic game implementation that creates a D3D12 device and
@@ -31,7 +40,8 @@ class Game
 {
 public:
 
-	Game();
+	explicit Game(Clock& _clock);
+	~Game();
 
 	// Initialization and management
 	void Initialize(IUnknown* window, int width, int height, DXGI_MODE_ROTATION rotation);
@@ -45,6 +55,8 @@ public:
 	void OnSuspending();
 	void OnResuming();
 	void OnWindowSizeChanged(int width, int height, DXGI_MODE_ROTATION rotation);
+	void OnPointer(int x, int y, bool leftButton);
+	void OnDumpKey();
 	void ValidateDevice();
 
 	// Properties
@@ -52,13 +64,34 @@ public:
 
 	// MPU6050
 	Concurrency::task<bool> Game::InitMPU6050();
-	bool Game::WriteByteToI2C(I2cDevice^ _I2cMPU6050Device, byte _regAddr, byte _data);
+	bool Game::WriteByteToI2C(byte _regAddr, byte _data);
+	bool Game::ResetFifo();
+	bool Game::InitMotionInterrupts();
+	void Game::OpenMotionInterruptPin();
+	void Game::OnMotionInterrupt();
 
 private:
 
 	void Update(DX::StepTimer const& timer);
 	void Render();
 
+	void RenderSpectrum();
+	void RenderNoiseAnalysis();
+	void RenderFilterTuning();
+	void RenderReplay();
+	void RenderColumnarExport();
+	void RenderLogCheck();
+	void RenderBusTrace();
+	void RenderBlackBox();
+	void RenderTelemetry();
+	void StopReplay();
+
+	// the timers on m_Clock call back into Game, they run from Initialize or
+	// OnResuming until OnSuspending or the destructor
+	void StartTimers();
+	void StopTimers();
+	void ReadFifoBurst();
+
 	void Clear();
 	void Present();
 
@@ -98,27 +131,108 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12Resource>              m_renderTargets[c_swapBufferCount];
 	Microsoft::WRL::ComPtr<ID3D12Resource>              m_depthStencil;
 
-	// Game state
+	// Game state, timed by m_Clock like the sensor timers and the sample timestamps
+	Clock&                                              m_Clock;
 	DX::StepTimer                                       m_timer;
 
 
 	// imgui
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>        g_pd3dSrvDescHeap;
 
-	// data to render - angles generated by MPU6050 accelerometer
-	float m_AngleRoll;
-	float m_AnglePitch;
-
 
 	// MPU6050 connection and reading
 	I2cDevice^ m_I2cMPU6050Device;
-	Threading::ThreadPoolTimer ^m_PeriodicTimer;
-	Platform::Array<byte> ^m_ReadRegAddr;
-	Platform::Array<byte> ^m_ReadBuf;
-	uint32 m_AccelerometerReads;	// count reads to calculate 'reads per secons'
-
-	// data produced by MPU6050 accelerometer
-	AccelData m_AccelData;
+	uint32 m_AcquisitionTimer;		// on m_Clock
+	std::mutex m_TimerMutex;		// StartTimers runs on the device init continuation as well
+	uint32 m_AccelerometerReads;	// count samples to calculate 'samples per second'
+
+	// every transaction goes through m_Bus, which records it while the trace is open
+	std::unique_ptr<I2cTransport> m_DeviceBus;
+	I2cTraceWriter m_I2cTrace;
+	TracingI2cTransport m_Bus;
+	Mpu6050FifoReader m_FifoReader;
+
+	// the FIFO acquisition replayed from the trace
+	std::wstring m_I2cTracePath;
+	Concurrency::task<BusReplayResult> m_BusReplayTask;
+	bool m_BusReplayStarted;
+	Concurrency::task<I2cTraceCheckResult> m_BusTraceCheckTask;
+	bool m_BusTraceCheckStarted;
+
+	// samples produced by MPU6050 acquisition thread
+	SampleQueue<SensorSample, 1024> m_SampleQueue;
+
+	// oversampling, vibration filters, fusion, heading and display sampling, fed
+	// from m_SampleQueue or from a log replay
+	SensorPipeline m_Pipeline;
+	uint64_t m_FusionTicks;		// time spent in fusion, to show per-update cost
+	uint32 m_FusionUpdates;
+
+	// motion events: sample rules on the acquisition thread, MPU6050 interrupts on a GPIO pin
+	MotionEventDetector m_MotionDetector;
+	SampleQueue<MotionEvent, 64> m_MotionEvents;		// pushed by the detector callback
+	SampleQueue<MotionEvent, 64> m_InterruptEvents;		// pushed by the GPIO handler
+	GpioPin ^m_MotionInterruptPin;
+	MotionEvent m_LastMotionEvent;
+	uint32 m_MotionEventCounts[MOTION_EVENT_TYPE_COUNT];
+
+	// vibration spectrum of the raw accelerometer data, computed on a pool thread
+	SpectrumAnalyzer m_Spectrum;
+	uint32 m_SpectrumTimer;
+	int m_SpectrumAxis;
+
+	// raw sample log, packed copy and offline Allan deviation of it
+	std::wstring m_LogPath;
+	SensorLogWriter m_LogWriter;
+	bool m_Recording;
+	Concurrency::task<SensorLogPackResult> m_PackTask;
+	bool m_PackStarted;
+	Concurrency::task<AllanResult> m_AllanTask;
+	bool m_AllanStarted;
+
+	// fusion parameters tuned on the same log
+	Concurrency::task<TuningReport> m_TuningTask;
+	bool m_TuningStarted;
+
+	// the log replayed through m_Pipeline on a virtual clock instead of live samples,
+	// and the determinism check of two headless runs
+	LogReplay m_Replay;
+	bool m_Replaying;
+	float m_ReplaySpeed;
+	Concurrency::task<ReplayGoldenCheck> m_ReplayCheckTask;
+	bool m_ReplayCheckStarted;
+
+	// the log as per-channel arrays for analytics tools
+	Concurrency::task<std::vector<ColumnarExportResult>> m_ExportTask;
+	bool m_ExportStarted;
+
+	// synthetic log written, read back and damaged on this storage
+	Concurrency::task<SensorLogCheckResult> m_LogCheckTask;
+	bool m_LogCheckStarted;
+
+	// last seconds of samples and orientation, dumped on a shock, a free-fall,
+	// an acquisition error or the dump key
+	BlackBoxRecorder m_BlackBox;
+
+	// samples and orientation for other processes on this machine, null when
+	// the region could not be created
+	SensorShm* m_SharedMemory;
+
+	// the same over TCP to remote dashboards, on the private network interface by default
+	TelemetryServer m_Telemetry;
+	char m_TelemetryAddress[16];		// edited in the UI, applied by Listen
+	int m_TelemetryPort;
+	bool m_TelemetryFailed;
+
+	// pipeline benchmarks and feature measurements, run once at startup
+	Concurrency::task<std::vector<BenchmarkResult>> m_BenchmarkTask;
+	Concurrency::task<std::vector<ApproximationAccuracy>> m_AccuracyTask;
+	Concurrency::task<std::vector<FeatureMeasurement>> m_FeatureTask;
+
+	// pipeline validation on the first live samples
+	std::vector<SensorSample> m_ValidationSamples;
+	Concurrency::task<PipelineValidation> m_ValidationTask;
+	bool m_ValidationStarted;
 
 	// model DirectXTK
 	std::unique_ptr<DirectX::GraphicsMemory> m_graphicsMemory;
@@ -0,0 +1,111 @@
+//
+// HeadingTracker.cpp
+//
+
+#include "pch.h"
+#include "HeadingTracker.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	const float MAX_INTEGRATION_DT = 0.5f;		// longer gaps are treated as a restart of the stream
+	const float PI = 3.14159265f;
+
+	float WrapAngle(float _angle)
+	{
+		if (_angle > PI)
+		{
+			return _angle - 2.0f * PI;
+		}
+		if (_angle < -PI)
+		{
+			return _angle + 2.0f * PI;
+		}
+		return _angle;
+	}
+}
+
+
+HeadingTracker::HeadingTracker()
+{
+	Reset();
+}
+
+void HeadingTracker::Reset()
+{
+	m_Yaw = 0.0f;
+	m_GyroBias[0] = m_GyroBias[1] = m_GyroBias[2] = 0.0f;
+	m_StillSeconds = 0.0f;
+	m_StationarySeconds = HeadingSettings().stationarySeconds;
+	m_LastTimestamp = 0;
+}
+
+void HeadingTracker::ResetHeading(float _yaw)
+{
+	m_Yaw = WrapAngle(_yaw);
+}
+
+void HeadingTracker::ProcessReading(const ImuReading& _reading, uint64_t _timestamp, const Quaternion& _tilt, const HeadingSettings& _settings)
+{
+	const uint64_t lastTimestamp = m_LastTimestamp;
+	m_LastTimestamp = _timestamp;
+	m_StationarySeconds = _settings.stationarySeconds;
+	if (lastTimestamp == 0 || _timestamp <= lastTimestamp)
+	{
+		return;
+	}
+
+	const float dt = float(DX::StepTimer::TicksToSeconds(_timestamp - lastTimestamp));
+	if (dt > MAX_INTEGRATION_DT)
+	{
+		m_StillSeconds = 0.0f;
+		return;
+	}
+
+	float rate[3];
+	bool still = true;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		rate[axis] = _reading.gyro[axis] - m_GyroBias[axis];
+		still = still && fabsf(rate[axis]) < _settings.stationaryRate;
+	}
+	const float accel = sqrtf(_reading.accel[0] * _reading.accel[0] + _reading.accel[1] * _reading.accel[1] + _reading.accel[2] * _reading.accel[2]);
+	still = still && fabsf(accel - 1.0f) < _settings.stationaryAccel;
+
+	m_StillSeconds = still ? m_StillSeconds + dt : 0.0f;
+	if (IsStationary())
+	{
+		// the device is not turning, everything the gyro reports is bias
+		const float weight = dt / (_settings.biasTimeConstant + dt);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			m_GyroBias[axis] += weight * rate[axis];
+		}
+		if (_settings.zeroRateHold)
+		{
+			return;
+		}
+	}
+
+	// rate around world Z is the projection of the body rate on gravity in the sensor frame
+	float gravity[3];
+	GravityInSensorFrame(_tilt, gravity);
+	const float yawRate = gravity[0] * rate[0] + gravity[1] * rate[1] + gravity[2] * rate[2];
+	m_Yaw = WrapAngle(m_Yaw + yawRate * dt);
+}
+
+Quaternion HeadingTracker::Apply(const Quaternion& _tilt, const HeadingSettings& _settings) const
+{
+	const Quaternion tilt = QuaternionRemoveHeading(_tilt);
+	if (!_settings.enabled)
+	{
+		return tilt;
+	}
+
+	// yaw is a rotation around world Z, applied after the tilt
+	const Quaternion yaw(0.0f, 0.0f, sinf(0.5f * m_Yaw), cosf(0.5f * m_Yaw));
+	return QuaternionProduct(yaw, tilt);
+}
@@ -0,0 +1,65 @@
+//
+// HeadingTracker.h - relative yaw from gyro integration, no magnetometer needed
+//
+// The gyro rate around world Z (gravity) is integrated at sensor rate on top of
+// the tilt from fusion. Heading is unobservable from gravity, so the bias of that
+// rate is learned only while the device is still, and the optional zero-rate hold
+// freezes yaw during those periods so the remaining bias cannot accumulate.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+
+struct HeadingSettings
+{
+	bool enabled;				// off: published orientation has zero yaw, as before
+	bool zeroRateHold;			// no integration while stationary
+	float stationaryRate;		// rad/s, |gyro - bias| below this on all axes counts as still
+	float stationaryAccel;		// g, ||accel| - 1| below this counts as still
+	float stationarySeconds;	// stillness needed before bias learning and hold start
+	float biasTimeConstant;		// s, averaging time of the bias estimate
+
+	HeadingSettings() :
+		enabled(true),
+		zeroRateHold(true),
+		stationaryRate(0.05f),		// about 3 deg/s, above the MPU6050 zero-rate offset spec
+		stationaryAccel(0.05f),
+		stationarySeconds(0.5f),
+		biasTimeConstant(5.0f)
+	{
+	}
+};
+
+
+class HeadingTracker
+{
+public:
+
+	HeadingTracker();
+
+	// forget yaw and the learned bias
+	void Reset();
+
+	// current direction becomes yaw _yaw, the learned bias is kept
+	void ResetHeading(float _yaw = 0.0f);
+
+	// _tilt is the fused orientation of the same sample, its own yaw is ignored
+	void ProcessReading(const ImuReading& _reading, uint64_t _timestamp, const DirectX::SimpleMath::Quaternion& _tilt, const HeadingSettings& _settings);
+
+	// _tilt with its yaw replaced by the tracked one (zero when disabled)
+	DirectX::SimpleMath::Quaternion Apply(const DirectX::SimpleMath::Quaternion& _tilt, const HeadingSettings& _settings) const;
+
+	float GetYaw() const						{ return m_Yaw; }		// radians, -pi..pi
+	const float* GetGyroBias() const			{ return m_GyroBias; }	// rad/s per sensor axis
+	bool IsStationary() const					{ return m_StillSeconds >= m_StationarySeconds; }
+
+private:
+
+	float m_Yaw;
+	float m_GyroBias[3];
+	float m_StillSeconds;
+	float m_StationarySeconds;	// from the last settings, for IsStationary
+	uint64_t m_LastTimestamp;
+};
@@ -0,0 +1,105 @@
+//
+// HistoryRing.h - lock-free ring of the most recent entries for any number of readers
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+
+// Overwriting ring with one writer and any number of readers. Readers copy a
+// range without stopping the writer and drop what it overwrote meanwhile: the
+// writer claims an index before storing the entry, and a reader checks the
+// claims after its copy (the seqlock pattern on the whole ring).
+template<typename T>
+class HistoryRing
+{
+public:
+
+	HistoryRing() :
+		m_Mask(0),
+		m_Claimed(0),
+		m_Published(0)
+	{
+	}
+
+	// capacity rounded up to a power of two; before the writer starts
+	void Allocate(size_t _capacity)
+	{
+		size_t capacity = 1;
+		while (capacity < _capacity)
+		{
+			capacity *= 2;
+		}
+		m_Items.assign(capacity, T());
+		m_Mask = capacity - 1;
+		m_Claimed.store(0);
+		m_Published.store(0);
+	}
+
+	size_t GetCapacity() const			{ return m_Items.size(); }
+
+	// writer; a no-op before Allocate
+	void Push(const T& _item)
+	{
+		if (m_Items.empty())
+		{
+			return;
+		}
+		const uint64_t index = m_Published.load(std::memory_order_relaxed);
+		m_Claimed.store(index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Items[size_t(index) & m_Mask] = _item;
+		m_Published.store(index + 1, std::memory_order_release);
+	}
+
+	// entries ever pushed, the newest has index GetPublished() - 1
+	uint64_t GetPublished() const		{ return m_Published.load(std::memory_order_acquire); }
+
+	// copies the entries still in the ring, oldest first, into _output (room for
+	// the capacity); returns the count, _first gets the index of the first one
+	size_t Copy(T* _output, uint64_t& _first) const
+	{
+		return CopyFrom(0, _output, _first);
+	}
+
+	// as Copy, but only the entries from index _begin on; a reader that keeps
+	// _first + count as its next _begin sees every entry once, and a _first past
+	// its _begin tells how many were overwritten before it got to them
+	size_t CopyFrom(uint64_t _begin, T* _output, uint64_t& _first) const
+	{
+		const uint64_t end = GetPublished();
+		const uint64_t oldest = (end > m_Items.size()) ? end - m_Items.size() : 0;
+		const uint64_t begin = std::min(std::max(_begin, oldest), end);
+		for (uint64_t index = begin; index < end; ++index)
+		{
+			_output[index - begin] = m_Items[size_t(index) & m_Mask];
+		}
+
+		// entries the writer may have started to overwrite during the copy are invalid
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t claimed = m_Claimed.load(std::memory_order_relaxed);
+		const uint64_t oldestIntact = (claimed > m_Items.size()) ? claimed - m_Items.size() : 0;
+		_first = std::max(begin, std::min(oldestIntact, end));
+		const size_t skipped = size_t(_first - begin);
+		const size_t count = size_t(end - _first);
+		for (size_t i = 0; i < count && skipped > 0; ++i)
+		{
+			_output[i] = _output[i + skipped];
+		}
+		return count;
+	}
+
+private:
+
+	HistoryRing(const HistoryRing&);
+	HistoryRing& operator=(const HistoryRing&);
+
+	std::vector<T> m_Items;
+	size_t m_Mask;
+	std::atomic<uint64_t> m_Claimed;
+	std::atomic<uint64_t> m_Published;
+};
@@ -0,0 +1,488 @@
+//
+// I2cTrace.cpp
+//
+
+#include "pch.h"
+#include "I2cTrace.h"
+#include "Mpu6050Fifo.h"
+#include "MotionEventDetector.h"
+
+#include <string.h>
+
+
+namespace
+{
+	const size_t STAGING_WRITE_BYTES = 64 * 1024;	// wakes the writer thread
+	const size_t STAGING_LIMIT = 1024 * 1024;		// transactions are dropped beyond, the writer fell behind
+	const int WRITER_POLL_MS = 250;					// staged records reach the file at least this often
+
+	const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+
+	uint64_t HashBytes(uint64_t _hash, const void* _data, size_t _size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(_data);
+		for (size_t i = 0; i < _size; ++i)
+		{
+			_hash = (_hash ^ bytes[i]) * FNV_PRIME;
+		}
+		return _hash;
+	}
+
+#if defined(_WIN32)
+	const PathChar OLD_SUFFIX[] = L".old";
+
+	FILE* OpenForWriting(const PathChar* _path)
+	{
+		FILE* file = nullptr;
+		return (_wfopen_s(&file, _path, L"wb") == 0) ? file : nullptr;
+	}
+
+	void ReplaceFile(const PathChar* _from, const PathChar* _to)
+	{
+		_wremove(_to);
+		_wrename(_from, _to);
+	}
+#else
+	const PathChar OLD_SUFFIX[] = ".old";
+
+	FILE* OpenForWriting(const PathChar* _path)
+	{
+		return fopen(_path, "wb");
+	}
+
+	void ReplaceFile(const PathChar* _from, const PathChar* _to)
+	{
+		remove(_to);
+		rename(_from, _to);
+	}
+#endif
+
+	bool IsRecordedAs(const I2cTraceEntry& _entry, uint8_t _address, uint8_t _kind, const uint8_t* _write, uint32_t _writeSize, uint32_t _readSize)
+	{
+		const I2cTraceRecord& record = *_entry.record;
+		return record.address == _address && record.kind == _kind && record.writeSize == _writeSize && record.readSize == _readSize
+			&& memcmp(_entry.written, _write, _writeSize) == 0;
+	}
+
+	bool IsRegisterRead(const I2cTraceEntry& _entry, uint8_t _register)
+	{
+		return _entry.record->kind == I2C_TRACE_WRITE_READ && _entry.record->writeSize == 1 && _entry.written[0] == _register;
+	}
+}
+
+
+I2cTraceWriter::I2cTraceWriter() :
+	m_MaxFileBytes(0),
+	m_File(nullptr),
+	m_FileBytes(0),
+	m_Open(false),
+	m_Stopping(false),
+	m_RecordCount(0),
+	m_DroppedCount(0),
+	m_WrittenSize(0),
+	m_WriteError(false)
+{
+}
+
+I2cTraceWriter::~I2cTraceWriter()
+{
+	Close();
+}
+
+bool I2cTraceWriter::Open(const PathChar* _path, uint64_t _maxFileBytes)
+{
+	Close();
+
+	m_Path = _path;
+	m_MaxFileBytes = _maxFileBytes;
+	if (!StartFile())
+	{
+		return false;
+	}
+
+	m_Staging.clear();
+	m_Staging.reserve(STAGING_WRITE_BYTES * 2);
+	m_Stopping = false;
+	m_RecordCount.store(0);
+	m_DroppedCount.store(0);
+	m_WrittenSize.store(m_FileBytes);
+	m_WriteError.store(false);
+
+	m_Thread = std::thread([this]() { WriterLoop(); });
+	m_Open.store(true);
+	return true;
+}
+
+void I2cTraceWriter::Close()
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Open.store(false);
+		m_Stopping = true;
+	}
+	m_Wake.notify_one();
+	m_Thread.join();
+
+	if (m_File != nullptr)
+	{
+		fclose(m_File);
+		m_File = nullptr;
+	}
+}
+
+void I2cTraceWriter::Append(uint8_t _address, uint8_t _kind, uint64_t _start, uint64_t _end, const I2cResult& _result,
+	const uint8_t* _write, uint32_t _writeSize, const uint8_t* _read, uint32_t _readSize)
+{
+	I2cTraceRecord record;
+	record.timestamp = _start;
+	record.duration = uint32_t(std::min<uint64_t>(_end - _start, UINT32_MAX));
+	record.address = _address;
+	record.kind = _kind;
+	record.status = uint8_t(_result.status);
+	record.writeSize = uint8_t(std::min<uint32_t>(_writeSize, UINT8_MAX));
+	record.readSize = uint16_t(std::min<uint32_t>(_readSize, UINT16_MAX));
+	record.bytesTransferred = uint16_t(std::min<uint32_t>(_result.bytesTransferred, UINT16_MAX));
+	record.reserved = 0;
+	const size_t size = GetI2cTraceRecordSize(record);
+
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Open.load(std::memory_order_relaxed) || m_Staging.size() + size > STAGING_LIMIT)
+		{
+			m_DroppedCount.fetch_add(m_Open.load(std::memory_order_relaxed) ? 1 : 0, std::memory_order_relaxed);
+			return;
+		}
+
+		const size_t offset = m_Staging.size();
+		m_Staging.resize(offset + size);
+		uint8_t* data = m_Staging.data() + offset;
+		memcpy(data, &record, sizeof(record));
+		memcpy(data + sizeof(record), _write, record.writeSize);
+		if (record.readSize > 0)
+		{
+			memcpy(data + sizeof(record) + record.writeSize, _read, record.readSize);
+		}
+		memset(data + sizeof(record) + record.writeSize + record.readSize, 0, size - sizeof(record) - record.writeSize - record.readSize);
+		wake = (offset < STAGING_WRITE_BYTES && offset + size >= STAGING_WRITE_BYTES);
+	}
+	m_RecordCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (wake)
+	{
+		m_Wake.notify_one();
+	}
+}
+
+bool I2cTraceWriter::StartFile()
+{
+	m_File = OpenForWriting(m_Path.c_str());
+	if (m_File == nullptr)
+	{
+		return false;
+	}
+
+	I2cTraceHeader header;
+	header.magic = I2C_TRACE_MAGIC;
+	header.version = I2C_TRACE_VERSION;
+	header.ticksPerSecond = DX::StepTimer::TicksPerSecond;
+	if (fwrite(&header, sizeof(header), 1, m_File) != 1 || fflush(m_File) != 0)
+	{
+		fclose(m_File);
+		m_File = nullptr;
+		return false;
+	}
+	m_FileBytes = sizeof(header);
+	return true;
+}
+
+void I2cTraceWriter::WriterLoop()
+{
+	std::vector<uint8_t> pending;
+	pending.reserve(STAGING_WRITE_BYTES * 2);
+
+	for (;;)
+	{
+		bool stopping;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Wake.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS), [this]()
+			{
+				return m_Stopping || m_Staging.size() >= STAGING_WRITE_BYTES;
+			});
+			stopping = m_Stopping;
+
+			// the producers go on filling the other buffer while this one is written
+			pending.swap(m_Staging);
+		}
+
+		WriteStaged(pending);
+		pending.clear();
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+void I2cTraceWriter::WriteStaged(std::vector<uint8_t>& _data)
+{
+	if (_data.empty() || m_WriteError.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	// the staging buffer holds whole records only, so no record is split between files
+	if (m_MaxFileBytes > 0 && m_FileBytes > sizeof(I2cTraceHeader) && m_FileBytes + _data.size() > m_MaxFileBytes)
+	{
+		fclose(m_File);
+		ReplaceFile(m_Path.c_str(), (m_Path + OLD_SUFFIX).c_str());
+		if (!StartFile())
+		{
+			m_WriteError.store(true);
+			return;
+		}
+	}
+
+	if (m_File == nullptr || fwrite(_data.data(), _data.size(), 1, m_File) != 1 || fflush(m_File) != 0)
+	{
+		m_WriteError.store(true);
+		return;
+	}
+	m_FileBytes += _data.size();
+	m_WrittenSize.fetch_add(_data.size(), std::memory_order_relaxed);
+}
+
+
+TracingI2cTransport::TracingI2cTransport(const Clock& _clock, I2cTraceWriter& _writer) :
+	m_Clock(_clock),
+	m_Writer(_writer),
+	m_Target(nullptr)
+{
+}
+
+I2cResult TracingI2cTransport::Write(uint8_t _address, const uint8_t* _data, uint32_t _size)
+{
+	if (m_Target == nullptr)
+	{
+		return I2cResult();
+	}
+	if (!m_Writer.IsOpen())
+	{
+		I2cResult result = m_Target->Write(_address, _data, _size);
+		result.endTicks = m_Clock.GetTicks();
+		return result;
+	}
+
+	const uint64_t start = m_Clock.GetTicks();
+	I2cResult result = m_Target->Write(_address, _data, _size);
+	result.endTicks = m_Clock.GetTicks();
+	m_Writer.Append(_address, I2C_TRACE_WRITE, start, result.endTicks, result, _data, _size, nullptr, 0);
+	return result;
+}
+
+I2cResult TracingI2cTransport::WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize)
+{
+	if (m_Target == nullptr)
+	{
+		return I2cResult();
+	}
+	if (!m_Writer.IsOpen())
+	{
+		I2cResult result = m_Target->WriteRead(_address, _write, _writeSize, _read, _readSize);
+		result.endTicks = m_Clock.GetTicks();
+		return result;
+	}
+
+	const uint64_t start = m_Clock.GetTicks();
+	I2cResult result = m_Target->WriteRead(_address, _write, _writeSize, _read, _readSize);
+	result.endTicks = m_Clock.GetTicks();
+	m_Writer.Append(_address, I2C_TRACE_WRITE_READ, start, result.endTicks, result, _write, _writeSize, _read, _readSize);
+	return result;
+}
+
+
+ReplayI2cTransport::ReplayI2cTransport() :
+	m_Position(0),
+	m_Clock(nullptr),
+	m_Diverged(0),
+	m_SkippedCount(0)
+{
+}
+
+bool ReplayI2cTransport::Open(const PathChar* _path)
+{
+	Close();
+	if (!m_File.Open(_path) || m_File.GetSize() < sizeof(I2cTraceHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const uint8_t* data = m_File.GetData();
+	const I2cTraceHeader* header = reinterpret_cast<const I2cTraceHeader*>(data);
+	if (header->magic != I2C_TRACE_MAGIC || header->version != I2C_TRACE_VERSION || header->ticksPerSecond != DX::StepTimer::TicksPerSecond)
+	{
+		Close();
+		return false;
+	}
+
+	size_t offset = sizeof(I2cTraceHeader);
+	while (offset + sizeof(I2cTraceRecord) <= m_File.GetSize())
+	{
+		const I2cTraceRecord* record = reinterpret_cast<const I2cTraceRecord*>(data + offset);
+		const size_t size = GetI2cTraceRecordSize(*record);
+		if (offset + size > m_File.GetSize())
+		{
+			break;
+		}
+
+		I2cTraceEntry entry;
+		entry.record = record;
+		entry.written = data + offset + sizeof(I2cTraceRecord);
+		entry.read = entry.written + record->writeSize;
+		m_Entries.push_back(entry);
+		offset += size;
+	}
+	return true;
+}
+
+void ReplayI2cTransport::Close()
+{
+	m_File.Close();
+	m_Entries.clear();
+	m_Position = 0;
+	m_Diverged = 0;
+	m_SkippedCount = 0;
+}
+
+I2cResult ReplayI2cTransport::Write(uint8_t _address, const uint8_t* _data, uint32_t _size)
+{
+	return Replay(_address, I2C_TRACE_WRITE, _data, _size, nullptr, 0);
+}
+
+I2cResult ReplayI2cTransport::WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize)
+{
+	return Replay(_address, I2C_TRACE_WRITE_READ, _write, _writeSize, _read, _readSize);
+}
+
+void ReplayI2cTransport::SkipNext()
+{
+	if (IsFinished())
+	{
+		return;
+	}
+
+	const I2cTraceRecord& record = *m_Entries[m_Position].record;
+	if (m_Clock != nullptr)
+	{
+		m_Clock->AdvanceTo(record.timestamp + record.duration);
+	}
+	++m_Position;
+}
+
+I2cResult ReplayI2cTransport::Replay(uint8_t _address, uint8_t _kind, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize)
+{
+	const size_t end = std::min(m_Entries.size(), m_Position + LOOKAHEAD);
+	size_t match = m_Position;
+	while (match < end && !IsRecordedAs(m_Entries[match], _address, _kind, _write, _writeSize, _readSize))
+	{
+		++match;
+	}
+	if (match == end)
+	{
+		++m_Diverged;
+		return I2cResult(I2C_UNKNOWN_ERROR, 0);
+	}
+
+	// what other threads did on the bus meanwhile
+	for (; m_Position < match; ++m_Position)
+	{
+		++m_SkippedCount;
+		if (m_Skipped)
+		{
+			m_Skipped(m_Entries[m_Position]);
+		}
+	}
+
+	const I2cTraceEntry& entry = m_Entries[m_Position++];
+	if (_readSize > 0)
+	{
+		memcpy(_read, entry.read, _readSize);
+	}
+	const uint64_t endTicks = entry.record->timestamp + entry.record->duration;
+	if (m_Clock != nullptr)
+	{
+		m_Clock->AdvanceTo(endTicks);
+	}
+	return I2cResult(entry.record->status, entry.record->bytesTransferred, endTicks);
+}
+
+
+bool ReplayBusTrace(const PathChar* _path, float _sampleRate, BusReplayResult& _result, const std::function<void(const SensorSample&)>& _onSample)
+{
+	ReplayI2cTransport bus;
+	if (!bus.Open(_path))
+	{
+		return false;
+	}
+
+	memset(&_result, 0, sizeof(_result));
+	_result.transactionCount = bus.GetEntryCount();
+	_result.digest = FNV_OFFSET_BASIS;
+
+	VirtualClock clock(bus.IsFinished() ? 0 : bus.GetNext().record->timestamp);
+	bus.SetClock(&clock);
+	bus.SetSkippedCallback([&_result](const I2cTraceEntry& _entry)
+	{
+		_result.interruptCount += IsRegisterRead(_entry, MPU6050_INT_STATUS) ? 1 : 0;
+	});
+
+	Mpu6050FifoReader reader(MPU6050_I2C_ADDRESS, _sampleRate);
+	SensorSample samples[MPU6050_FIFO_MAX_FRAMES];
+	while (!bus.IsFinished())
+	{
+		// the acquisition timer starts a burst with the count read; configuration
+		// writes and interrupt status reads are issued by code that is not replayed
+		if (!IsRegisterRead(bus.GetNext(), MPU6050_FIFO_COUNT_H) || bus.GetNext().record->address != MPU6050_I2C_ADDRESS)
+		{
+			_result.interruptCount += IsRegisterRead(bus.GetNext(), MPU6050_INT_STATUS) ? 1 : 0;
+			bus.SkipNext();
+			continue;
+		}
+
+		unsigned int count = 0;
+		const size_t position = bus.GetPosition();
+		const FifoBurstStatus status = reader.ReadBurst(bus, clock, samples, count);
+		if (bus.GetPosition() == position)
+		{
+			// the count read itself diverged (a different size, say), pass it by
+			bus.SkipNext();
+			continue;
+		}
+		++_result.burstCount;
+		_result.busErrorCount += (status == FIFO_BURST_BUS_ERROR) ? 1 : 0;
+
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			_result.digest = HashBytes(_result.digest, &samples[i].timestamp, sizeof(samples[i].timestamp));
+			_result.digest = HashBytes(_result.digest, samples[i].accel, sizeof(samples[i].accel));
+			_result.digest = HashBytes(_result.digest, samples[i].gyro, sizeof(samples[i].gyro));
+			if (_onSample)
+			{
+				_onSample(samples[i]);
+			}
+		}
+		_result.sampleCount += count;
+	}
+
+	_result.overflowCount = reader.GetOverflowCount();
+	_result.divergedCount = bus.GetDivergedCount();
+	return true;
+}
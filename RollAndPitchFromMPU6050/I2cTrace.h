@@ -0,0 +1,234 @@
+//
+// I2cTrace.h - every I2C transaction of the application, recorded and replayed
+//
+// Some faults only show in how the bus behaved: a NAK, a short read, a FIFO
+// count that arrived late. TracingI2cTransport sits under all MPU6050 traffic
+// and hands each transaction to an I2cTraceWriter: when it started and how long
+// it took, the address, what was written (the register first), the status and
+// the bytes that came back. Recording costs two clock reads, a short uncontended
+// lock and a copy into a staging buffer per transaction, against the hundreds of
+// microseconds the transaction itself takes on a 400 kHz bus; a writer thread
+// does the file I/O. At 1 kHz that is about 14 KB/s, and the file is rotated at
+// a size limit, so the trace can stay on in the field.
+//
+// ReplayI2cTransport answers from a trace: each transaction the code issues is
+// matched against the next recorded one and gets the recorded status and bytes,
+// with a VirtualClock moved to the recorded end time, so the acquisition sees
+// the bus exactly as it was. ReplayBusTrace runs the FIFO acquisition over a
+// whole trace that way; CheckI2cTrace (I2cTraceCheck.h) records and replays one
+// from a simulated MPU6050 and times the recording.
+//
+// File: I2cTraceHeader, then records back to back, each an I2cTraceRecord
+// followed by writeSize written and readSize read bytes, zero padded to a
+// multiple of 8. Records are written whole; a torn last record after a crash
+// is ignored by the reader.
+//
+
+#pragma once
+
+#include "I2cTransport.h"
+#include "Clock.h"
+#include "MappedFile.h"
+#include "SensorData.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const uint32_t I2C_TRACE_MAGIC = 0x5455504D;	// "MPUT"
+const uint32_t I2C_TRACE_VERSION = 1;
+
+enum I2cTraceKind
+{
+	I2C_TRACE_WRITE = 1,
+	I2C_TRACE_WRITE_READ = 2,
+};
+
+struct I2cTraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t ticksPerSecond;	// of the record timestamps
+};
+
+struct I2cTraceRecord
+{
+	uint64_t timestamp;			// Clock ticks when the transaction started
+	uint32_t duration;			// ticks until it returned
+	uint8_t address;
+	uint8_t kind;				// I2cTraceKind
+	uint8_t status;				// I2cStatus
+	uint8_t writeSize;
+	uint16_t readSize;			// bytes the caller asked for, all of them are kept
+	uint16_t bytesTransferred;
+	uint32_t reserved;
+};
+
+// with its bytes and padding, records stay 8-byte aligned for the mapped reader
+inline size_t GetI2cTraceRecordSize(const I2cTraceRecord& _record)
+{
+	return (sizeof(I2cTraceRecord) + _record.writeSize + _record.readSize + 7) & ~size_t(7);
+}
+
+
+// Thread safe, any thread on the bus may append. When the staging buffer is
+// full because storage stalls, transactions are dropped and counted rather than
+// holding up the bus.
+class I2cTraceWriter
+{
+public:
+
+	I2cTraceWriter();
+	~I2cTraceWriter();
+
+	// at _maxFileBytes the file is renamed to _path plus ".old", replacing an
+	// earlier one, and a new file is started; 0 = no limit
+	bool Open(const PathChar* _path, uint64_t _maxFileBytes = 0);
+	void Close();
+	bool IsOpen() const								{ return m_Open.load(std::memory_order_relaxed); }
+
+	void Append(uint8_t _address, uint8_t _kind, uint64_t _start, uint64_t _end, const I2cResult& _result,
+		const uint8_t* _write, uint32_t _writeSize, const uint8_t* _read, uint32_t _readSize);
+
+	uint64_t GetRecordCount() const					{ return m_RecordCount.load(std::memory_order_relaxed); }
+	uint32_t GetDroppedCount() const				{ return m_DroppedCount.load(std::memory_order_relaxed); }
+	uint64_t GetWrittenSize() const					{ return m_WrittenSize.load(std::memory_order_relaxed); }
+	bool HasWriteError() const						{ return m_WriteError.load(std::memory_order_relaxed); }
+
+private:
+
+	I2cTraceWriter(const I2cTraceWriter&);
+	I2cTraceWriter& operator=(const I2cTraceWriter&);
+
+	void WriterLoop();
+	bool StartFile();
+	void WriteStaged(std::vector<uint8_t>& _data);
+
+	std::basic_string<PathChar> m_Path;
+	uint64_t m_MaxFileBytes;
+	FILE* m_File;
+	uint64_t m_FileBytes;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::vector<uint8_t> m_Staging;		// under m_Mutex
+	std::thread m_Thread;
+	std::atomic<bool> m_Open;
+	bool m_Stopping;					// under m_Mutex
+
+	std::atomic<uint64_t> m_RecordCount;
+	std::atomic<uint32_t> m_DroppedCount;
+	std::atomic<uint64_t> m_WrittenSize;
+	std::atomic<bool> m_WriteError;
+};
+
+
+// passes every transaction on to the target and records it while the writer is
+// open; results carry the end time, the one recorded
+class TracingI2cTransport : public I2cTransport
+{
+public:
+
+	TracingI2cTransport(const Clock& _clock, I2cTraceWriter& _writer);
+
+	// the real bus, nullptr until there is one; transactions fail without it
+	void SetTarget(I2cTransport* _target)			{ m_Target = _target; }
+
+	I2cResult Write(uint8_t _address, const uint8_t* _data, uint32_t _size) override;
+	I2cResult WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize) override;
+
+private:
+
+	TracingI2cTransport(const TracingI2cTransport&);
+	TracingI2cTransport& operator=(const TracingI2cTransport&);
+
+	const Clock& m_Clock;
+	I2cTraceWriter& m_Writer;
+	I2cTransport* m_Target;
+};
+
+
+// a recorded transaction in a mapped trace
+struct I2cTraceEntry
+{
+	const I2cTraceRecord* record;
+	const uint8_t* written;
+	const uint8_t* read;
+};
+
+// recorded transactions skipped to reach the one the code issued, issued on the
+// bus by other threads in between (the motion interrupt, say)
+typedef std::function<void(const I2cTraceEntry& _entry)> I2cSkippedCallback;
+
+// Plays a trace back as the bus. A transaction that matches none of the next
+// few recorded ones (the code now issues something else than it did) fails
+// with I2C_UNKNOWN_ERROR, is counted as diverged and consumes nothing. Results
+// carry the recorded end time.
+class ReplayI2cTransport : public I2cTransport
+{
+public:
+
+	static const uint32_t LOOKAHEAD = 8;
+
+	ReplayI2cTransport();
+
+	bool Open(const PathChar* _path);
+	void Close();
+
+	// moved to the end of each replayed transaction, optional
+	void SetClock(VirtualClock* _clock)				{ m_Clock = _clock; }
+	void SetSkippedCallback(const I2cSkippedCallback& _callback)	{ m_Skipped = _callback; }
+
+	I2cResult Write(uint8_t _address, const uint8_t* _data, uint32_t _size) override;
+	I2cResult WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize) override;
+
+	size_t GetEntryCount() const					{ return m_Entries.size(); }
+	size_t GetPosition() const						{ return m_Position; }
+	bool IsFinished() const							{ return m_Position >= m_Entries.size(); }
+	const I2cTraceEntry& GetNext() const			{ return m_Entries[m_Position]; }
+
+	// replays the next recorded transaction whatever it is, for the ones no code issues now
+	void SkipNext();
+
+	uint64_t GetDivergedCount() const				{ return m_Diverged; }
+	uint64_t GetSkippedCount() const				{ return m_SkippedCount; }
+
+private:
+
+	ReplayI2cTransport(const ReplayI2cTransport&);
+	ReplayI2cTransport& operator=(const ReplayI2cTransport&);
+
+	I2cResult Replay(uint8_t _address, uint8_t _kind, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize);
+
+	MappedFile m_File;
+	std::vector<I2cTraceEntry> m_Entries;
+	size_t m_Position;
+	VirtualClock* m_Clock;
+	I2cSkippedCallback m_Skipped;
+	uint64_t m_Diverged;
+	uint64_t m_SkippedCount;
+};
+
+
+struct BusReplayResult
+{
+	uint64_t transactionCount;	// in the trace
+	uint64_t burstCount;
+	uint64_t sampleCount;
+	uint32_t overflowCount;
+	uint32_t busErrorCount;		// bursts ended by a NAK, a short transfer or a timeout
+	uint32_t interruptCount;	// motion interrupt status reads
+	uint64_t divergedCount;		// transactions the acquisition issued differently than recorded
+	uint64_t digest;			// FNV-1a of the decoded samples
+};
+
+// the FIFO acquisition at _sampleRate over a whole trace, every sample to _onSample;
+// false when the trace cannot be opened
+bool ReplayBusTrace(const PathChar* _path, float _sampleRate, BusReplayResult& _result,
+	const std::function<void(const SensorSample& _sample)>& _onSample = std::function<void(const SensorSample&)>());
@@ -0,0 +1,315 @@
+//
+// I2cTraceCheck.cpp
+//
+
+#include "pch.h"
+#include "I2cTraceCheck.h"
+#include "Mpu6050Fifo.h"
+#include "MotionEventDetector.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+
+namespace
+{
+	const uint64_t BURST_PERIOD_TICKS = 200000;		// the 20 ms acquisition timer
+	const uint64_t BURST_JITTER_TICKS = 5000;
+	const uint64_t STALL_TICKS = 2000000;			// long enough for the FIFO to overflow
+	const uint32_t STALL_EVERY = 97;				// bursts
+	const uint32_t INTERRUPT_EVERY = 50;			// bursts, status reads between them
+	const uint64_t BYTE_TICKS = 225;				// 9 bits at 400 kHz
+	const uint32_t NAK_ONE_IN = 500;				// transactions
+	const uint32_t SHORT_READ_ONE_IN = 300;			// frame reads
+	const uint32_t INTERLEAVE_ONE_IN = 40;			// frame reads with a status read inside
+	const uint32_t TIMED_BATCH = 512;				// full FIFO reads, about 0.5 MB of trace
+	const uint64_t WRITER_LAG_BYTES = 128 * 1024;	// staged but not yet written before a batch
+
+	void RemoveFile(const PathChar* _path)
+	{
+#if defined(_WIN32)
+		_wremove(_path);
+#else
+		remove(_path);
+#endif
+	}
+
+	// deterministic so a failure can be reproduced
+	uint32_t NextRandom(uint32_t& _state)
+	{
+		_state = _state * 1664525u + 1013904223u;
+		return _state >> 8;
+	}
+
+	bool IsSameSample(const SensorSample& _a, const SensorSample& _b)
+	{
+		return _a.timestamp == _b.timestamp && _a.deviceId == _b.deviceId && _a.temperature == _b.temperature
+			&& memcmp(_a.accel, _b.accel, sizeof(_a.accel)) == 0 && memcmp(_a.gyro, _b.gyro, sizeof(_a.gyro)) == 0;
+	}
+
+	// An MPU6050 on a 400 kHz bus: each transaction takes the clock forward by its
+	// bytes, frames enter the FIFO on the sample period and a frame read takes
+	// them out. The interrupt thread is played by a status read through _outer
+	// from inside a frame read, which the trace records before the frame read.
+	class SimulatedMpu6050 : public I2cTransport
+	{
+	public:
+
+		SimulatedMpu6050(VirtualClock& _clock, float _sampleRate) :
+			m_Clock(_clock),
+			m_Outer(nullptr),
+			m_Period(uint64_t(DX::StepTimer::TicksPerSecond / _sampleRate)),
+			m_LastFrame(_clock.GetTicks()),
+			m_FifoBytes(0),
+			m_Random(2024),
+			m_NextByte(0),
+			m_Temperature(-2000),
+			m_InterruptCount(0),
+			m_TracedSize(0)
+		{
+		}
+
+		void SetOuter(I2cTransport* _outer)			{ m_Outer = _outer; }
+		uint32_t GetInterruptCount() const			{ return m_InterruptCount; }
+		uint64_t GetTracedSize() const				{ return m_TracedSize; }	// of the records of all transactions so far
+
+		I2cResult Write(uint8_t, const uint8_t* _data, uint32_t _size) override
+		{
+			Transfer(_size, 0);
+			if (NextRandom(m_Random) % NAK_ONE_IN == 0)
+			{
+				return I2cResult(I2C_ADDRESS_NAK, 0);
+			}
+			if (_size == 2 && _data[0] == MPU6050_USER_CTRL && (_data[1] & MPU6050_USER_CTRL_FIFO_RESET) != 0)
+			{
+				m_FifoBytes = 0;
+			}
+			return I2cResult(I2C_FULL_TRANSFER, _size);
+		}
+
+		I2cResult WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize) override
+		{
+			Transfer(_writeSize, _readSize);
+			m_InterruptCount += (_write[0] == MPU6050_INT_STATUS) ? 1 : 0;
+			if (NextRandom(m_Random) % NAK_ONE_IN == 0)
+			{
+				memset(_read, 0xEE, _readSize);
+				return I2cResult(I2C_ADDRESS_NAK, 0);
+			}
+
+			switch (_write[0])
+			{
+			case MPU6050_FIFO_COUNT_H:
+				_read[0] = uint8_t(m_FifoBytes >> 8);
+				_read[1] = uint8_t(m_FifoBytes);
+				break;
+
+			case MPU6050_FIFO_R_W:
+			{
+				if (m_Outer != nullptr && NextRandom(m_Random) % INTERLEAVE_ONE_IN == 0)
+				{
+					uint8_t status;
+					ReadRegisters(*m_Outer, _address, MPU6050_INT_STATUS, &status, 1);
+				}
+				for (uint32_t i = 0; i < _readSize; ++i)
+				{
+					_read[i] = uint8_t(m_NextByte++ * 31);
+				}
+				const uint32_t read = (NextRandom(m_Random) % SHORT_READ_ONE_IN == 0) ? _readSize / 2 : _readSize;
+				m_FifoBytes -= std::min(m_FifoBytes, read);
+				return I2cResult((read == _readSize) ? I2C_FULL_TRANSFER : I2C_PARTIAL_TRANSFER, _writeSize + read);
+			}
+
+			case MPU6050_TEMP_OUT_H:
+				++m_Temperature;
+				_read[0] = uint8_t(uint16_t(m_Temperature) >> 8);
+				_read[1] = uint8_t(m_Temperature);
+				break;
+
+			case MPU6050_INT_STATUS:
+				_read[0] = MPU6050_INT_MOTION;
+				break;
+
+			default:
+				memset(_read, 0, _readSize);
+				break;
+			}
+			return I2cResult(I2C_FULL_TRANSFER, _writeSize + _readSize);
+		}
+
+	private:
+
+		SimulatedMpu6050(const SimulatedMpu6050&);
+		SimulatedMpu6050& operator=(const SimulatedMpu6050&);
+
+		// the bus time of the transaction, and the frames sampled meanwhile
+		void Transfer(uint32_t _writeSize, uint32_t _readSize)
+		{
+			I2cTraceRecord record = {};
+			record.writeSize = uint8_t(_writeSize);
+			record.readSize = uint16_t(_readSize);
+			m_TracedSize += GetI2cTraceRecordSize(record);
+
+			m_Clock.Advance((1 + _writeSize + ((_readSize > 0) ? 1 + _readSize : 0)) * BYTE_TICKS);
+			const uint64_t now = m_Clock.GetTicks();
+			for (; m_LastFrame + m_Period <= now; m_LastFrame += m_Period)
+			{
+				m_FifoBytes = std::min(m_FifoBytes + MPU6050_FIFO_FRAME_SIZE, MPU6050_FIFO_SIZE);
+			}
+		}
+
+		VirtualClock& m_Clock;
+		I2cTransport* m_Outer;
+		uint64_t m_Period;
+		uint64_t m_LastFrame;
+		unsigned int m_FifoBytes;
+		uint32_t m_Random;
+		uint32_t m_NextByte;
+		int16_t m_Temperature;
+		uint32_t m_InterruptCount;
+		uint64_t m_TracedSize;
+	};
+
+	// answers at once, so only the cost of the transport itself is timed
+	class NullI2cTransport : public I2cTransport
+	{
+	public:
+
+		I2cResult Write(uint8_t, const uint8_t*, uint32_t _size) override
+		{
+			return I2cResult(I2C_FULL_TRANSFER, _size);
+		}
+
+		I2cResult WriteRead(uint8_t, const uint8_t*, uint32_t _writeSize, uint8_t*, uint32_t _readSize) override
+		{
+			return I2cResult(I2C_FULL_TRANSFER, _writeSize + _readSize);
+		}
+	};
+
+	// in batches small enough for the staging buffer, each started once the writer
+	// thread caught up; a batch in which the writer dropped records is not timed
+	double TimeFifoReads(TracingI2cTransport& _bus, const I2cTraceWriter& _writer, uint32_t _count)
+	{
+		uint8_t frames[MPU6050_FIFO_MAX_FRAMES * MPU6050_FIFO_FRAME_SIZE];
+		I2cTraceRecord record = {};
+		record.writeSize = 1;
+		record.readSize = sizeof(frames);
+		const uint64_t recordSize = GetI2cTraceRecordSize(record);
+
+		double seconds = 0.0;
+		uint32_t timed = 0;
+		uint64_t staged = 0;
+		for (uint32_t done = 0; done < _count; done += TIMED_BATCH)
+		{
+			const uint32_t batch = std::min(TIMED_BATCH, _count - done);
+			while (_writer.IsOpen() && _writer.GetWrittenSize() + WRITER_LAG_BYTES < staged && !_writer.HasWriteError())
+			{
+				std::this_thread::yield();
+			}
+
+			const uint32_t dropped = _writer.GetDroppedCount();
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < batch; ++i)
+			{
+				ReadRegisters(_bus, MPU6050_I2C_ADDRESS, MPU6050_FIFO_R_W, frames, sizeof(frames));
+			}
+			const double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			staged += _writer.IsOpen() ? batch * recordSize : 0;
+			if (_writer.GetDroppedCount() == dropped)
+			{
+				seconds += batchSeconds;
+				timed += batch;
+			}
+		}
+		return (timed > 0) ? seconds * 1e9 / timed : 0.0;
+	}
+}
+
+
+bool CheckI2cTrace(const PathChar* _path, const I2cTraceCheckSettings& _settings, I2cTraceCheckResult& _result)
+{
+	memset(&_result, 0, sizeof(_result));
+
+	// 1) the acquisition on the simulated bus, traced, with the samples it decoded kept
+	std::vector<SensorSample> acquired;
+	{
+		VirtualClock clock(DX::StepTimer::TicksPerSecond);
+		SimulatedMpu6050 sensor(clock, _settings.sampleRate);
+		I2cTraceWriter writer;
+		TracingI2cTransport bus(clock, writer);
+		bus.SetTarget(&sensor);
+		sensor.SetOuter(&bus);
+		if (!writer.Open(_path))
+		{
+			return false;
+		}
+
+		Mpu6050FifoReader reader(MPU6050_I2C_ADDRESS, _settings.sampleRate);
+		reader.ResetFifo(bus);
+		SensorSample samples[MPU6050_FIFO_MAX_FRAMES];
+		uint32_t random = 99;
+		const uint32_t burstCount = uint32_t(_settings.seconds * DX::StepTimer::TicksPerSecond / BURST_PERIOD_TICKS);
+		for (uint32_t burst = 0; burst < burstCount; ++burst)
+		{
+			clock.Advance(BURST_PERIOD_TICKS + NextRandom(random) % BURST_JITTER_TICKS + ((burst % STALL_EVERY == STALL_EVERY - 1) ? STALL_TICKS : 0));
+			unsigned int count = 0;
+			_result.busErrorCount += (reader.ReadBurst(bus, clock, samples, count) == FIFO_BURST_BUS_ERROR) ? 1 : 0;
+			acquired.insert(acquired.end(), samples, samples + count);
+
+			// the simulation outruns any storage, it waits for the writer rather than have records dropped
+			while (writer.GetWrittenSize() + WRITER_LAG_BYTES < sensor.GetTracedSize() && !writer.HasWriteError())
+			{
+				std::this_thread::yield();
+			}
+
+			if (burst % INTERRUPT_EVERY == 0)
+			{
+				uint8_t status;
+				ReadRegisters(bus, MPU6050_I2C_ADDRESS, MPU6050_INT_STATUS, &status, 1);
+			}
+		}
+		writer.Close();
+		if (writer.HasWriteError() || writer.GetDroppedCount() > 0)
+		{
+			RemoveFile(_path);
+			return false;
+		}
+		_result.sampleCount = acquired.size();
+		_result.overflowCount = reader.GetOverflowCount();
+		_result.interruptCount = sensor.GetInterruptCount();
+	}
+
+	// 2) the same samples back from the trace, bit for bit
+	uint64_t replayed = 0;
+	const bool opened = ReplayBusTrace(_path, _settings.sampleRate, _result.replay, [&](const SensorSample& _sample)
+	{
+		_result.mismatchCount += (replayed < acquired.size() && IsSameSample(_sample, acquired[replayed])) ? 0 : 1;
+		++replayed;
+	});
+	if (!opened)
+	{
+		RemoveFile(_path);
+		return false;
+	}
+	_result.mismatchCount += (replayed < acquired.size()) ? acquired.size() - replayed : 0;
+
+	// 3) what tracing adds to a transaction, on the real clock
+	{
+		NullI2cTransport target;
+		I2cTraceWriter writer;
+		TracingI2cTransport bus(GetRealClock(), writer);
+		bus.SetTarget(&target);
+		_result.untracedNanoseconds = TimeFifoReads(bus, writer, _settings.timedTransactions);
+		if (writer.Open(_path))
+		{
+			_result.tracedNanoseconds = TimeFifoReads(bus, writer, _settings.timedTransactions);
+			writer.Close();
+			_result.droppedCount = writer.GetDroppedCount();
+		}
+	}
+
+	RemoveFile(_path);
+	_result.succeeded = true;
+	return true;
+}
@@ -0,0 +1,47 @@
+//
+// I2cTraceCheck.h - end to end check of the I2C trace against a simulated MPU6050
+//
+// Runs the FIFO acquisition on a simulated bus under a VirtualClock, traced to
+// a file: the FIFO fills at the sample rate, every few hundred transactions one
+// is NAKed or a frame read comes back short, now and then a burst is late enough
+// for the FIFO to overflow, and motion interrupt status reads interleave with the
+// frame reads the way the interrupt thread's do. ReplayBusTrace then has to
+// reproduce every sample bit for bit without a diverged transaction. The cost of
+// tracing is timed apart on the real clock, against a bus that returns at once.
+//
+
+#pragma once
+
+#include "I2cTrace.h"
+
+
+struct I2cTraceCheckSettings
+{
+	float sampleRate;			// Hz
+	float seconds;				// of simulated acquisition
+	uint32_t timedTransactions;	// per pass of the cost measurement
+
+	I2cTraceCheckSettings() :
+		sampleRate(1000.0f),
+		seconds(600.0f),
+		timedTransactions(100000)
+	{
+	}
+};
+
+struct I2cTraceCheckResult
+{
+	bool succeeded;					// the trace could be written and replayed
+	uint64_t sampleCount;			// acquired on the simulated bus
+	uint32_t busErrorCount;			// bursts ended by a simulated fault
+	uint32_t overflowCount;
+	uint32_t interruptCount;		// interleaved status reads, NAKed ones too
+	BusReplayResult replay;
+	uint64_t mismatchCount;			// replayed samples different from the acquired ones, or missing
+	double untracedNanoseconds;		// per full FIFO read through TracingI2cTransport, writer closed
+	double tracedNanoseconds;		// the same, writer open
+	uint32_t droppedCount;			// by the writer during the timed pass, their batches are not timed
+};
+
+// _path is overwritten and removed afterwards
+bool CheckI2cTrace(const PathChar* _path, const I2cTraceCheckSettings& _settings, I2cTraceCheckResult& _result);
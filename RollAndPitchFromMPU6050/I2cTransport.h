@@ -0,0 +1,66 @@
+//
+// I2cTransport.h - the bus transactions of the acquisition, apart from the bus driver
+//
+// The MPU6050 code issues its writes and register reads through an I2cTransport
+// rather than the Windows I2cDevice, so the same code runs on the device, under
+// the trace recorder and against a recorded trace. Results mirror
+// I2cTransferResult of Windows.Devices.I2c: a NAK or a short transfer comes
+// back as a status instead of an exception, with the bytes that made it.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+
+// same order as Windows::Devices::I2c::I2cTransferStatus
+enum I2cStatus
+{
+	I2C_FULL_TRANSFER,
+	I2C_PARTIAL_TRANSFER,
+	I2C_ADDRESS_NAK,
+	I2C_CLOCK_STRETCH_TIMEOUT,
+	I2C_UNKNOWN_ERROR,
+};
+
+struct I2cResult
+{
+	uint32_t status;				// I2cStatus
+	uint32_t bytesTransferred;		// written and read
+	uint64_t endTicks;				// Clock ticks when it returned, 0 from a transport that keeps no time
+
+	I2cResult(uint32_t _status = I2C_UNKNOWN_ERROR, uint32_t _bytesTransferred = 0, uint64_t _endTicks = 0) :
+		status(_status),
+		bytesTransferred(_bytesTransferred),
+		endTicks(_endTicks)
+	{
+	}
+
+	bool IsFull() const				{ return status == I2C_FULL_TRANSFER; }
+};
+
+
+class I2cTransport
+{
+public:
+
+	virtual ~I2cTransport() {}
+
+	virtual I2cResult Write(uint8_t _address, const uint8_t* _data, uint32_t _size) = 0;
+
+	// _write (the register address) then a repeated start and _readSize bytes into _read
+	virtual I2cResult WriteRead(uint8_t _address, const uint8_t* _write, uint32_t _writeSize, uint8_t* _read, uint32_t _readSize) = 0;
+};
+
+
+inline bool WriteRegister(I2cTransport& _bus, uint8_t _address, uint8_t _register, uint8_t _value)
+{
+	const uint8_t data[2] = { _register, _value };
+	return _bus.Write(_address, data, sizeof(data)).IsFull();
+}
+
+// _size registers from _register on; auto-increments except on the FIFO register
+inline bool ReadRegisters(I2cTransport& _bus, uint8_t _address, uint8_t _register, uint8_t* _data, uint32_t _size)
+{
+	return _bus.WriteRead(_address, &_register, 1, _data, _size).IsFull();
+}
@@ -0,0 +1,263 @@
+//
+// LogReplay.cpp
+//
+
+#include "pch.h"
+#include "LogReplay.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+
+namespace
+{
+	const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+
+#if defined(_WIN32)
+	const PathChar GOLDEN_EXTENSION[] = L".golden";
+#else
+	const PathChar GOLDEN_EXTENSION[] = ".golden";
+#endif
+
+	FILE* OpenFile(const PathChar* _path, bool _write)
+	{
+#if defined(_WIN32)
+		FILE* file = nullptr;
+		return (_wfopen_s(&file, _path, _write ? L"wb" : L"rb") == 0) ? file : nullptr;
+#else
+		return fopen(_path, _write ? "wb" : "rb");
+#endif
+	}
+
+	// the recording the golden digest belongs to
+	bool GetLogIdentity(const PathChar* _path, uint64_t& _size, uint64_t& _recordCount)
+	{
+		MappedSensorLog log;
+		if (!log.Open(_path))
+		{
+			return false;
+		}
+		_size = log.GetFileSize();
+		_recordCount = log.GetRecordCount();
+		return true;
+	}
+
+	uint64_t HashBytes(uint64_t _hash, const void* _data, size_t _size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(_data);
+		for (size_t i = 0; i < _size; ++i)
+		{
+			_hash = (_hash ^ bytes[i]) * FNV_PRIME;
+		}
+		return _hash;
+	}
+
+	// field by field, the padding of FusedOrientation is not part of the output
+	uint64_t HashFrame(uint64_t _hash, const SensorPipeline& _pipeline)
+	{
+		const FusedOrientation& fused = _pipeline.GetOrientation();
+		_hash = HashBytes(_hash, &fused.timestamp, sizeof(fused.timestamp));
+		_hash = HashBytes(_hash, &fused.orientation, sizeof(fused.orientation));
+		_hash = HashBytes(_hash, fused.attitudeVariance, sizeof(fused.attitudeVariance));
+		return HashBytes(_hash, &_pipeline.GetDisplayOrientation(), sizeof(DirectX::SimpleMath::Quaternion));
+	}
+}
+
+
+LogReplay::LogReplay() :
+	m_DeviceId(0),
+	m_BurstTicks(0),
+	m_StartTime(0),
+	m_SampleCount(0),
+	m_DrainTimer(0),
+	m_FrameTimer(m_Clock),
+	m_Target(nullptr)
+{
+}
+
+bool LogReplay::Open(const PathChar* _path, uint32_t _deviceId, double _burstPeriod)
+{
+	Close();
+	if (!m_Log.Open(_path) || m_Log.GetRecordCount() == 0)
+	{
+		m_Log.Close();
+		return false;
+	}
+
+	m_DeviceId = (_deviceId != 0) ? _deviceId : m_Log.Begin().GetRecord().deviceId;
+	m_BurstTicks = DX::StepTimer::SecondsToTicks(_burstPeriod);
+	if (m_BurstTicks > 0)
+	{
+		// the acquisition drains the FIFO on its period, samples wait there until then
+		m_DrainTimer = m_Clock.StartTimer(m_BurstTicks, [this]() { Drain(m_Clock.GetTicks()); });
+	}
+	Rewind();
+	return true;
+}
+
+void LogReplay::Close()
+{
+	m_Clock.StopTimer(m_DrainTimer);
+	m_DrainTimer = 0;
+	m_Cursor = SensorLogCursor();
+	m_Log.Close();
+	m_SampleCount = 0;
+}
+
+void LogReplay::Rewind()
+{
+	m_Cursor = m_Log.Begin();
+	m_StartTime = m_Log.GetFirstTimestamp();
+	m_Clock.Restart(m_StartTime);
+	m_FrameTimer.ResetElapsedTime();
+	m_SampleCount = 0;
+}
+
+bool LogReplay::AdvanceTo(uint64_t _time, SensorPipeline& _pipeline)
+{
+	m_Target = &_pipeline;
+	m_Clock.AdvanceTo(_time);
+	if (m_DrainTimer == 0)
+	{
+		Drain(m_Clock.GetTicks());
+	}
+	m_Target = nullptr;
+	return m_Cursor.IsValid();
+}
+
+bool LogReplay::RunFrame(uint64_t _frameTicks, SensorPipeline& _pipeline)
+{
+	const bool more = AdvanceTo(GetTime() + _frameTicks, _pipeline);
+	m_FrameTimer.Tick([&]()
+	{
+		_pipeline.Flush();
+		_pipeline.UpdateDisplay(GetTime(), float(m_FrameTimer.GetElapsedSeconds()));
+	});
+	return more;
+}
+
+void LogReplay::Drain(uint64_t _time)
+{
+	for (; m_Cursor.IsValid() && m_Cursor.GetTimestamp() <= _time; m_Cursor.Next())
+	{
+		if (m_Cursor.GetRecord().deviceId == m_DeviceId)
+		{
+			m_Target->Push(m_Cursor.GetSample());
+			++m_SampleCount;
+		}
+	}
+}
+
+
+bool ReplayLog(const PathChar* _path, const PipelineSettings& _settings, const ReplaySettings& _replay, ReplayResult& _result, const ReplayFrameCallback& _onFrame)
+{
+	LogReplay replay;
+	if (!replay.Open(_path, _replay.deviceId, _replay.burstPeriod))
+	{
+		return false;
+	}
+
+	SensorPipeline pipeline(_settings);
+	const uint64_t frameTicks = std::max<uint64_t>(DX::StepTimer::SecondsToTicks(_replay.framePeriod), 1);
+	const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+	_result.deviceId = replay.GetDeviceId();
+	_result.frameCount = 0;
+	_result.digest = FNV_OFFSET_BASIS;
+
+	bool more;
+	do
+	{
+		more = replay.RunFrame(frameTicks, pipeline);
+		++_result.frameCount;
+		_result.digest = HashFrame(_result.digest, pipeline);
+		if (_onFrame)
+		{
+			_onFrame(replay.GetTime(), pipeline);
+		}
+
+		// pacing only delays the next frame, the virtual clock does not see it
+		if (_replay.speed > 0.0)
+		{
+			const double wallSeconds = _result.frameCount * _replay.framePeriod / _replay.speed;
+			std::this_thread::sleep_until(wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wallSeconds)));
+		}
+	} while (more);
+
+	_result.sampleCount = replay.GetSampleCount();
+	_result.fusedCount = pipeline.GetFusedCount();
+	_result.virtualSeconds = DX::StepTimer::TicksToSeconds(replay.GetTime() - replay.GetStartTime());
+	_result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	return true;
+}
+
+bool SaveReplayGolden(const PathChar* _path, const ReplayResult& _result)
+{
+	ReplayGoldenFile golden;
+	memset(&golden, 0, sizeof(golden));
+	if (!GetLogIdentity(_path, golden.logSize, golden.recordCount))
+	{
+		return false;
+	}
+	golden.magic = REPLAY_GOLDEN_MAGIC;
+	golden.version = REPLAY_GOLDEN_VERSION;
+	golden.deviceId = _result.deviceId;
+	golden.frameCount = _result.frameCount;
+	golden.sampleCount = _result.sampleCount;
+	golden.digest = _result.digest;
+
+	FILE* file = OpenFile((std::basic_string<PathChar>(_path) + GOLDEN_EXTENSION).c_str(), true);
+	if (file == nullptr)
+	{
+		return false;
+	}
+	const bool written = fwrite(&golden, sizeof(golden), 1, file) == 1;
+	return (fclose(file) == 0) && written;
+}
+
+bool LoadReplayGolden(const PathChar* _path, ReplayResult& _golden)
+{
+	FILE* file = OpenFile((std::basic_string<PathChar>(_path) + GOLDEN_EXTENSION).c_str(), false);
+	if (file == nullptr)
+	{
+		return false;
+	}
+	ReplayGoldenFile golden;
+	const bool read = fread(&golden, sizeof(golden), 1, file) == 1;
+	fclose(file);
+
+	uint64_t logSize, recordCount;
+	if (!read || golden.magic != REPLAY_GOLDEN_MAGIC || golden.version != REPLAY_GOLDEN_VERSION
+		|| !GetLogIdentity(_path, logSize, recordCount) || golden.logSize != logSize || golden.recordCount != recordCount)
+	{
+		return false;
+	}
+
+	memset(&_golden, 0, sizeof(_golden));
+	_golden.deviceId = golden.deviceId;
+	_golden.frameCount = golden.frameCount;
+	_golden.sampleCount = golden.sampleCount;
+	_golden.digest = golden.digest;
+	return true;
+}
+
+bool CheckReplayGolden(const PathChar* _path, const PipelineSettings& _settings, const ReplaySettings& _replay, ReplayGoldenCheck& _check)
+{
+	_check.replayed = ReplayLog(_path, _settings, _replay, _check.result);
+	if (!_check.replayed)
+	{
+		return false;
+	}
+
+	_check.goldenSaved = !LoadReplayGolden(_path, _check.golden);
+	if (_check.goldenSaved)
+	{
+		_check.golden = _check.result;
+		SaveReplayGolden(_path, _check.result);
+	}
+	_check.matches = _check.golden.deviceId == _check.result.deviceId && _check.golden.frameCount == _check.result.frameCount
+		&& _check.golden.sampleCount == _check.result.sampleCount && _check.golden.digest == _check.result.digest;
+	return true;
+}
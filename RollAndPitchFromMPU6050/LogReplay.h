@@ -0,0 +1,150 @@
+//
+// LogReplay.h - recorded logs through the live pipeline on a virtual clock
+//
+// A log holds the frames exactly as they came off the bus, so replaying it
+// through SensorPipeline reproduces what the application showed, without the
+// hardware. Time is a VirtualClock: it only moves when the caller advances it,
+// by a whole number of ticks per frame. A timer on it hands samples over at the
+// FIFO drain times the acquisition would have seen, and a StepTimer on it times
+// the frames as in Game. Nothing depends on the wall clock or on thread timing,
+// so a replay with the same log and settings gives bit-identical output on
+// every run; pacing only decides how long it takes.
+//
+// The digest of a replay can be kept next to the log as its golden digest. A
+// later replay of the same recording that does not reproduce it shows a change
+// in the pipeline code, its settings, the compiler or the platform. Replays
+// cover one device of a log.
+//
+
+#pragma once
+
+#include "SensorLog.h"
+#include "SensorPipeline.h"
+
+#include <functional>
+
+
+// Steps the virtual clock of one device's samples. Game drives it once per
+// rendered frame, ReplayLog as fast as possible or at a multiple of real time.
+class LogReplay
+{
+public:
+
+	LogReplay();
+
+	// _deviceId 0 replays the device of the first record; _burstPeriod is the FIFO
+	// drain period in seconds, 0 hands every sample over at its own timestamp
+	bool Open(const PathChar* _path, uint32_t _deviceId = 0, double _burstPeriod = 0.02);
+	void Close();
+	bool IsOpen() const					{ return m_Log.IsOpen(); }
+
+	// virtual clock back to the first record
+	void Rewind();
+
+	// moves the virtual clock to _time and pushes every sample drained by then;
+	// false once the whole log has been delivered
+	bool AdvanceTo(uint64_t _time, SensorPipeline& _pipeline);
+
+	// one frame of Game::Update: advance by _frameTicks, then flush and sample the
+	// display from the frame timer; false once the whole log has been delivered
+	bool RunFrame(uint64_t _frameTicks, SensorPipeline& _pipeline);
+
+	const Clock& GetClock() const		{ return m_Clock; }
+	uint32_t GetDeviceId() const		{ return m_DeviceId; }
+	uint64_t GetTime() const			{ return m_Clock.GetTicks(); }	// StepTimer ticks in the time base of the log
+	uint64_t GetStartTime() const		{ return m_StartTime; }
+	uint64_t GetEndTime() const			{ return m_Log.GetLastTimestamp(); }
+	uint64_t GetSampleCount() const		{ return m_SampleCount; }	// delivered so far
+	bool IsFinished() const				{ return !m_Cursor.IsValid(); }
+
+private:
+
+	LogReplay(const LogReplay&);
+	LogReplay& operator=(const LogReplay&);
+
+	// pushes the samples up to _time into m_Target
+	void Drain(uint64_t _time);
+
+	MappedSensorLog m_Log;
+	SensorLogCursor m_Cursor;
+	uint32_t m_DeviceId;
+	uint64_t m_BurstTicks;
+	uint64_t m_StartTime;
+	uint64_t m_SampleCount;
+
+	VirtualClock m_Clock;
+	uint32_t m_DrainTimer;				// FIFO drains on m_Clock, 0 = per sample
+	DX::StepTimer m_FrameTimer;
+	SensorPipeline* m_Target;			// during AdvanceTo
+};
+
+
+struct ReplaySettings
+{
+	double framePeriod;		// virtual seconds per frame, the display refresh of the live run
+	double burstPeriod;		// FIFO drain period of the acquisition, 0 = per sample
+	double speed;			// multiple of real time, 0 = as fast as possible
+	uint32_t deviceId;		// 0 = device of the first record
+
+	ReplaySettings() :
+		framePeriod(1.0 / 60.0),
+		burstPeriod(0.02),
+		speed(0.0),
+		deviceId(0)
+	{
+	}
+};
+
+struct ReplayResult
+{
+	uint32_t deviceId;
+	uint64_t frameCount;
+	uint64_t sampleCount;		// raw samples delivered
+	uint64_t fusedCount;		// after oversampling
+	double virtualSeconds;
+	double wallSeconds;
+	uint64_t digest;			// FNV-1a of the fused and displayed orientation bits of every frame
+};
+
+// after every frame, with the virtual time of the frame
+typedef std::function<void(uint64_t _time, const SensorPipeline& _pipeline)> ReplayFrameCallback;
+
+// runs the whole log through a pipeline made from _settings; false when the log cannot be opened or is empty
+bool ReplayLog(const PathChar* _path, const PipelineSettings& _settings, const ReplaySettings& _replay, ReplayResult& _result,
+	const ReplayFrameCallback& _onFrame = ReplayFrameCallback());
+
+
+const uint32_t REPLAY_GOLDEN_MAGIC = 0x4755504D;	// "MPUG"
+const uint32_t REPLAY_GOLDEN_VERSION = 1;
+
+// _path plus ".golden"; logSize and recordCount tie it to one recording
+struct ReplayGoldenFile
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t logSize;
+	uint64_t recordCount;
+	uint32_t deviceId;
+	uint32_t reserved;
+	uint64_t frameCount;
+	uint64_t sampleCount;
+	uint64_t digest;
+};
+
+bool SaveReplayGolden(const PathChar* _path, const ReplayResult& _result);
+
+// false when none was saved or it belongs to another recording at the same path
+bool LoadReplayGolden(const PathChar* _path, ReplayResult& _golden);
+
+struct ReplayGoldenCheck
+{
+	bool replayed;				// the log could be replayed, the rest is valid
+	ReplayResult result;
+	ReplayResult golden;		// frame and sample count and digest
+	bool goldenSaved;			// there was none for this recording, the result is the golden digest from now on
+	bool matches;
+};
+
+// one unpaced replay against the golden digest of the log, which is saved when
+// missing; false when the log cannot be replayed
+bool CheckReplayGolden(const PathChar* _path, const PipelineSettings& _settings, const ReplaySettings& _replay, ReplayGoldenCheck& _check);
@@ -46,7 +46,7 @@ public:
         CoreApplication::Resuming +=
             ref new EventHandler<Platform::Object^>(this, &ViewProvider::OnResuming);
 
-        m_game = std::make_unique<Game>();
+        m_game = std::make_unique<Game>(GetRealClock());
     }
 
     virtual void Uninitialize()
@@ -74,6 +74,15 @@ public:
         }
 #endif
 
+        window->PointerPressed +=
+            ref new TypedEventHandler<CoreWindow^, PointerEventArgs^>(this, &ViewProvider::OnPointerEvent);
+
+        window->PointerReleased +=
+            ref new TypedEventHandler<CoreWindow^, PointerEventArgs^>(this, &ViewProvider::OnPointerEvent);
+
+        window->PointerMoved +=
+            ref new TypedEventHandler<CoreWindow^, PointerEventArgs^>(this, &ViewProvider::OnPointerEvent);
+
         window->VisibilityChanged +=
             ref new TypedEventHandler<CoreWindow^, VisibilityChangedEventArgs^>(this, &ViewProvider::OnVisibilityChanged);
 
@@ -236,6 +245,12 @@ protected:
         m_exit = true;
     }
 
+    void OnPointerEvent(CoreWindow^ sender, PointerEventArgs^ args)
+    {
+        auto point = args->CurrentPoint;
+        m_game->OnPointer(ConvertDipsToPixels(point->Position.X), ConvertDipsToPixels(point->Position.Y), point->Properties->IsLeftButtonPressed);
+    }
+
     void OnAcceleratorKeyActivated(CoreDispatcher^, AcceleratorKeyEventArgs^ args)
     {
         if (args->EventType == CoreAcceleratorKeyEventType::SystemKeyDown
@@ -251,6 +266,15 @@ protected:
             else
                 view->TryEnterFullScreenMode();
 
+            args->Handled = true;
+        }
+        else if (args->EventType == CoreAcceleratorKeyEventType::KeyDown
+            && args->VirtualKey == VirtualKey::F9
+            && !args->KeyStatus.WasKeyDown)
+        {
+            // black box dump of the seconds around now
+            m_game->OnDumpKey();
+
             args->Handled = true;
         }
     }
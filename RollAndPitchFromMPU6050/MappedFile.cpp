@@ -0,0 +1,140 @@
+//
+// MappedFile.cpp
+//
+
+#include "pch.h"
+#include "MappedFile.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() :
+	m_Data(nullptr),
+	m_Size(0),
+	m_File(INVALID_HANDLE_VALUE),
+	m_Mapping(nullptr)
+{
+}
+
+bool MappedFile::Open(const PathChar* _path)
+{
+	Close();
+
+	// the *FromApp variants are the ones available to UWP apps
+	m_File = CreateFile2(_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	FILE_STANDARD_INFO info;
+	if (!GetFileInformationByHandleEx(m_File, FileStandardInfo, &info, sizeof(info)) || info.EndOfFile.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingFromApp(m_File, nullptr, PAGE_READONLY, 0, nullptr);
+	if (m_Mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	m_Data = static_cast<const uint8_t*>(MapViewOfFileFromApp(m_Mapping, FILE_MAP_READ, 0, 0));
+	if (m_Data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	m_Size = size_t(info.EndOfFile.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data != nullptr)
+	{
+		UnmapViewOfFile(m_Data);
+		m_Data = nullptr;
+	}
+	if (m_Mapping != nullptr)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_File);
+		m_File = INVALID_HANDLE_VALUE;
+	}
+	m_Size = 0;
+}
+
+#else
+
+MappedFile::MappedFile() :
+	m_Data(nullptr),
+	m_Size(0),
+	m_File(-1)
+{
+}
+
+bool MappedFile::Open(const PathChar* _path)
+{
+	Close();
+
+	m_File = open(_path, O_RDONLY);
+	if (m_File < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(m_File, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = size_t(info.st_size);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(m_Data), m_Size);
+		m_Data = nullptr;
+	}
+	if (m_File >= 0)
+	{
+		close(m_File);
+		m_File = -1;
+	}
+	m_Size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
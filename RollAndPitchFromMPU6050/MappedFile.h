@@ -0,0 +1,47 @@
+//
+// MappedFile.h - read-only memory mapping of a whole file
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#if defined(_WIN32)
+typedef wchar_t PathChar;
+#else
+typedef char PathChar;
+#endif
+
+
+class MappedFile
+{
+public:
+
+	MappedFile();
+	~MappedFile();
+
+	// maps the whole file, returns false if it can't be opened or is empty
+	bool Open(const PathChar* _path);
+	void Close();
+
+	bool IsOpen() const					{ return m_Data != nullptr; }
+	const uint8_t* GetData() const		{ return m_Data; }
+	size_t GetSize() const				{ return m_Size; }
+
+private:
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const uint8_t* m_Data;
+	size_t m_Size;
+
+#if defined(_WIN32)
+	void* m_File;
+	void* m_Mapping;
+#else
+	int m_File;
+#endif
+};
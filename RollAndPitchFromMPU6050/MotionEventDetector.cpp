@@ -0,0 +1,188 @@
+//
+// MotionEventDetector.cpp
+//
+
+#include "pch.h"
+#include "MotionEventDetector.h"
+
+#include <math.h>
+
+
+namespace
+{
+	uint64_t MillisecondsToTicks(float _ms)
+	{
+		return (_ms > 0.0f) ? uint64_t(_ms * (DX::StepTimer::TicksPerSecond / 1000)) : 0;
+	}
+
+	uint8_t ToRegister(float _value, float _unit)
+	{
+		const float lsb = _value / _unit + 0.5f;
+		return (lsb <= 1.0f) ? 1 : ((lsb >= 255.0f) ? 255 : uint8_t(lsb));
+	}
+}
+
+
+MotionInterruptConfig MakeMotionInterruptConfig(const MotionEventSettings& _settings)
+{
+	MotionInterruptConfig config;
+	config.freeFallThreshold = ToRegister(_settings.freeFallThreshold, 0.002f);
+	config.freeFallDuration = ToRegister(_settings.freeFallMs, 1.0f);
+	config.motionThreshold = ToRegister(_settings.wakeThreshold, 0.002f);
+	config.motionDuration = 1;	// a single sample over threshold
+	return config;
+}
+
+int DecodeMotionInterrupts(uint8_t _status, uint64_t _timestamp, MotionEvent _events[2])
+{
+	int count = 0;
+	if (_status & MPU6050_INT_FREE_FALL)
+	{
+		MotionEvent& event = _events[count++];
+		event.type = MOTION_FREE_FALL;
+		event.timestamp = _timestamp;
+		event.magnitude = 0.0f;
+		event.hardware = true;
+	}
+	if (_status & MPU6050_INT_MOTION)
+	{
+		MotionEvent& event = _events[count++];
+		event.type = MOTION_WAKE;
+		event.timestamp = _timestamp;
+		event.magnitude = 0.0f;
+		event.hardware = true;
+	}
+	return count;
+}
+
+
+MotionEventDetector::MotionEventDetector()
+{
+	Reset();
+}
+
+MotionEventDetector::MotionEventDetector(const MotionEventSettings& _settings) :
+	m_Settings(_settings)
+{
+	Reset();
+}
+
+void MotionEventDetector::Reset()
+{
+	m_HasPrevious = false;
+	m_TapActive = false;
+	m_Falling = false;
+	m_FallReported = false;
+	m_InShock = false;
+
+	for (int type = 0; type < MOTION_EVENT_TYPE_COUNT; ++type)
+	{
+		m_LastEvent[type] = 0;
+	}
+}
+
+void MotionEventDetector::ProcessSample(const SensorSample& _sample)
+{
+	const ImuReading reading = ConvertToPhysical(_sample);
+	const float* accel = reading.accel;
+	const uint64_t now = _sample.timestamp;
+
+	const float magnitude = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+	const float deviation = fabsf(magnitude - 1.0f);
+
+	// shock: report on the first sample over the threshold
+	if (deviation > m_Settings.shockThreshold)
+	{
+		if (!m_InShock)
+		{
+			m_InShock = true;
+			m_TapActive = false;	// a shock is not also a tap
+			Fire(MOTION_SHOCK, now, deviation);
+		}
+	}
+	else
+	{
+		m_InShock = false;
+	}
+
+	// free-fall: magnitude stays low for the configured time, reported once per fall
+	if (magnitude < m_Settings.freeFallThreshold)
+	{
+		if (!m_Falling)
+		{
+			m_Falling = true;
+			m_FallStart = now;
+		}
+		if (!m_FallReported && now - m_FallStart >= MillisecondsToTicks(m_Settings.freeFallMs))
+		{
+			m_FallReported = true;
+			Fire(MOTION_FREE_FALL, now, float(DX::StepTimer::TicksToSeconds(now - m_FallStart)));
+		}
+	}
+	else
+	{
+		m_Falling = false;
+		m_FallReported = false;
+	}
+
+	// tap: jerk spike that settles back to 1g quickly
+	if (m_HasPrevious && now > m_PreviousTimestamp)
+	{
+		const float dt = float(DX::StepTimer::TicksToSeconds(now - m_PreviousTimestamp));
+		const float dx = accel[0] - m_PreviousAccel[0];
+		const float dy = accel[1] - m_PreviousAccel[1];
+		const float dz = accel[2] - m_PreviousAccel[2];
+		const float jerk = sqrtf(dx * dx + dy * dy + dz * dz) / dt;
+
+		if (m_TapActive)
+		{
+			m_TapPeak = std::max(m_TapPeak, deviation);
+			if (now - m_TapStart > MillisecondsToTicks(m_Settings.tapMaxMs))
+			{
+				m_TapActive = false;	// too long for a tap
+			}
+			else if (deviation <= m_Settings.tapSettle)
+			{
+				// fast rotations change the vector but not its length, those never leave 1g
+				m_TapActive = false;
+				if (m_TapPeak > m_Settings.tapSettle)
+				{
+					Fire(MOTION_TAP, now, m_TapPeak);
+				}
+			}
+		}
+		else if (jerk > m_Settings.tapJerk && !m_InShock && !m_Falling)
+		{
+			m_TapActive = true;
+			m_TapStart = now;
+			m_TapPeak = deviation;
+		}
+	}
+
+	m_HasPrevious = true;
+	m_PreviousTimestamp = now;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_PreviousAccel[axis] = accel[axis];
+	}
+}
+
+void MotionEventDetector::Fire(MotionEventType _type, uint64_t _timestamp, float _magnitude)
+{
+	const uint64_t last = m_LastEvent[_type];
+	if (last != 0 && _timestamp - last < MillisecondsToTicks(m_Settings.holdoffMs))
+	{
+		return;
+	}
+	m_LastEvent[_type] = _timestamp;
+
+	if (m_Callback)
+	{
+		MotionEvent event;
+		event.type = _type;
+		event.timestamp = _timestamp;
+		event.magnitude = _magnitude;
+		event.hardware = false;
+		m_Callback(event);
+	}
+}
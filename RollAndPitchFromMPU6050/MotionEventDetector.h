@@ -0,0 +1,129 @@
+//
+// MotionEventDetector.h - tap, free-fall and shock detection on the raw sample stream
+//
+// Runs on the acquisition thread right after each read, so events are reported
+// within one sample period instead of once per rendered frame. State is a few
+// scalars per rule, the cost per sample is constant.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+#include <functional>
+
+
+enum MotionEventType
+{
+	MOTION_TAP,				// short jerk spike that settles quickly
+	MOTION_FREE_FALL,		// acceleration magnitude near zero for a while
+	MOTION_SHOCK,			// acceleration magnitude far from 1g
+	MOTION_WAKE,			// MPU6050 motion interrupt only: high-passed acceleration above MOT_THR
+	MOTION_EVENT_TYPE_COUNT,
+};
+
+struct MotionEvent
+{
+	MotionEventType type;
+	uint64_t timestamp;		// StepTimer ticks of the sample that completed the event
+	float magnitude;		// peak |accel - 1g| for tap and shock (g), fall duration for free-fall (s)
+	bool hardware;			// reported by the MPU6050 interrupt instead of the sample rules
+};
+
+typedef std::function<void(const MotionEvent&)> MotionEventCallback;
+
+
+struct MotionEventSettings
+{
+	float tapJerk;				// g/s, sample to sample change that starts a tap
+	float tapMaxMs;				// spike must settle within this time to count as a tap
+	float tapSettle;			// g, |accel - 1g| considered settled
+	float freeFallThreshold;	// g, |accel| below this is falling
+	float freeFallMs;
+	float shockThreshold;		// g, |accel - 1g| above this is a shock
+	float wakeThreshold;		// g, MOT_THR of the hardware motion interrupt, at most 0.51
+	float holdoffMs;			// minimum time between two events of the same type
+
+	MotionEventSettings() :
+		tapJerk(15.0f),
+		tapMaxMs(120.0f),
+		tapSettle(0.15f),
+		freeFallThreshold(0.3f),
+		freeFallMs(100.0f),
+		shockThreshold(1.0f),
+		wakeThreshold(0.5f),
+		holdoffMs(250.0f)
+	{
+	}
+};
+
+
+// MPU6050 motion and free-fall interrupt registers (see MPU-6000 register map)
+const uint8_t MPU6050_FF_THR = 0x1D;
+const uint8_t MPU6050_FF_DUR = 0x1E;
+const uint8_t MPU6050_MOT_THR = 0x1F;
+const uint8_t MPU6050_MOT_DUR = 0x20;
+const uint8_t MPU6050_INT_PIN_CFG = 0x37;
+const uint8_t MPU6050_INT_ENABLE = 0x38;
+const uint8_t MPU6050_INT_STATUS = 0x3A;
+
+const uint8_t MPU6050_INT_LATCH = 0x20;			// INT_PIN_CFG: hold INT high until INT_STATUS is read
+const uint8_t MPU6050_INT_FREE_FALL = 0x80;		// INT_ENABLE / INT_STATUS bits
+const uint8_t MPU6050_INT_MOTION = 0x40;
+
+// register values matching the detector settings; MOT_THR cannot hold the shock
+// threshold, so the motion interrupt reports MOTION_WAKE at wakeThreshold and
+// shocks come from the sample rules only
+struct MotionInterruptConfig
+{
+	uint8_t freeFallThreshold;	// 2 mg per LSB
+	uint8_t freeFallDuration;	// 1 ms per LSB
+	uint8_t motionThreshold;	// 2 mg per LSB (saturates at 0.51 g), compared against the high-passed accel
+	uint8_t motionDuration;		// 1 ms per LSB
+};
+
+MotionInterruptConfig MakeMotionInterruptConfig(const MotionEventSettings& _settings);
+
+// events flagged in an INT_STATUS value, returns the number written to _events (at most 2)
+int DecodeMotionInterrupts(uint8_t _status, uint64_t _timestamp, MotionEvent _events[2]);
+
+
+class MotionEventDetector
+{
+public:
+
+	MotionEventDetector();
+	explicit MotionEventDetector(const MotionEventSettings& _settings);
+
+	void Reset();
+
+	// called from the thread that runs ProcessSample
+	void SetCallback(const MotionEventCallback& _callback)		{ m_Callback = _callback; }
+
+	void ProcessSample(const SensorSample& _sample);
+
+	const MotionEventSettings& GetSettings() const				{ return m_Settings; }
+
+private:
+
+	void Fire(MotionEventType _type, uint64_t _timestamp, float _magnitude);
+
+	MotionEventSettings m_Settings;
+	MotionEventCallback m_Callback;
+
+	bool m_HasPrevious;
+	float m_PreviousAccel[3];
+	uint64_t m_PreviousTimestamp;
+
+	bool m_TapActive;
+	uint64_t m_TapStart;
+	float m_TapPeak;
+
+	bool m_Falling;
+	bool m_FallReported;
+	uint64_t m_FallStart;
+
+	bool m_InShock;
+
+	uint64_t m_LastEvent[MOTION_EVENT_TYPE_COUNT];
+};
@@ -0,0 +1,185 @@
+//
+// Mpu6050Fifo.cpp
+//
+
+#include "pch.h"
+#include "Mpu6050Fifo.h"
+#include "Clock.h"
+
+
+namespace
+{
+	// gyro bandwidth per DLPF_CFG 0..6, 0 runs the gyro at 8 kHz, the others at 1 kHz
+	const float LOWPASS_BANDWIDTH[7] = { 256.0f, 188.0f, 98.0f, 42.0f, 20.0f, 10.0f, 5.0f };
+
+	const double PHASE_GAIN = 0.1;		// share of the timing error corrected per burst
+	const double PERIOD_GAIN = 0.01;
+	const double RELOCK_PERIODS = 8.0;	// timing error that restarts the timeline (lost frames, long stall)
+}
+
+
+Mpu6050RateConfig MakeRateConfig(float _rate)
+{
+	Mpu6050RateConfig config;
+
+	if (_rate > 1000.0f)
+	{
+		config.lowpassConfig = 0;
+		config.sampleRateDivider = uint8_t(std::min(std::max(8000.0f / _rate - 1.0f + 0.5f, 0.0f), 255.0f));
+		config.sampleRate = 8000.0f / (1 + config.sampleRateDivider);
+	}
+	else
+	{
+		config.sampleRateDivider = uint8_t(std::min(std::max(1000.0f / _rate - 1.0f + 0.5f, 0.0f), 255.0f));
+		config.sampleRate = 1000.0f / (1 + config.sampleRateDivider);
+
+		// narrowest filter is the fallback for very low rates
+		config.lowpassConfig = 6;
+		for (uint8_t cfg = 1; cfg <= 6; ++cfg)
+		{
+			if (LOWPASS_BANDWIDTH[cfg] < 0.5f * config.sampleRate)
+			{
+				config.lowpassConfig = cfg;
+				break;
+			}
+		}
+	}
+	config.bandwidth = LOWPASS_BANDWIDTH[config.lowpassConfig];
+	return config;
+}
+
+SensorSample DecodeFifoFrame(const uint8_t* _frame, uint64_t _timestamp, uint32_t _deviceId, int16_t _temperature)
+{
+	SensorSample sample;
+	sample.timestamp = _timestamp;
+	sample.deviceId = _deviceId;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		sample.accel[axis] = ReadBigEndian16(_frame + 2 * axis);
+		sample.gyro[axis] = ReadBigEndian16(_frame + 6 + 2 * axis);
+	}
+	sample.temperature = _temperature;
+	return sample;
+}
+
+
+FifoTimeline::FifoTimeline(float _sampleRate) :
+	m_NominalPeriod(DX::StepTimer::TicksPerSecond / double(_sampleRate))
+{
+	Reset();
+}
+
+void FifoTimeline::Reset()
+{
+	m_Period = m_NominalPeriod;
+	m_Next = 0.0;
+}
+
+void FifoTimeline::Assign(uint64_t _readTime, size_t _count, uint64_t* _timestamps)
+{
+	if (_count == 0)
+	{
+		return;
+	}
+
+	// the newest frame was sampled within one period before the read
+	const double newest = double(_readTime) - 0.5 * m_Period;
+	const double span = (_count - 1) * m_Period;
+
+	const double error = newest - (m_Next + span);
+	if (m_Next == 0.0 || fabs(error) > RELOCK_PERIODS * m_Period)
+	{
+		m_Period = m_NominalPeriod;
+		m_Next = newest - (_count - 1) * m_Period;
+	}
+	else
+	{
+		// keep the sensor clock continuous, pull phase and period slowly towards the host clock
+		m_Next += PHASE_GAIN * error;
+		m_Period += PERIOD_GAIN * error / _count;
+		m_Period = std::min(std::max(m_Period, 0.9 * m_NominalPeriod), 1.1 * m_NominalPeriod);
+	}
+
+	for (size_t i = 0; i < _count; ++i)
+	{
+		_timestamps[i] = uint64_t(m_Next + i * m_Period);
+	}
+	m_Next += _count * m_Period;
+}
+
+double FifoTimeline::GetMeasuredRate() const
+{
+	return DX::StepTimer::TicksPerSecond / m_Period;
+}
+
+
+Mpu6050FifoReader::Mpu6050FifoReader(uint8_t _address, float _sampleRate) :
+	m_Address(_address),
+	m_Timeline(_sampleRate),
+	m_Overflows(0),
+	m_Temperature(0)
+{
+}
+
+bool Mpu6050FifoReader::ResetFifo(I2cTransport& _bus)
+{
+	return WriteRegister(_bus, m_Address, MPU6050_FIFO_EN, MPU6050_FIFO_EN_ACCEL_GYRO)
+		&& WriteRegister(_bus, m_Address, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN | MPU6050_USER_CTRL_FIFO_RESET);
+}
+
+FifoBurstStatus Mpu6050FifoReader::ReadBurst(I2cTransport& _bus, const Clock& _clock, SensorSample* _samples, unsigned int& _count)
+{
+	_count = 0;
+
+	// 1) how many whole frames the MPU6050 buffered since the last burst
+	const uint8_t countRegister = MPU6050_FIFO_COUNT_H;
+	uint8_t countBytes[2];
+	const I2cResult countResult = _bus.WriteRead(m_Address, &countRegister, 1, countBytes, sizeof(countBytes));
+	if (!countResult.IsFull())
+	{
+		return FIFO_BURST_BUS_ERROR;
+	}
+	// the end of the count read, the time a trace records and replays
+	const uint64_t readTime = (countResult.endTicks != 0) ? countResult.endTicks : _clock.GetTicks();
+
+	const unsigned int fifoBytes = (countBytes[0] << 8) | countBytes[1];
+	if (fifoBytes >= MPU6050_FIFO_SIZE)
+	{
+		// overflowed and frame alignment is lost, drop the content and relock the timeline
+		ResetFifo(_bus);
+		m_Timeline.Reset();
+		++m_Overflows;
+		return FIFO_BURST_OVERFLOW;
+	}
+
+	const unsigned int frameCount = std::min(fifoBytes / MPU6050_FIFO_FRAME_SIZE, MPU6050_FIFO_MAX_FRAMES);
+	if (frameCount == 0)
+	{
+		return FIFO_BURST_OK;
+	}
+
+	// 2) drain them in one burst, the FIFO register does not auto-increment
+	if (!ReadRegisters(_bus, m_Address, MPU6050_FIFO_R_W, m_Frames, frameCount * MPU6050_FIFO_FRAME_SIZE))
+	{
+		ResetFifo(_bus);
+		m_Timeline.Reset();
+		return FIFO_BURST_BUS_ERROR;
+	}
+
+	// 3) one temperature for the burst; the frames are good without it, a failed
+	// read keeps the previous value
+	uint8_t temperatureBytes[2];
+	if (ReadRegisters(_bus, m_Address, MPU6050_TEMP_OUT_H, temperatureBytes, sizeof(temperatureBytes)))
+	{
+		m_Temperature = ReadBigEndian16(temperatureBytes);
+	}
+
+	uint64_t timestamps[MPU6050_FIFO_MAX_FRAMES];
+	m_Timeline.Assign(readTime, frameCount, timestamps);
+	for (unsigned int i = 0; i < frameCount; ++i)
+	{
+		_samples[i] = DecodeFifoFrame(&m_Frames[i * MPU6050_FIFO_FRAME_SIZE], timestamps[i], m_Address, m_Temperature);
+	}
+	_count = frameCount;
+	return FIFO_BURST_OK;
+}
@@ -0,0 +1,118 @@
+//
+// Mpu6050Fifo.h - high rate acquisition through the MPU6050 FIFO
+//
+// At rates above what a periodic timer can poll, the sensor buffers samples in
+// its 1 KB FIFO and the acquisition thread drains it in bursts. Each FIFO frame
+// is accel XYZ + gyro XYZ (12 bytes). Temperature changes far slower than a
+// burst, so it is read from TEMP_OUT once per burst and given to all its frames
+// instead of costing two more FIFO bytes per sample. Timestamps are rebuilt from
+// the sensor sample clock, locked to the host clock at every burst.
+//
+// Rates above 1 kHz need the digital low-pass off (gyro only, accel repeats at
+// 1 kHz). 8 kHz is 96 KB/s, more than a 400 kHz I2C bus carries; over I2C about
+// 2 kHz is the practical limit.
+//
+
+#pragma once
+
+#include "SensorData.h"
+#include "I2cTransport.h"
+
+
+class Clock;
+
+
+// MPU6050 rate and FIFO registers (see MPU-6000 register map)
+const uint8_t MPU6050_SMPLRT_DIV = 0x19;
+const uint8_t MPU6050_CONFIG = 0x1A;
+const uint8_t MPU6050_FIFO_EN = 0x23;
+const uint8_t MPU6050_USER_CTRL = 0x6A;
+const uint8_t MPU6050_FIFO_COUNT_H = 0x72;	// followed by FIFO_COUNT_L
+const uint8_t MPU6050_FIFO_R_W = 0x74;
+const uint8_t MPU6050_TEMP_OUT_H = 0x41;	// followed by TEMP_OUT_L
+
+const uint8_t MPU6050_FIFO_EN_ACCEL_GYRO = 0x78;	// FIFO_EN: XG, YG, ZG and ACCEL
+const uint8_t MPU6050_USER_CTRL_FIFO_EN = 0x40;
+const uint8_t MPU6050_USER_CTRL_FIFO_RESET = 0x04;
+
+const unsigned int MPU6050_FIFO_SIZE = 1024;
+const unsigned int MPU6050_FIFO_FRAME_SIZE = 12;
+const unsigned int MPU6050_FIFO_MAX_FRAMES = MPU6050_FIFO_SIZE / MPU6050_FIFO_FRAME_SIZE;
+
+
+// SMPLRT_DIV and CONFIG values for a requested output rate
+struct Mpu6050RateConfig
+{
+	uint8_t sampleRateDivider;	// output rate = gyro rate / (1 + divider)
+	uint8_t lowpassConfig;		// DLPF_CFG, 0 = off (gyro rate 8 kHz), else gyro rate 1 kHz
+	float sampleRate;			// Hz actually produced
+	float bandwidth;			// Hz, gyro bandwidth of the selected DLPF
+};
+
+// picks the widest DLPF below Nyquist of the output rate, _rate from 4 Hz to 8 kHz
+Mpu6050RateConfig MakeRateConfig(float _rate);
+
+// one FIFO frame in the 0x3B register layout without temperature, which the burst supplies
+SensorSample DecodeFifoFrame(const uint8_t* _frame, uint64_t _timestamp, uint32_t _deviceId, int16_t _temperature);
+
+
+// Sample timestamps for FIFO bursts. The sensor clock is accurate to a few percent
+// only, so the period is tracked from burst to burst instead of taken as nominal.
+class FifoTimeline
+{
+public:
+
+	explicit FifoTimeline(float _sampleRate);
+
+	// after a FIFO reset or overflow
+	void Reset();
+
+	// timestamps of _count frames drained at _readTime, oldest first
+	void Assign(uint64_t _readTime, size_t _count, uint64_t* _timestamps);
+
+	double GetMeasuredRate() const;
+
+private:
+
+	double m_NominalPeriod;		// StepTimer ticks
+	double m_Period;
+	double m_Next;				// timestamp of the next frame, 0 = not locked
+};
+
+
+enum FifoBurstStatus
+{
+	FIFO_BURST_OK,				// the frames there were, possibly none
+	FIFO_BURST_OVERFLOW,		// frame alignment was lost, the FIFO is reset and the timeline relocks
+	FIFO_BURST_BUS_ERROR,		// a transaction failed or came back short
+};
+
+// The transactions of one drain: the FIFO byte count, every whole frame in one
+// read, then the temperature. Works over any I2cTransport, so a recorded bus trace drives exactly
+// the code that ran on the device. One thread calls ReadBurst.
+class Mpu6050FifoReader
+{
+public:
+
+	Mpu6050FifoReader(uint8_t _address, float _sampleRate);
+
+	// buffer accel and gyro frames in the FIFO, discarding what it holds
+	bool ResetFifo(I2cTransport& _bus);
+
+	// decodes up to MPU6050_FIFO_MAX_FRAMES samples into _samples, timestamped
+	// from the end of the count read, as the transport reports it or else read
+	// from _clock right after; a short frame read resets the FIFO
+	// since the frame boundaries are lost with it
+	FifoBurstStatus ReadBurst(I2cTransport& _bus, const Clock& _clock, SensorSample* _samples, unsigned int& _count);
+
+	const FifoTimeline& GetTimeline() const		{ return m_Timeline; }
+	uint32_t GetOverflowCount() const			{ return m_Overflows; }
+
+private:
+
+	uint8_t m_Address;
+	FifoTimeline m_Timeline;
+	uint32_t m_Overflows;
+	int16_t m_Temperature;		// of the latest burst that read it
+	uint8_t m_Frames[MPU6050_FIFO_MAX_FRAMES * MPU6050_FIFO_FRAME_SIZE];
+};
@@ -0,0 +1,67 @@
+//
+// OneEuroFilter.cpp
+//
+
+#include "pch.h"
+#include "OneEuroFilter.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	// smoothing factor of a first order low-pass with cutoff _cutoffHz sampled every _dt
+	float SmoothingFactor(float _cutoffHz, float _dt)
+	{
+		const float tau = 1.0f / (2.0f * 3.14159265f * _cutoffHz);
+		return 1.0f / (1.0f + tau / _dt);
+	}
+}
+
+
+OrientationOneEuro::OrientationOneEuro()
+{
+	Reset();
+}
+
+void OrientationOneEuro::Reset()
+{
+	m_Initialized = false;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_Speed[axis] = 0.0f;
+		m_CutoffHz[axis] = 0.0f;
+	}
+}
+
+Quaternion OrientationOneEuro::Filter(const Quaternion& _orientation, float _dt, const OneEuroSettings& _settings)
+{
+	if (!m_Initialized)
+	{
+		m_Initialized = true;
+		m_Filtered = _orientation;
+		return m_Filtered;
+	}
+	if (_dt <= 0.0f)
+	{
+		return m_Filtered;
+	}
+
+	// rotation from the previous output to the input, in the body frame
+	const Quaternion inverse(-m_Filtered.x, -m_Filtered.y, -m_Filtered.z, m_Filtered.w);
+	float delta[3];
+	QuaternionToRotationVector(QuaternionProduct(inverse, _orientation), delta);
+
+	const float speedFactor = SmoothingFactor(_settings.derivativeCutoffHz, _dt);
+	float step[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_Speed[axis] += speedFactor * (delta[axis] / _dt - m_Speed[axis]);
+		m_CutoffHz[axis] = _settings.minCutoffHz + _settings.beta * fabsf(m_Speed[axis]);
+		step[axis] = SmoothingFactor(m_CutoffHz[axis], _dt) * delta[axis];
+	}
+
+	m_Filtered = QuaternionNormalized(QuaternionProduct(m_Filtered, QuaternionFromRotationVector(step[0], step[1], step[2])));
+	return m_Filtered;
+}
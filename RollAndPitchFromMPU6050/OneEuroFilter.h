@@ -0,0 +1,53 @@
+//
+// OneEuroFilter.h - speed adaptive low-pass for the displayed orientation
+//
+// One Euro filter (Casiez et al.): the cutoff rises with the filtered speed of
+// the signal, so a still device is smoothed heavily while fast motion passes
+// with little lag. Display only, fusion never sees the smoothed orientation.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+
+struct OneEuroSettings
+{
+	bool enabled;
+	float minCutoffHz;			// cutoff when still, lower = less jitter
+	float beta;					// cutoff increase per rad/s of motion, higher = less lag
+	float derivativeCutoffHz;	// smoothing of the speed estimate
+
+	OneEuroSettings() :
+		enabled(true),
+		minCutoffHz(1.0f),
+		beta(2.0f),
+		derivativeCutoffHz(1.0f)
+	{
+	}
+};
+
+
+// Filters the rotation from the previous output to the new input, one adaptive
+// cutoff per body axis, so the output stays a unit quaternion. Constant cost per update.
+class OrientationOneEuro
+{
+public:
+
+	OrientationOneEuro();
+
+	void Reset();
+
+	// _dt is the time since the previous update in seconds
+	DirectX::SimpleMath::Quaternion Filter(const DirectX::SimpleMath::Quaternion& _orientation, float _dt, const OneEuroSettings& _settings);
+
+	// current adaptive cutoff per axis, for display
+	const float* GetCutoffHz() const		{ return m_CutoffHz; }
+
+private:
+
+	bool m_Initialized;
+	DirectX::SimpleMath::Quaternion m_Filtered;
+	float m_Speed[3];		// filtered rad/s per body axis
+	float m_CutoffHz[3];
+};
@@ -0,0 +1,167 @@
+//
+// OrientationInterpolator.cpp
+//
+
+#include "pch.h"
+#include "OrientationInterpolator.h"
+#include "ErrorStateKalman.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	uint64_t MillisecondsToTicks(float _ms)
+	{
+		return (_ms > 0.0f) ? uint64_t(_ms * (DX::StepTimer::TicksPerSecond / 1000)) : 0;
+	}
+}
+
+
+OrientationInterpolator::OrientationInterpolator()
+{
+	Reset();
+}
+
+void OrientationInterpolator::Reset()
+{
+	m_Next = 0;
+	m_Count = 0;
+}
+
+void OrientationInterpolator::Push(const FusedOrientation& _orientation, const float _angularRate[3])
+{
+	// samples must arrive in time order, drop anything older than the newest entry
+	if (m_Count > 0 && _orientation.timestamp <= GetEntry(0).timestamp)
+	{
+		return;
+	}
+
+	Entry& entry = m_History[m_Next];
+	entry.timestamp = _orientation.timestamp;
+	entry.orientation = _orientation.orientation;
+	entry.angularRate[0] = _angularRate[0];
+	entry.angularRate[1] = _angularRate[1];
+	entry.angularRate[2] = _angularRate[2];
+
+	m_Next = (m_Next + 1) % HISTORY_SIZE;
+	m_Count = std::min(m_Count + 1, HISTORY_SIZE);
+}
+
+bool OrientationInterpolator::Sample(uint64_t _time, uint64_t _maxExtrapolation, Quaternion& _result) const
+{
+	if (m_Count == 0)
+	{
+		return false;
+	}
+
+	// past the newest sample: extrapolate with the gyro rate
+	const Entry& newest = GetEntry(0);
+	if (_time >= newest.timestamp)
+	{
+		const uint64_t ahead = std::min(_time - newest.timestamp, _maxExtrapolation);
+		const float dt = float(DX::StepTimer::TicksToSeconds(ahead));
+		_result = QuaternionNormalized(QuaternionProduct(newest.orientation,
+			QuaternionFromRotationVector(newest.angularRate[0] * dt, newest.angularRate[1] * dt, newest.angularRate[2] * dt)));
+		return true;
+	}
+
+	// find the bracketing pair, history is short and the match is usually the newest pair
+	for (size_t age = 1; age < m_Count; ++age)
+	{
+		const Entry& older = GetEntry(age);
+		if (older.timestamp <= _time)
+		{
+			const Entry& newer = GetEntry(age - 1);
+			const float t = float(double(_time - older.timestamp) / double(newer.timestamp - older.timestamp));
+			_result = QuaternionSlerp(older.orientation, newer.orientation, t);
+			return true;
+		}
+	}
+
+	// older than the whole history
+	_result = GetEntry(m_Count - 1).orientation;
+	return true;
+}
+
+uint64_t OrientationInterpolator::GetRenderTime(uint64_t _now, const InterpolatorSettings& _settings)
+{
+	return _now + MillisecondsToTicks(_settings.latencyMs) - std::min(_now, MillisecondsToTicks(_settings.delayMs));
+}
+
+
+InterpolationError MeasureInterpolationError(const std::vector<SensorSample>& _samples, uint32_t _decimation, const InterpolatorSettings& _settings)
+{
+	InterpolationError result = {};
+	if (_samples.empty() || _decimation == 0)
+	{
+		return result;
+	}
+
+	// ground truth: fusion at the full sample rate
+	ErrorStateKalman filter;
+	std::vector<FusedOrientation> truth;
+	std::vector<float> rates;
+	truth.reserve(_samples.size());
+	rates.reserve(_samples.size() * 3);
+	for (const SensorSample& sample : _samples)
+	{
+		const ImuReading reading = ConvertToPhysical(sample);
+		filter.ProcessReading(reading, sample.timestamp);
+		truth.push_back(filter.GetOrientation());
+
+		const float* bias = filter.GetGyroBias();
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			rates.push_back(reading.gyro[axis] - bias[axis]);
+		}
+	}
+
+	// Each truth sample is the moment a frame is shown. The renderer knows the
+	// decimated stream up to (moment - latency), and asks for the orientation at
+	// the render time computed from that "now".
+	OrientationInterpolator interpolator;
+	const uint64_t latency = MillisecondsToTicks(_settings.latencyMs);
+	const uint64_t maxExtrapolation = MillisecondsToTicks(_settings.maxExtrapolationMs);
+
+	size_t fed = 0;
+	size_t lastFed = 0;
+	double sum = 0.0;
+	double holdSum = 0.0;
+	uint32_t count = 0;
+
+	for (size_t i = 0; i < truth.size(); ++i)
+	{
+		const uint64_t shown = truth[i].timestamp;
+		const uint64_t now = (shown > latency) ? shown - latency : 0;
+
+		for (; fed < truth.size() && truth[fed].timestamp <= now; ++fed)
+		{
+			if (fed % _decimation == 0)
+			{
+				interpolator.Push(truth[fed], &rates[fed * 3]);
+				lastFed = fed;
+			}
+		}
+
+		Quaternion displayed;
+		if (!interpolator.Sample(OrientationInterpolator::GetRenderTime(now, _settings), maxExtrapolation, displayed))
+		{
+			continue;
+		}
+
+		const float error = QuaternionAngleBetween(displayed, truth[i].orientation) * 180.0f / 3.14159265f;
+		sum += error;
+		holdSum += QuaternionAngleBetween(truth[lastFed].orientation, truth[i].orientation) * 180.0f / 3.14159265f;
+		result.maxDegrees = std::max(result.maxDegrees, error);
+		++count;
+	}
+
+	if (count > 0)
+	{
+		result.meanDegrees = float(sum / count);
+		result.holdMeanDegrees = float(holdSum / count);
+	}
+	return result;
+}
@@ -0,0 +1,78 @@
+//
+// OrientationInterpolator.h - orientation at the display timestamp
+//
+// Fusion runs at the sensor rate and rendering at vsync. The interpolator keeps a
+// short history of fused samples and returns the orientation for any render time:
+// slerp between the two bracketing samples, or gyro-rate extrapolation past the
+// newest one to hide the acquisition and display latency.
+//
+
+#pragma once
+
+#include "SensorData.h"
+
+#include <vector>
+
+
+struct InterpolatorSettings
+{
+	float delayMs;				// render this far in the past so two bracketing samples exist
+	float latencyMs;			// display pipeline latency to compensate (present to scan-out)
+	float maxExtrapolationMs;	// never predict further than this past the newest sample, 0 = hold
+
+	InterpolatorSettings() :
+		delayMs(0.0f),
+		latencyMs(16.0f),
+		maxExtrapolationMs(50.0f)
+	{
+	}
+};
+
+
+class OrientationInterpolator
+{
+public:
+
+	static const size_t HISTORY_SIZE = 64;
+
+	OrientationInterpolator();
+
+	void Reset();
+
+	// _angularRate is the bias corrected body rate (rad/s) at the sample
+	void Push(const FusedOrientation& _orientation, const float _angularRate[3]);
+
+	// orientation at _time (StepTimer ticks), false while the history is empty
+	bool Sample(uint64_t _time, uint64_t _maxExtrapolation, DirectX::SimpleMath::Quaternion& _result) const;
+
+	// render time for a frame presented now
+	static uint64_t GetRenderTime(uint64_t _now, const InterpolatorSettings& _settings);
+
+private:
+
+	struct Entry
+	{
+		uint64_t timestamp;
+		DirectX::SimpleMath::Quaternion orientation;
+		float angularRate[3];
+	};
+
+	const Entry& GetEntry(size_t _age) const		{ return m_History[(m_Next + HISTORY_SIZE - 1 - _age) % HISTORY_SIZE]; }
+
+	Entry m_History[HISTORY_SIZE];
+	size_t m_Next;
+	size_t m_Count;
+};
+
+
+// Error of the displayed orientation against ground truth on recorded samples.
+// The full-rate fused stream is the truth; every _decimation-th sample is fed to the
+// interpolator and each truth timestamp is rendered as a display frame would be.
+struct InterpolationError
+{
+	float holdMeanDegrees;		// showing the newest fused sample, as before interpolation
+	float meanDegrees;
+	float maxDegrees;
+};
+
+InterpolationError MeasureInterpolationError(const std::vector<SensorSample>& _samples, uint32_t _decimation, const InterpolatorSettings& _settings);
@@ -0,0 +1,143 @@
+//
+// QuaternionMath.h - Hamilton quaternion helpers for sensor fusion
+//
+// Quaternions rotate sensor frame vectors into the world frame (Z up).
+// DirectXMath composes quaternions in the opposite order, so fusion code
+// uses these helpers instead of SimpleMath operator*.
+//
+
+#pragma once
+
+#include "FastMath.h"
+
+#include <math.h>
+
+
+// Hamilton product _a * _b (apply _b first, then _a)
+inline DirectX::SimpleMath::Quaternion QuaternionProduct(const DirectX::SimpleMath::Quaternion& _a, const DirectX::SimpleMath::Quaternion& _b)
+{
+	return DirectX::SimpleMath::Quaternion(
+		_a.w * _b.x + _a.x * _b.w + _a.y * _b.z - _a.z * _b.y,
+		_a.w * _b.y - _a.x * _b.z + _a.y * _b.w + _a.z * _b.x,
+		_a.w * _b.z + _a.x * _b.y - _a.y * _b.x + _a.z * _b.w,
+		_a.w * _b.w - _a.x * _b.x - _a.y * _b.y - _a.z * _b.z);
+}
+
+inline DirectX::SimpleMath::Quaternion QuaternionNormalized(const DirectX::SimpleMath::Quaternion& _q)
+{
+	const float normSquared = _q.x * _q.x + _q.y * _q.y + _q.z * _q.z + _q.w * _q.w;
+	const float scale = (normSquared > 0.0f) ? FastRsqrt(normSquared) : 0.0f;
+	return DirectX::SimpleMath::Quaternion(_q.x * scale, _q.y * scale, _q.z * scale, _q.w * scale);
+}
+
+// rotation of |v| radians around v
+inline DirectX::SimpleMath::Quaternion QuaternionFromRotationVector(float _x, float _y, float _z)
+{
+	const float angle = sqrtf(_x * _x + _y * _y + _z * _z);
+	if (angle < 1e-6f)
+	{
+		// first order expansion keeps tiny gyro steps exact enough
+		return QuaternionNormalized(DirectX::SimpleMath::Quaternion(0.5f * _x, 0.5f * _y, 0.5f * _z, 1.0f));
+	}
+
+	const float scale = sinf(0.5f * angle) / angle;
+	return DirectX::SimpleMath::Quaternion(_x * scale, _y * scale, _z * scale, cosf(0.5f * angle));
+}
+
+// inverse of QuaternionFromRotationVector, picks the shorter rotation (angle <= pi)
+inline void QuaternionToRotationVector(const DirectX::SimpleMath::Quaternion& _q, float _rotation[3])
+{
+	const float sign = (_q.w < 0.0f) ? -1.0f : 1.0f;
+	const float sinHalf = sqrtf(_q.x * _q.x + _q.y * _q.y + _q.z * _q.z);
+
+	// small angles: 2 * atan2(s, w) / s tends to 2
+	const float scale = (sinHalf < 1e-6f) ? 2.0f * sign : 2.0f * sign * FastAtan2(sinHalf, sign * _q.w) / sinHalf;
+	_rotation[0] = _q.x * scale;
+	_rotation[1] = _q.y * scale;
+	_rotation[2] = _q.z * scale;
+}
+
+// spherical interpolation along the shorter arc, _t in [0, 1]
+inline DirectX::SimpleMath::Quaternion QuaternionSlerp(const DirectX::SimpleMath::Quaternion& _a, const DirectX::SimpleMath::Quaternion& _b, float _t)
+{
+	float dot = _a.x * _b.x + _a.y * _b.y + _a.z * _b.z + _a.w * _b.w;
+	const float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+	dot *= sign;
+
+	// nearly parallel quaternions use normalized lerp, acos is ill-conditioned there
+	float weightA = 1.0f - _t;
+	float weightB = _t * sign;
+	if (dot < 0.9995f)
+	{
+		const float angle = acosf(dot);
+		const float invSin = 1.0f / sinf(angle);
+		weightA = sinf((1.0f - _t) * angle) * invSin;
+		weightB = sinf(_t * angle) * invSin * sign;
+	}
+
+	return QuaternionNormalized(DirectX::SimpleMath::Quaternion(
+		weightA * _a.x + weightB * _b.x,
+		weightA * _a.y + weightB * _b.y,
+		weightA * _a.z + weightB * _b.z,
+		weightA * _a.w + weightB * _b.w));
+}
+
+// rotation angle between two orientations, radians
+inline float QuaternionAngleBetween(const DirectX::SimpleMath::Quaternion& _a, const DirectX::SimpleMath::Quaternion& _b)
+{
+	const float dot = fabsf(_a.x * _b.x + _a.y * _b.y + _a.z * _b.z + _a.w * _b.w);
+	return 2.0f * acosf(dot > 1.0f ? 1.0f : dot);
+}
+
+// world Z axis (gravity reaction) expressed in the sensor frame
+inline void GravityInSensorFrame(const DirectX::SimpleMath::Quaternion& _q, float _gravity[3])
+{
+	_gravity[0] = 2.0f * (_q.x * _q.z - _q.w * _q.y);
+	_gravity[1] = 2.0f * (_q.y * _q.z + _q.w * _q.x);
+	_gravity[2] = 1.0f - 2.0f * (_q.x * _q.x + _q.y * _q.y);
+}
+
+// remove the rotation around world Z (heading), keeps the tilt without going through Euler angles
+inline DirectX::SimpleMath::Quaternion QuaternionRemoveHeading(const DirectX::SimpleMath::Quaternion& _q)
+{
+	// swing-twist: _q = twist * swing with twist around world Z
+	const float norm = sqrtf(_q.z * _q.z + _q.w * _q.w);
+	if (norm < 1e-6f)
+	{
+		return _q;	// tilted by 180 degrees, heading is undefined
+	}
+
+	const DirectX::SimpleMath::Quaternion inverseTwist(0.0f, 0.0f, -_q.z / norm, _q.w / norm);
+	return QuaternionProduct(inverseTwist, _q);
+}
+
+// ZYX Euler angles: roll around X, pitch around Y, yaw around Z (radians)
+inline DirectX::SimpleMath::Quaternion QuaternionFromEuler(float _roll, float _pitch, float _yaw)
+{
+	const float cr = cosf(0.5f * _roll), sr = sinf(0.5f * _roll);
+	const float cp = cosf(0.5f * _pitch), sp = sinf(0.5f * _pitch);
+	const float cy = cosf(0.5f * _yaw), sy = sinf(0.5f * _yaw);
+
+	return DirectX::SimpleMath::Quaternion(
+		sr * cp * cy - cr * sp * sy,
+		cr * sp * cy + sr * cp * sy,
+		cr * cp * sy - sr * sp * cy,
+		cr * cp * cy + sr * sp * sy);
+}
+
+inline void QuaternionToEuler(const DirectX::SimpleMath::Quaternion& _q, float& _roll, float& _pitch, float& _yaw)
+{
+	_roll = FastAtan2(2.0f * (_q.w * _q.x + _q.y * _q.z), 1.0f - 2.0f * (_q.x * _q.x + _q.y * _q.y));
+
+	_pitch = FastAsin(2.0f * (_q.w * _q.y - _q.z * _q.x));	// clamps rounding past +-1
+
+	_yaw = FastAtan2(2.0f * (_q.w * _q.z + _q.x * _q.y), 1.0f - 2.0f * (_q.y * _q.y + _q.z * _q.z));
+}
+
+// tilt (roll and pitch, zero yaw) from a gravity measurement in g
+inline DirectX::SimpleMath::Quaternion QuaternionFromGravity(const float _accel[3])
+{
+	const float roll = FastAtan2(_accel[1], _accel[2]);
+	const float pitch = FastAtan2(-_accel[0], sqrtf(_accel[1] * _accel[1] + _accel[2] * _accel[2]));
+	return QuaternionFromEuler(roll, pitch, 0.0f);
+}
@@ -0,0 +1,77 @@
+//
+// SampleQueue.h - single producer / single consumer lock-free ring
+//
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Passes samples from the acquisition thread to the consumer without locks.
+// Exactly one thread may call Push and exactly one thread may call Pop.
+template<typename T, size_t Capacity>
+class SampleQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+
+	SampleQueue() :
+		m_head(0),
+		m_tail(0),
+		m_dropped(0)
+	{
+	}
+
+	// producer: returns false (and counts the drop) when the consumer fell behind
+	bool Push(const T& _item)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		m_items[head & (Capacity - 1)] = _item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer
+	bool Pop(T& _item)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		_item = m_items[tail & (Capacity - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t Size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	uint32_t GetDroppedCount() const
+	{
+		return m_dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	// keep producer and consumer indices on separate cache lines
+	// (padding rather than alignas, the owner is heap allocated)
+	std::atomic<size_t> m_head;
+	char m_headPadding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail;
+	char m_tailPadding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<uint32_t> m_dropped;
+	T m_items[Capacity];
+};
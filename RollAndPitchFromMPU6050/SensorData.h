@@ -0,0 +1,146 @@
+//
+// SensorData.h
+//
+
+#pragma once
+
+#include "StepTimer.h"
+
+#include <stdint.h>
+
+
+const uint8_t MPU6050_I2C_ADDRESS = 0x68;
+
+// MPU6050 data registers 0x3B..0x48: accel XYZ, temperature, gyro XYZ (big-endian int16)
+const uint8_t MPU6050_DATA_REGISTER = 0x3B;
+const unsigned int MPU6050_FRAME_SIZE = 14;
+
+// scale factors for the configured ranges (see registers 0x1B and 0x1C)
+const float ACCEL_UNITS_PER_G = 16384.0f;	// +/- 2g
+const float GYRO_UNITS_PER_DPS = 131.0f;	// +/- 250 deg/s
+const float TEMPERATURE_UNITS_PER_C = 340.0f;
+const float TEMPERATURE_OFFSET_C = 36.53f;	// at raw 0
+
+
+// raw data from MPU6050, timestamped by the acquisition thread
+struct SensorSample
+{
+	uint64_t timestamp;		// StepTimer ticks (100 nS)
+	uint32_t deviceId;		// I2C address of the sensor
+	int16_t accel[3];
+	int16_t temperature;
+	int16_t gyro[3];
+};
+
+
+// sample converted to physical units
+struct ImuReading
+{
+	float accel[3];		// g
+	float gyro[3];		// rad/s
+};
+
+
+// block of samples in physical units, one contiguous array per channel
+const int IMU_CHANNEL_COUNT = 6;	// accel XYZ (g), gyro XYZ (rad/s)
+
+struct SampleBlock
+{
+	static const size_t CAPACITY = 256;
+
+	size_t count;
+	uint64_t timestamp[CAPACITY];
+	float channels[IMU_CHANNEL_COUNT][CAPACITY];
+};
+
+
+// sensor fusion algorithm
+enum FusionEngine
+{
+	FUSION_KALMAN,			// float error-state EKF
+	FUSION_FIXED_POINT,		// integer complementary filter
+	FUSION_ENGINE_COUNT,
+};
+
+// orientation produced by fusion
+struct FusedOrientation
+{
+	uint64_t timestamp;								// timestamp of the last fused sample
+	DirectX::SimpleMath::Quaternion orientation;	// sensor to world rotation
+	float attitudeVariance[3];						// rad^2 around sensor X, Y, Z
+};
+
+
+inline int16_t ReadBigEndian16(const uint8_t* _data)
+{
+	return (int16_t)((_data[0] << 8) | _data[1]);
+}
+
+// decode MPU6050 data register block
+inline SensorSample DecodeMPU6050Frame(const uint8_t* _frame, uint64_t _timestamp, uint32_t _deviceId)
+{
+	SensorSample sample;
+	sample.timestamp = _timestamp;
+	sample.deviceId = _deviceId;
+	sample.accel[0] = ReadBigEndian16(_frame + 0);
+	sample.accel[1] = ReadBigEndian16(_frame + 2);
+	sample.accel[2] = ReadBigEndian16(_frame + 4);
+	sample.temperature = ReadBigEndian16(_frame + 6);
+	sample.gyro[0] = ReadBigEndian16(_frame + 8);
+	sample.gyro[1] = ReadBigEndian16(_frame + 10);
+	sample.gyro[2] = ReadBigEndian16(_frame + 12);
+	return sample;
+}
+
+inline void WriteBigEndian16(uint8_t* _data, int16_t _value)
+{
+	_data[0] = uint8_t(uint16_t(_value) >> 8);
+	_data[1] = uint8_t(_value);
+}
+
+// inverse of DecodeMPU6050Frame, for logs of the raw register block
+inline void EncodeMPU6050Frame(const SensorSample& _sample, uint8_t* _frame)
+{
+	WriteBigEndian16(_frame + 0, _sample.accel[0]);
+	WriteBigEndian16(_frame + 2, _sample.accel[1]);
+	WriteBigEndian16(_frame + 4, _sample.accel[2]);
+	WriteBigEndian16(_frame + 6, _sample.temperature);
+	WriteBigEndian16(_frame + 8, _sample.gyro[0]);
+	WriteBigEndian16(_frame + 10, _sample.gyro[1]);
+	WriteBigEndian16(_frame + 12, _sample.gyro[2]);
+}
+
+inline ImuReading ConvertToPhysical(const SensorSample& _sample)
+{
+	const float RAD_PER_DEG = 3.14159265f / 180.0f;
+
+	ImuReading reading;
+	for (int i = 0; i < 3; ++i)
+	{
+		reading.accel[i] = _sample.accel[i] / ACCEL_UNITS_PER_G;
+		reading.gyro[i] = _sample.gyro[i] / GYRO_UNITS_PER_DPS * RAD_PER_DEG;
+	}
+	return reading;
+}
+
+inline void AppendToBlock(SampleBlock& _block, uint64_t _timestamp, const ImuReading& _reading)
+{
+	const size_t index = _block.count++;
+	_block.timestamp[index] = _timestamp;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		_block.channels[axis][index] = _reading.accel[axis];
+		_block.channels[3 + axis][index] = _reading.gyro[axis];
+	}
+}
+
+inline ImuReading GetBlockReading(const SampleBlock& _block, size_t _index)
+{
+	ImuReading reading;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		reading.accel[axis] = _block.channels[axis][_index];
+		reading.gyro[axis] = _block.channels[3 + axis][_index];
+	}
+	return reading;
+}
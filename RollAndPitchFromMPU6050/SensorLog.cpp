@@ -0,0 +1,840 @@
+//
+// SensorLog.cpp
+//
+
+#include "pch.h"
+#include "SensorLog.h"
+#include "SensorLogCodec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+	const int WRITER_POLL_MS = 100;		// wake-ups from the producer are not locked, poll as a fallback
+	const uint32_t OLDEST_READABLE_VERSION = 2;	// raw chunks only
+	const uint32_t MIN_SPLIT_BLOCK_RECORDS = 16;	// smallest block packed to fill the end of a chunk
+	const double PACK_CHUNK_SECONDS = 1e6;		// no age limit for PackSensorLog, chunks are sealed when full
+
+	struct Crc32Table
+	{
+		uint32_t entries[256];
+
+		Crc32Table()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+				}
+				entries[i] = crc;
+			}
+		}
+	};
+
+	SensorChunkHeader* GetChunkHeader(std::vector<uint8_t>& _buffer)
+	{
+		return reinterpret_cast<SensorChunkHeader*>(_buffer.data());
+	}
+
+	SensorLogRecord* GetChunkRecords(std::vector<uint8_t>& _buffer)
+	{
+		return reinterpret_cast<SensorLogRecord*>(_buffer.data() + sizeof(SensorChunkHeader));
+	}
+
+	// 0 for a foreign magic
+	uint32_t GetChunkCapacity(uint32_t _magic, uint32_t _chunkSize)
+	{
+		if (_magic == SENSOR_CHUNK_MAGIC)
+		{
+			return uint32_t((_chunkSize - sizeof(SensorChunkHeader)) / sizeof(SensorLogRecord));
+		}
+		if (_magic == SENSOR_PACKED_CHUNK_MAGIC)
+		{
+			return GetPackedChunkCapacity(_chunkSize);
+		}
+		return 0;
+	}
+
+	// data reaches the storage device, not just the OS cache
+	bool FlushToDevice(FILE* _file)
+	{
+		if (fflush(_file) != 0)
+		{
+			return false;
+		}
+#if defined(_WIN32)
+		return _commit(_fileno(_file)) == 0;
+#else
+		return fsync(fileno(_file)) == 0;
+#endif
+	}
+}
+
+
+uint32_t Crc32(const void* _data, size_t _size, uint32_t _crc)
+{
+	static const Crc32Table table;
+
+	const uint8_t* data = static_cast<const uint8_t*>(_data);
+	uint32_t crc = ~_crc;
+	for (size_t i = 0; i < _size; ++i)
+	{
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+bool IsValidChunk(const uint8_t* _chunk, uint32_t _chunkSize)
+{
+	SensorChunkHeader header;
+	memcpy(&header, _chunk, sizeof(header));
+	const uint32_t capacity = GetChunkCapacity(header.magic, _chunkSize);
+	if (capacity == 0 || header.recordCount > capacity)
+	{
+		return false;
+	}
+
+	const uint32_t storedCrc = header.crc;
+	header.crc = 0;
+	const uint32_t crc = Crc32(_chunk + sizeof(header), _chunkSize - sizeof(header), Crc32(&header, sizeof(header)));
+	return crc == storedCrc;
+}
+
+SensorSample DecodeLogRecord(const SensorChunkHeader& _chunk, const SensorLogRecord& _record)
+{
+	return DecodeMPU6050Frame(_record.frame, _chunk.firstTimestamp + _record.timeOffset, _record.deviceId);
+}
+
+
+SensorLogWriter::SensorLogWriter() :
+	m_File(nullptr),
+	m_Open(false),
+	m_Stopping(false),
+	m_ActiveWriters(0),
+	m_Sealed(0),
+	m_Written(0),
+	m_FillCount(0),
+	m_Sequence(0),
+	m_MaxChunkTicks(0),
+	m_Encoding(SENSOR_LOG_RAW),
+	m_PackedSize(0),
+	m_PackedCount(0),
+	m_PackedSequence(0),
+	m_SampleCount(0),
+	m_DroppedCount(0),
+	m_WrittenChunks(0),
+	m_WriteError(false)
+{
+	for (int i = 0; i < BUFFER_COUNT; ++i)
+	{
+		m_Buffers[i].assign(SENSOR_CHUNK_SIZE, 0);
+	}
+	m_PackedChunk.assign(SENSOR_CHUNK_SIZE, 0);
+	m_PackedBlock.assign(PACKED_BLOCK_MAX_SIZE, 0);
+	m_PendingRecords.reserve(PACKED_BLOCK_RECORDS);
+	m_PendingTimestamps.reserve(PACKED_BLOCK_RECORDS);
+}
+
+SensorLogWriter::~SensorLogWriter()
+{
+	Close();
+}
+
+bool SensorLogWriter::Open(const PathChar* _path, double _maxChunkSeconds, SensorLogEncoding _encoding)
+{
+	Close();
+
+#if defined(_WIN32)
+	if (_wfopen_s(&m_File, _path, L"wb") != 0)
+	{
+		m_File = nullptr;
+	}
+#else
+	m_File = fopen(_path, "wb");
+#endif
+	if (m_File == nullptr)
+	{
+		return false;
+	}
+
+	SensorLogHeader header;
+	header.magic = SENSOR_LOG_MAGIC;
+	header.version = SENSOR_LOG_VERSION;
+	header.recordSize = sizeof(SensorLogRecord);
+	header.chunkSize = SENSOR_CHUNK_SIZE;
+	if (fwrite(&header, sizeof(header), 1, m_File) != 1 || !FlushToDevice(m_File))
+	{
+		fclose(m_File);
+		m_File = nullptr;
+		return false;
+	}
+
+	m_Sealed.store(0);
+	m_Written.store(0);
+	m_FillCount = 0;
+	m_Sequence = 0;
+	m_MaxChunkTicks = DX::StepTimer::SecondsToTicks(_maxChunkSeconds);
+	m_Encoding = _encoding;
+	m_PendingRecords.clear();
+	m_PendingTimestamps.clear();
+	m_PackedSize = sizeof(SensorChunkHeader);
+	m_PackedCount = 0;
+	m_PackedSequence = 0;
+	m_SampleCount.store(0);
+	m_DroppedCount.store(0);
+	m_WrittenChunks.store(0);
+	m_WriteError.store(false);
+	m_Stopping.store(false);
+
+	m_Thread = std::thread([this]() { WriterLoop(); });
+	m_Open.store(true);
+	return true;
+}
+
+void SensorLogWriter::Close()
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+
+	// no producer is inside Write after this, so the chunk being filled is ours
+	m_Open.store(false);
+	while (m_ActiveWriters.load() != 0)
+	{
+		std::this_thread::yield();
+	}
+
+	// the last chunk goes out even if the ring is full, the writer is about to drain it
+	while (m_FillCount > 0 && m_Sealed.load() - m_Written.load() >= uint32_t(BUFFER_COUNT))
+	{
+		m_Wake.notify_one();
+		std::this_thread::yield();
+	}
+	if (m_FillCount > 0)
+	{
+		Seal();
+	}
+
+	m_Stopping.store(true);
+	m_Wake.notify_one();
+	m_Thread.join();
+
+	fclose(m_File);
+	m_File = nullptr;
+}
+
+bool SensorLogWriter::Write(const SensorSample& _sample)
+{
+	m_ActiveWriters.fetch_add(1);
+	if (!m_Open.load())
+	{
+		m_ActiveWriters.fetch_sub(1);
+		return false;
+	}
+
+	// an old or full chunk is sealed before the record that does not fit
+	if (m_FillCount > 0)
+	{
+		const SensorChunkHeader* header = GetChunkHeader(m_Buffers[m_Sealed.load(std::memory_order_relaxed) % BUFFER_COUNT]);
+		const uint64_t offset = _sample.timestamp - header->firstTimestamp;
+		if (m_FillCount == SENSOR_CHUNK_CAPACITY || offset > m_MaxChunkTicks || offset > UINT32_MAX)
+		{
+			Seal();
+		}
+	}
+
+	const uint32_t sealed = m_Sealed.load(std::memory_order_relaxed);
+	if (sealed - m_Written.load(std::memory_order_acquire) >= uint32_t(BUFFER_COUNT))
+	{
+		// storage fell behind by the whole ring
+		m_DroppedCount.fetch_add(1, std::memory_order_relaxed);
+		m_ActiveWriters.fetch_sub(1);
+		return false;
+	}
+
+	std::vector<uint8_t>& buffer = m_Buffers[sealed % BUFFER_COUNT];
+	SensorChunkHeader* header = GetChunkHeader(buffer);
+	if (m_FillCount == 0)
+	{
+		header->firstTimestamp = _sample.timestamp;
+	}
+
+	SensorLogRecord& record = GetChunkRecords(buffer)[m_FillCount++];
+	record.timeOffset = uint32_t(_sample.timestamp - header->firstTimestamp);
+	record.deviceId = uint8_t(_sample.deviceId);
+	record.reserved = 0;
+	EncodeMPU6050Frame(_sample, record.frame);
+	header->lastTimestamp = _sample.timestamp;
+
+	m_SampleCount.fetch_add(1, std::memory_order_relaxed);
+	m_ActiveWriters.fetch_sub(1);
+	return true;
+}
+
+// hand the chunk being filled to the writer thread, its CRC is computed there
+void SensorLogWriter::Seal()
+{
+	const uint32_t sealed = m_Sealed.load(std::memory_order_relaxed);
+	std::vector<uint8_t>& buffer = m_Buffers[sealed % BUFFER_COUNT];
+	SensorChunkHeader* header = GetChunkHeader(buffer);
+	header->magic = SENSOR_CHUNK_MAGIC;
+	header->sequence = m_Sequence++;
+	header->recordCount = m_FillCount;
+
+	// stale records of the previous use would otherwise end up in the file
+	SensorLogRecord* records = GetChunkRecords(buffer);
+	memset(records + m_FillCount, 0, (SENSOR_CHUNK_CAPACITY - m_FillCount) * sizeof(SensorLogRecord));
+
+	m_FillCount = 0;
+	m_Sealed.store(sealed + 1, std::memory_order_release);
+	m_Wake.notify_one();
+}
+
+void SensorLogWriter::WriterLoop()
+{
+	for (;;)
+	{
+		const uint32_t written = m_Written.load(std::memory_order_relaxed);
+		if (written != m_Sealed.load(std::memory_order_acquire))
+		{
+			std::vector<uint8_t>& buffer = m_Buffers[written % BUFFER_COUNT];
+			if (m_Encoding == SENSOR_LOG_PACKED)
+			{
+				PackRecords(buffer.data());
+			}
+			else
+			{
+				WriteChunk(buffer.data());
+			}
+			m_Written.store(written + 1, std::memory_order_release);
+			continue;
+		}
+
+		// the last chunk is sealed before m_Stopping is set, look once more before leaving
+		if (m_Stopping.load())
+		{
+			if (written == m_Sealed.load(std::memory_order_acquire))
+			{
+				PackPending();
+				WritePacked();
+				return;
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_Wake.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS), [this]()
+		{
+			return m_Stopping.load() || m_Written.load(std::memory_order_relaxed) != m_Sealed.load(std::memory_order_acquire);
+		});
+	}
+}
+
+bool SensorLogWriter::WriteChunk(uint8_t* _chunk)
+{
+	SensorChunkHeader* header = reinterpret_cast<SensorChunkHeader*>(_chunk);
+	header->crc = 0;
+	header->crc = Crc32(_chunk, SENSOR_CHUNK_SIZE);
+
+	if (fwrite(_chunk, SENSOR_CHUNK_SIZE, 1, m_File) != 1 || !FlushToDevice(m_File))
+	{
+		m_WriteError.store(true, std::memory_order_relaxed);
+		return false;
+	}
+	m_WrittenChunks.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+// the records of a sealed raw chunk join the pending block; the buffer is free again afterwards
+void SensorLogWriter::PackRecords(const uint8_t* _chunk)
+{
+	const SensorChunkHeader* header = reinterpret_cast<const SensorChunkHeader*>(_chunk);
+	const SensorLogRecord* records = reinterpret_cast<const SensorLogRecord*>(header + 1);
+	for (uint32_t i = 0; i < header->recordCount; ++i)
+	{
+		const uint64_t timestamp = header->firstTimestamp + records[i].timeOffset;
+		if (!m_PendingTimestamps.empty() && timestamp - m_PendingTimestamps.front() > UINT32_MAX)
+		{
+			PackPending();
+		}
+		m_PendingRecords.push_back(records[i]);
+		m_PendingTimestamps.push_back(timestamp);
+		if (m_PendingRecords.size() == PACKED_BLOCK_RECORDS)
+		{
+			PackPending();
+		}
+	}
+
+	// sealed by age or by Close, or the oldest record not yet on disk is older than
+	// a chunk may get: the data goes out now, whatever the packed chunk holds
+	const SensorChunkHeader* packed = reinterpret_cast<const SensorChunkHeader*>(m_PackedChunk.data());
+	const uint64_t oldest = (m_PackedCount > 0) ? packed->firstTimestamp
+		: (m_PendingTimestamps.empty() ? header->lastTimestamp : m_PendingTimestamps.front());
+	if (header->recordCount < SENSOR_CHUNK_CAPACITY || header->lastTimestamp - oldest > m_MaxChunkTicks)
+	{
+		PackPending();
+		WritePacked();
+	}
+}
+
+void SensorLogWriter::PackPending()
+{
+	SensorChunkHeader* header = reinterpret_cast<SensorChunkHeader*>(m_PackedChunk.data());
+	while (!m_PendingRecords.empty())
+	{
+		if (m_PackedCount > 0 && m_PendingTimestamps.back() - header->firstTimestamp > UINT32_MAX)
+		{
+			WritePacked();
+		}
+		if (m_PackedCount == 0)
+		{
+			header->firstTimestamp = m_PendingTimestamps.front();
+		}
+		for (size_t i = 0; i < m_PendingRecords.size(); ++i)
+		{
+			m_PendingRecords[i].timeOffset = uint32_t(m_PendingTimestamps[i] - header->firstTimestamp);
+		}
+
+		// a smaller block fills the end of the chunk, the rest goes into the next one
+		uint32_t count = uint32_t(m_PendingRecords.size());
+		uint32_t size = PackSensorBlock(m_PendingRecords.data(), count, m_PackedBlock.data());
+		while (m_PackedSize + size > SENSOR_CHUNK_SIZE && count > MIN_SPLIT_BLOCK_RECORDS)
+		{
+			count /= 2;
+			size = PackSensorBlock(m_PendingRecords.data(), count, m_PackedBlock.data());
+		}
+		if (m_PackedSize + size > SENSOR_CHUNK_SIZE)
+		{
+			WritePacked();
+			continue;
+		}
+
+		memcpy(m_PackedChunk.data() + m_PackedSize, m_PackedBlock.data(), size);
+		m_PackedSize += size;
+		m_PackedCount += count;
+		header->lastTimestamp = m_PendingTimestamps[count - 1];
+		m_PendingRecords.erase(m_PendingRecords.begin(), m_PendingRecords.begin() + count);
+		m_PendingTimestamps.erase(m_PendingTimestamps.begin(), m_PendingTimestamps.begin() + count);
+	}
+}
+
+void SensorLogWriter::WritePacked()
+{
+	if (m_PackedCount == 0)
+	{
+		return;
+	}
+
+	SensorChunkHeader* header = reinterpret_cast<SensorChunkHeader*>(m_PackedChunk.data());
+	header->magic = SENSOR_PACKED_CHUNK_MAGIC;
+	header->sequence = m_PackedSequence++;
+	header->recordCount = m_PackedCount;
+	memset(m_PackedChunk.data() + m_PackedSize, 0, SENSOR_CHUNK_SIZE - m_PackedSize);
+	WriteChunk(m_PackedChunk.data());
+
+	m_PackedSize = sizeof(SensorChunkHeader);
+	m_PackedCount = 0;
+}
+
+
+SensorLogCursor::SensorLogCursor() :
+	m_Log(nullptr),
+	m_ChunkIndex(0),
+	m_Chunk(nullptr),
+	m_Records(nullptr),
+	m_Position(0),
+	m_Count(0)
+{
+}
+
+SensorLogCursor::SensorLogCursor(const SensorLogCursor& _other) :
+	m_Log(_other.m_Log),
+	m_ChunkIndex(_other.m_ChunkIndex),
+	m_Chunk(_other.m_Chunk),
+	m_Records(_other.m_Records),
+	m_Position(_other.m_Position),
+	m_Count(_other.m_Count),
+	m_Unpacked(_other.m_Unpacked)
+{
+	if (_other.m_Records != nullptr && _other.m_Records == _other.m_Unpacked.data())
+	{
+		m_Records = m_Unpacked.data();
+	}
+}
+
+SensorLogCursor& SensorLogCursor::operator=(const SensorLogCursor& _other)
+{
+	if (this != &_other)
+	{
+		m_Log = _other.m_Log;
+		m_ChunkIndex = _other.m_ChunkIndex;
+		m_Chunk = _other.m_Chunk;
+		m_Position = _other.m_Position;
+		m_Count = _other.m_Count;
+		m_Unpacked = _other.m_Unpacked;
+		const bool unpacked = _other.m_Records != nullptr && _other.m_Records == _other.m_Unpacked.data();
+		m_Records = unpacked ? m_Unpacked.data() : _other.m_Records;
+	}
+	return *this;
+}
+
+void SensorLogCursor::EnterChunk(size_t _chunk, uint32_t _record)
+{
+	for (; _chunk < m_Log->GetChunkCount(); ++_chunk, _record = 0)
+	{
+		m_ChunkIndex = _chunk;
+		m_Chunk = m_Log->GetChunkHeader(_chunk);
+		m_Count = m_Chunk->recordCount;
+		if (m_Chunk->magic == SENSOR_PACKED_CHUNK_MAGIC)
+		{
+			m_Unpacked.resize(m_Count);
+			if (!UnpackSensorChunk(reinterpret_cast<const uint8_t*>(m_Chunk), m_Log->GetChunkSize(), m_Unpacked.data()))
+			{
+				continue;
+			}
+			m_Records = m_Unpacked.data();
+		}
+		else
+		{
+			m_Records = reinterpret_cast<const SensorLogRecord*>(m_Chunk + 1);
+		}
+
+		m_Position = _record;
+		if (m_Position < m_Count)
+		{
+			return;
+		}
+	}
+
+	m_ChunkIndex = _chunk;
+	m_Chunk = nullptr;
+	m_Records = nullptr;
+	m_Position = 0;
+	m_Count = 0;
+}
+
+void SensorLogCursor::Next()
+{
+	if (m_Records == nullptr)
+	{
+		return;
+	}
+	if (++m_Position == m_Count)
+	{
+		EnterChunk(m_ChunkIndex + 1, 0);
+	}
+}
+
+
+MappedSensorLog::MappedSensorLog() :
+	m_Version(0),
+	m_ChunkSize(0),
+	m_DamagedChunks(0),
+	m_RecordCount(0),
+	m_IndexLoaded(false),
+	m_IndexVerified(false)
+{
+}
+
+bool MappedSensorLog::Open(const PathChar* _path, bool _verifyChunks)
+{
+	Close();
+
+	if (!m_File.Open(_path) || m_File.GetSize() < sizeof(SensorLogHeader))
+	{
+		Close();
+		return false;
+	}
+
+	SensorLogHeader header;
+	memcpy(&header, m_File.GetData(), sizeof(header));
+	if (header.magic != SENSOR_LOG_MAGIC || header.version < OLDEST_READABLE_VERSION || header.version > SENSOR_LOG_VERSION
+		|| header.recordSize != sizeof(SensorLogRecord)
+		|| header.chunkSize <= sizeof(SensorChunkHeader) || header.chunkSize % 8 != 0)
+	{
+		Close();
+		return false;
+	}
+	m_Version = header.version;
+	m_ChunkSize = header.chunkSize;
+
+#if defined(_WIN32)
+	const std::wstring indexPath = std::wstring(_path) + L".idx";
+#else
+	const std::string indexPath = std::string(_path) + ".idx";
+#endif
+	m_IndexLoaded = LoadIndex(indexPath.c_str(), _verifyChunks);
+	if (!m_IndexLoaded)
+	{
+		BuildIndex(_verifyChunks);
+		SaveIndex(indexPath.c_str());	// only an optimization, a read-only folder is fine
+	}
+
+	m_RecordCount = 0;
+	for (const SensorChunkIndexEntry& entry : m_Index)
+	{
+		m_RecordCount += entry.recordCount;
+	}
+	return true;
+}
+
+void MappedSensorLog::Close()
+{
+	m_File.Close();
+	m_Version = 0;
+	m_ChunkSize = 0;
+	m_Index.clear();
+	m_DamagedChunks = 0;
+	m_RecordCount = 0;
+	m_IndexLoaded = false;
+	m_IndexVerified = false;
+}
+
+// a torn last chunk counts as damaged
+void MappedSensorLog::BuildIndex(bool _verifyChunks)
+{
+	m_Index.clear();
+	m_DamagedChunks = 0;
+	m_IndexVerified = _verifyChunks;
+	for (size_t offset = sizeof(SensorLogHeader); offset < m_File.GetSize(); offset += m_ChunkSize)
+	{
+		const uint8_t* chunk = m_File.GetData() + offset;
+		const SensorChunkHeader* header = reinterpret_cast<const SensorChunkHeader*>(chunk);
+		const bool complete = m_File.GetSize() - offset >= m_ChunkSize;
+		const uint32_t capacity = complete ? GetChunkCapacity(header->magic, m_ChunkSize) : 0;
+		if (capacity == 0 || header->recordCount > capacity
+			|| (_verifyChunks && !IsValidChunk(chunk, m_ChunkSize)))
+		{
+			++m_DamagedChunks;
+			continue;
+		}
+		if (header->recordCount == 0)
+		{
+			continue;
+		}
+
+		SensorChunkIndexEntry entry;
+		entry.firstTimestamp = header->firstTimestamp;
+		entry.lastTimestamp = header->lastTimestamp;
+		entry.offset = offset;
+		entry.recordCount = header->recordCount;
+		entry.sequence = header->sequence;
+		m_Index.push_back(entry);
+	}
+}
+
+bool MappedSensorLog::LoadIndex(const PathChar* _indexPath, bool _verifyChunks)
+{
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (_wfopen_s(&file, _indexPath, L"rb") != 0)
+	{
+		file = nullptr;
+	}
+#else
+	file = fopen(_indexPath, "rb");
+#endif
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	SensorIndexHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& header.magic == SENSOR_INDEX_MAGIC && header.version == SENSOR_INDEX_VERSION
+		&& header.logSize == m_File.GetSize() && header.chunkSize == m_ChunkSize
+		&& header.entryCount <= m_File.GetSize() / m_ChunkSize
+		&& (header.verified != 0 || !_verifyChunks);
+	if (valid)
+	{
+		m_Index.resize(header.entryCount);
+		valid = header.entryCount == 0 || fread(m_Index.data(), sizeof(SensorChunkIndexEntry), header.entryCount, file) == header.entryCount;
+		m_DamagedChunks = header.damagedCount;
+		m_IndexVerified = header.verified != 0;
+	}
+	fclose(file);
+
+	// entries must point at chunks inside the mapping
+	for (size_t i = 0; valid && i < m_Index.size(); ++i)
+	{
+		valid = m_Index[i].offset >= sizeof(SensorLogHeader) && m_Index[i].offset + m_ChunkSize <= m_File.GetSize();
+	}
+	if (!valid)
+	{
+		m_Index.clear();
+		m_DamagedChunks = 0;
+	}
+	return valid;
+}
+
+bool MappedSensorLog::SaveIndex(const PathChar* _indexPath) const
+{
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (_wfopen_s(&file, _indexPath, L"wb") != 0)
+	{
+		file = nullptr;
+	}
+#else
+	file = fopen(_indexPath, "wb");
+#endif
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	SensorIndexHeader header;
+	header.magic = SENSOR_INDEX_MAGIC;
+	header.version = SENSOR_INDEX_VERSION;
+	header.logSize = m_File.GetSize();
+	header.chunkSize = m_ChunkSize;
+	header.entryCount = uint32_t(m_Index.size());
+	header.damagedCount = m_DamagedChunks;
+	header.verified = m_IndexVerified ? 1 : 0;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	written = written && (m_Index.empty() || fwrite(m_Index.data(), sizeof(SensorChunkIndexEntry), m_Index.size(), file) == m_Index.size());
+	fclose(file);
+	return written;
+}
+
+uint64_t MappedSensorLog::GetFirstTimestamp() const
+{
+	return m_Index.empty() ? 0 : m_Index.front().firstTimestamp;
+}
+
+uint64_t MappedSensorLog::GetLastTimestamp() const
+{
+	return m_Index.empty() ? 0 : m_Index.back().lastTimestamp;
+}
+
+const SensorChunkHeader* MappedSensorLog::GetChunkHeader(size_t _chunk) const
+{
+	return reinterpret_cast<const SensorChunkHeader*>(m_File.GetData() + m_Index[_chunk].offset);
+}
+
+SensorLogCursor MappedSensorLog::Begin() const
+{
+	SensorLogCursor cursor;
+	cursor.m_Log = this;
+	cursor.EnterChunk(0, 0);
+	return cursor;
+}
+
+SensorLogCursor MappedSensorLog::Seek(uint64_t _timestamp) const
+{
+	// first chunk that ends at or after the time
+	const std::vector<SensorChunkIndexEntry>::const_iterator chunk = std::lower_bound(m_Index.begin(), m_Index.end(), _timestamp,
+		[](const SensorChunkIndexEntry& _entry, uint64_t _time) { return _entry.lastTimestamp < _time; });
+
+	SensorLogCursor cursor;
+	cursor.m_Log = this;
+	if (chunk == m_Index.end())
+	{
+		cursor.EnterChunk(m_Index.size(), 0);
+		return cursor;
+	}
+
+	// then the first record in it at or after the time
+	const size_t chunkIndex = size_t(chunk - m_Index.begin());
+	cursor.EnterChunk(chunkIndex, 0);
+	if (!cursor.IsValid() || cursor.m_ChunkIndex != chunkIndex)
+	{
+		return cursor;		// the chunk did not unpack, the next one starts later anyway
+	}
+
+	const uint64_t firstTimestamp = cursor.m_Chunk->firstTimestamp;
+	const uint32_t offset = (_timestamp > firstTimestamp) ? uint32_t(std::min<uint64_t>(_timestamp - firstTimestamp, UINT32_MAX)) : 0;
+	const SensorLogRecord* record = std::lower_bound(cursor.m_Records, cursor.m_Records + cursor.m_Count, offset,
+		[](const SensorLogRecord& _record, uint32_t _offset) { return _record.timeOffset < _offset; });
+
+	if (record == cursor.m_Records + cursor.m_Count)
+	{
+		cursor.EnterChunk(chunkIndex + 1, 0);	// only when the chunk was not in time order
+	}
+	else
+	{
+		cursor.m_Position = uint32_t(record - cursor.m_Records);
+	}
+	return cursor;
+}
+
+
+SensorLogReader::SensorLogReader() :
+	m_DamagedChunks(0)
+{
+}
+
+bool SensorLogReader::Open(const PathChar* _path)
+{
+	Close();
+
+	MappedSensorLog log;
+	if (!log.Open(_path))
+	{
+		return false;
+	}
+
+	m_Samples.reserve(size_t(log.GetRecordCount()));
+	for (SensorLogCursor cursor = log.Begin(); cursor.IsValid(); cursor.Next())
+	{
+		m_Samples.push_back(cursor.GetSample());
+	}
+	m_DamagedChunks = log.GetDamagedChunkCount();
+	return true;
+}
+
+void SensorLogReader::Close()
+{
+	m_Samples.clear();
+	m_DamagedChunks = 0;
+}
+
+bool PackSensorLog(const PathChar* _source, const PathChar* _destination, SensorLogPackResult& _result)
+{
+	_result.sampleCount = 0;
+	_result.sourceSize = 0;
+	_result.packedSize = 0;
+
+	MappedSensorLog source;
+	if (!source.Open(_source) || !source.HasTemperature())
+	{
+		return false;
+	}
+	_result.sourceSize = source.GetFileSize();
+
+	SensorLogWriter writer;
+	if (!writer.Open(_destination, PACK_CHUNK_SECONDS, SENSOR_LOG_PACKED))
+	{
+		return false;
+	}
+	for (SensorLogCursor cursor = source.Begin(); cursor.IsValid(); cursor.Next())
+	{
+		// unlike the acquisition thread this one can wait for storage
+		const SensorSample sample = cursor.GetSample();
+		while (!writer.Write(sample))
+		{
+			if (writer.HasWriteError())
+			{
+				writer.Close();
+				return false;
+			}
+			std::this_thread::yield();
+		}
+	}
+	writer.Close();
+
+	_result.sampleCount = writer.GetSampleCount();
+	_result.packedSize = sizeof(SensorLogHeader) + writer.GetWrittenSize();
+	return !writer.HasWriteError();
+}
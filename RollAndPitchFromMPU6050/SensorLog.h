@@ -0,0 +1,316 @@
+//
+// SensorLog.h - raw sample log: a file header followed by fixed-size chunks of records
+//
+// Every chunk carries its own header and CRC and is written whole, so a power
+// loss costs at most the chunk that was being filled or written; readers skip
+// chunks that fail the check. The file is only ever appended to.
+//
+// Records keep the 14-byte MPU6050 data register frame as read from the bus,
+// with the device and a timestamp relative to the chunk. A chunk holds them
+// either raw or packed by SensorLogCodec.h. Live recording writes raw chunks;
+// PackSensorLog re-encodes a finished log into full packed chunks, which hold
+// 2.98 times the records at 30 LSB of sensor noise and 2.66 times at 90 LSB
+// (MeasureFeatures in Benchmark.h). Version 2 files have raw chunks only, and
+// before version 4 the temperature of the records is 0 rather than measured.
+//
+
+#pragma once
+
+#include "SensorData.h"
+#include "MappedFile.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const uint32_t SENSOR_LOG_MAGIC = 0x4C55504D;	// "MPUL"
+const uint32_t SENSOR_LOG_VERSION = 4;
+const uint32_t SENSOR_LOG_TEMPERATURE_VERSION = 4;	// earlier FIFO acquisition left the temperature 0
+const uint32_t SENSOR_CHUNK_MAGIC = 0x4355504D;	// "MPUC"
+const uint32_t SENSOR_PACKED_CHUNK_MAGIC = 0x5055504D;	// "MPUP"
+const uint32_t SENSOR_CHUNK_SIZE = 16384;		// 817 records, 0.8 s of one sensor at 1 kHz
+
+struct SensorLogHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;	// sizeof(SensorLogRecord) of the writer
+	uint32_t chunkSize;
+};
+
+struct SensorChunkHeader
+{
+	uint32_t magic;
+	uint32_t sequence;			// chunk number from the start of the file
+	uint64_t firstTimestamp;	// StepTimer ticks of the first record, base of the record offsets
+	uint64_t lastTimestamp;
+	uint32_t recordCount;
+	uint32_t crc;				// CRC-32 of the whole chunk with this field zero
+};
+
+struct SensorLogRecord
+{
+	uint32_t timeOffset;		// ticks after firstTimestamp of the chunk
+	uint8_t deviceId;			// I2C address
+	uint8_t reserved;
+	uint8_t frame[MPU6050_FRAME_SIZE];	// big-endian, register order 0x3B..0x48
+};
+
+const uint32_t SENSOR_CHUNK_CAPACITY = (SENSOR_CHUNK_SIZE - sizeof(SensorChunkHeader)) / sizeof(SensorLogRecord);
+
+// CRC-32 (IEEE 802.3), _crc of the previous part to continue a running checksum
+uint32_t Crc32(const void* _data, size_t _size, uint32_t _crc = 0);
+
+enum SensorLogEncoding
+{
+	SENSOR_LOG_RAW,			// records as they are, readable in place
+	SENSOR_LOG_PACKED,		// columnar packed chunks, decoded on reading
+};
+
+// checks magic, record count and CRC of a chunk in memory
+bool IsValidChunk(const uint8_t* _chunk, uint32_t _chunkSize);
+
+SensorSample DecodeLogRecord(const SensorChunkHeader& _chunk, const SensorLogRecord& _record);
+
+
+// Records are staged in a chunk buffer by the producer (the acquisition thread)
+// and a writer thread appends sealed chunks to the file, so the producer never
+// waits on storage. A chunk is sealed when it is full or older than the
+// configured age, which bounds the data lost at low sample rates.
+// Packing is opt-in, raw chunks keep the one chunk bound of a power loss.
+// When packing, the writer thread packs the sealed records into blocks and
+// writes a packed chunk once the next block does not fit, right away after a
+// chunk sealed by age, or once its first record is older than the configured
+// age when the next raw chunk arrives. A power loss then costs at most about
+// twice that age: the raw chunk being filled and the packed one waiting for it.
+// At rates where a raw chunk fills in less than the age, packed chunks are
+// written partly filled and the file is correspondingly larger.
+// One thread calls Write, another may Open and Close.
+class SensorLogWriter
+{
+public:
+
+	static const int BUFFER_COUNT = 4;		// chunks in flight, covers storage stalls of a few chunk periods
+
+	SensorLogWriter();
+	~SensorLogWriter();
+
+	// _maxChunkSeconds: seal a partly filled chunk after this long
+	bool Open(const PathChar* _path, double _maxChunkSeconds = 1.0, SensorLogEncoding _encoding = SENSOR_LOG_RAW);
+
+	// seals and writes the current chunk, then stops the writer thread
+	void Close();
+	bool IsOpen() const					{ return m_Open.load(std::memory_order_acquire); }
+
+	// producer side, no file access; returns false when closed or when all buffers wait for storage
+	bool Write(const SensorSample& _sample);
+
+	uint64_t GetSampleCount() const		{ return m_SampleCount.load(std::memory_order_relaxed); }
+	uint32_t GetDroppedCount() const	{ return m_DroppedCount.load(std::memory_order_relaxed); }
+	uint32_t GetChunkCount() const		{ return m_WrittenChunks.load(std::memory_order_relaxed); }
+	uint64_t GetWrittenSize() const		{ return uint64_t(GetChunkCount()) * SENSOR_CHUNK_SIZE; }
+	bool HasWriteError() const			{ return m_WriteError.load(std::memory_order_relaxed); }
+
+private:
+
+	SensorLogWriter(const SensorLogWriter&);
+	SensorLogWriter& operator=(const SensorLogWriter&);
+
+	void Seal();
+	void WriterLoop();
+
+	// writer thread
+	bool WriteChunk(uint8_t* _chunk);
+	void PackRecords(const uint8_t* _chunk);
+	void PackPending();
+	void WritePacked();
+
+	FILE* m_File;
+	std::thread m_Thread;
+	std::mutex m_WakeMutex;
+	std::condition_variable m_Wake;
+	std::atomic<bool> m_Open;
+	std::atomic<bool> m_Stopping;		// writer thread exits once everything sealed is written
+	std::atomic<int> m_ActiveWriters;	// producers inside Write, Close waits for them
+
+	// ring of chunk buffers: the producer fills m_Sealed, the writer thread drains up to it
+	std::vector<uint8_t> m_Buffers[BUFFER_COUNT];
+	std::atomic<uint32_t> m_Sealed;
+	std::atomic<uint32_t> m_Written;
+	uint32_t m_FillCount;				// records in the chunk being filled
+	uint32_t m_Sequence;
+	uint64_t m_MaxChunkTicks;
+	SensorLogEncoding m_Encoding;
+
+	// packing state of the writer thread: records waiting for a full block, the chunk being packed
+	std::vector<SensorLogRecord> m_PendingRecords;
+	std::vector<uint64_t> m_PendingTimestamps;
+	std::vector<uint8_t> m_PackedChunk;
+	std::vector<uint8_t> m_PackedBlock;
+	uint32_t m_PackedSize;
+	uint32_t m_PackedCount;
+	uint32_t m_PackedSequence;
+
+	std::atomic<uint64_t> m_SampleCount;
+	std::atomic<uint32_t> m_DroppedCount;
+	std::atomic<uint32_t> m_WrittenChunks;
+	std::atomic<bool> m_WriteError;
+};
+
+
+// one entry per valid chunk, kept next to the log as <log>.idx
+struct SensorChunkIndexEntry
+{
+	uint64_t firstTimestamp;
+	uint64_t lastTimestamp;
+	uint64_t offset;			// of the chunk header in the log
+	uint32_t recordCount;
+	uint32_t sequence;
+};
+
+const uint32_t SENSOR_INDEX_MAGIC = 0x4955504D;	// "MPUI"
+const uint32_t SENSOR_INDEX_VERSION = 1;
+
+struct SensorIndexHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t logSize;			// the index is rebuilt when the log has grown since
+	uint32_t chunkSize;
+	uint32_t entryCount;
+	uint32_t damagedCount;
+	uint32_t verified;			// 1 when built with the chunk CRCs checked; a verifying open rebuilds an index without
+};
+
+
+class MappedSensorLog;
+
+// position in a mapped log; records of raw chunks are read in place, packed
+// chunks are decoded whole into the cursor on entering them
+class SensorLogCursor
+{
+public:
+
+	SensorLogCursor();
+	SensorLogCursor(const SensorLogCursor& _other);
+	SensorLogCursor& operator=(const SensorLogCursor& _other);
+
+	bool IsValid() const						{ return m_Records != nullptr; }
+	const SensorLogRecord& GetRecord() const	{ return m_Records[m_Position]; }
+	uint64_t GetTimestamp() const				{ return m_Chunk->firstTimestamp + GetRecord().timeOffset; }
+	SensorSample GetSample() const				{ return DecodeLogRecord(*m_Chunk, GetRecord()); }
+
+	// moves to the next record, across chunk boundaries; invalid past the last one
+	void Next();
+
+private:
+
+	friend class MappedSensorLog;
+
+	// skips chunks that fail to unpack
+	void EnterChunk(size_t _chunk, uint32_t _record);
+
+	const MappedSensorLog* m_Log;
+	size_t m_ChunkIndex;
+	const SensorChunkHeader* m_Chunk;
+	const SensorLogRecord* m_Records;	// in the mapping or in m_Unpacked
+	uint32_t m_Position;
+	uint32_t m_Count;
+	std::vector<SensorLogRecord> m_Unpacked;
+};
+
+
+// Maps a log of any length and seeks by time without reading it from the start:
+// a binary search over the chunk index, then over the record offsets of one chunk.
+// The index is built on the first open (one pass over the chunk headers, with the
+// CRCs when verifying) and saved next to the log for later opens; a verifying
+// open does not trust an index that was built without the CRCs.
+// Packed chunks are unpacked when a cursor enters them, one chunk per seek.
+// Records must be in time order, as the writer produces them. The whole file is
+// mapped at once, so 32-bit builds are limited by their address space.
+class MappedSensorLog
+{
+public:
+
+	MappedSensorLog();
+
+	bool Open(const PathChar* _path, bool _verifyChunks = true);
+	void Close();
+	bool IsOpen() const									{ return m_File.IsOpen(); }
+	uint64_t GetFileSize() const						{ return m_File.GetSize(); }
+	bool HasTemperature() const							{ return m_Version >= SENSOR_LOG_TEMPERATURE_VERSION; }
+
+	uint32_t GetChunkSize() const						{ return m_ChunkSize; }
+	size_t GetChunkCount() const						{ return m_Index.size(); }
+	const SensorChunkIndexEntry& GetChunk(size_t _chunk) const	{ return m_Index[_chunk]; }
+	uint32_t GetDamagedChunkCount() const				{ return m_DamagedChunks; }
+	uint64_t GetRecordCount() const						{ return m_RecordCount; }
+	bool WasIndexLoaded() const							{ return m_IndexLoaded; }
+
+	// time span of the recording, 0 when it has no records
+	uint64_t GetFirstTimestamp() const;
+	uint64_t GetLastTimestamp() const;
+
+	SensorLogCursor Begin() const;
+
+	// first record at or after _timestamp, O(log n); invalid when the log ends before it
+	SensorLogCursor Seek(uint64_t _timestamp) const;
+
+	const SensorChunkHeader* GetChunkHeader(size_t _chunk) const;
+
+private:
+
+	void BuildIndex(bool _verifyChunks);
+	bool LoadIndex(const PathChar* _indexPath, bool _verifyChunks);
+	bool SaveIndex(const PathChar* _indexPath) const;
+
+	MappedFile m_File;
+	uint32_t m_Version;
+	uint32_t m_ChunkSize;
+	std::vector<SensorChunkIndexEntry> m_Index;
+	uint32_t m_DamagedChunks;
+	uint64_t m_RecordCount;
+	bool m_IndexLoaded;
+	bool m_IndexVerified;
+};
+
+
+// every valid record of a log decoded into memory, for analyses that need an array
+class SensorLogReader
+{
+public:
+
+	SensorLogReader();
+
+	// fails on a missing file, foreign header or record layout
+	bool Open(const PathChar* _path);
+	void Close();
+
+	size_t GetSampleCount() const				{ return m_Samples.size(); }
+	const SensorSample* GetSamples() const		{ return m_Samples.data(); }
+	uint32_t GetDamagedChunkCount() const		{ return m_DamagedChunks; }
+
+private:
+
+	std::vector<SensorSample> m_Samples;
+	uint32_t m_DamagedChunks;
+};
+
+
+struct SensorLogPackResult
+{
+	uint64_t sampleCount;
+	uint64_t sourceSize;
+	uint64_t packedSize;
+};
+
+// Re-encodes a finished log into packed chunks for keeping: without an age limit
+// every chunk but the last is full. _destination is overwritten. Logs from
+// before the temperature version are refused, their records would read as
+// measured at 0 degrees.
+bool PackSensorLog(const PathChar* _source, const PathChar* _destination, SensorLogPackResult& _result);
@@ -0,0 +1,279 @@
+//
+// SensorLogCheck.cpp
+//
+
+#include "pch.h"
+#include "SensorLogCheck.h"
+
+#include <chrono>
+#include <string.h>
+
+
+namespace
+{
+	const uint32_t TIMED_BATCH = 256;			// Write calls per producer timing
+	const uint32_t SEEK_COUNT = 10000;
+	const uint32_t FIRST_DEVICE_ID = 0x68;
+	const size_t CORRUPTED_CHUNK = 2;			// index of the chunk damaged in the copy
+
+#if defined(_WIN32)
+	const PathChar DAMAGED_EXTENSION[] = L".damaged";
+	const PathChar PACKED_EXTENSION[] = L".packed";
+	const PathChar INDEX_EXTENSION[] = L".idx";
+#else
+	const PathChar DAMAGED_EXTENSION[] = ".damaged";
+	const PathChar PACKED_EXTENSION[] = ".packed";
+	const PathChar INDEX_EXTENSION[] = ".idx";
+#endif
+
+	FILE* OpenFile(const PathChar* _path, bool _write)
+	{
+#if defined(_WIN32)
+		FILE* file = nullptr;
+		return (_wfopen_s(&file, _path, _write ? L"wb" : L"rb") == 0) ? file : nullptr;
+#else
+		return fopen(_path, _write ? "wb" : "rb");
+#endif
+	}
+
+	void RemoveFile(const PathChar* _path)
+	{
+#if defined(_WIN32)
+		_wremove(_path);
+#else
+		remove(_path);
+#endif
+	}
+
+	void RemoveLog(const std::basic_string<PathChar>& _path)
+	{
+		RemoveFile(_path.c_str());
+		RemoveFile((_path + INDEX_EXTENSION).c_str());
+	}
+
+	bool ReadWholeFile(const PathChar* _path, std::vector<uint8_t>& _data)
+	{
+		FILE* file = OpenFile(_path, false);
+		if (file == nullptr)
+		{
+			return false;
+		}
+		_data.clear();
+		uint8_t buffer[65536];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			_data.insert(_data.end(), buffer, buffer + read);
+		}
+		fclose(file);
+		return true;
+	}
+
+	bool WriteWholeFile(const PathChar* _path, const uint8_t* _data, size_t _size)
+	{
+		FILE* file = OpenFile(_path, true);
+		if (file == nullptr)
+		{
+			return false;
+		}
+		const bool written = fwrite(_data, 1, _size, file) == _size;
+		return (fclose(file) == 0) && written;
+	}
+
+	// deterministic noise so a failure can be reproduced
+	int16_t NextNoise(uint32_t& _state, int _amplitude)
+	{
+		_state = _state * 1664525u + 1013904223u;
+		return int16_t(int((_state >> 16) % uint32_t(2 * _amplitude + 1)) - _amplitude);
+	}
+
+	// sensors sample on a shared clock, staggered inside each period
+	std::vector<SensorSample> GenerateSamples(const SensorLogCheckSettings& _settings)
+	{
+		const uint64_t period = uint64_t(DX::StepTimer::TicksPerSecond / _settings.sampleRate);
+		const uint32_t steps = uint32_t(_settings.seconds * _settings.sampleRate);
+
+		std::vector<SensorSample> samples;
+		samples.reserve(size_t(steps) * _settings.sensorCount);
+		uint32_t noise = 2024;
+		for (uint32_t step = 0; step < steps; ++step)
+		{
+			for (uint32_t sensor = 0; sensor < _settings.sensorCount; ++sensor)
+			{
+				SensorSample sample;
+				sample.timestamp = DX::StepTimer::TicksPerSecond + step * period + sensor * period / _settings.sensorCount;
+				sample.deviceId = FIRST_DEVICE_ID + sensor;
+				sample.accel[0] = NextNoise(noise, 40);
+				sample.accel[1] = NextNoise(noise, 40);
+				sample.accel[2] = int16_t(16384 + NextNoise(noise, 40));
+				sample.temperature = int16_t(-2000 + step / 1000);
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					sample.gyro[axis] = NextNoise(noise, 20);
+				}
+				samples.push_back(sample);
+			}
+		}
+		return samples;
+	}
+
+	double SecondsSince(const std::chrono::steady_clock::time_point& _start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+	bool IsSameSample(const SensorSample& _a, const SensorSample& _b)
+	{
+		return _a.timestamp == _b.timestamp && _a.deviceId == _b.deviceId && _a.temperature == _b.temperature
+			&& memcmp(_a.accel, _b.accel, sizeof(_a.accel)) == 0 && memcmp(_a.gyro, _b.gyro, sizeof(_a.gyro)) == 0;
+	}
+}
+
+
+bool CheckSensorLog(const PathChar* _path, const SensorLogCheckSettings& _settings, SensorLogCheckResult& _result)
+{
+	memset(&_result, 0, sizeof(_result));
+	const std::basic_string<PathChar> path(_path);
+	const std::basic_string<PathChar> damagedPath = path + DAMAGED_EXTENSION;
+	const std::basic_string<PathChar> packedPath = path + PACKED_EXTENSION;
+	RemoveLog(path);
+
+	const std::vector<SensorSample> samples = GenerateSamples(_settings);
+	_result.sampleCount = samples.size();
+
+	// 1) write as fast as the writer takes it; a batch that had to wait for storage is not timed
+	SensorLogWriter writer;
+	if (!writer.Open(_path, 1.0, _settings.encoding))
+	{
+		return false;
+	}
+	double producerSeconds = 0.0;
+	uint64_t timedCalls = 0;
+	for (size_t start = 0; start < samples.size(); start += TIMED_BATCH)
+	{
+		const size_t end = std::min(start + TIMED_BATCH, samples.size());
+		bool waited = false;
+		const std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+		for (size_t i = start; i < end; ++i)
+		{
+			while (!writer.Write(samples[i]))
+			{
+				waited = true;
+				std::this_thread::yield();
+			}
+		}
+		if (!waited)
+		{
+			producerSeconds += SecondsSince(batchStart);
+			timedCalls += end - start;
+		}
+	}
+	writer.Close();
+	if (writer.HasWriteError())
+	{
+		RemoveLog(path);
+		return false;
+	}
+	_result.producerNanoseconds = (timedCalls > 0) ? producerSeconds * 1e9 / timedCalls : 0.0;
+
+	// 2) every sample back, bit for bit
+	std::vector<uint8_t> file;
+	SensorLogReader reader;
+	if (!reader.Open(_path) || !ReadWholeFile(_path, file))
+	{
+		RemoveLog(path);
+		return false;
+	}
+	_result.fileSize = file.size();
+	_result.mismatchCount = (reader.GetSampleCount() < samples.size()) ? samples.size() - reader.GetSampleCount() : 0;
+	for (size_t i = 0; i < std::min(reader.GetSampleCount(), samples.size()); ++i)
+	{
+		_result.mismatchCount += IsSameSample(reader.GetSamples()[i], samples[i]) ? 0 : 1;
+	}
+	reader.Close();
+
+	// 3) the mapped reader: an unverified index first, which the verifying open must not take
+	{
+		RemoveFile((path + INDEX_EXTENSION).c_str());	// the reader above saved a verified one
+		MappedSensorLog log;
+		log.Open(_path, false);
+		log.Close();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const bool opened = log.Open(_path, true);
+		_result.indexBuildSeconds = SecondsSince(start);
+		_result.unverifiedIndexRebuilt = opened && !log.WasIndexLoaded();
+		log.Close();
+
+		start = std::chrono::steady_clock::now();
+		log.Open(_path, true);
+		_result.indexLoadSeconds = log.WasIndexLoaded() ? SecondsSince(start) : 0.0;
+
+		const uint64_t first = log.GetFirstTimestamp();
+		const uint64_t span = log.GetLastTimestamp() - first + 1;
+		uint32_t random = 99;
+		uint64_t checksum = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < SEEK_COUNT; ++i)
+		{
+			random = random * 1664525u + 1013904223u;
+			const SensorLogCursor cursor = log.Seek(first + (uint64_t(random) * span >> 32));
+			checksum += cursor.IsValid() ? cursor.GetTimestamp() : 0;
+		}
+		_result.seekNanoseconds = SecondsSince(start) * 1e9 / SEEK_COUNT;
+
+		uint64_t records = 0;
+		start = std::chrono::steady_clock::now();
+		for (SensorLogCursor cursor = log.Begin(); cursor.IsValid(); cursor.Next())
+		{
+			checksum += cursor.GetTimestamp();
+			++records;
+		}
+		_result.iterateNanoseconds = (records > 0) ? SecondsSince(start) * 1e9 / records : 0.0;
+
+		// keep the optimizer from dropping the loops
+		volatile uint64_t sink = checksum;
+		(void)sink;
+	}
+
+	// 4) one chunk corrupted and the last one cut in half lose exactly their records
+	MappedSensorLog log;
+	if (log.Open(_path) && log.GetChunkCount() > CORRUPTED_CHUNK + 1)
+	{
+		const SensorChunkIndexEntry& corrupted = log.GetChunk(CORRUPTED_CHUNK);
+		const SensorChunkIndexEntry& last = log.GetChunk(log.GetChunkCount() - 1);
+		_result.expectedLostSamples = corrupted.recordCount + last.recordCount;
+
+		file[size_t(corrupted.offset) + log.GetChunkSize() / 2] ^= 0x5A;
+		const size_t cutSize = size_t(last.offset) + log.GetChunkSize() / 2;
+		log.Close();
+
+		SensorLogReader damaged;
+		if (WriteWholeFile(damagedPath.c_str(), file.data(), cutSize) && damaged.Open(damagedPath.c_str()))
+		{
+			_result.damagedChunks = damaged.GetDamagedChunkCount();
+			_result.lostSamples = samples.size() - damaged.GetSampleCount();
+		}
+	}
+	log.Close();
+
+	// 5) the offline re-encode reads back the same samples
+	SensorLogPackResult packed;
+	SensorLogReader packedReader;
+	if (PackSensorLog(_path, packedPath.c_str(), packed) && packedReader.Open(packedPath.c_str()))
+	{
+		_result.packedFileSize = packed.packedSize;
+		_result.packedMismatchCount = (packedReader.GetSampleCount() < samples.size()) ? samples.size() - packedReader.GetSampleCount() : 0;
+		for (size_t i = 0; i < std::min(packedReader.GetSampleCount(), samples.size()); ++i)
+		{
+			_result.packedMismatchCount += IsSameSample(packedReader.GetSamples()[i], samples[i]) ? 0 : 1;
+		}
+	}
+	packedReader.Close();
+
+	RemoveLog(path);
+	RemoveLog(damagedPath);
+	RemoveLog(packedPath);
+	_result.succeeded = true;
+	return true;
+}
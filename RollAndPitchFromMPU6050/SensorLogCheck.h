@@ -0,0 +1,55 @@
+//
+// SensorLogCheck.h - end to end check of the sample log on the storage it runs on
+//
+// Writes a synthetic recording of several sensors through SensorLogWriter,
+// reads it back and compares every sample, then damages a copy the way a crash
+// or a bad sector would (one chunk corrupted, the file cut inside its last
+// chunk) and checks that exactly those chunks are lost. PackSensorLog then
+// re-encodes the log and the packed copy is compared too. The producer cost is
+// the time spent in SensorLogWriter::Write, the figure that matters on the
+// acquisition thread. The mapped reader is timed on the same log: building the
+// verified index, reopening from the saved one, seeking and iterating.
+//
+
+#pragma once
+
+#include "SensorLog.h"
+
+
+struct SensorLogCheckSettings
+{
+	uint32_t sensorCount;
+	float sampleRate;			// Hz per sensor
+	float seconds;
+	SensorLogEncoding encoding;
+
+	SensorLogCheckSettings() :
+		sensorCount(4),
+		sampleRate(1000.0f),
+		seconds(15.0f),
+		encoding(SENSOR_LOG_RAW)
+	{
+	}
+};
+
+struct SensorLogCheckResult
+{
+	bool succeeded;					// the log could be written and read
+	uint64_t sampleCount;			// written
+	uint64_t fileSize;
+	double producerNanoseconds;		// per Write, over the calls that did not wait for storage
+	uint64_t mismatchCount;			// samples read back different from what was written, or missing
+	double indexBuildSeconds;		// first open, CRCs verified
+	double indexLoadSeconds;		// reopen from the saved index
+	bool unverifiedIndexRebuilt;	// a verifying open did not take an index built without CRCs
+	double seekNanoseconds;			// per Seek to a random time
+	double iterateNanoseconds;		// per record, cursor Next and GetTimestamp
+	uint32_t damagedChunks;			// reported by the reader of the damaged copy, 2 expected
+	uint64_t lostSamples;			// missing from the damaged copy
+	uint64_t expectedLostSamples;	// records of the corrupted and the cut chunk
+	uint64_t packedFileSize;		// of the log re-encoded by PackSensorLog, 0 when that failed
+	uint64_t packedMismatchCount;	// samples of the packed log different from what was written, or missing
+};
+
+// _path and _path plus ".damaged" and ".packed" are overwritten and removed afterwards, with their indexes
+bool CheckSensorLog(const PathChar* _path, const SensorLogCheckSettings& _settings, SensorLogCheckResult& _result);
@@ -0,0 +1,429 @@
+//
+// SensorLogCodec.cpp
+//
+
+#include "pch.h"
+#include "SensorLogCodec.h"
+
+#include <string.h>
+
+#if defined(_XM_SSE_INTRINSICS_)
+#include <emmintrin.h>
+#define SENSOR_CODEC_SSE2
+#elif defined(_XM_ARM_NEON_INTRINSICS_)
+#include <arm_neon.h>
+#define SENSOR_CODEC_NEON
+#endif
+
+
+namespace
+{
+	const uint32_t PACKED_LANES = 4;
+	const uint32_t PACKED_LANE_VALUES = PACKED_BLOCK_RECORDS / PACKED_LANES;
+
+	int32_t GetColumnValue(const SensorLogRecord& _record, int _column)
+	{
+		if (_column == 0)
+		{
+			return int32_t(_record.timeOffset);
+		}
+		if (_column == 1)
+		{
+			return _record.deviceId;
+		}
+		return ReadBigEndian16(_record.frame + 2 * (_column - 2));
+	}
+
+	uint32_t ZigzagEncode(uint32_t _delta)
+	{
+		return (_delta << 1) ^ uint32_t(int32_t(_delta) >> 31);
+	}
+
+	uint32_t ZigzagDecode(uint32_t _value)
+	{
+		return (_value >> 1) ^ (0u - (_value & 1));
+	}
+
+	uint32_t GetBitWidth(uint32_t _value)
+	{
+		uint32_t width = 0;
+		while (width < 32 && (_value >> width) != 0)
+		{
+			++width;
+		}
+		return width;
+	}
+
+	uint32_t GetWidthMask(uint32_t _width)
+	{
+		return (_width >= 32) ? 0xFFFFFFFFu : (1u << _width) - 1;
+	}
+
+	// _width words per lane, lanes interleaved: word w of lane l at _words[w * 4 + l]
+	void PackColumn(const uint32_t* _values, uint32_t _width, uint32_t* _words)
+	{
+		memset(_words, 0, _width * PACKED_LANES * sizeof(uint32_t));
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			const uint32_t lane = i % PACKED_LANES;
+			const uint32_t position = (i / PACKED_LANES) * _width;
+			const uint32_t word = position >> 5;
+			const uint32_t shift = position & 31;
+			_words[word * PACKED_LANES + lane] |= _values[i] << shift;
+			if (shift + _width > 32)
+			{
+				_words[(word + 1) * PACKED_LANES + lane] |= _values[i] >> (32 - shift);
+			}
+		}
+	}
+
+	// the inverse of PackColumn for four consecutive values, unrolled over the groups
+	// of a block so every shift is a constant of the width
+	template <uint32_t WIDTH, uint32_t GROUP>
+	struct LaneGroup
+	{
+		static void Unpack(const uint32_t* _words, uint32_t* _values)
+		{
+			const uint32_t WORD = (GROUP * WIDTH) >> 5;
+			const uint32_t SHIFT = (GROUP * WIDTH) & 31;
+			const uint32_t* words = _words + WORD * PACKED_LANES;
+			uint32_t* values = _values + GROUP * PACKED_LANES;
+
+#if defined(SENSOR_CODEC_SSE2)
+			__m128i value = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words)), SHIFT);
+			if (SHIFT + WIDTH > 32)
+			{
+				value = _mm_or_si128(value, _mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words + PACKED_LANES)), 32 - SHIFT));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_and_si128(value, _mm_set1_epi32(int32_t(GetWidthMask(WIDTH)))));
+#elif defined(SENSOR_CODEC_NEON)
+			uint32x4_t value = vshlq_u32(vld1q_u32(words), vdupq_n_s32(-int32_t(SHIFT)));
+			if (SHIFT + WIDTH > 32)
+			{
+				value = vorrq_u32(value, vshlq_u32(vld1q_u32(words + PACKED_LANES), vdupq_n_s32(int32_t(32 - SHIFT))));
+			}
+			vst1q_u32(values, vandq_u32(value, vdupq_n_u32(GetWidthMask(WIDTH))));
+#else
+			for (uint32_t lane = 0; lane < PACKED_LANES; ++lane)
+			{
+				uint32_t value = words[lane] >> SHIFT;
+				if (SHIFT + WIDTH > 32)
+				{
+					value |= words[PACKED_LANES + lane] << ((32 - SHIFT) & 31);
+				}
+				values[lane] = value & GetWidthMask(WIDTH);
+			}
+#endif
+			LaneGroup<WIDTH, GROUP + 1>::Unpack(_words, _values);
+		}
+	};
+
+	template <uint32_t WIDTH>
+	struct LaneGroup<WIDTH, PACKED_LANE_VALUES>
+	{
+		static void Unpack(const uint32_t*, uint32_t*)
+		{
+		}
+	};
+
+	template <uint32_t WIDTH>
+	void UnpackLanes(const uint32_t* _words, uint32_t* _values)
+	{
+		if (WIDTH == 0)
+		{
+			memset(_values, 0, PACKED_BLOCK_RECORDS * sizeof(uint32_t));
+			return;
+		}
+		LaneGroup<WIDTH, 0>::Unpack(_words, _values);
+	}
+
+	typedef void (*LaneUnpacker)(const uint32_t* _words, uint32_t* _values);
+
+	const LaneUnpacker LANE_UNPACKERS[33] =
+	{
+		UnpackLanes<0>, UnpackLanes<1>, UnpackLanes<2>, UnpackLanes<3>, UnpackLanes<4>, UnpackLanes<5>,
+		UnpackLanes<6>, UnpackLanes<7>, UnpackLanes<8>, UnpackLanes<9>, UnpackLanes<10>, UnpackLanes<11>,
+		UnpackLanes<12>, UnpackLanes<13>, UnpackLanes<14>, UnpackLanes<15>, UnpackLanes<16>, UnpackLanes<17>,
+		UnpackLanes<18>, UnpackLanes<19>, UnpackLanes<20>, UnpackLanes<21>, UnpackLanes<22>, UnpackLanes<23>,
+		UnpackLanes<24>, UnpackLanes<25>, UnpackLanes<26>, UnpackLanes<27>, UnpackLanes<28>, UnpackLanes<29>,
+		UnpackLanes<30>, UnpackLanes<31>, UnpackLanes<32>,
+	};
+
+	// remainders plus the reference, zigzag decoded, summed up from _first
+	void DecodeDeltas(const uint32_t* _values, uint32_t _base, int32_t _first, int32_t* _output)
+	{
+#if defined(SENSOR_CODEC_SSE2)
+		const __m128i base = _mm_set1_epi32(int32_t(_base));
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i carry = _mm_set1_epi32(_first);
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; i += PACKED_LANES)
+		{
+			const __m128i zigzag = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_values + i)), base);
+			__m128i delta = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, one)));
+
+			// running sum of the four deltas, then the total so far
+			delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+			delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+			delta = _mm_add_epi32(delta, carry);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(_output + i), delta);
+			carry = _mm_shuffle_epi32(delta, 0xFF);
+		}
+#elif defined(SENSOR_CODEC_NEON)
+		const uint32x4_t base = vdupq_n_u32(_base);
+		const uint32x4_t one = vdupq_n_u32(1);
+		const uint32x4_t zero = vdupq_n_u32(0);
+		uint32x4_t carry = vdupq_n_u32(uint32_t(_first));
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; i += PACKED_LANES)
+		{
+			const uint32x4_t zigzag = vaddq_u32(vld1q_u32(_values + i), base);
+			uint32x4_t delta = veorq_u32(vshrq_n_u32(zigzag, 1), vsubq_u32(zero, vandq_u32(zigzag, one)));
+
+			delta = vaddq_u32(delta, vextq_u32(zero, delta, 3));
+			delta = vaddq_u32(delta, vextq_u32(zero, delta, 2));
+			delta = vaddq_u32(delta, carry);
+			vst1q_s32(_output + i, vreinterpretq_s32_u32(delta));
+			carry = vdupq_n_u32(vgetq_lane_u32(delta, 3));
+		}
+#else
+		uint32_t sum = uint32_t(_first);
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			sum += ZigzagDecode(_values[i] + _base);
+			_output[i] = int32_t(sum);
+		}
+#endif
+	}
+
+	void AddReference(const uint32_t* _values, uint32_t _base, int32_t* _output)
+	{
+#if defined(SENSOR_CODEC_SSE2)
+		const __m128i base = _mm_set1_epi32(int32_t(_base));
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; i += PACKED_LANES)
+		{
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_values + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(_output + i), _mm_add_epi32(value, base));
+		}
+#elif defined(SENSOR_CODEC_NEON)
+		const uint32x4_t base = vdupq_n_u32(_base);
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; i += PACKED_LANES)
+		{
+			vst1q_s32(_output + i, vreinterpretq_s32_u32(vaddq_u32(vld1q_u32(_values + i), base)));
+		}
+#else
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			_output[i] = int32_t(_values[i] + _base);
+		}
+#endif
+	}
+
+#if defined(SENSOR_CODEC_SSE2)
+	// frame word in the low 16 bits, byte-swapped to register order
+	__m128i SwapWordBytes(const int32_t* _column)
+	{
+		const __m128i lowByte = _mm_set1_epi32(0xFF);
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_column));
+		return _mm_or_si128(_mm_slli_epi32(_mm_and_si128(value, lowByte), 8), _mm_and_si128(_mm_srli_epi32(value, 8), lowByte));
+	}
+#endif
+
+	void StoreRecordsScalar(const int32_t _columns[PACKED_COLUMN_COUNT][PACKED_BLOCK_RECORDS], uint32_t _begin, uint32_t _end, SensorLogRecord* _records)
+	{
+		for (uint32_t i = _begin; i < _end; ++i)
+		{
+			SensorLogRecord& record = _records[i];
+			record.timeOffset = uint32_t(_columns[0][i]);
+			record.deviceId = uint8_t(_columns[1][i]);
+			record.reserved = 0;
+			for (int word = 0; word < PACKED_COLUMN_COUNT - 2; ++word)
+			{
+				const int32_t value = _columns[2 + word][i];
+				record.frame[2 * word] = uint8_t(value >> 8);
+				record.frame[2 * word + 1] = uint8_t(value);
+			}
+		}
+	}
+
+	// columns back to records, frame words big-endian again
+	void StoreRecords(const int32_t _columns[PACKED_COLUMN_COUNT][PACKED_BLOCK_RECORDS], uint32_t _count, SensorLogRecord* _records)
+	{
+		uint32_t i = 0;
+#if defined(SENSOR_CODEC_SSE2)
+		// a record is five 32-bit words: time offset, device and word 0, words 1-2, 3-4, 5-6;
+		// four records at a time are built as five vectors and transposed
+		static_assert(sizeof(SensorLogRecord) == 20, "record layout of the transpose");
+		const __m128i lowByte = _mm_set1_epi32(0xFF);
+		for (; i + PACKED_LANES <= _count; i += PACKED_LANES)
+		{
+			const __m128i time = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_columns[0] + i));
+			const __m128i device = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_columns[1] + i)), lowByte);
+			const __m128i word1 = _mm_or_si128(device, _mm_slli_epi32(SwapWordBytes(_columns[2] + i), 16));
+			const __m128i word2 = _mm_or_si128(SwapWordBytes(_columns[3] + i), _mm_slli_epi32(SwapWordBytes(_columns[4] + i), 16));
+			const __m128i word3 = _mm_or_si128(SwapWordBytes(_columns[5] + i), _mm_slli_epi32(SwapWordBytes(_columns[6] + i), 16));
+			__m128i word4 = _mm_or_si128(SwapWordBytes(_columns[7] + i), _mm_slli_epi32(SwapWordBytes(_columns[8] + i), 16));
+
+			const __m128i low01 = _mm_unpacklo_epi32(time, word1);
+			const __m128i low23 = _mm_unpacklo_epi32(word2, word3);
+			const __m128i high01 = _mm_unpackhi_epi32(time, word1);
+			const __m128i high23 = _mm_unpackhi_epi32(word2, word3);
+			uint8_t* output = reinterpret_cast<uint8_t*>(_records + i);
+			for (uint32_t lane = 0; lane < PACKED_LANES; ++lane)
+			{
+				const __m128i row = (lane == 0) ? _mm_unpacklo_epi64(low01, low23) : (lane == 1) ? _mm_unpackhi_epi64(low01, low23)
+					: (lane == 2) ? _mm_unpacklo_epi64(high01, high23) : _mm_unpackhi_epi64(high01, high23);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + lane * sizeof(SensorLogRecord)), row);
+				const int32_t last = _mm_cvtsi128_si32(word4);
+				memcpy(output + lane * sizeof(SensorLogRecord) + 16, &last, sizeof(last));
+				word4 = _mm_srli_si128(word4, 4);
+			}
+		}
+#endif
+		StoreRecordsScalar(_columns, i, _count, _records);
+	}
+}
+
+
+uint32_t PackSensorBlock(const SensorLogRecord* _records, uint32_t _count, uint8_t* _output)
+{
+	PackedBlockHeader header;
+	memset(&header, 0, sizeof(header));
+	header.recordCount = uint8_t(_count);
+
+	uint32_t references[2 * PACKED_COLUMN_COUNT];
+	uint32_t referenceCount = 0;
+	uint32_t words[PACKED_COLUMN_COUNT * PACKED_BLOCK_RECORDS];
+	uint32_t wordCount = 0;
+	for (int column = 0; column < PACKED_COLUMN_COUNT; ++column)
+	{
+		// the last record repeats into the padding, which costs no width either way
+		uint32_t values[PACKED_BLOCK_RECORDS];
+		uint32_t smallest = 0xFFFFFFFFu;
+		uint32_t largest = 0;
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			values[i] = uint32_t(GetColumnValue(_records[std::min(i, _count - 1)], column));
+			smallest = std::min(smallest, values[i] ^ 0x80000000u);
+			largest = std::max(largest, values[i] ^ 0x80000000u);
+		}
+
+		uint32_t zigzag[PACKED_BLOCK_RECORDS];
+		uint32_t smallestDelta = 0xFFFFFFFFu;
+		uint32_t largestDelta = 0;
+		for (uint32_t i = 1; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			zigzag[i] = ZigzagEncode(values[i] - values[i - 1]);
+			smallestDelta = std::min(smallestDelta, zigzag[i]);
+			largestDelta = std::max(largestDelta, zigzag[i]);
+		}
+
+		// signed range of the values against the range of the deltas
+		uint32_t* remainders = values;
+		uint32_t width = GetBitWidth(largest - smallest);
+		uint32_t base = smallest ^ 0x80000000u;
+		if (GetBitWidth(largestDelta - smallestDelta) < width)
+		{
+			// the first value is reached by the reference delta as well, so its remainder is 0
+			width = GetBitWidth(largestDelta - smallestDelta);
+			base = smallestDelta;
+			zigzag[0] = smallestDelta;
+			references[referenceCount++] = base;
+			references[referenceCount++] = values[0] - ZigzagDecode(smallestDelta);
+			header.deltaColumns |= uint16_t(1 << column);
+			remainders = zigzag;
+		}
+		else
+		{
+			references[referenceCount++] = base;
+		}
+
+		for (uint32_t i = 0; i < PACKED_BLOCK_RECORDS; ++i)
+		{
+			remainders[i] -= base;
+		}
+		header.widths[column] = uint8_t(width);
+		PackColumn(remainders, width, words + wordCount);
+		wordCount += width * PACKED_LANES;
+	}
+
+	uint8_t* output = _output;
+	memcpy(output, &header, sizeof(header));
+	output += sizeof(header);
+	memcpy(output, references, referenceCount * sizeof(uint32_t));
+	output += referenceCount * sizeof(uint32_t);
+	memcpy(output, words, wordCount * sizeof(uint32_t));
+	output += wordCount * sizeof(uint32_t);
+	return uint32_t(output - _output);
+}
+
+uint32_t UnpackSensorBlock(const uint8_t* _block, size_t _size, int32_t _columns[PACKED_COLUMN_COUNT][PACKED_BLOCK_RECORDS], uint32_t& _count)
+{
+	PackedBlockHeader header;
+	if (_size < sizeof(header))
+	{
+		return 0;
+	}
+	memcpy(&header, _block, sizeof(header));
+
+	uint32_t referenceCount = 0;
+	uint32_t wordCount = 0;
+	for (int column = 0; column < PACKED_COLUMN_COUNT; ++column)
+	{
+		if (header.widths[column] > 32)
+		{
+			return 0;
+		}
+		referenceCount += ((header.deltaColumns >> column) & 1) ? 2 : 1;
+		wordCount += header.widths[column] * PACKED_LANES;
+	}
+	const uint32_t blockSize = uint32_t(sizeof(header) + (referenceCount + wordCount) * sizeof(uint32_t));
+	if (header.recordCount == 0 || header.recordCount > PACKED_BLOCK_RECORDS || blockSize > _size)
+	{
+		return 0;
+	}
+
+	const uint32_t* references = reinterpret_cast<const uint32_t*>(_block + sizeof(header));
+	const uint32_t* words = references + referenceCount;
+	uint32_t remainders[PACKED_BLOCK_RECORDS];
+	for (int column = 0; column < PACKED_COLUMN_COUNT; ++column)
+	{
+		LANE_UNPACKERS[header.widths[column]](words, remainders);
+		words += header.widths[column] * PACKED_LANES;
+
+		if ((header.deltaColumns >> column) & 1)
+		{
+			DecodeDeltas(remainders, references[0], int32_t(references[1]), _columns[column]);
+			references += 2;
+		}
+		else
+		{
+			AddReference(remainders, references[0], _columns[column]);
+			references += 1;
+		}
+	}
+	_count = header.recordCount;
+	return blockSize;
+}
+
+bool UnpackSensorChunk(const uint8_t* _chunk, uint32_t _chunkSize, SensorLogRecord* _records)
+{
+	SensorChunkHeader chunk;
+	memcpy(&chunk, _chunk, sizeof(chunk));
+
+	int32_t columns[PACKED_COLUMN_COUNT][PACKED_BLOCK_RECORDS];
+	size_t offset = sizeof(chunk);
+	uint32_t decoded = 0;
+	while (decoded < chunk.recordCount)
+	{
+		uint32_t count = 0;
+		const uint32_t blockSize = UnpackSensorBlock(_chunk + offset, _chunkSize - offset, columns, count);
+		if (blockSize == 0 || count > chunk.recordCount - decoded)
+		{
+			return false;
+		}
+		offset += blockSize;
+
+		StoreRecords(columns, count, _records + decoded);
+		decoded += count;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+//
+// SensorLogCodec.h - columnar packing of log records: delta, zigzag, frame of reference, bit packing
+//
+// Neighbouring samples of one sensor differ by a few LSB of noise, so the
+// 20-byte records of a raw chunk are mostly redundant. A packed chunk stores
+// blocks of up to 128 records column by column (time offset, device, the seven
+// frame words). Each column is delta coded, zigzag mapped so small negative
+// steps stay small, reduced by the smallest value of the block (frame of
+// reference, which removes the constant step of the timestamps) and bit packed
+// at the width of the largest remainder. Sensor noise is close to white, where
+// deltas are wider than the values, so a column of a block is stored without
+// deltas when that packs narrower. Constant columns take no bits at all.
+//
+// The bits of a column are interleaved over 4 lanes of 32-bit words, value i in
+// lane i % 4, so a 128-bit register unpacks four consecutive values with the
+// same shifts. Decoding uses SSE2 or NEON when available; the format is the
+// same for all paths.
+//
+// The acquisition writes each sensor's FIFO burst as a run, so several sensors
+// in one log only cost bits where the runs change.
+//
+
+#pragma once
+
+#include "SensorLog.h"
+
+
+const uint32_t PACKED_BLOCK_RECORDS = 128;
+const int PACKED_COLUMN_COUNT = 2 + MPU6050_FRAME_SIZE / 2;	// time offset, device, frame words
+
+// followed by the references of each column in column order: the frame of
+// reference, then for delta coded columns the value before the first delta;
+// then the packed words of each column
+struct PackedBlockHeader
+{
+	uint8_t widths[PACKED_COLUMN_COUNT];	// bits per value, 0..32
+	uint8_t recordCount;					// 1..PACKED_BLOCK_RECORDS
+	uint16_t deltaColumns;					// bit per column, others are stored as value minus reference
+};
+
+const uint32_t PACKED_BLOCK_MAX_SIZE = sizeof(PackedBlockHeader) + PACKED_COLUMN_COUNT * (2 + PACKED_BLOCK_RECORDS) * 4;
+const uint32_t PACKED_BLOCK_MIN_SIZE = sizeof(PackedBlockHeader) + PACKED_COLUMN_COUNT * 4;
+
+// upper bound of the records in a packed chunk, for validation
+inline uint32_t GetPackedChunkCapacity(uint32_t _chunkSize)
+{
+	return uint32_t((_chunkSize - sizeof(SensorChunkHeader)) / PACKED_BLOCK_MIN_SIZE) * PACKED_BLOCK_RECORDS;
+}
+
+// packs _count (1..PACKED_BLOCK_RECORDS) records, time offsets relative to the
+// chunk; _output needs PACKED_BLOCK_MAX_SIZE bytes, returns the bytes used
+uint32_t PackSensorBlock(const SensorLogRecord* _records, uint32_t _count, uint8_t* _output);
+
+// one block into columns of PACKED_BLOCK_RECORDS values, frame words sign-extended;
+// returns the bytes read, 0 when the block does not fit in _size
+uint32_t UnpackSensorBlock(const uint8_t* _block, size_t _size, int32_t _columns[PACKED_COLUMN_COUNT][PACKED_BLOCK_RECORDS], uint32_t& _count);
+
+// all records of a packed chunk; _records has room for its recordCount.
+// false when the blocks do not add up to the header (unverified damage)
+bool UnpackSensorChunk(const uint8_t* _chunk, uint32_t _chunkSize, SensorLogRecord* _records);
@@ -0,0 +1,240 @@
+//
+// SensorPipeline.cpp
+//
+
+#include "pch.h"
+#include "SensorPipeline.h"
+#include "QuaternionMath.h"
+
+using namespace DirectX::SimpleMath;
+
+
+namespace
+{
+	const float DEFAULT_SAMPLE_RATE = 1000.0f;
+	const int DEFAULT_CORRECTION_DECIMATION = 8;	// accel corrections at 125 Hz
+	const int CORRECTION_FIR_TAPS_PER_PHASE = 4;
+
+	FusedOrientation MakeLevelOrientation()
+	{
+		FusedOrientation level;
+		level.timestamp = 0;
+		level.orientation = Quaternion::Identity;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			level.attitudeVariance[axis] = 0.0f;
+		}
+		return level;
+	}
+}
+
+
+PipelineSettings::PipelineSettings() :
+	sampleRate(DEFAULT_SAMPLE_RATE),
+	oversamplingShift(0),
+	oversamplingOrder(3),
+	filtersEnabled(false),
+#if defined(_M_ARM)
+	fusionEngine(FUSION_FIXED_POINT),	// Raspberry Pi FPU is slow, use integer fusion by default
+#else
+	fusionEngine(FUSION_KALMAN),
+#endif
+	correctionDecimation(DEFAULT_CORRECTION_DECIMATION),
+	fixedPoint(MakeFixedPointSettings(DEFAULT_SAMPLE_RATE)),
+	fixedPointRate(DEFAULT_SAMPLE_RATE)
+{
+}
+
+
+SensorPipeline::SensorPipeline() :
+	m_FusedCount(0)
+{
+	Reset();
+}
+
+SensorPipeline::SensorPipeline(const PipelineSettings& _settings) :
+	m_Settings(_settings),
+	m_FusedCount(0)
+{
+	Reset();
+}
+
+void SensorPipeline::ConfigureOversampling()
+{
+	m_Oversampler.Configure(m_Settings.oversamplingOrder, m_Settings.oversamplingShift);
+	m_DecimatedNoise.Reset(m_Oversampler.GetOrder());
+	m_Settings.fixedPoint = RescaleFixedPointSettings(m_Settings.fixedPoint, m_Settings.fixedPointRate, GetFusionRate());
+	m_Settings.fixedPointRate = GetFusionRate();
+	m_FixedPoint = FixedPointComplementary(m_Settings.fixedPoint);
+	m_Interpolator.Reset();
+	m_SampleBlock.count = 0;
+	ConfigureFilters();
+}
+
+void SensorPipeline::ConfigureFilters()
+{
+	const float fusionRate = GetFusionRate();
+	const ChannelFilterConfig accel = MakeChannelFilterConfig(m_Settings.accelFilter, fusionRate);
+	const ChannelFilterConfig gyro = MakeChannelFilterConfig(m_Settings.gyroFilter, fusionRate);
+	const ChannelFilterConfig channels[IMU_CHANNEL_COUNT] = { accel, accel, accel, gyro, gyro, gyro };
+	m_FilterBank.Configure(channels);
+
+	// FIR cutoff below the Nyquist frequency of the correction rate
+	const int decimation = m_Settings.correctionDecimation;
+	const float correctionRate = fusionRate / decimation;
+	m_CorrectionDecimator.Configure(decimation, CORRECTION_FIR_TAPS_PER_PHASE * decimation, 0.4f * correctionRate, fusionRate);
+}
+
+void SensorPipeline::ResetFusion()
+{
+	m_Kalman.Reset();
+	m_FixedPoint.Reset();
+	m_Heading.Reset();
+	m_Interpolator.Reset();
+}
+
+void SensorPipeline::SetFusionSettings(const ErrorStateKalmanSettings& _kalman, const FixedPointSettings& _fixedPoint, float _fixedPointRate)
+{
+	m_Settings.kalman = _kalman;
+	m_Settings.fixedPoint = RescaleFixedPointSettings(_fixedPoint, _fixedPointRate, GetFusionRate());
+	m_Settings.fixedPointRate = GetFusionRate();
+	m_Kalman = ErrorStateKalman(_kalman);
+	m_FixedPoint = FixedPointComplementary(m_Settings.fixedPoint);
+	m_Interpolator.Reset();
+}
+
+void SensorPipeline::Reset()
+{
+	// configured from the settings as they are, the fixed-point ones are not remade
+	m_Oversampler.Configure(m_Settings.oversamplingOrder, m_Settings.oversamplingShift);
+	m_RawNoise.Reset();
+	m_DecimatedNoise.Reset(m_Oversampler.GetOrder());
+	ConfigureFilters();
+	m_SampleBlock.count = 0;
+
+	m_Kalman = ErrorStateKalman(m_Settings.kalman);
+	m_FixedPoint = FixedPointComplementary(m_Settings.fixedPoint);
+	m_Orientation = MakeLevelOrientation();
+	m_Heading.Reset();
+
+	m_Interpolator.Reset();
+	m_DisplaySmoothing.Reset();
+	m_DisplayOrientation = Quaternion::Identity;
+	m_FusedCount = 0;
+}
+
+void SensorPipeline::Push(const SensorSample& _raw)
+{
+	m_RawNoise.Push(_raw);
+	SensorSample& sample = m_BlockSamples[m_SampleBlock.count];
+	if (!m_Oversampler.Push(_raw, sample))
+	{
+		return;
+	}
+	m_DecimatedNoise.Push(sample);
+	AppendToBlock(m_SampleBlock, sample.timestamp, ConvertToPhysical(sample));
+
+	if (m_SampleBlock.count == SampleBlock::CAPACITY)
+	{
+		FuseBlock();
+	}
+}
+
+void SensorPipeline::Flush()
+{
+	if (m_SampleBlock.count > 0)
+	{
+		FuseBlock();
+	}
+
+	m_Orientation = (m_Settings.fusionEngine == FUSION_FIXED_POINT) ? m_FixedPoint.GetOrientation() : m_Kalman.GetOrientation();
+	m_Orientation.orientation = m_Heading.Apply(m_Orientation.orientation, m_Settings.heading);
+}
+
+const Quaternion& SensorPipeline::UpdateDisplay(uint64_t _now, float _elapsedSeconds)
+{
+	// sample fused orientation at the time this frame reaches the display
+	const InterpolatorSettings& interpolator = m_Settings.interpolator;
+	const uint64_t renderTime = OrientationInterpolator::GetRenderTime(_now, interpolator);
+	const uint64_t maxExtrapolation = DX::StepTimer::SecondsToTicks(interpolator.maxExtrapolationMs / 1000.0);
+	if (!m_Interpolator.Sample(renderTime, maxExtrapolation, m_DisplayOrientation))
+	{
+		m_DisplayOrientation = m_Orientation.orientation;
+	}
+
+	// speed adaptive smoothing hides sensor noise while still, adds little lag in motion
+	if (m_Settings.displaySmoothing.enabled)
+	{
+		m_DisplayOrientation = m_DisplaySmoothing.Filter(m_DisplayOrientation, _elapsedSeconds, m_Settings.displaySmoothing);
+	}
+	else
+	{
+		m_DisplaySmoothing.Reset();
+	}
+
+	if (!m_Settings.heading.enabled)
+	{
+		m_DisplayOrientation = QuaternionRemoveHeading(m_DisplayOrientation);
+	}
+	return m_DisplayOrientation;
+}
+
+// filter and fuse the samples collected in m_SampleBlock
+void SensorPipeline::FuseBlock()
+{
+	if (m_Settings.filtersEnabled)
+	{
+		m_FilterBank.Process(m_SampleBlock);
+	}
+
+	for (size_t i = 0; i < m_SampleBlock.count; ++i)
+	{
+		const SensorSample& sample = m_BlockSamples[i];
+		const ImuReading reading = GetBlockReading(m_SampleBlock, i);
+		float angularRate[3] = { reading.gyro[0], reading.gyro[1], reading.gyro[2] };
+		FusedOrientation fused;
+
+		if (m_Settings.fusionEngine == FUSION_FIXED_POINT)
+		{
+			// integer path works on raw sensor units and bypasses the float filters
+			m_FixedPoint.ProcessSample(sample);
+			fused = m_FixedPoint.GetOrientation();
+		}
+		else
+		{
+			if (m_CorrectionDecimator.GetDecimation() > 1)
+			{
+				// gyro at the full rate, accel through the anti-alias filter at the reduced rate
+				float accel[3];
+				if (m_Kalman.PredictReading(reading, sample.timestamp) && m_CorrectionDecimator.Push(reading.accel, accel))
+				{
+					m_Kalman.Correct(accel);
+				}
+			}
+			else
+			{
+				m_Kalman.ProcessReading(reading, sample.timestamp);
+			}
+			fused = m_Kalman.GetOrientation();
+
+			const float* bias = m_Kalman.GetGyroBias();
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				angularRate[axis] -= bias[axis];
+			}
+		}
+
+		// heading is integrated at sensor rate, the tilt still comes from fusion
+		m_Heading.ProcessReading(reading, sample.timestamp, fused.orientation, m_Settings.heading);
+		fused.orientation = m_Heading.Apply(fused.orientation, m_Settings.heading);
+		m_Interpolator.Push(fused, angularRate);
+
+		if (m_Callback)
+		{
+			m_Callback(sample, fused);
+		}
+	}
+
+	m_FusedCount += m_SampleBlock.count;
+	m_SampleBlock.count = 0;
+}
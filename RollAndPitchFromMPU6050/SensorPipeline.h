@@ -0,0 +1,134 @@
+//
+// SensorPipeline.h - everything between a decoded sample and the displayed orientation
+//
+// Oversampling, noise floor meters, vibration filters, fusion, heading, display
+// interpolation and smoothing in the order Game::Update runs them. Keeping the
+// chain in one object lets live data and recorded logs go through the very
+// same code: the pipeline never reads a clock, time only comes in through the
+// sample timestamps and the frame time passed to UpdateDisplay. Given the same
+// samples, block boundaries and frame times it produces the same bits.
+//
+
+#pragma once
+
+#include "CicDecimator.h"
+#include "FilterBank.h"
+#include "ErrorStateKalman.h"
+#include "FixedPointFusion.h"
+#include "HeadingTracker.h"
+#include "OrientationInterpolator.h"
+#include "OneEuroFilter.h"
+
+#include <functional>
+
+
+struct PipelineSettings
+{
+	float sampleRate;				// Hz of the samples pushed in, ahead of the CIC
+	int oversamplingShift;			// CIC decimation 2^shift
+	int oversamplingOrder;
+	bool filtersEnabled;
+	VibrationFilterSettings accelFilter;
+	VibrationFilterSettings gyroFilter;
+	int fusionEngine;				// FusionEngine
+	int correctionDecimation;		// Kalman accel correction on 1 in N samples
+	ErrorStateKalmanSettings kalman;
+	FixedPointSettings fixedPoint;
+	float fixedPointRate;			// Hz the fixed-point settings were made or tuned for
+	HeadingSettings heading;
+	InterpolatorSettings interpolator;
+	OneEuroSettings displaySmoothing;
+
+	PipelineSettings();
+};
+
+// sample as it reached fusion (after the CIC) and its fused orientation with heading
+typedef std::function<void(const SensorSample& _sample, const FusedOrientation& _fused)> FusedSampleCallback;
+
+
+class SensorPipeline
+{
+public:
+
+	SensorPipeline();
+	explicit SensorPipeline(const PipelineSettings& _settings);
+
+	// heading, interpolator and smoothing settings apply on the next sample or
+	// frame; the others need the Configure call named next to them
+	PipelineSettings& GetSettings()						{ return m_Settings; }
+	const PipelineSettings& GetSettings() const			{ return m_Settings; }
+
+	// oversampling: everything downstream of the CIC depends on its output rate,
+	// the fixed-point settings are rescaled to it and keep their tuned gain
+	void ConfigureOversampling();
+	// vibration filters and the correction decimation
+	void ConfigureFilters();
+	// fusion engine switch
+	void ResetFusion();
+	// tuned parameters, fusion restarts with them; _fixedPoint was tuned at _fixedPointRate
+	// and is rescaled to the fusion rate
+	void SetFusionSettings(const ErrorStateKalmanSettings& _kalman, const FixedPointSettings& _fixedPoint, float _fixedPointRate);
+
+	// back to the state right after construction with the current settings
+	void Reset();
+
+	// decoded raw sample; fuses a block whenever one is full
+	void Push(const SensorSample& _raw);
+	// fuses the partial block and updates the orientation, once per frame
+	void Flush();
+
+	// display orientation for a frame presented at _now (StepTimer ticks),
+	// _elapsedSeconds since the previous frame; heading removed when not tracked
+	const DirectX::SimpleMath::Quaternion& UpdateDisplay(uint64_t _now, float _elapsedSeconds);
+
+	const FusedOrientation& GetOrientation() const				{ return m_Orientation; }
+	const DirectX::SimpleMath::Quaternion& GetDisplayOrientation() const	{ return m_DisplayOrientation; }
+	uint64_t GetFusedCount() const								{ return m_FusedCount; }
+
+	// rate of the samples reaching the filters and fusion
+	float GetFusionRate() const				{ return m_Settings.sampleRate / m_Oversampler.GetDecimation(); }
+
+	// called on every fused sample, on the thread calling Push or Flush
+	void SetCallback(const FusedSampleCallback& _callback)		{ m_Callback = _callback; }
+
+	// stages, for status display
+	const CicDecimator& GetOversampler() const					{ return m_Oversampler; }
+	const NoiseFloorMeter& GetRawNoise() const					{ return m_RawNoise; }
+	const NoiseFloorMeter& GetDecimatedNoise() const			{ return m_DecimatedNoise; }
+	const FilterBank& GetFilterBank() const						{ return m_FilterBank; }
+	const DecimatingFir& GetCorrectionDecimator() const			{ return m_CorrectionDecimator; }
+	const FixedPointComplementary& GetFixedPoint() const		{ return m_FixedPoint; }
+	const OrientationOneEuro& GetDisplaySmoothing() const		{ return m_DisplaySmoothing; }
+	HeadingTracker& GetHeading()								{ return m_Heading; }
+
+private:
+
+	SensorPipeline(const SensorPipeline&);
+	SensorPipeline& operator=(const SensorPipeline&);
+
+	void FuseBlock();
+
+	PipelineSettings m_Settings;
+
+	CicDecimator m_Oversampler;
+	NoiseFloorMeter m_RawNoise;
+	NoiseFloorMeter m_DecimatedNoise;
+
+	// samples are fused in blocks so the filters run over whole channels
+	FilterBank m_FilterBank;
+	SampleBlock m_SampleBlock;
+	SensorSample m_BlockSamples[SampleBlock::CAPACITY];	// raw samples of m_SampleBlock
+
+	DecimatingFir m_CorrectionDecimator;
+	ErrorStateKalman m_Kalman;
+	FixedPointComplementary m_FixedPoint;
+	FusedOrientation m_Orientation;
+	HeadingTracker m_Heading;
+
+	OrientationInterpolator m_Interpolator;
+	OrientationOneEuro m_DisplaySmoothing;
+	DirectX::SimpleMath::Quaternion m_DisplayOrientation;
+
+	uint64_t m_FusedCount;
+	FusedSampleCallback m_Callback;
+};
@@ -0,0 +1,485 @@
+//
+// SensorShm.c
+//
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "SensorShm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Aligned 32-bit loads and stores are atomic on every target; the fences order
+// them against the slot contents. MemoryBarrier is a full fence, x86 and x64
+// need less but ARM does not.
+#if defined(_MSC_VER)
+#define LOAD_ACQUIRE(_p)		LoadAcquire(_p)
+#define STORE_RELEASE(_p, _v)	StoreRelease(_p, _v)
+#define STORE_RELAXED(_p, _v)	(*(_p) = (_v))
+#define FENCE_ACQUIRE()			MemoryBarrier()
+#define FENCE_RELEASE()			MemoryBarrier()
+
+static uint32_t LoadAcquire(const volatile uint32_t* _p)
+{
+	const uint32_t value = *_p;
+	MemoryBarrier();
+	return value;
+}
+
+static void StoreRelease(volatile uint32_t* _p, uint32_t _value)
+{
+	MemoryBarrier();
+	*_p = _value;
+}
+#else
+#define LOAD_ACQUIRE(_p)		__atomic_load_n(_p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(_p, _v)	__atomic_store_n(_p, _v, __ATOMIC_RELEASE)
+#define STORE_RELAXED(_p, _v)	__atomic_store_n(_p, _v, __ATOMIC_RELAXED)
+#define FENCE_ACQUIRE()			__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define FENCE_RELEASE()			__atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+#define MAX_NAME_LENGTH			64
+#define MAX_OBJECT_NAME_LENGTH	256		// Windows, room for an AppContainerNamedObjects path
+#define SLOT_HEADER_SIZE		8		// sequence and reserved, before the payload
+#define MAX_CAPACITY			(1u << 24)
+
+
+struct SensorShm
+{
+	uint8_t* base;
+	size_t size;
+	int publisher;
+	SensorShmHeader* header;
+	uint8_t* samples;
+	uint8_t* orientations;
+
+	// publisher side, the next index of each ring
+	uint32_t sampleNext;
+	uint32_t orientationNext;
+
+	// reader side, of the region when it was opened
+	uint32_t generation;
+
+#if defined(_WIN32)
+	HANDLE mapping;
+#else
+	char name[MAX_NAME_LENGTH + 2];
+#endif
+};
+
+
+static uint32_t RoundUpToPowerOfTwo(uint32_t _value)
+{
+	uint32_t result = 1;
+	while (result < _value && result < MAX_CAPACITY)
+	{
+		result *= 2;
+	}
+	return result;
+}
+
+static int IsPowerOfTwo(uint32_t _value)
+{
+	return _value != 0 && (_value & (_value - 1)) == 0;
+}
+
+// header, then the sample slots, then the orientation slots, each on a cache line
+static size_t RegionSize(uint32_t _sampleCapacity, uint32_t _orientationCapacity, uint32_t* _sampleOffset, uint32_t* _orientationOffset)
+{
+	const size_t sampleBytes = (size_t)_sampleCapacity * sizeof(SensorShmSampleSlot);
+	const size_t orientationBytes = (size_t)_orientationCapacity * sizeof(SensorShmOrientationSlot);
+	*_sampleOffset = (uint32_t)sizeof(SensorShmHeader);
+	*_orientationOffset = (uint32_t)((*_sampleOffset + sampleBytes + 63) & ~(size_t)63);
+	return *_orientationOffset + orientationBytes;
+}
+
+static void Publish(uint8_t* _slots, uint32_t _slotSize, uint32_t _mask, uint32_t _index, const void* _payload, size_t _size)
+{
+	uint8_t* slot = _slots + (size_t)(_index & _mask) * _slotSize;
+	volatile uint32_t* sequence = (volatile uint32_t*)slot;
+
+	// odd while the payload is inconsistent; the fence keeps the payload stores after it
+	STORE_RELAXED(sequence, 2 * _index + 1);
+	FENCE_RELEASE();
+	memcpy(slot + SLOT_HEADER_SIZE, _payload, _size);
+	STORE_RELEASE(sequence, 2 * _index + 2);
+}
+
+static int Read(const uint8_t* _slots, uint32_t _slotSize, uint32_t _mask, uint32_t _index, void* _payload, size_t _size)
+{
+	const uint8_t* slot = _slots + (size_t)(_index & _mask) * _slotSize;
+	const volatile uint32_t* sequence = (const volatile uint32_t*)slot;
+	const uint32_t expected = 2 * _index + 2;
+
+	const uint32_t before = LOAD_ACQUIRE(sequence);
+	if (before != expected)
+	{
+		// behind the index: not written yet or being written right now
+		return ((int32_t)(before - expected) < 0) ? SENSOR_SHM_NOT_YET : SENSOR_SHM_OVERWRITTEN;
+	}
+
+	memcpy(_payload, slot + SLOT_HEADER_SIZE, _size);
+
+	// the copy may have raced with the publisher wrapping around onto this slot
+	FENCE_ACQUIRE();
+	return (*sequence == expected) ? SENSOR_SHM_OK : SENSOR_SHM_OVERWRITTEN;
+}
+
+static uint32_t Oldest(uint32_t _head, uint32_t _capacity, const volatile uint32_t* _full)
+{
+	return LOAD_ACQUIRE(_full) ? _head - _capacity : 0;
+}
+
+
+#if defined(_WIN32)
+
+// a plain name goes into the session namespace, a path (AppContainerNamedObjects\\<SID>\\name) as it is
+static int MakeObjectName(const char* _name, wchar_t* _objectName, size_t _length)
+{
+	const wchar_t prefix[] = L"Local\\";
+	const size_t prefixLength = (strchr(_name, '\\') == NULL) ? (sizeof(prefix) / sizeof(prefix[0])) - 1 : 0;
+	const size_t nameLength = strlen(_name);
+	size_t i;
+	if (nameLength == 0 || prefixLength + nameLength >= _length)
+	{
+		return 0;
+	}
+	memcpy(_objectName, prefix, prefixLength * sizeof(wchar_t));
+	for (i = 0; i <= nameLength; ++i)
+	{
+		_objectName[prefixLength + i] = (wchar_t)(unsigned char)_name[i];
+	}
+	return 1;
+}
+
+static void UnmapRegion(SensorShm* _shm)
+{
+	UnmapViewOfFile(_shm->base);
+	CloseHandle(_shm->mapping);
+}
+
+static SensorShm* MapRegion(const char* _name, size_t _size, int _publisher)
+{
+	wchar_t objectName[MAX_OBJECT_NAME_LENGTH];
+	MEMORY_BASIC_INFORMATION info;
+	SensorShm* shm;
+	HANDLE mapping;
+	void* view;
+
+	if (!MakeObjectName(_name, objectName, sizeof(objectName) / sizeof(objectName[0])))
+	{
+		return NULL;
+	}
+
+	// the *FromApp variants are the ones available to UWP apps; a reader opens
+	// the existing section, its size is taken from the section itself
+	mapping = CreateFileMappingFromApp(INVALID_HANDLE_VALUE, NULL, _publisher ? PAGE_READWRITE : PAGE_READONLY, _size, objectName);
+	if (mapping == NULL)
+	{
+		return NULL;
+	}
+	if (!_publisher && GetLastError() != ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+
+	view = MapViewOfFileFromApp(mapping, _publisher ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0);
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+
+	shm = (SensorShm*)calloc(1, sizeof(SensorShm));
+	if (shm == NULL)
+	{
+		UnmapViewOfFile(view);
+		CloseHandle(mapping);
+		return NULL;
+	}
+	shm->base = (uint8_t*)view;
+	shm->mapping = mapping;
+
+	// the section outlives the publisher while readers hold it, and a new one then
+	// opens it again with its old size
+	shm->size = (VirtualQuery(view, &info, sizeof(info)) != 0) ? info.RegionSize : 0;
+	if (shm->size < _size)
+	{
+		UnmapRegion(shm);
+		free(shm);
+		return NULL;
+	}
+	return shm;
+}
+
+#else
+
+static SensorShm* MapRegion(const char* _name, size_t _size, int _publisher)
+{
+	char objectName[MAX_NAME_LENGTH + 2];
+	SensorShm* shm;
+	struct stat info;
+	void* view;
+	int file;
+
+	if (strlen(_name) == 0 || strlen(_name) > MAX_NAME_LENGTH)
+	{
+		return NULL;
+	}
+	objectName[0] = '/';
+	strcpy(objectName + 1, _name);
+
+	if (_publisher)
+	{
+		// a fresh object, readers of a previous publisher keep their old mapping
+		shm_unlink(objectName);
+		file = shm_open(objectName, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (file >= 0 && ftruncate(file, (off_t)_size) != 0)
+		{
+			close(file);
+			shm_unlink(objectName);
+			return NULL;
+		}
+	}
+	else
+	{
+		file = shm_open(objectName, O_RDONLY, 0);
+	}
+	if (file < 0)
+	{
+		return NULL;
+	}
+	if (!_publisher)
+	{
+		if (fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(SensorShmHeader))
+		{
+			close(file);
+			return NULL;
+		}
+		_size = (size_t)info.st_size;
+	}
+
+	view = mmap(NULL, _size, _publisher ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (view == MAP_FAILED)
+	{
+		if (_publisher)
+		{
+			shm_unlink(objectName);
+		}
+		return NULL;
+	}
+
+	shm = (SensorShm*)calloc(1, sizeof(SensorShm));
+	if (shm == NULL)
+	{
+		munmap(view, _size);
+		return NULL;
+	}
+	shm->base = (uint8_t*)view;
+	shm->size = _size;
+	strcpy(shm->name, objectName);
+	return shm;
+}
+
+static void UnmapRegion(SensorShm* _shm)
+{
+	if (_shm->publisher)
+	{
+		shm_unlink(_shm->name);
+	}
+	munmap(_shm->base, _shm->size);
+}
+
+#endif
+
+
+SensorShm* SensorShmCreate(const char* _name, uint32_t _sampleCapacity, uint32_t _orientationCapacity)
+{
+	const uint32_t sampleCapacity = RoundUpToPowerOfTwo(_sampleCapacity);
+	const uint32_t orientationCapacity = RoundUpToPowerOfTwo(_orientationCapacity);
+	uint32_t sampleOffset;
+	uint32_t orientationOffset;
+	const size_t size = RegionSize(sampleCapacity, orientationCapacity, &sampleOffset, &orientationOffset);
+	SensorShmHeader* header;
+	uint32_t generation = 1;
+
+	SensorShm* shm = MapRegion(_name, size, 1);
+	if (shm == NULL)
+	{
+		return NULL;
+	}
+	shm->publisher = 1;
+	shm->header = header = (SensorShmHeader*)shm->base;
+	shm->samples = shm->base + sampleOffset;
+	shm->orientations = shm->base + orientationOffset;
+
+	// a section still held by readers comes back with the previous publisher's
+	// contents, its readers must see a new generation
+	if (header->magic == SENSOR_SHM_MAGIC && header->headerSize == sizeof(SensorShmHeader))
+	{
+		generation = (header->generation + 1 != 0) ? header->generation + 1 : 1;
+	}
+
+	// a new mapping is zero filled: no slot is valid, sequence 0 is never expected;
+	// readers of the old generation see generation 0 from here on
+	memset(shm->base, 0, size);
+	header->version = SENSOR_SHM_VERSION;
+	header->headerSize = sizeof(SensorShmHeader);
+	header->sampleSlotSize = sizeof(SensorShmSampleSlot);
+	header->orientationSlotSize = sizeof(SensorShmOrientationSlot);
+	header->sampleCapacity = sampleCapacity;
+	header->orientationCapacity = orientationCapacity;
+	header->sampleOffset = sampleOffset;
+	header->orientationOffset = orientationOffset;
+	header->generation = generation;
+
+	// the magic last, a reader checks it first
+	STORE_RELEASE(&header->magic, SENSOR_SHM_MAGIC);
+	return shm;
+}
+
+SensorShm* SensorShmOpen(const char* _name)
+{
+	uint32_t sampleOffset;
+	uint32_t orientationOffset;
+	const SensorShmHeader* header;
+
+	SensorShm* shm = MapRegion(_name, sizeof(SensorShmHeader), 0);
+	if (shm == NULL)
+	{
+		return NULL;
+	}
+
+	header = (const SensorShmHeader*)shm->base;
+	if (shm->size < sizeof(SensorShmHeader)
+		|| LOAD_ACQUIRE(&header->magic) != SENSOR_SHM_MAGIC || header->version != SENSOR_SHM_VERSION
+		|| header->headerSize != sizeof(SensorShmHeader)
+		|| header->sampleSlotSize != sizeof(SensorShmSampleSlot) || header->orientationSlotSize != sizeof(SensorShmOrientationSlot)
+		|| !IsPowerOfTwo(header->sampleCapacity) || header->sampleCapacity > MAX_CAPACITY
+		|| !IsPowerOfTwo(header->orientationCapacity) || header->orientationCapacity > MAX_CAPACITY
+		|| RegionSize(header->sampleCapacity, header->orientationCapacity, &sampleOffset, &orientationOffset) > shm->size
+		|| header->sampleOffset != sampleOffset || header->orientationOffset != orientationOffset)
+	{
+		SensorShmClose(shm);
+		return NULL;
+	}
+
+	shm->header = (SensorShmHeader*)header;
+	shm->samples = shm->base + sampleOffset;
+	shm->orientations = shm->base + orientationOffset;
+	shm->generation = LOAD_ACQUIRE(&header->generation);
+	return shm;
+}
+
+void SensorShmClose(SensorShm* _shm)
+{
+	if (_shm == NULL)
+	{
+		return;
+	}
+	if (_shm->publisher)
+	{
+		STORE_RELEASE(&_shm->header->closed, 1);
+	}
+	UnmapRegion(_shm);
+	free(_shm);
+}
+
+void SensorShmPublishSample(SensorShm* _shm, const SensorShmSample* _sample)
+{
+	SensorShmHeader* header = _shm->header;
+	const uint32_t index = _shm->sampleNext++;
+
+	Publish(_shm->samples, sizeof(SensorShmSampleSlot), header->sampleCapacity - 1, index, _sample, sizeof(SensorShmSample));
+	if (index + 1 == header->sampleCapacity)
+	{
+		STORE_RELEASE(&header->sampleFull, 1);
+	}
+	STORE_RELEASE(&header->sampleHead, index + 1);
+}
+
+void SensorShmPublishOrientation(SensorShm* _shm, const SensorShmOrientation* _orientation)
+{
+	SensorShmHeader* header = _shm->header;
+	const uint32_t index = _shm->orientationNext++;
+
+	Publish(_shm->orientations, sizeof(SensorShmOrientationSlot), header->orientationCapacity - 1, index, _orientation, sizeof(SensorShmOrientation));
+	if (index + 1 == header->orientationCapacity)
+	{
+		STORE_RELEASE(&header->orientationFull, 1);
+	}
+	STORE_RELEASE(&header->orientationHead, index + 1);
+}
+
+const SensorShmHeader* SensorShmGetHeader(const SensorShm* _shm)
+{
+	return _shm->header;
+}
+
+int SensorShmIsClosed(const SensorShm* _shm)
+{
+	return LOAD_ACQUIRE(&_shm->header->closed) != 0
+		|| (!_shm->publisher && LOAD_ACQUIRE(&_shm->header->generation) != _shm->generation);
+}
+
+uint32_t SensorShmGetSampleHead(const SensorShm* _shm)
+{
+	return LOAD_ACQUIRE(&_shm->header->sampleHead);
+}
+
+uint32_t SensorShmGetOldestSample(const SensorShm* _shm)
+{
+	return Oldest(SensorShmGetSampleHead(_shm), _shm->header->sampleCapacity, &_shm->header->sampleFull);
+}
+
+uint32_t SensorShmGetOrientationHead(const SensorShm* _shm)
+{
+	return LOAD_ACQUIRE(&_shm->header->orientationHead);
+}
+
+uint32_t SensorShmGetOldestOrientation(const SensorShm* _shm)
+{
+	return Oldest(SensorShmGetOrientationHead(_shm), _shm->header->orientationCapacity, &_shm->header->orientationFull);
+}
+
+int SensorShmReadSample(const SensorShm* _shm, uint32_t _index, SensorShmSample* _sample)
+{
+	return Read(_shm->samples, sizeof(SensorShmSampleSlot), _shm->header->sampleCapacity - 1, _index, _sample, sizeof(SensorShmSample));
+}
+
+int SensorShmReadOrientation(const SensorShm* _shm, uint32_t _index, SensorShmOrientation* _orientation)
+{
+	return Read(_shm->orientations, sizeof(SensorShmOrientationSlot), _shm->header->orientationCapacity - 1, _index, _orientation, sizeof(SensorShmOrientation));
+}
+
+int SensorShmReadLatestOrientation(const SensorShm* _shm, SensorShmOrientation* _orientation)
+{
+	// the newest slot can only be overwritten by a later one, retry with that
+	for (;;)
+	{
+		const uint32_t head = SensorShmGetOrientationHead(_shm);
+		if (head == 0)
+		{
+			return SENSOR_SHM_NOT_YET;
+		}
+		if (SensorShmReadOrientation(_shm, head - 1, _orientation) == SENSOR_SHM_OK)
+		{
+			return SENSOR_SHM_OK;
+		}
+	}
+}
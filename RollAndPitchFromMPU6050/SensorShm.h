@@ -0,0 +1,154 @@
+//
+// SensorShm.h - raw samples and orientation published in shared memory for local readers
+//
+// Controllers and loggers running next to the application read the sensor
+// straight out of a named shared memory region: no socket, no syscall per
+// sample, and any number of readers without the publisher knowing about them.
+// The region holds one ring of raw samples and one of fused orientations. Every
+// slot has its own sequence number (a seqlock): the publisher makes it odd while
+// it writes the slot and sets it to 2 * index + 2 when done, a reader copies the
+// slot between two reads of the sequence and keeps the copy only when both read
+// the value it expected. Readers only ever read the region, so a slow or crashed
+// reader cannot disturb the publisher or the other readers; one that falls more
+// than a ring behind finds its slots overwritten and skips ahead.
+//
+// A publisher that re-creates the region while readers still hold it (Windows
+// keeps the section alive, a suspended and resumed app finds it again) bumps the
+// generation in the header, so a reader that missed the closed flag still sees
+// that the region was restarted and re-attaches.
+//
+// Plain C so that readers need nothing of the application: SensorShm.c builds
+// on Windows and POSIX (gcc -std=c99, link with -lrt on older glibc), see
+// tools/shm_reader.c for a reader on Linux.
+//
+// On Windows a name is created in the session namespace, Local\name. The
+// application runs in an AppContainer, whose Local\ is its own namespace,
+// AppContainerNamedObjects\<AppContainer SID>, so a reader outside the package
+// passes that path with the name, AppContainerNamedObjects\<SID>\name; any
+// name with a backslash is taken as such an object path. The SID follows from
+// the package family name, see tools/shm_reader_win.c.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define SENSOR_SHM_MAGIC		0x534D504Du		// "MPMS"
+#define SENSOR_SHM_VERSION		2u
+#define SENSOR_SHM_DEFAULT_NAME	"RollAndPitchMPU6050"
+
+
+// SensorSample of the application, the same fields and layout
+typedef struct SensorShmSample
+{
+	uint64_t timestamp;			// 100 ns ticks of the publisher's monotonic clock
+	uint32_t deviceId;			// I2C address of the sensor
+	int16_t accel[3];			// raw MPU6050 units
+	int16_t temperature;
+	int16_t gyro[3];
+	uint16_t reserved;
+} SensorShmSample;
+
+typedef struct SensorShmOrientation
+{
+	uint64_t timestamp;			// of the last fused sample
+	float orientation[4];		// sensor to world quaternion x, y, z, w
+	float attitudeVariance[3];	// rad^2 around sensor X, Y, Z
+	float reserved;
+} SensorShmOrientation;
+
+typedef struct SensorShmSampleSlot
+{
+	volatile uint32_t sequence;	// 2 * index + 1 while written, 2 * index + 2 once valid
+	uint32_t reserved;
+	SensorShmSample sample;
+} SensorShmSampleSlot;
+
+typedef struct SensorShmOrientationSlot
+{
+	volatile uint32_t sequence;
+	uint32_t reserved;
+	SensorShmOrientation orientation;
+} SensorShmOrientationSlot;
+
+// Start of the region. Each head has its own cache line, they are written by
+// different threads of the publisher. Indexes are uint32_t and wrap, compare
+// them by their difference.
+typedef struct SensorShmHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t sampleSlotSize;
+	uint32_t orientationSlotSize;
+	uint32_t sampleCapacity;		// slots, a power of two
+	uint32_t orientationCapacity;
+	uint32_t sampleOffset;			// bytes from the start of the region
+	uint32_t orientationOffset;
+	volatile uint32_t closed;		// set when the publisher is gone, reopen to follow a new one
+	volatile uint32_t sampleFull;	// set once every sample slot has been written
+	volatile uint32_t orientationFull;
+	volatile uint32_t generation;	// 1 for a new region, one more on every re-create of the same one, never 0
+	uint8_t reserved0[12];
+
+	volatile uint32_t sampleHead;	// samples published so far
+	uint8_t reserved1[60];
+
+	volatile uint32_t orientationHead;
+	uint8_t reserved2[60];
+} SensorShmHeader;
+
+
+// results of the read functions
+enum
+{
+	SENSOR_SHM_OK = 0,
+	SENSOR_SHM_NOT_YET = 1,			// the index has not been published yet
+	SENSOR_SHM_OVERWRITTEN = 2,		// the ring has moved past the index, skip to SensorShmGetOldest*
+};
+
+typedef struct SensorShm SensorShm;
+
+
+// publisher: creates (or replaces) the region, capacities are rounded up to a
+// power of two; NULL on failure. One thread per ring may publish.
+SensorShm* SensorShmCreate(const char* _name, uint32_t _sampleCapacity, uint32_t _orientationCapacity);
+void SensorShmPublishSample(SensorShm* _shm, const SensorShmSample* _sample);
+void SensorShmPublishOrientation(SensorShm* _shm, const SensorShmOrientation* _orientation);
+
+// reader: maps an existing region read-only; NULL when there is none or it is
+// of another version
+SensorShm* SensorShmOpen(const char* _name);
+
+// both; the publisher marks the region closed and removes its name
+void SensorShmClose(SensorShm* _shm);
+
+const SensorShmHeader* SensorShmGetHeader(const SensorShm* _shm);
+
+// reader: the publisher is gone or has re-created the region since it was
+// opened; close it and open it again to follow the new publisher
+int SensorShmIsClosed(const SensorShm* _shm);
+
+// index of the next entry to be published, and of the oldest one still in the ring
+uint32_t SensorShmGetSampleHead(const SensorShm* _shm);
+uint32_t SensorShmGetOldestSample(const SensorShm* _shm);
+uint32_t SensorShmGetOrientationHead(const SensorShm* _shm);
+uint32_t SensorShmGetOldestOrientation(const SensorShm* _shm);
+
+// copies one entry out of its slot; SENSOR_SHM_OK, _NOT_YET or _OVERWRITTEN
+int SensorShmReadSample(const SensorShm* _shm, uint32_t _index, SensorShmSample* _sample);
+int SensorShmReadOrientation(const SensorShm* _shm, uint32_t _index, SensorShmOrientation* _orientation);
+
+// the newest orientation; SENSOR_SHM_NOT_YET before the first one
+int SensorShmReadLatestOrientation(const SensorShm* _shm, SensorShmOrientation* _orientation);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+//
+// SimdLanes.h - native width float vectors for batch kernels
+//
+// FloatLanes holds SIMD_LANE_COUNT floats: 16 with AVX-512, 8 with AVX2,
+// 4 with SSE or NEON (DirectXMath intrinsics selection) and 4 plain floats
+// otherwise. LaneMask is the result of a comparison and drives Select, so
+// kernels can leave individual lanes untouched without branches.
+//
+// The project builds with SSE2 by default; the wider lanes are compiled in by
+// building x64 with /p:SimdLanes=AVX2 or /p:SimdLanes=AVX512, for machines
+// that have them.
+//
+
+#pragma once
+
+#include <math.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(_XM_SSE_INTRINSICS_)
+#include <xmmintrin.h>
+#elif defined(_XM_ARM_NEON_INTRINSICS_)
+#include <arm_neon.h>
+#endif
+
+
+#if defined(__AVX512F__)
+
+const int SIMD_LANE_COUNT = 16;
+#define SIMD_LANES_NAME "AVX-512"
+const int SIMD_RSQRT_STEPS = 1;		// Newton-Raphson steps after RsqrtEstimate
+
+struct FloatLanes { __m512 v; };
+struct LaneMask { __mmask16 m; };
+
+inline FloatLanes LoadLanes(const float* _p)									{ FloatLanes r; r.v = _mm512_loadu_ps(_p); return r; }
+inline void StoreLanes(float* _p, const FloatLanes& _a)							{ _mm512_storeu_ps(_p, _a.v); }
+inline FloatLanes SplatLanes(float _value)										{ FloatLanes r; r.v = _mm512_set1_ps(_value); return r; }
+inline FloatLanes operator+(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm512_add_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator-(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm512_sub_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator*(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm512_mul_ps(_a.v, _b.v); return r; }
+inline FloatLanes MulAdd(const FloatLanes& _a, const FloatLanes& _b, const FloatLanes& _c)	{ FloatLanes r; r.v = _mm512_fmadd_ps(_a.v, _b.v, _c.v); return r; }
+inline LaneMask operator>(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm512_cmp_ps_mask(_a.v, _b.v, _CMP_GT_OQ); return r; }
+inline LaneMask operator&(const LaneMask& _a, const LaneMask& _b)				{ LaneMask r; r.m = _a.m & _b.m; return r; }
+inline FloatLanes Select(const LaneMask& _mask, const FloatLanes& _a, const FloatLanes& _b)	{ FloatLanes r; r.v = _mm512_mask_blend_ps(_mask.m, _b.v, _a.v); return r; }
+inline bool AnyLane(const LaneMask& _mask)										{ return _mask.m != 0; }
+inline FloatLanes RsqrtEstimate(const FloatLanes& _a)							{ FloatLanes r; r.v = _mm512_rsqrt14_ps(_a.v); return r; }
+inline FloatLanes operator/(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm512_div_ps(_a.v, _b.v); return r; }
+inline LaneMask operator<(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm512_cmp_ps_mask(_a.v, _b.v, _CMP_LT_OQ); return r; }
+inline FloatLanes Abs(const FloatLanes& _a)										{ FloatLanes r; r.v = _mm512_abs_ps(_a.v); return r; }
+inline FloatLanes Min(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm512_min_ps(_a.v, _b.v); return r; }
+inline FloatLanes Max(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm512_max_ps(_a.v, _b.v); return r; }
+inline FloatLanes Sqrt(const FloatLanes& _a)									{ FloatLanes r; r.v = _mm512_sqrt_ps(_a.v); return r; }
+
+#elif defined(__AVX2__)
+
+const int SIMD_LANE_COUNT = 8;
+#define SIMD_LANES_NAME "AVX2"
+const int SIMD_RSQRT_STEPS = 1;		// Newton-Raphson steps after RsqrtEstimate
+
+struct FloatLanes { __m256 v; };
+struct LaneMask { __m256 m; };
+
+inline FloatLanes LoadLanes(const float* _p)									{ FloatLanes r; r.v = _mm256_loadu_ps(_p); return r; }
+inline void StoreLanes(float* _p, const FloatLanes& _a)							{ _mm256_storeu_ps(_p, _a.v); }
+inline FloatLanes SplatLanes(float _value)										{ FloatLanes r; r.v = _mm256_set1_ps(_value); return r; }
+inline FloatLanes operator+(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm256_add_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator-(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm256_sub_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator*(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm256_mul_ps(_a.v, _b.v); return r; }
+inline FloatLanes MulAdd(const FloatLanes& _a, const FloatLanes& _b, const FloatLanes& _c)	{ FloatLanes r; r.v = _mm256_fmadd_ps(_a.v, _b.v, _c.v); return r; }
+inline LaneMask operator>(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm256_cmp_ps(_a.v, _b.v, _CMP_GT_OQ); return r; }
+inline LaneMask operator&(const LaneMask& _a, const LaneMask& _b)				{ LaneMask r; r.m = _mm256_and_ps(_a.m, _b.m); return r; }
+inline FloatLanes Select(const LaneMask& _mask, const FloatLanes& _a, const FloatLanes& _b)	{ FloatLanes r; r.v = _mm256_blendv_ps(_b.v, _a.v, _mask.m); return r; }
+inline bool AnyLane(const LaneMask& _mask)										{ return _mm256_movemask_ps(_mask.m) != 0; }
+inline FloatLanes RsqrtEstimate(const FloatLanes& _a)							{ FloatLanes r; r.v = _mm256_rsqrt_ps(_a.v); return r; }
+inline FloatLanes operator/(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm256_div_ps(_a.v, _b.v); return r; }
+inline LaneMask operator<(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm256_cmp_ps(_a.v, _b.v, _CMP_LT_OQ); return r; }
+inline FloatLanes Abs(const FloatLanes& _a)										{ FloatLanes r; r.v = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _a.v); return r; }
+inline FloatLanes Min(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm256_min_ps(_a.v, _b.v); return r; }
+inline FloatLanes Max(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm256_max_ps(_a.v, _b.v); return r; }
+inline FloatLanes Sqrt(const FloatLanes& _a)									{ FloatLanes r; r.v = _mm256_sqrt_ps(_a.v); return r; }
+
+#elif defined(_XM_SSE_INTRINSICS_)
+
+const int SIMD_LANE_COUNT = 4;
+#define SIMD_LANES_NAME "SSE"
+const int SIMD_RSQRT_STEPS = 1;		// Newton-Raphson steps after RsqrtEstimate
+
+struct FloatLanes { __m128 v; };
+struct LaneMask { __m128 m; };
+
+inline FloatLanes LoadLanes(const float* _p)									{ FloatLanes r; r.v = _mm_loadu_ps(_p); return r; }
+inline void StoreLanes(float* _p, const FloatLanes& _a)							{ _mm_storeu_ps(_p, _a.v); }
+inline FloatLanes SplatLanes(float _value)										{ FloatLanes r; r.v = _mm_set1_ps(_value); return r; }
+inline FloatLanes operator+(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm_add_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator-(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm_sub_ps(_a.v, _b.v); return r; }
+inline FloatLanes operator*(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm_mul_ps(_a.v, _b.v); return r; }
+inline FloatLanes MulAdd(const FloatLanes& _a, const FloatLanes& _b, const FloatLanes& _c)	{ FloatLanes r; r.v = _mm_add_ps(_mm_mul_ps(_a.v, _b.v), _c.v); return r; }
+inline LaneMask operator>(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm_cmpgt_ps(_a.v, _b.v); return r; }
+inline LaneMask operator&(const LaneMask& _a, const LaneMask& _b)				{ LaneMask r; r.m = _mm_and_ps(_a.m, _b.m); return r; }
+inline FloatLanes Select(const LaneMask& _mask, const FloatLanes& _a, const FloatLanes& _b)	{ FloatLanes r; r.v = _mm_or_ps(_mm_and_ps(_mask.m, _a.v), _mm_andnot_ps(_mask.m, _b.v)); return r; }
+inline bool AnyLane(const LaneMask& _mask)										{ return _mm_movemask_ps(_mask.m) != 0; }
+inline FloatLanes RsqrtEstimate(const FloatLanes& _a)							{ FloatLanes r; r.v = _mm_rsqrt_ps(_a.v); return r; }
+inline FloatLanes operator/(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = _mm_div_ps(_a.v, _b.v); return r; }
+inline LaneMask operator<(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = _mm_cmplt_ps(_a.v, _b.v); return r; }
+inline FloatLanes Abs(const FloatLanes& _a)										{ FloatLanes r; r.v = _mm_andnot_ps(_mm_set1_ps(-0.0f), _a.v); return r; }
+inline FloatLanes Min(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm_min_ps(_a.v, _b.v); return r; }
+inline FloatLanes Max(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = _mm_max_ps(_a.v, _b.v); return r; }
+inline FloatLanes Sqrt(const FloatLanes& _a)									{ FloatLanes r; r.v = _mm_sqrt_ps(_a.v); return r; }
+
+#elif defined(_XM_ARM_NEON_INTRINSICS_)
+
+const int SIMD_LANE_COUNT = 4;
+#define SIMD_LANES_NAME "NEON"
+const int SIMD_RSQRT_STEPS = 2;		// Newton-Raphson steps after RsqrtEstimate
+
+struct FloatLanes { float32x4_t v; };
+struct LaneMask { uint32x4_t m; };
+
+inline FloatLanes LoadLanes(const float* _p)									{ FloatLanes r; r.v = vld1q_f32(_p); return r; }
+inline void StoreLanes(float* _p, const FloatLanes& _a)							{ vst1q_f32(_p, _a.v); }
+inline FloatLanes SplatLanes(float _value)										{ FloatLanes r; r.v = vdupq_n_f32(_value); return r; }
+inline FloatLanes operator+(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = vaddq_f32(_a.v, _b.v); return r; }
+inline FloatLanes operator-(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = vsubq_f32(_a.v, _b.v); return r; }
+inline FloatLanes operator*(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; r.v = vmulq_f32(_a.v, _b.v); return r; }
+inline FloatLanes MulAdd(const FloatLanes& _a, const FloatLanes& _b, const FloatLanes& _c)	{ FloatLanes r; r.v = vmlaq_f32(_c.v, _a.v, _b.v); return r; }
+inline LaneMask operator>(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = vcgtq_f32(_a.v, _b.v); return r; }
+inline LaneMask operator&(const LaneMask& _a, const LaneMask& _b)				{ LaneMask r; r.m = vandq_u32(_a.m, _b.m); return r; }
+inline FloatLanes Select(const LaneMask& _mask, const FloatLanes& _a, const FloatLanes& _b)	{ FloatLanes r; r.v = vbslq_f32(_mask.m, _a.v, _b.v); return r; }
+inline bool AnyLane(const LaneMask& _mask)
+{
+	const uint32x2_t folded = vorr_u32(vget_low_u32(_mask.m), vget_high_u32(_mask.m));
+	return (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0;
+}
+inline FloatLanes RsqrtEstimate(const FloatLanes& _a)							{ FloatLanes r; r.v = vrsqrteq_f32(_a.v); return r; }
+inline LaneMask operator<(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; r.m = vcltq_f32(_a.v, _b.v); return r; }
+inline FloatLanes Abs(const FloatLanes& _a)										{ FloatLanes r; r.v = vabsq_f32(_a.v); return r; }
+inline FloatLanes Min(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = vminq_f32(_a.v, _b.v); return r; }
+inline FloatLanes Max(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; r.v = vmaxq_f32(_a.v, _b.v); return r; }
+
+// ARMv7 NEON has no vector divide or square root: reciprocal estimates refined by Newton-Raphson
+inline FloatLanes operator/(const FloatLanes& _a, const FloatLanes& _b)
+{
+	float32x4_t inverse = vrecpeq_f32(_b.v);
+	inverse = vmulq_f32(inverse, vrecpsq_f32(_b.v, inverse));
+	inverse = vmulq_f32(inverse, vrecpsq_f32(_b.v, inverse));
+	FloatLanes r; r.v = vmulq_f32(_a.v, inverse); return r;
+}
+inline FloatLanes Sqrt(const FloatLanes& _a)
+{
+	float32x4_t y = vrsqrteq_f32(_a.v);
+	y = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(_a.v, y), y));
+	y = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(_a.v, y), y));
+	const uint32x4_t positive = vcgtq_f32(_a.v, vdupq_n_f32(0.0f));
+	FloatLanes r; r.v = vbslq_f32(positive, vmulq_f32(_a.v, y), vdupq_n_f32(0.0f)); return r;
+}
+
+#else
+
+const int SIMD_LANE_COUNT = 4;
+#define SIMD_LANES_NAME "scalar"
+const int SIMD_RSQRT_STEPS = 0;		// Newton-Raphson steps after RsqrtEstimate
+
+struct FloatLanes { float v[SIMD_LANE_COUNT]; };
+struct LaneMask { bool m[SIMD_LANE_COUNT]; };
+
+inline FloatLanes LoadLanes(const float* _p)									{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _p[i]; return r; }
+inline void StoreLanes(float* _p, const FloatLanes& _a)							{ for (int i = 0; i < SIMD_LANE_COUNT; ++i) _p[i] = _a.v[i]; }
+inline FloatLanes SplatLanes(float _value)										{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _value; return r; }
+inline FloatLanes operator+(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] + _b.v[i]; return r; }
+inline FloatLanes operator-(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] - _b.v[i]; return r; }
+inline FloatLanes operator*(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] * _b.v[i]; return r; }
+inline FloatLanes MulAdd(const FloatLanes& _a, const FloatLanes& _b, const FloatLanes& _c)	{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] * _b.v[i] + _c.v[i]; return r; }
+inline LaneMask operator>(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.m[i] = _a.v[i] > _b.v[i]; return r; }
+inline LaneMask operator&(const LaneMask& _a, const LaneMask& _b)				{ LaneMask r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.m[i] = _a.m[i] && _b.m[i]; return r; }
+inline FloatLanes Select(const LaneMask& _mask, const FloatLanes& _a, const FloatLanes& _b)	{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _mask.m[i] ? _a.v[i] : _b.v[i]; return r; }
+inline bool AnyLane(const LaneMask& _mask)										{ for (int i = 0; i < SIMD_LANE_COUNT; ++i) if (_mask.m[i]) return true; return false; }
+inline FloatLanes RsqrtEstimate(const FloatLanes& _a)							{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = 1.0f / sqrtf(_a.v[i]); return r; }
+inline FloatLanes operator/(const FloatLanes& _a, const FloatLanes& _b)			{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] / _b.v[i]; return r; }
+inline LaneMask operator<(const FloatLanes& _a, const FloatLanes& _b)			{ LaneMask r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.m[i] = _a.v[i] < _b.v[i]; return r; }
+inline FloatLanes Abs(const FloatLanes& _a)										{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = fabsf(_a.v[i]); return r; }
+inline FloatLanes Min(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] < _b.v[i] ? _a.v[i] : _b.v[i]; return r; }
+inline FloatLanes Max(const FloatLanes& _a, const FloatLanes& _b)				{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = _a.v[i] > _b.v[i] ? _a.v[i] : _b.v[i]; return r; }
+inline FloatLanes Sqrt(const FloatLanes& _a)									{ FloatLanes r; for (int i = 0; i < SIMD_LANE_COUNT; ++i) r.v[i] = sqrtf(_a.v[i]); return r; }
+
+#endif
+
+
+// 1 / sqrt(_a) to about full float precision: hardware estimate plus Newton-Raphson steps
+inline FloatLanes Rsqrt(const FloatLanes& _a)
+{
+	const FloatLanes half = SplatLanes(0.5f);
+	const FloatLanes threeHalves = SplatLanes(1.5f);
+
+	FloatLanes y = RsqrtEstimate(_a);
+	for (int i = 0; i < SIMD_RSQRT_STEPS; ++i)
+	{
+		y = y * (threeHalves - half * _a * y * y);
+	}
+	return y;
+}
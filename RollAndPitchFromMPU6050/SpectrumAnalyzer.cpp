@@ -0,0 +1,255 @@
+//
+// SpectrumAnalyzer.cpp
+//
+
+#include "pch.h"
+#include "SpectrumAnalyzer.h"
+
+#include <math.h>
+#include <string.h>
+
+
+namespace
+{
+	const double TWO_PI = 6.283185307179586;
+}
+
+
+RealFft::RealFft(int _size) :
+	m_Size(_size)
+{
+	const int half = _size / 2;
+
+	int bits = 0;
+	while ((1 << bits) < half)
+	{
+		++bits;
+	}
+
+	m_BitReverse.resize(half);
+	for (int i = 0; i < half; ++i)
+	{
+		int reversed = 0;
+		for (int b = 0; b < bits; ++b)
+		{
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		m_BitReverse[i] = reversed;
+	}
+
+	m_TwiddleRe.resize(half / 2 + 1);
+	m_TwiddleIm.resize(half / 2 + 1);
+	for (int k = 0; k <= half / 2; ++k)
+	{
+		m_TwiddleRe[k] = float(cos(TWO_PI * k / half));
+		m_TwiddleIm[k] = float(-sin(TWO_PI * k / half));
+	}
+
+	m_SplitRe.resize(half + 1);
+	m_SplitIm.resize(half + 1);
+	for (int k = 0; k <= half; ++k)
+	{
+		m_SplitRe[k] = float(cos(TWO_PI * k / _size));
+		m_SplitIm[k] = float(-sin(TWO_PI * k / _size));
+	}
+
+	m_WorkRe.resize(half);
+	m_WorkIm.resize(half);
+}
+
+void RealFft::Forward(const float* _input, float* _re, float* _im)
+{
+	const int half = m_Size / 2;
+	float* re = m_WorkRe.data();
+	float* im = m_WorkIm.data();
+
+	// even samples as real part, odd samples as imaginary part, in bit reversed order
+	for (int i = 0; i < half; ++i)
+	{
+		const int j = m_BitReverse[i];
+		re[j] = _input[2 * i];
+		im[j] = _input[2 * i + 1];
+	}
+
+	// iterative radix-2 decimation in time
+	for (int span = 1; span < half; span *= 2)
+	{
+		const int step = half / (2 * span);
+		for (int start = 0; start < half; start += 2 * span)
+		{
+			for (int k = 0; k < span; ++k)
+			{
+				const float wr = m_TwiddleRe[k * step];
+				const float wi = m_TwiddleIm[k * step];
+				const int a = start + k;
+				const int b = a + span;
+
+				const float tr = wr * re[b] - wi * im[b];
+				const float ti = wr * im[b] + wi * re[b];
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+
+	// split the packed transform into the spectra of the even and odd samples:
+	// X[k] = E[k] + exp(-2 pi i k / N) O[k]
+	for (int k = 0; k <= half; ++k)
+	{
+		const int i = (k == half) ? 0 : k;
+		const int j = (k == 0) ? 0 : half - k;
+
+		const float evenRe = 0.5f * (re[i] + re[j]);
+		const float evenIm = 0.5f * (im[i] - im[j]);
+		const float oddRe = 0.5f * (im[i] + im[j]);
+		const float oddIm = -0.5f * (re[i] - re[j]);
+
+		_re[k] = evenRe + m_SplitRe[k] * oddRe - m_SplitIm[k] * oddIm;
+		_im[k] = evenIm + m_SplitRe[k] * oddIm + m_SplitIm[k] * oddRe;
+	}
+}
+
+
+SpectrumAnalyzer::SpectrumAnalyzer() :
+	m_Processing(false),
+	m_Fft(SPECTRUM_FFT_SIZE),
+	m_RingPosition(0),
+	m_Buffered(0),
+	m_SinceFrame(0)
+{
+	float windowSum = 0.0f;
+	for (int n = 0; n < SPECTRUM_FFT_SIZE; ++n)
+	{
+		m_Window[n] = float(0.5 - 0.5 * cos(TWO_PI * n / SPECTRUM_FFT_SIZE));
+		windowSum += m_Window[n];
+	}
+
+	// one-sided spectrum: every bin except DC and Nyquist carries half of the amplitude
+	for (int k = 0; k < SPECTRUM_BIN_COUNT; ++k)
+	{
+		m_BinScale[k] = ((k == 0 || k == SPECTRUM_BIN_COUNT - 1) ? 1.0f : 2.0f) / windowSum;
+	}
+
+	memset(&m_Working, 0, sizeof(m_Working));
+}
+
+int SpectrumAnalyzer::ProcessPending()
+{
+	if (m_Processing.exchange(true, std::memory_order_acquire))
+	{
+		return 0;	// previous call still running on another pool thread
+	}
+
+	int frames = 0;
+	SensorSample sample;
+	while (m_Input.Pop(sample))
+	{
+		const ImuReading reading = ConvertToPhysical(sample);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			m_Ring[axis][m_RingPosition] = reading.accel[axis];
+		}
+		m_Timestamps[m_RingPosition] = sample.timestamp;
+		m_RingPosition = (m_RingPosition + 1) & (SPECTRUM_FFT_SIZE - 1);
+
+		m_Buffered = std::min(m_Buffered + 1, SPECTRUM_FFT_SIZE);
+		if (++m_SinceFrame >= HOP_SIZE && m_Buffered == SPECTRUM_FFT_SIZE)
+		{
+			ComputeFrame();
+			m_SinceFrame = 0;
+			++frames;
+		}
+	}
+
+	if (frames > 0)
+	{
+		m_Published.GetBackBuffer() = m_Working;
+		m_Published.Publish();
+	}
+
+	m_Processing.store(false, std::memory_order_release);
+	return frames;
+}
+
+const SpectrumSnapshot& SpectrumAnalyzer::GetSnapshot()
+{
+	m_Published.Update();
+	return m_Published.GetFrontBuffer();
+}
+
+void SpectrumAnalyzer::ComputeFrame()
+{
+	// ring position is the oldest sample now
+	const int oldest = m_RingPosition;
+	const int newest = (m_RingPosition + SPECTRUM_FFT_SIZE - 1) & (SPECTRUM_FFT_SIZE - 1);
+	const uint64_t duration = m_Timestamps[newest] - m_Timestamps[oldest];
+	if (duration > 0)
+	{
+		m_Working.sampleRate = float(double(SPECTRUM_FFT_SIZE - 1) * DX::StepTimer::TicksPerSecond / duration);
+	}
+
+	const int row = (m_Working.frameCount == 0) ? 0 : (m_Working.newestRow + 1) % SPECTRUM_HISTORY;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		// remove the mean first, gravity would otherwise leak from DC into the low bins
+		float mean = 0.0f;
+		for (int n = 0; n < SPECTRUM_FFT_SIZE; ++n)
+		{
+			mean += m_Ring[axis][n];
+		}
+		mean /= SPECTRUM_FFT_SIZE;
+
+		for (int n = 0; n < SPECTRUM_FFT_SIZE; ++n)
+		{
+			m_Frame[n] = (m_Ring[axis][(oldest + n) & (SPECTRUM_FFT_SIZE - 1)] - mean) * m_Window[n];
+		}
+		m_Fft.Forward(m_Frame, m_Re, m_Im);
+
+		float* amplitude = m_Working.amplitude[row][axis];
+		for (int k = 0; k < SPECTRUM_BIN_COUNT; ++k)
+		{
+			amplitude[k] = m_BinScale[k] * sqrtf(m_Re[k] * m_Re[k] + m_Im[k] * m_Im[k]);
+		}
+		FindPeaks(amplitude, m_Working.sampleRate, m_Working.peaks[axis]);
+	}
+
+	m_Working.newestRow = row;
+	++m_Working.frameCount;
+}
+
+void SpectrumAnalyzer::FindPeaks(const float* _amplitude, float _sampleRate, SpectrumPeak* _peaks) const
+{
+	for (int p = 0; p < SPECTRUM_PEAK_COUNT; ++p)
+	{
+		_peaks[p].frequency = 0.0f;
+		_peaks[p].amplitude = 0.0f;
+	}
+
+	const float binWidth = _sampleRate / SPECTRUM_FFT_SIZE;
+	for (int k = 1; k < SPECTRUM_BIN_COUNT - 1; ++k)
+	{
+		const float left = _amplitude[k - 1];
+		const float center = _amplitude[k];
+		const float right = _amplitude[k + 1];
+		if (center <= left || center < right || center <= _peaks[SPECTRUM_PEAK_COUNT - 1].amplitude)
+		{
+			continue;
+		}
+
+		// parabolic interpolation between bins
+		const float curvature = left - 2.0f * center + right;
+		const float offset = (curvature < 0.0f) ? 0.5f * (left - right) / curvature : 0.0f;
+
+		// insert keeping the list sorted by amplitude
+		int p = SPECTRUM_PEAK_COUNT - 1;
+		while (p > 0 && _peaks[p - 1].amplitude < center)
+		{
+			_peaks[p] = _peaks[p - 1];
+			--p;
+		}
+		_peaks[p].frequency = (k + offset) * binWidth;
+		_peaks[p].amplitude = center;
+	}
+}
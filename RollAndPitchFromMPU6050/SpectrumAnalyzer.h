@@ -0,0 +1,108 @@
+//
+// SpectrumAnalyzer.h - streaming vibration spectrum of the accelerometer channels
+//
+// Raw samples are pushed by the acquisition thread and transformed on a worker
+// thread with a Hann windowed, 50% overlapping real FFT. Every new frame is
+// published through a triple buffer, so the render thread never waits for it.
+//
+
+#pragma once
+
+#include "SensorData.h"
+#include "SampleQueue.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <vector>
+
+
+// FFT of real input with power-of-two size: one complex radix-2 FFT of half
+// the size followed by a split step, all twiddles precomputed
+class RealFft
+{
+public:
+
+	explicit RealFft(int _size);
+
+	int GetSize() const		{ return m_Size; }
+
+	// _re and _im receive _size / 2 + 1 bins
+	void Forward(const float* _input, float* _re, float* _im);
+
+private:
+
+	int m_Size;
+	std::vector<int> m_BitReverse;
+	std::vector<float> m_TwiddleRe;		// exp(-2 pi i k / (N / 2))
+	std::vector<float> m_TwiddleIm;
+	std::vector<float> m_SplitRe;		// exp(-2 pi i k / N)
+	std::vector<float> m_SplitIm;
+	std::vector<float> m_WorkRe;
+	std::vector<float> m_WorkIm;
+};
+
+
+const int SPECTRUM_FFT_SIZE = 128;
+const int SPECTRUM_BIN_COUNT = SPECTRUM_FFT_SIZE / 2 + 1;
+const int SPECTRUM_HISTORY = 64;		// spectrogram rows
+const int SPECTRUM_PEAK_COUNT = 4;
+
+struct SpectrumPeak
+{
+	float frequency;	// Hz
+	float amplitude;	// g
+};
+
+struct SpectrumSnapshot
+{
+	uint32_t frameCount;		// frames computed so far, 0 = no data yet
+	int newestRow;				// row of amplitude holding the latest frame
+	float sampleRate;			// Hz, measured from the sample timestamps of the latest frame
+	float amplitude[SPECTRUM_HISTORY][3][SPECTRUM_BIN_COUNT];	// g, accel X, Y, Z
+	SpectrumPeak peaks[3][SPECTRUM_PEAK_COUNT];					// strongest first
+};
+
+
+class SpectrumAnalyzer
+{
+public:
+
+	static const int HOP_SIZE = SPECTRUM_FFT_SIZE / 2;
+
+	SpectrumAnalyzer();
+
+	// acquisition thread
+	void Push(const SensorSample& _sample)		{ m_Input.Push(_sample); }
+	uint32_t GetDroppedCount() const			{ return m_Input.GetDroppedCount(); }
+
+	// worker thread: transforms everything pushed so far, returns the number of new frames.
+	// Overlapping calls from several pool threads return 0 instead of blocking.
+	int ProcessPending();
+
+	// render thread: latest published spectrum
+	const SpectrumSnapshot& GetSnapshot();
+
+private:
+
+	void ComputeFrame();
+	void FindPeaks(const float* _amplitude, float _sampleRate, SpectrumPeak* _peaks) const;
+
+	SampleQueue<SensorSample, 1024> m_Input;
+	std::atomic<bool> m_Processing;
+
+	// worker state
+	RealFft m_Fft;
+	float m_Window[SPECTRUM_FFT_SIZE];
+	float m_BinScale[SPECTRUM_BIN_COUNT];		// FFT magnitude to amplitude in g
+	float m_Ring[3][SPECTRUM_FFT_SIZE];
+	uint64_t m_Timestamps[SPECTRUM_FFT_SIZE];
+	int m_RingPosition;
+	int m_Buffered;
+	int m_SinceFrame;
+	float m_Frame[SPECTRUM_FFT_SIZE];
+	float m_Re[SPECTRUM_BIN_COUNT];
+	float m_Im[SPECTRUM_BIN_COUNT];
+	SpectrumSnapshot m_Working;
+
+	TripleBuffer<SpectrumSnapshot> m_Published;
+};
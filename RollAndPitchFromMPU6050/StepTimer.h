@@ -4,7 +4,8 @@
 
 #pragma once
 
-#include <exception>
+#include "Clock.h"
+
 #include <stdint.h>
 
 namespace DX
@@ -13,29 +14,21 @@ namespace DX
     class StepTimer
     {
     public:
-        StepTimer() : 
+        // Time comes from _clock, a VirtualClock runs the update loop without waiting.
+        explicit StepTimer(const Clock& _clock = GetRealClock()) :
+            m_clock(&_clock),
+            m_lastTime(_clock.GetTicks()),
+            m_maxDelta(TicksPerSecond / 10),    // Initialize max delta to 1/10 of a second.
             m_elapsedTicks(0),
             m_totalTicks(0),
             m_leftOverTicks(0),
             m_frameCount(0),
             m_framesPerSecond(0),
             m_framesThisSecond(0),
-            m_qpcSecondCounter(0),
+            m_secondCounter(0),
             m_isFixedTimeStep(false),
             m_targetElapsedTicks(TicksPerSecond / 60)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
-            {
-                throw std::exception( "QueryPerformanceFrequency" );
-            }
-
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
-
-            // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
         }
 
         // Get elapsed time since the previous Update call.
@@ -71,44 +64,32 @@ namespace DX
 
         void ResetElapsedTime()
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception("QueryPerformanceCounter");
-            }
+            m_lastTime = m_clock->GetTicks();
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter = 0;
+            m_secondCounter = 0;
         }
 
         // Update timer state, calling the specified Update function the appropriate number of times.
         template<typename TUpdate>
         void Tick(const TUpdate& update)
         {
-            // Query the current time.
-            LARGE_INTEGER currentTime;
-
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            // Query the current time, the clock already counts in the canonical tick format.
+            const uint64_t currentTime = m_clock->GetTicks();
 
-            uint64_t timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+            uint64_t timeDelta = currentTime - m_lastTime;
 
-            m_qpcLastTime = currentTime;
-            m_qpcSecondCounter += timeDelta;
+            m_lastTime = currentTime;
+            m_secondCounter += timeDelta;
 
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
-            if (timeDelta > m_qpcMaxDelta)
+            if (timeDelta > m_maxDelta)
             {
-                timeDelta = m_qpcMaxDelta;
+                timeDelta = m_maxDelta;
             }
 
-            // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
-            timeDelta *= TicksPerSecond;
-            timeDelta /= m_qpcFrequency.QuadPart;
-
             uint32_t lastFrameCount = m_frameCount;
 
             if (m_isFixedTimeStep)
@@ -156,19 +137,19 @@ namespace DX
                 m_framesThisSecond++;
             }
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_secondCounter >= TicksPerSecond)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+                m_secondCounter %= TicksPerSecond;
             }
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
-        uint64_t m_qpcMaxDelta;
+        // Source timing data, in the canonical tick format of the clock.
+        const Clock* m_clock;
+        uint64_t m_lastTime;
+        uint64_t m_maxDelta;
 
         // Derived timing data uses a canonical tick format.
         uint64_t m_elapsedTicks;
@@ -179,7 +160,7 @@ namespace DX
         uint32_t m_frameCount;
         uint32_t m_framesPerSecond;
         uint32_t m_framesThisSecond;
-        uint64_t m_qpcSecondCounter;
+        uint64_t m_secondCounter;
 
         // Members for configuring fixed timestep mode.
         bool m_isFixedTimeStep;
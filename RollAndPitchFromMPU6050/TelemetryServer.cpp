@@ -0,0 +1,648 @@
+//
+// TelemetryServer.cpp
+//
+
+// no precompiled header, Winsock has to come before windows.h
+#if defined(_WIN32)
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "TelemetryServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+
+namespace
+{
+	const int LISTEN_BACKLOG = 128;
+	const uint32_t MAX_FRAME_RECORDS = 0xFFFF;	// count of TelemetryFrameHeader, bounds the history
+
+#if defined(_WIN32)
+	const TelemetrySocket NO_SOCKET = INVALID_SOCKET;
+	const int SEND_FLAGS = 0;
+
+	bool WouldBlock()			{ return WSAGetLastError() == WSAEWOULDBLOCK; }
+	void CloseSocket(TelemetrySocket _socket)	{ closesocket(_socket); }
+
+	bool SetNonBlocking(TelemetrySocket _socket)
+	{
+		u_long enable = 1;
+		return ioctlsocket(_socket, FIONBIO, &enable) == 0;
+	}
+#else
+	const TelemetrySocket NO_SOCKET = -1;
+	const int SEND_FLAGS = MSG_NOSIGNAL;	// a closed peer is an error, not SIGPIPE
+
+	bool WouldBlock()			{ return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+	void CloseSocket(TelemetrySocket _socket)	{ close(_socket); }
+
+	bool SetNonBlocking(TelemetrySocket _socket)
+	{
+		const int flags = fcntl(_socket, F_GETFL, 0);
+		return flags >= 0 && fcntl(_socket, F_SETFL, flags | O_NONBLOCK) == 0;
+	}
+#endif
+
+	// appends a frame header for _count records, returns where the records go
+	uint8_t* AppendFrame(std::vector<uint8_t>& _output, TelemetryFrameType _type, size_t _recordSize, size_t _count, uint32_t _dropped, uint64_t _baseTimestamp)
+	{
+		TelemetryFrameHeader header;
+		header.magic = TELEMETRY_MAGIC;
+		header.type = uint8_t(_type);
+		header.recordSize = uint8_t(_recordSize);
+		header.count = uint16_t(_count);
+		header.dropped = _dropped;
+		header.baseTimestamp = _baseTimestamp;
+
+		const size_t offset = _output.size();
+		_output.resize(offset + sizeof(header) + _count * _recordSize);
+		memcpy(&_output[offset], &header, sizeof(header));
+		return &_output[offset + sizeof(header)];
+	}
+
+	// first index from _first on that a client with _divider takes, and how many of _count it takes
+	size_t Decimate(uint64_t _first, size_t _count, uint16_t _divider, size_t& _skip)
+	{
+		_skip = size_t((_divider - _first % _divider) % _divider);
+		return (_count > _skip) ? (_count - _skip + _divider - 1) / _divider : 0;
+	}
+}
+
+
+// readiness of the listener (context null) and the clients, level triggered
+struct TelemetryServer::Poller
+{
+	struct Event
+	{
+		Client* client;
+		bool readable;
+		bool writable;
+		bool failed;
+	};
+
+	std::vector<Event> ready;
+
+#if defined(_WIN32)
+	std::vector<WSAPOLLFD> sockets;
+	std::vector<Client*> clients;
+
+	bool Open()
+	{
+		return true;
+	}
+
+	void Close()
+	{
+		sockets.clear();
+		clients.clear();
+	}
+
+	bool Add(TelemetrySocket _socket, Client* _client)
+	{
+		WSAPOLLFD entry;
+		entry.fd = _socket;
+		entry.events = POLLRDNORM;
+		entry.revents = 0;
+		sockets.push_back(entry);
+		clients.push_back(_client);
+		return true;
+	}
+
+	void SetWriteWanted(TelemetrySocket _socket, Client*, bool _wanted)
+	{
+		for (WSAPOLLFD& entry : sockets)
+		{
+			if (entry.fd == _socket)
+			{
+				entry.events = _wanted ? (POLLRDNORM | POLLWRNORM) : POLLRDNORM;
+				return;
+			}
+		}
+	}
+
+	void Remove(TelemetrySocket _socket)
+	{
+		for (size_t i = 0; i < sockets.size(); ++i)
+		{
+			if (sockets[i].fd == _socket)
+			{
+				sockets.erase(sockets.begin() + i);
+				clients.erase(clients.begin() + i);
+				return;
+			}
+		}
+	}
+
+	void Wait(int _timeoutMs)
+	{
+		ready.clear();
+		if (WSAPoll(sockets.data(), ULONG(sockets.size()), _timeoutMs) <= 0)
+		{
+			return;
+		}
+		for (size_t i = 0; i < sockets.size(); ++i)
+		{
+			const SHORT events = sockets[i].revents;
+			if (events != 0)
+			{
+				Event event = { clients[i], (events & (POLLRDNORM | POLLHUP)) != 0, (events & POLLWRNORM) != 0, (events & (POLLERR | POLLNVAL)) != 0 };
+				ready.push_back(event);
+			}
+		}
+	}
+#else
+	int epoll;
+	std::vector<epoll_event> events;
+
+	bool Open()
+	{
+		epoll = epoll_create1(0);
+		events.resize(256);
+		return epoll >= 0;
+	}
+
+	void Close()
+	{
+		if (epoll >= 0)
+		{
+			close(epoll);
+			epoll = -1;
+		}
+	}
+
+	bool Add(TelemetrySocket _socket, Client* _client)
+	{
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = _client;
+		return epoll_ctl(epoll, EPOLL_CTL_ADD, _socket, &event) == 0;
+	}
+
+	void SetWriteWanted(TelemetrySocket _socket, Client* _client, bool _wanted)
+	{
+		epoll_event event;
+		event.events = _wanted ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+		event.data.ptr = _client;
+		epoll_ctl(epoll, EPOLL_CTL_MOD, _socket, &event);
+	}
+
+	void Remove(TelemetrySocket _socket)
+	{
+		epoll_ctl(epoll, EPOLL_CTL_DEL, _socket, nullptr);
+	}
+
+	void Wait(int _timeoutMs)
+	{
+		ready.clear();
+		const int count = epoll_wait(epoll, events.data(), int(events.size()), _timeoutMs);
+		for (int i = 0; i < count; ++i)
+		{
+			const uint32_t flags = events[i].events;
+			Event event = { static_cast<Client*>(events[i].data.ptr), (flags & (EPOLLIN | EPOLLHUP)) != 0, (flags & EPOLLOUT) != 0, (flags & EPOLLERR) != 0 };
+			ready.push_back(event);
+		}
+	}
+#endif
+};
+
+
+struct TelemetryServer::Client
+{
+	TelemetrySocket socket;
+	bool closed;
+
+	// unsent frames from sent on
+	std::vector<uint8_t> output;
+	size_t sent;
+	bool writeWanted;
+
+	// request being received
+	uint8_t request[sizeof(TelemetryRequest)];
+	size_t requestBytes;
+
+	uint16_t sampleDivider;
+	uint16_t orientationDivider;
+	uint32_t droppedSamples;		// since the last frame of the stream
+	uint32_t droppedOrientations;
+
+	size_t GetQueued() const		{ return output.size() - sent; }
+};
+
+
+TelemetryServer::TelemetryServer() :
+	m_Port(0),
+	m_Listener(NO_SOCKET),
+	m_NextSample(0),
+	m_NextOrientation(0),
+	m_Stopping(false),
+	m_ClientCount(0),
+	m_Dropped(0),
+	m_SentBytes(0)
+{
+}
+
+TelemetryServer::~TelemetryServer()
+{
+	Stop();
+}
+
+bool TelemetryServer::Start(const TelemetrySettings& _settings)
+{
+	Stop();
+	m_Settings = _settings;
+
+#if defined(_WIN32)
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		return false;
+	}
+#endif
+
+	m_Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (m_Listener == NO_SOCKET)
+	{
+#if defined(_WIN32)
+		WSACleanup();
+#endif
+		return false;
+	}
+
+	// a restarted server gets its port back while old connections linger
+	int reuse = 1;
+	setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(_settings.port);
+	socklen_t addressSize = sizeof(address);
+	if (inet_pton(AF_INET, _settings.bindAddress.c_str(), &address.sin_addr) != 1
+		|| bind(m_Listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(m_Listener, LISTEN_BACKLOG) != 0
+		|| !SetNonBlocking(m_Listener)
+		|| getsockname(m_Listener, reinterpret_cast<sockaddr*>(&address), &addressSize) != 0)
+	{
+		Stop();
+		return false;
+	}
+	m_Port = ntohs(address.sin_port);
+
+	m_Poller.reset(new Poller);
+	if (!m_Poller->Open() || !m_Poller->Add(m_Listener, nullptr))
+	{
+		Stop();
+		return false;
+	}
+
+	// everything the loop needs per batch, the producers may already be pushing
+	const uint32_t historySize = std::min(_settings.historySize, MAX_FRAME_RECORDS / 2 + 1);
+	m_Samples.Allocate(historySize);
+	m_Orientations.Allocate(historySize);
+	m_SampleCopy.resize(m_Samples.GetCapacity());
+	m_OrientationCopy.resize(m_Orientations.GetCapacity());
+	m_NextSample = 0;
+	m_NextOrientation = 0;
+	m_Dropped.store(0);
+	m_SentBytes.store(0);
+
+	m_Stopping.store(false);
+	m_Thread = std::thread([this]() { Loop(); });
+	return true;
+}
+
+void TelemetryServer::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		m_Stopping.store(true);
+		m_Thread.join();
+	}
+	CloseAll();
+
+	if (m_Poller)
+	{
+		m_Poller->Close();
+		m_Poller.reset();
+	}
+	if (m_Listener != NO_SOCKET)
+	{
+		CloseSocket(m_Listener);
+		m_Listener = NO_SOCKET;
+#if defined(_WIN32)
+		WSACleanup();
+#endif
+	}
+	m_Port = 0;
+}
+
+void TelemetryServer::Loop()
+{
+	const std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<float>(std::max(m_Settings.flushPeriod, 0.001f)));
+	std::chrono::steady_clock::time_point nextFlush = std::chrono::steady_clock::now() + period;
+
+	while (!m_Stopping.load())
+	{
+		// the flush period bounds the wait, Stop is seen within it as well
+		const std::chrono::steady_clock::duration wait = nextFlush - std::chrono::steady_clock::now();
+		m_Poller->Wait(int(std::max<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(wait).count(), 0)));
+
+		for (const Poller::Event& event : m_Poller->ready)
+		{
+			if (event.client == nullptr)
+			{
+				Accept();
+				continue;
+			}
+
+			Client& client = *event.client;
+			if (client.closed)
+			{
+				continue;
+			}
+			if (event.failed || (event.readable && !Receive(client)) || (event.writable && !Send(client)))
+			{
+				CloseClient(client);
+			}
+		}
+
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now >= nextFlush)
+		{
+			Flush();
+
+			// a late batch carries more, the next one still comes a period later
+			nextFlush += period;
+			if (nextFlush <= now)
+			{
+				nextFlush = now + period;
+			}
+		}
+
+		RemoveClosedClients();
+	}
+}
+
+void TelemetryServer::Accept()
+{
+	for (;;)
+	{
+		const TelemetrySocket socket = accept(m_Listener, nullptr, nullptr);
+		if (socket == NO_SOCKET)
+		{
+			return;
+		}
+		if (m_Clients.size() >= m_Settings.maxClients || !SetNonBlocking(socket))
+		{
+			CloseSocket(socket);
+			continue;
+		}
+
+		// frames are batched here already; a slow client should back up into the
+		// queue, where it is dropped and conflated, not into megabytes of kernel buffer
+		int noDelay = 1;
+		int sendBuffer = int(m_Settings.socketBufferBytes);
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+		setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&sendBuffer), sizeof(sendBuffer));
+
+		std::unique_ptr<Client> client(new Client);
+		client->socket = socket;
+		client->closed = false;
+		client->output.reserve(2 * m_Settings.queueBytes);
+		client->sent = 0;
+		client->writeWanted = false;
+		client->requestBytes = 0;
+		client->sampleDivider = 0;
+		client->orientationDivider = 0;
+		client->droppedSamples = 0;
+		client->droppedOrientations = 0;
+		if (!m_Poller->Add(socket, client.get()))
+		{
+			CloseSocket(socket);
+			continue;
+		}
+
+		m_Clients.push_back(std::move(client));
+		m_ClientCount.store(uint32_t(m_Clients.size()), std::memory_order_relaxed);
+	}
+}
+
+bool TelemetryServer::Receive(Client& _client)
+{
+	for (;;)
+	{
+		const int received = int(recv(_client.socket, reinterpret_cast<char*>(_client.request) + _client.requestBytes,
+			int(sizeof(_client.request) - _client.requestBytes), 0));
+		if (received == 0)
+		{
+			return false;
+		}
+		if (received < 0)
+		{
+			return WouldBlock();
+		}
+
+		_client.requestBytes += size_t(received);
+		if (_client.requestBytes == sizeof(TelemetryRequest))
+		{
+			TelemetryRequest request;
+			memcpy(&request, _client.request, sizeof(request));
+			if (request.magic != TELEMETRY_MAGIC)
+			{
+				return false;
+			}
+			_client.sampleDivider = request.sampleDivider;
+			_client.orientationDivider = request.orientationDivider;
+			_client.requestBytes = 0;
+		}
+	}
+}
+
+bool TelemetryServer::Send(Client& _client)
+{
+	while (_client.GetQueued() > 0)
+	{
+		const int sent = int(send(_client.socket, reinterpret_cast<const char*>(&_client.output[_client.sent]), int(_client.GetQueued()), SEND_FLAGS));
+		if (sent < 0)
+		{
+			if (!WouldBlock())
+			{
+				return false;
+			}
+
+			// socket buffer full, go on when the client has read some
+			if (!_client.writeWanted)
+			{
+				m_Poller->SetWriteWanted(_client.socket, &_client, true);
+				_client.writeWanted = true;
+			}
+			break;
+		}
+		_client.sent += size_t(sent);
+		m_SentBytes.fetch_add(uint64_t(sent), std::memory_order_relaxed);
+	}
+
+	if (_client.GetQueued() == 0)
+	{
+		_client.output.clear();
+		_client.sent = 0;
+		if (_client.writeWanted)
+		{
+			m_Poller->SetWriteWanted(_client.socket, &_client, false);
+			_client.writeWanted = false;
+		}
+	}
+	else if (_client.sent >= _client.output.size() / 2)
+	{
+		// keep the queue at the front, the buffer does not grow with a slow reader
+		_client.output.erase(_client.output.begin(), _client.output.begin() + _client.sent);
+		_client.sent = 0;
+	}
+	return true;
+}
+
+void TelemetryServer::Flush()
+{
+	uint64_t firstSample;
+	const size_t sampleCount = m_Samples.CopyFrom(m_NextSample, m_SampleCopy.data(), firstSample);
+	m_NextSample = firstSample + sampleCount;
+
+	uint64_t firstOrientation;
+	const size_t orientationCount = m_Orientations.CopyFrom(m_NextOrientation, m_OrientationCopy.data(), firstOrientation);
+	m_NextOrientation = firstOrientation + orientationCount;
+
+	for (const std::unique_ptr<Client>& client : m_Clients)
+	{
+		if (client->closed)
+		{
+			continue;
+		}
+		AppendSamples(*client, m_SampleCopy.data(), sampleCount, firstSample);
+		AppendOrientations(*client, m_OrientationCopy.data(), orientationCount, firstOrientation);
+		if (!client->writeWanted && !Send(*client))
+		{
+			CloseClient(*client);
+		}
+	}
+}
+
+void TelemetryServer::AppendSamples(Client& _client, const SensorShmSample* _samples, size_t _count, uint64_t _first)
+{
+	if (_client.sampleDivider == 0)
+	{
+		return;
+	}
+	size_t skip;
+	const size_t selected = Decimate(_first, _count, _client.sampleDivider, skip);
+	if (selected == 0)
+	{
+		return;
+	}
+
+	// a full queue drops the samples, they are only told as a count
+	if (_client.GetQueued() >= m_Settings.queueBytes)
+	{
+		_client.droppedSamples += uint32_t(selected);
+		m_Dropped.fetch_add(selected, std::memory_order_relaxed);
+		return;
+	}
+
+	// written straight into the queue, the whole batch is one frame
+	uint8_t* output = AppendFrame(_client.output, TELEMETRY_SAMPLES, sizeof(TelemetrySampleRecord), selected, _client.droppedSamples, _samples[skip].timestamp);
+	_client.droppedSamples = 0;
+	for (size_t i = skip; i < _count; i += _client.sampleDivider)
+	{
+		TelemetrySampleRecord record;
+		record.timeOffset = uint32_t(_samples[i].timestamp - _samples[skip].timestamp);
+		memcpy(record.accel, _samples[i].accel, sizeof(record.accel));
+		record.temperature = _samples[i].temperature;
+		memcpy(record.gyro, _samples[i].gyro, sizeof(record.gyro));
+		memcpy(output, &record, sizeof(record));
+		output += sizeof(record);
+	}
+}
+
+void TelemetryServer::AppendOrientations(Client& _client, const SensorShmOrientation* _orientations, size_t _count, uint64_t _first)
+{
+	if (_client.orientationDivider == 0)
+	{
+		return;
+	}
+	size_t skip;
+	size_t selected = Decimate(_first, _count, _client.orientationDivider, skip);
+	if (selected == 0)
+	{
+		return;
+	}
+
+	// only the state matters to a client that is behind: a full queue gets the
+	// newest orientation alone, one twice as full nothing
+	const size_t queued = _client.GetQueued();
+	if (queued >= 2 * size_t(m_Settings.queueBytes))
+	{
+		_client.droppedOrientations += uint32_t(selected);
+		m_Dropped.fetch_add(selected, std::memory_order_relaxed);
+		return;
+	}
+	if (queued >= m_Settings.queueBytes)
+	{
+		_client.droppedOrientations += uint32_t(selected - 1);
+		m_Dropped.fetch_add(selected - 1, std::memory_order_relaxed);
+		skip += (selected - 1) * _client.orientationDivider;
+		selected = 1;
+	}
+
+	uint8_t* output = AppendFrame(_client.output, TELEMETRY_ORIENTATIONS, sizeof(TelemetryOrientationRecord), selected, _client.droppedOrientations, _orientations[skip].timestamp);
+	_client.droppedOrientations = 0;
+	for (size_t i = skip; i < _count; i += _client.orientationDivider)
+	{
+		TelemetryOrientationRecord record;
+		record.timeOffset = uint32_t(_orientations[i].timestamp - _orientations[skip].timestamp);
+		memcpy(record.orientation, _orientations[i].orientation, sizeof(record.orientation));
+		memcpy(record.attitudeVariance, _orientations[i].attitudeVariance, sizeof(record.attitudeVariance));
+		memcpy(output, &record, sizeof(record));
+		output += sizeof(record);
+	}
+}
+
+void TelemetryServer::CloseClient(Client& _client)
+{
+	// the object stays until RemoveClosedClients, events of this wait may still name it
+	m_Poller->Remove(_client.socket);
+	CloseSocket(_client.socket);
+	_client.closed = true;
+}
+
+void TelemetryServer::RemoveClosedClients()
+{
+	m_Clients.erase(std::remove_if(m_Clients.begin(), m_Clients.end(),
+		[](const std::unique_ptr<Client>& _client) { return _client->closed; }), m_Clients.end());
+	m_ClientCount.store(uint32_t(m_Clients.size()), std::memory_order_relaxed);
+}
+
+void TelemetryServer::CloseAll()
+{
+	for (const std::unique_ptr<Client>& client : m_Clients)
+	{
+		if (!client->closed)
+		{
+			CloseClient(*client);
+		}
+	}
+	RemoveClosedClients();
+}
@@ -0,0 +1,179 @@
+//
+// TelemetryServer.h - samples and orientation streamed over TCP to remote dashboards
+//
+// One thread runs an event loop (epoll on Linux, WSAPoll on Windows) over the
+// listening socket and every client, no thread per client. The producers only
+// store into two HistoryRings; once per flush period the loop takes what is new,
+// decimates it for each client at the rate the client asked for and appends it
+// as one frame per stream to the client's output, which goes out with a single
+// send. A client that does not read fast enough fills its output queue; from
+// then on its samples are dropped and its orientations conflated to the newest
+// one, and it is told how many it missed. Nothing a client does can block the
+// producers or the other clients.
+//
+// Wire format, little endian: the client sends a TelemetryRequest whenever it
+// wants to change its rates (nothing is sent before the first one). The server
+// sends frames back to back, each a TelemetryFrameHeader followed by count
+// records of the type it names.
+//
+// The application is a UWP app: inbound loopback connections from other
+// processes are blocked by network isolation, and inbound connections from the
+// private network need the privateNetworkClientServer capability, which the
+// manifest declares. The server has no authentication, so it listens on this
+// machine only unless told otherwise; Game picks the private network interface,
+// and stays on loopback when there is none.
+//
+
+#pragma once
+
+#include "SensorShm.h"
+#include "HistoryRing.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const uint32_t TELEMETRY_MAGIC = 0x544D504D;	// "MPMT"
+const uint16_t TELEMETRY_DEFAULT_PORT = 5650;
+
+enum TelemetryFrameType
+{
+	TELEMETRY_SAMPLES = 1,			// TelemetrySampleRecord
+	TELEMETRY_ORIENTATIONS = 2,		// TelemetryOrientationRecord
+};
+
+#pragma pack(push, 1)
+
+// client to server, replaces the previous request
+struct TelemetryRequest
+{
+	uint32_t magic;
+	uint16_t sampleDivider;			// every n-th sample, 0 = none
+	uint16_t orientationDivider;	// every n-th orientation, 0 = none
+};
+
+struct TelemetryFrameHeader
+{
+	uint32_t magic;
+	uint8_t type;					// TelemetryFrameType
+	uint8_t recordSize;
+	uint16_t count;
+	uint32_t dropped;				// records of this stream not sent to this client since its last frame
+	uint64_t baseTimestamp;			// StepTimer ticks, the records carry offsets to it
+};
+
+struct TelemetrySampleRecord
+{
+	uint32_t timeOffset;			// ticks after baseTimestamp
+	int16_t accel[3];				// raw MPU6050 units
+	int16_t temperature;
+	int16_t gyro[3];
+};
+
+struct TelemetryOrientationRecord
+{
+	uint32_t timeOffset;
+	float orientation[4];			// sensor to world quaternion x, y, z, w
+	float attitudeVariance[3];		// rad^2 around sensor X, Y, Z
+};
+
+#pragma pack(pop)
+
+
+#if defined(_WIN32)
+typedef uintptr_t TelemetrySocket;	// SOCKET
+#else
+typedef int TelemetrySocket;
+#endif
+
+struct TelemetrySettings
+{
+	uint16_t port;					// 0 = any free port, see GetPort
+	std::string bindAddress;		// IPv4 of the interface to listen on, "127.0.0.1" this machine only, "0.0.0.0" every one
+	uint32_t maxClients;
+	uint32_t queueBytes;			// unsent output per client before its frames are dropped
+	uint32_t socketBufferBytes;		// kernel send buffer per client, bounds how stale its data gets
+	float flushPeriod;				// seconds between batches
+	uint32_t historySize;			// entries per stream the loop may fall behind the producers, up to 32768
+
+	TelemetrySettings() :
+		port(TELEMETRY_DEFAULT_PORT),
+		bindAddress("127.0.0.1"),
+		maxClients(512),
+		queueBytes(64 * 1024),
+		socketBufferBytes(64 * 1024),
+		flushPeriod(0.02f),
+		historySize(8192)
+	{
+	}
+};
+
+
+class TelemetryServer
+{
+public:
+
+	TelemetryServer();
+	~TelemetryServer();
+
+	// binds, listens and starts the loop; false when the address is not an IPv4
+	// address of this machine or the port cannot be bound
+	bool Start(const TelemetrySettings& _settings = TelemetrySettings());
+	void Stop();
+	bool IsStarted() const								{ return m_Thread.joinable(); }
+	const TelemetrySettings& GetSettings() const		{ return m_Settings; }
+	uint16_t GetPort() const							{ return m_Port; }
+
+	// hot path, one producer thread each; constant time, no locks, no syscalls
+	void PushSample(const SensorShmSample& _sample)				{ m_Samples.Push(_sample); }
+	void PushOrientation(const SensorShmOrientation& _orientation)	{ m_Orientations.Push(_orientation); }
+
+	uint32_t GetClientCount() const						{ return m_ClientCount.load(std::memory_order_relaxed); }
+	uint64_t GetDroppedCount() const					{ return m_Dropped.load(std::memory_order_relaxed); }	// records, all clients
+	uint64_t GetSentBytes() const						{ return m_SentBytes.load(std::memory_order_relaxed); }
+
+private:
+
+	TelemetryServer(const TelemetryServer&);
+	TelemetryServer& operator=(const TelemetryServer&);
+
+	struct Client;
+	struct Poller;
+
+	void Loop();
+	void Accept();
+	bool Receive(Client& _client);
+	bool Send(Client& _client);
+	void Flush();
+	void AppendSamples(Client& _client, const SensorShmSample* _samples, size_t _count, uint64_t _first);
+	void AppendOrientations(Client& _client, const SensorShmOrientation* _orientations, size_t _count, uint64_t _first);
+	void CloseClient(Client& _client);
+	void RemoveClosedClients();
+	void CloseAll();
+
+	TelemetrySettings m_Settings;
+	uint16_t m_Port;
+
+	HistoryRing<SensorShmSample> m_Samples;
+	HistoryRing<SensorShmOrientation> m_Orientations;
+
+	// loop thread only
+	TelemetrySocket m_Listener;
+	std::unique_ptr<Poller> m_Poller;
+	std::vector<std::unique_ptr<Client>> m_Clients;
+	uint64_t m_NextSample;
+	uint64_t m_NextOrientation;
+	std::vector<SensorShmSample> m_SampleCopy;
+	std::vector<SensorShmOrientation> m_OrientationCopy;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_Stopping;
+
+	std::atomic<uint32_t> m_ClientCount;
+	std::atomic<uint64_t> m_Dropped;
+	std::atomic<uint64_t> m_SentBytes;
+};
@@ -0,0 +1,62 @@
+//
+// TripleBuffer.h - lock-free publication of the latest result
+//
+
+#pragma once
+
+#include <atomic>
+
+
+// One writer thread fills the back buffer and publishes it, one reader thread
+// takes the most recently published buffer. Neither side ever waits; the reader
+// simply keeps its current buffer when nothing new was published.
+template<typename T>
+class TripleBuffer
+{
+public:
+
+	TripleBuffer() :
+		m_back(0),
+		m_shared(1),
+		m_front(2)
+	{
+	}
+
+	// writer: buffer to fill before Publish
+	T& GetBackBuffer()
+	{
+		return m_buffers[m_back];
+	}
+
+	void Publish()
+	{
+		m_back = m_shared.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// reader: swaps in the latest published buffer, returns false when there was none since the last call
+	bool Update()
+	{
+		if ((m_shared.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+		{
+			return false;
+		}
+
+		m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T& GetFrontBuffer() const
+	{
+		return m_buffers[m_front];
+	}
+
+private:
+
+	static const unsigned FRESH_BIT = 4;
+	static const unsigned INDEX_MASK = 3;
+
+	T m_buffers[3];
+	unsigned m_back;					// owned by the writer
+	std::atomic<unsigned> m_shared;		// index of the buffer in transit, FRESH_BIT when not yet taken
+	unsigned m_front;					// owned by the reader
+};
@@ -0,0 +1,171 @@
+//
+// WorkStealingPool.cpp
+//
+
+#include "pch.h"
+#include "WorkStealingPool.h"
+
+
+namespace
+{
+	// worker index of the current thread within its pool
+	thread_local const WorkStealingPool* t_Pool = nullptr;
+	thread_local unsigned t_WorkerIndex = 0;
+}
+
+
+WorkStealingPool::WorkStealingPool(unsigned _threadCount) :
+	m_Queued(0),
+	m_Unfinished(0),
+	m_NextWorker(0),
+	m_Stop(false)
+{
+	if (_threadCount == 0)
+	{
+		_threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	for (unsigned i = 0; i < _threadCount; ++i)
+	{
+		m_Workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+	for (unsigned i = 0; i < _threadCount; ++i)
+	{
+		m_Threads.push_back(std::thread([this, i]() { WorkerLoop(i); }));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Stop = true;
+	}
+	m_Wake.notify_all();
+
+	for (std::thread& thread : m_Threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkStealingPool::Submit(const Task& _task)
+{
+	const unsigned index = (t_Pool == this) ? t_WorkerIndex : m_NextWorker.fetch_add(1, std::memory_order_relaxed) % m_Workers.size();
+
+	m_Unfinished.fetch_add(1, std::memory_order_relaxed);
+	{
+		Worker& worker = *m_Workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(_task);
+	}
+	m_Queued.fetch_add(1, std::memory_order_release);
+
+	// taking the lock orders the notification after a sleeper checked m_Queued
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+	}
+	m_Wake.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+	const unsigned index = (t_Pool == this) ? t_WorkerIndex : 0;
+	while (m_Unfinished.load(std::memory_order_acquire) > 0)
+	{
+		if (!TryRunTask(index))
+		{
+			std::this_thread::yield();	// remaining tasks are running on other threads
+		}
+	}
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(m_ErrorMutex);
+		error.swap(m_Error);
+	}
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkStealingPool::WorkerLoop(unsigned _index)
+{
+	t_Pool = this;
+	t_WorkerIndex = _index;
+
+	for (;;)
+	{
+		if (TryRunTask(_index))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_Wake.wait(lock, [this]() { return m_Stop || m_Queued.load(std::memory_order_acquire) > 0; });
+		if (m_Stop)
+		{
+			return;
+		}
+	}
+}
+
+bool WorkStealingPool::TryRunTask(unsigned _index)
+{
+	Task task;
+	if (!TryPop(_index, task) && !TrySteal(_index, task))
+	{
+		return false;
+	}
+
+	m_Queued.fetch_sub(1, std::memory_order_relaxed);
+	try
+	{
+		task();
+	}
+	catch (...)
+	{
+		// a worker thread must not die with it, and Wait must still see the task finish
+		std::lock_guard<std::mutex> lock(m_ErrorMutex);
+		if (!m_Error)
+		{
+			m_Error = std::current_exception();
+		}
+	}
+	m_Unfinished.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+// own deque: newest first, its data is most likely still in cache
+bool WorkStealingPool::TryPop(unsigned _index, Task& _task)
+{
+	Worker& worker = *m_Workers[_index];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.tasks.empty())
+	{
+		return false;
+	}
+
+	_task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+// other deques: oldest first, usually the biggest remaining piece of work
+bool WorkStealingPool::TrySteal(unsigned _thief, Task& _task)
+{
+	const unsigned count = unsigned(m_Workers.size());
+	for (unsigned offset = 1; offset < count; ++offset)
+	{
+		Worker& victim = *m_Workers[(_thief + offset) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			_task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,71 @@
+//
+// WorkStealingPool.h - thread pool for offline analysis jobs
+//
+// Every worker owns a task deque. Workers take their own newest task first and
+// steal the oldest task of another worker when they run dry, so uneven task
+// sizes (long and short Allan clusters, slow replay candidates) still keep all
+// cores busy.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class WorkStealingPool
+{
+public:
+
+	typedef std::function<void()> Task;
+
+	// 0 threads = one per hardware thread
+	explicit WorkStealingPool(unsigned _threadCount = 0);
+	~WorkStealingPool();
+
+	// tasks submitted from a worker go to its own deque, others are spread round robin
+	void Submit(const Task& _task);
+
+	// runs tasks on the calling thread too until everything submitted so far has
+	// finished; then rethrows the first exception a task let escape, if any
+	void Wait();
+
+	unsigned GetThreadCount() const		{ return unsigned(m_Threads.size()); }
+
+private:
+
+	WorkStealingPool(const WorkStealingPool&);
+	WorkStealingPool& operator=(const WorkStealingPool&);
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(unsigned _index);
+	bool TryRunTask(unsigned _index);
+	bool TryPop(unsigned _index, Task& _task);
+	bool TrySteal(unsigned _thief, Task& _task);
+
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::vector<std::thread> m_Threads;
+
+	std::atomic<size_t> m_Queued;		// tasks waiting in deques
+	std::atomic<size_t> m_Unfinished;	// tasks queued or running
+	std::atomic<unsigned> m_NextWorker;
+	std::atomic<bool> m_Stop;
+
+	std::mutex m_WakeMutex;
+	std::condition_variable m_Wake;
+
+	std::mutex m_ErrorMutex;
+	std::exception_ptr m_Error;		// under m_ErrorMutex, the first one until Wait hands it out
+};
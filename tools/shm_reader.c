@@ -0,0 +1,113 @@
+//
+// shm_reader.c - follows the samples and orientation the application publishes in shared memory
+//
+// Build on Linux next to the application:
+//     gcc -O2 -std=c99 -I../RollAndPitchFromMPU6050 shm_reader.c ../RollAndPitchFromMPU6050/SensorShm.c -o shm_reader -lm -lrt
+// Run with the region name as the argument, SENSOR_SHM_DEFAULT_NAME without.
+//
+// Reads every sample once in order without any syscall while data is flowing,
+// counts the ones it was too slow for and prints the rate and roll and pitch of
+// the latest orientation once a second. Waits for a publisher and follows a
+// restarted one.
+//
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "SensorShm.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Sleep(long _microseconds)
+{
+	struct timespec delay;
+	delay.tv_sec = _microseconds / 1000000;
+	delay.tv_nsec = (_microseconds % 1000000) * 1000;
+	nanosleep(&delay, NULL);
+}
+
+static void PrintOrientation(const SensorShm* _shm)
+{
+	SensorShmOrientation latest;
+	const float* q = latest.orientation;
+	float roll;
+	float pitch;
+
+	if (SensorShmReadLatestOrientation(_shm, &latest) != SENSOR_SHM_OK)
+	{
+		printf("  no orientation yet\n");
+		return;
+	}
+
+	// sensor X forward, Z up
+	roll = atan2f(2.0f * (q[3] * q[0] + q[1] * q[2]), 1.0f - 2.0f * (q[0] * q[0] + q[1] * q[1]));
+	pitch = asinf(fmaxf(-1.0f, fminf(1.0f, 2.0f * (q[3] * q[1] - q[2] * q[0]))));
+	printf("  roll %7.2f  pitch %7.2f deg\n", roll * 57.29578f, pitch * 57.29578f);
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = (argc > 1) ? argv[1] : SENSOR_SHM_DEFAULT_NAME;
+
+	for (;;)
+	{
+		SensorShm* shm = SensorShmOpen(name);
+		uint32_t next;
+		unsigned long long received = 0;
+		unsigned long long lost = 0;
+		double reportTime = Now() + 1.0;
+
+		if (shm == NULL)
+		{
+			Sleep(500000);
+			continue;
+		}
+		printf("attached to %s, %u sample slots\n", name, SensorShmGetHeader(shm)->sampleCapacity);
+
+		// from the newest sample on, the history is of no interest here
+		next = SensorShmGetSampleHead(shm);
+		while (!SensorShmIsClosed(shm))
+		{
+			SensorShmSample sample;
+			const int result = SensorShmReadSample(shm, next, &sample);
+			if (result == SENSOR_SHM_OK)
+			{
+				++received;
+				++next;
+				continue;
+			}
+			if (result == SENSOR_SHM_OVERWRITTEN)
+			{
+				// fell a whole ring behind, resume at the oldest sample still there
+				const uint32_t oldest = SensorShmGetOldestSample(shm);
+				lost += (uint32_t)(oldest - next);
+				next = oldest;
+				continue;
+			}
+
+			// caught up, the publisher writes in bursts every few milliseconds
+			if (Now() >= reportTime)
+			{
+				printf("%llu samples/s, %llu lost", received, lost);
+				PrintOrientation(shm);
+				fflush(stdout);
+				received = 0;
+				lost = 0;
+				reportTime += 1.0;
+			}
+			Sleep(1000);
+		}
+
+		printf("publisher closed or restarted\n");
+		SensorShmClose(shm);
+	}
+}
@@ -0,0 +1,145 @@
+//
+// shm_reader_win.c - follows the samples and orientation the application publishes in shared memory, on Windows
+//
+// Build from a Developer Command Prompt:
+//     cl /O2 /I..\RollAndPitchFromMPU6050 shm_reader_win.c ..\RollAndPitchFromMPU6050\SensorShm.c userenv.lib
+// Run with the package family name of the installed application (Get-AppxPackage
+// shows it as PackageFamilyName) and optionally the region name,
+// SENSOR_SHM_DEFAULT_NAME without.
+//
+// The application creates the region in its AppContainer's namespace. A desktop
+// process finds it under AppContainerNamedObjects\<SID>, the SID derived from the
+// package family name; the default DACL of the AppContainer grants the same user
+// access. Otherwise the same as shm_reader.c: every sample once in order, the
+// ones it was too slow for counted, the rate and roll and pitch of the latest
+// orientation once a second, and a restarted or resumed publisher followed.
+//
+
+#include "SensorShm.h"
+
+#include <windows.h>
+#include <securityappcontainer.h>
+#include <userenv.h>
+#include <math.h>
+#include <stdio.h>
+
+
+// AppContainerNamedObjects\<SID>\_name, 0 when the package is unknown
+static int MakeAppContainerName(const char* _packageFamilyName, const char* _name, char* _objectName, size_t _length)
+{
+	wchar_t familyName[256];
+	wchar_t path[MAX_PATH];
+	char narrowPath[MAX_PATH];
+	ULONG pathLength = 0;
+	PSID sid = NULL;
+	int made;
+
+	if (MultiByteToWideChar(CP_UTF8, 0, _packageFamilyName, -1, familyName, 256) == 0
+		|| FAILED(DeriveAppContainerSidFromAppContainerName(familyName, &sid)))
+	{
+		return 0;
+	}
+	made = GetAppContainerNamedObjectPath(NULL, sid, MAX_PATH, path, &pathLength)
+		&& WideCharToMultiByte(CP_UTF8, 0, path, -1, narrowPath, MAX_PATH, NULL, NULL) != 0
+		&& _snprintf_s(_objectName, _length, _TRUNCATE, "%s\\%s", narrowPath, _name) > 0;
+	FreeSid(sid);
+	return made;
+}
+
+static double Now(void)
+{
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+static void PrintOrientation(const SensorShm* _shm)
+{
+	SensorShmOrientation latest;
+	const float* q = latest.orientation;
+	float roll;
+	float pitch;
+
+	if (SensorShmReadLatestOrientation(_shm, &latest) != SENSOR_SHM_OK)
+	{
+		printf("  no orientation yet\n");
+		return;
+	}
+
+	// sensor X forward, Z up
+	roll = atan2f(2.0f * (q[3] * q[0] + q[1] * q[2]), 1.0f - 2.0f * (q[0] * q[0] + q[1] * q[1]));
+	pitch = asinf(fmaxf(-1.0f, fminf(1.0f, 2.0f * (q[3] * q[1] - q[2] * q[0]))));
+	printf("  roll %7.2f  pitch %7.2f deg\n", roll * 57.29578f, pitch * 57.29578f);
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = (argc > 2) ? argv[2] : SENSOR_SHM_DEFAULT_NAME;
+	char objectName[512];
+
+	if (argc < 2)
+	{
+		printf("usage: shm_reader_win <package family name> [region name]\n");
+		return 1;
+	}
+	if (!MakeAppContainerName(argv[1], name, objectName, sizeof(objectName)))
+	{
+		printf("no AppContainer for package family %s\n", argv[1]);
+		return 1;
+	}
+
+	for (;;)
+	{
+		SensorShm* shm = SensorShmOpen(objectName);
+		uint32_t next;
+		unsigned long long received = 0;
+		unsigned long long lost = 0;
+		double reportTime = Now() + 1.0;
+
+		if (shm == NULL)
+		{
+			Sleep(500);
+			continue;
+		}
+		printf("attached to %s, %u sample slots\n", objectName, SensorShmGetHeader(shm)->sampleCapacity);
+
+		// from the newest sample on, the history is of no interest here
+		next = SensorShmGetSampleHead(shm);
+		while (!SensorShmIsClosed(shm))
+		{
+			SensorShmSample sample;
+			const int result = SensorShmReadSample(shm, next, &sample);
+			if (result == SENSOR_SHM_OK)
+			{
+				++received;
+				++next;
+				continue;
+			}
+			if (result == SENSOR_SHM_OVERWRITTEN)
+			{
+				// fell a whole ring behind, resume at the oldest sample still there
+				const uint32_t oldest = SensorShmGetOldestSample(shm);
+				lost += (uint32_t)(oldest - next);
+				next = oldest;
+				continue;
+			}
+
+			// caught up, the publisher writes in bursts every few milliseconds
+			if (Now() >= reportTime)
+			{
+				printf("%llu samples/s, %llu lost", received, lost);
+				PrintOrientation(shm);
+				fflush(stdout);
+				received = 0;
+				lost = 0;
+				reportTime += 1.0;
+			}
+			Sleep(1);
+		}
+
+		printf("publisher closed or restarted\n");
+		SensorShmClose(shm);
+	}
+}
@@ -0,0 +1,381 @@
+//
+// telemetry_load.cpp - load test of TelemetryServer with hundreds of local clients
+//
+// Build and run on Linux:
+//     g++ -O2 -std=c++17 -pthread -I../RollAndPitchFromMPU6050 telemetry_load.cpp ../RollAndPitchFromMPU6050/TelemetryServer.cpp -o telemetry_load
+//     ./telemetry_load [clients] [seconds]
+//
+// Runs the server in process on a free loopback port and feeds it like the
+// application does: 1 kHz samples in 20 ms bursts from one thread, fused
+// orientations from another. The clients all live on one epoll loop; each asks
+// for its own decimation, and every tenth one asks for everything and never
+// reads after its request.
+// Checks that every record arrives in order at the requested decimation, that
+// reading clients get everything, that the slow ones are told about their drops,
+// and how long the producers spent in the push calls.
+//
+
+#include "TelemetryServer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+	const uint64_t TICKS_PER_SAMPLE = 10000;	// 1 kHz in 100 ns ticks
+	const int SAMPLES_PER_BURST = 20;
+	const int BURST_MS = 20;
+	const int ORIENTATION_BATCH = 16;			// fused once per rendered frame
+
+	struct LoadClient
+	{
+		int socket;
+		bool slow;
+		uint16_t sampleDivider;
+		uint16_t orientationDivider;
+		std::vector<uint8_t> input;
+
+		uint64_t samples;
+		uint64_t orientations;
+		uint64_t droppedSamples;
+		uint64_t droppedOrientations;
+		uint64_t nextSample;			// index expected next, ~0 before the first
+		uint64_t nextOrientation;
+		uint64_t errors;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	double Microseconds(Clock::duration _duration)
+	{
+		return std::chrono::duration<double, std::micro>(_duration).count();
+	}
+
+	// indexes must follow at the decimation, or further when the server reported drops
+	void CheckIndex(LoadClient& _client, uint64_t _index, uint16_t _divider, uint64_t _dropped, uint64_t& _next)
+	{
+		if (_index % _divider != 0 || (_next != ~0ull && (_index < _next || (_dropped == 0 && _index != _next))))
+		{
+			++_client.errors;
+		}
+		_next = _index + _divider;
+	}
+
+	void Parse(LoadClient& _client)
+	{
+		size_t offset = 0;
+		while (_client.input.size() - offset >= sizeof(TelemetryFrameHeader))
+		{
+			TelemetryFrameHeader header;
+			memcpy(&header, &_client.input[offset], sizeof(header));
+			const size_t size = sizeof(header) + size_t(header.count) * header.recordSize;
+			if (header.magic != TELEMETRY_MAGIC)
+			{
+				++_client.errors;
+				_client.input.clear();
+				return;
+			}
+			if (_client.input.size() - offset < size)
+			{
+				break;
+			}
+
+			const uint8_t* records = &_client.input[offset + sizeof(header)];
+			uint64_t dropped = header.dropped;
+			if (header.type == TELEMETRY_SAMPLES && header.recordSize == sizeof(TelemetrySampleRecord))
+			{
+				_client.droppedSamples += header.dropped;
+				for (uint16_t i = 0; i < header.count; ++i, dropped = 0)
+				{
+					TelemetrySampleRecord record;
+					memcpy(&record, records + i * sizeof(record), sizeof(record));
+					const uint64_t index = (header.baseTimestamp + record.timeOffset) / TICKS_PER_SAMPLE;
+					CheckIndex(_client, index, _client.sampleDivider, dropped, _client.nextSample);
+					if (record.accel[0] != int16_t(index))
+					{
+						++_client.errors;
+					}
+				}
+				_client.samples += header.count;
+			}
+			else if (header.type == TELEMETRY_ORIENTATIONS && header.recordSize == sizeof(TelemetryOrientationRecord))
+			{
+				_client.droppedOrientations += header.dropped;
+				for (uint16_t i = 0; i < header.count; ++i, dropped = 0)
+				{
+					TelemetryOrientationRecord record;
+					memcpy(&record, records + i * sizeof(record), sizeof(record));
+					const uint64_t index = (header.baseTimestamp + record.timeOffset) / TICKS_PER_SAMPLE;
+					CheckIndex(_client, index, _client.orientationDivider, dropped, _client.nextOrientation);
+					if (record.orientation[3] != float(index))
+					{
+						++_client.errors;
+					}
+				}
+				_client.orientations += header.count;
+			}
+			else
+			{
+				++_client.errors;
+			}
+			offset += size;
+		}
+		_client.input.erase(_client.input.begin(), _client.input.begin() + offset);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	const int clientCount = (argc > 1) ? atoi(argv[1]) : 500;
+	const int seconds = (argc > 2) ? atoi(argv[2]) : 10;
+
+	// two descriptors per client in this process
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	TelemetrySettings settings;
+	settings.port = 0;
+	settings.bindAddress = "127.0.0.1";
+	settings.maxClients = uint32_t(clientCount);
+	TelemetryServer server;
+	if (!server.Start(settings))
+	{
+		printf("server failed to start\n");
+		return 1;
+	}
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(server.GetPort());
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	const int epoll = epoll_create1(0);
+	std::vector<LoadClient> clients(clientCount);
+	for (int i = 0; i < clientCount; ++i)
+	{
+		LoadClient& client = clients[i];
+		client.socket = socket(AF_INET, SOCK_STREAM, 0);
+		client.slow = (i % 10 == 9);
+		client.sampleDivider = client.slow ? 1 : uint16_t(1 + i % 10);
+		client.orientationDivider = client.slow ? 1 : uint16_t(1 + i % 4);
+		client.samples = client.orientations = client.droppedSamples = client.droppedOrientations = client.errors = 0;
+		client.nextSample = client.nextOrientation = ~0ull;
+
+		// a small receive buffer makes the slow clients back up quickly
+		if (client.slow)
+		{
+			int size = 4096;
+			setsockopt(client.socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		}
+		if (connect(client.socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			printf("connect %d failed: %s\n", i, strerror(errno));
+			return 1;
+		}
+
+		TelemetryRequest request;
+		request.magic = TELEMETRY_MAGIC;
+		request.sampleDivider = client.sampleDivider;
+		request.orientationDivider = client.orientationDivider;
+		if (send(client.socket, &request, sizeof(request), 0) != sizeof(request))
+		{
+			printf("request %d failed\n", i);
+			return 1;
+		}
+
+		fcntl(client.socket, F_SETFL, fcntl(client.socket, F_GETFL, 0) | O_NONBLOCK);
+		if (!client.slow)
+		{
+			epoll_event event;
+			event.events = EPOLLIN;
+			event.data.ptr = &client;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, client.socket, &event);
+		}
+	}
+
+	// wait until the server has every client and their requests
+	while (server.GetClientCount() < uint32_t(clientCount))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	std::atomic<bool> producing(true);
+	std::atomic<uint64_t> sampleCount(0);
+	std::atomic<uint64_t> orientationCount(0);
+	Clock::duration maxSampleBurst = Clock::duration::zero();
+	Clock::duration maxOrientationBatch = Clock::duration::zero();
+
+	std::thread acquisition([&]()
+	{
+		uint64_t index = 0;
+		Clock::time_point next = Clock::now();
+		while (producing.load())
+		{
+			const Clock::time_point start = Clock::now();
+			for (int i = 0; i < SAMPLES_PER_BURST; ++i, ++index)
+			{
+				SensorShmSample sample;
+				memset(&sample, 0, sizeof(sample));
+				sample.timestamp = index * TICKS_PER_SAMPLE;
+				sample.accel[0] = int16_t(index);
+				server.PushSample(sample);
+			}
+			maxSampleBurst = std::max(maxSampleBurst, Clock::now() - start);
+			sampleCount.store(index);
+
+			next += std::chrono::milliseconds(BURST_MS);
+			std::this_thread::sleep_until(next);
+		}
+	});
+
+	std::thread fusion([&]()
+	{
+		uint64_t index = 0;
+		while (producing.load())
+		{
+			// follows the samples, as the pipeline does
+			const uint64_t available = sampleCount.load();
+			const Clock::time_point start = Clock::now();
+			for (; index < available; ++index)
+			{
+				SensorShmOrientation orientation;
+				memset(&orientation, 0, sizeof(orientation));
+				orientation.timestamp = index * TICKS_PER_SAMPLE;
+				orientation.orientation[3] = float(index);
+				server.PushOrientation(orientation);
+			}
+			maxOrientationBatch = std::max(maxOrientationBatch, Clock::now() - start);
+			orientationCount.store(index);
+			std::this_thread::sleep_for(std::chrono::milliseconds(ORIENTATION_BATCH));
+		}
+	});
+
+	// the clients that read, until a while after the producers stopped
+	const Clock::time_point producersEnd = Clock::now() + std::chrono::seconds(seconds);
+	const Clock::time_point readEnd = producersEnd + std::chrono::milliseconds(500);
+	std::vector<epoll_event> events(256);
+	uint8_t buffer[65536];
+	while (Clock::now() < readEnd)
+	{
+		if (producing.load() && Clock::now() >= producersEnd)
+		{
+			producing.store(false);
+			acquisition.join();
+			fusion.join();
+		}
+
+		const int count = epoll_wait(epoll, events.data(), int(events.size()), 10);
+		for (int i = 0; i < count; ++i)
+		{
+			LoadClient& client = *static_cast<LoadClient*>(events[i].data.ptr);
+			for (;;)
+			{
+				const ssize_t received = recv(client.socket, buffer, sizeof(buffer), 0);
+				if (received <= 0)
+				{
+					break;
+				}
+				client.input.insert(client.input.end(), buffer, buffer + received);
+			}
+			Parse(client);
+		}
+	}
+
+	// the slow ones read only now, until the server has sent them all it queued
+	for (LoadClient& client : clients)
+	{
+		if (client.slow)
+		{
+			epoll_event event;
+			event.events = EPOLLIN;
+			event.data.ptr = &client;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, client.socket, &event);
+		}
+	}
+	for (;;)
+	{
+		const int count = epoll_wait(epoll, events.data(), int(events.size()), 200);
+		if (count <= 0)
+		{
+			break;
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			LoadClient& client = *static_cast<LoadClient*>(events[i].data.ptr);
+			for (;;)
+			{
+				const ssize_t received = recv(client.socket, buffer, sizeof(buffer), 0);
+				if (received <= 0)
+				{
+					break;
+				}
+				client.input.insert(client.input.end(), buffer, buffer + received);
+			}
+			Parse(client);
+		}
+	}
+
+	const uint64_t samples = sampleCount.load();
+	const uint64_t orientations = orientationCount.load();
+	double worstRatio = 1.0;
+	uint64_t errors = 0;
+	uint64_t fastDrops = 0;
+	uint64_t slowDrops = 0;
+	uint64_t slowReceived = 0;
+	int slowWithoutDrops = 0;
+	for (const LoadClient& client : clients)
+	{
+		errors += client.errors;
+		const uint64_t expectedSamples = (samples + client.sampleDivider - 1) / client.sampleDivider;
+		const uint64_t expectedOrientations = (orientations + client.orientationDivider - 1) / client.orientationDivider;
+		if (client.slow)
+		{
+			slowDrops += client.droppedSamples + client.droppedOrientations;
+			slowReceived += client.samples;
+			// sample drops are told in the next sample frame, which comes only once the
+			// client reads again; the conflated orientations already carry theirs
+			slowWithoutDrops += (client.droppedSamples + client.droppedOrientations == 0) ? 1 : 0;
+		}
+		else
+		{
+			fastDrops += client.droppedSamples + client.droppedOrientations;
+			worstRatio = std::min(worstRatio, double(client.samples) / double(expectedSamples));
+			worstRatio = std::min(worstRatio, double(client.orientations) / double(expectedOrientations));
+		}
+	}
+
+	printf("%d clients for %d s: %llu samples, %llu orientations pushed, %.1f MB sent\n", clientCount, seconds,
+		(unsigned long long)samples, (unsigned long long)orientations, server.GetSentBytes() / 1e6);
+	printf("reading clients: worst %.4f of their records, %llu dropped\n", worstRatio, (unsigned long long)fastDrops);
+	printf("slow clients: %llu samples before backing up, %llu records dropped, %d without drops\n",
+		(unsigned long long)slowReceived, (unsigned long long)slowDrops, slowWithoutDrops);
+	printf("producers: longest sample burst %.1f us, longest orientation batch %.1f us\n",
+		Microseconds(maxSampleBurst), Microseconds(maxOrientationBatch));
+	printf("order or content errors: %llu\n", (unsigned long long)errors);
+
+	server.Stop();
+	const bool passed = errors == 0 && fastDrops == 0 && worstRatio > 0.99 && slowWithoutDrops == 0;
+	printf("%s\n", passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+}